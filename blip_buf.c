@@ -1,350 +1,720 @@
-/* blip_buf 1.1.0. http://www.slack.net/~ant/ */
-/* Baoshi modification:
- * malloc -> VGM_MALLOC
- * free -> VGM_FREE
- * assert -> VGM_ASSERT
- * Macro defined in vgm_conf.h
- */   
-
-#include "blip_buf.h"
-
-#include <limits.h>
-#include <string.h>
-#include <stdlib.h>
-#include "vgm_conf.h"
-
-/* Library Copyright (C) 2003-2009 Shay Green. This library is free software;
-you can redistribute it and/or modify it under the terms of the GNU Lesser
-General Public License as published by the Free Software Foundation; either
-version 2.1 of the License, or (at your option) any later version. This
-library is distributed in the hope that it will be useful, but WITHOUT ANY
-WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
-A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for more
-details. You should have received a copy of the GNU Lesser General Public
-License along with this module; if not, write to the Free Software Foundation,
-Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA */
-
-#if defined (BLARGG_TEST) && BLARGG_TEST
-	#include "blargg_test.h"
-#endif
-
-/* Equivalent to ULONG_MAX >= 0xFFFFFFFF00000000.
-Avoids constants that don't fit in 32 bits. */
-#if ULONG_MAX/0xFFFFFFFF > 0xFFFFFFFF
-	typedef unsigned long fixed_t;
-	enum { pre_shift = 32 };
-
-#elif defined(ULLONG_MAX)
-	typedef unsigned long long fixed_t;
-	enum { pre_shift = 32 };
-
-#else
-	typedef unsigned fixed_t;
-	enum { pre_shift = 0 };
-
-#endif
-
-enum { time_bits = pre_shift + 20 };
-
-static fixed_t const time_unit = (fixed_t) 1 << time_bits;
-
-enum { bass_shift  = 9 }; /* affects high-pass filter breakpoint frequency */
-enum { end_frame_extra = 2 }; /* allows deltas slightly after frame length */
-
-enum { half_width  = 8 };
-enum { buf_extra   = half_width*2 + end_frame_extra };
-enum { phase_bits  = 5 };
-enum { phase_count = 1 << phase_bits };
-enum { delta_bits  = 15 };
-enum { delta_unit  = 1 << delta_bits };
-enum { frac_bits = time_bits - pre_shift };
-
-/* We could eliminate avail and encode whole samples in offset, but that would
-limit the total buffered samples to blip_max_frame. That could only be
-increased by decreasing time_bits, which would reduce resample ratio accuracy.
-*/
-
-/** Sample buffer that resamples to output rate and accumulates samples
-until they're read out */
-struct blip_t
-{
-	fixed_t factor;
-	fixed_t offset;
-	int avail;
-	int size;
-	int integrator;
-};
-
-typedef int buf_t;
-
-/* probably not totally portable */
-#define SAMPLES( buf ) ((buf_t*) ((buf) + 1))
-
-/* Arithmetic (sign-preserving) right shift */
-#define ARITH_SHIFT( n, shift ) \
-	((n) >> (shift))
-
-enum { max_sample = +32767 };
-enum { min_sample = -32768 };
-
-#define CLAMP( n ) \
-	{\
-		if ( (short) n != n )\
-			n = ARITH_SHIFT( n, 16 ) ^ max_sample;\
-	}
-
-static void check_assumptions( void )
-{
-	int n;
-	
-	#if INT_MAX < 0x7FFFFFFF || UINT_MAX < 0xFFFFFFFF
-		#error "int must be at least 32 bits"
-	#endif
-	
-	VGM_ASSERT( (-3 >> 1) == -2 ); /* right shift must preserve sign */
-	
-	n = max_sample * 2;
-	CLAMP( n );
-	VGM_ASSERT( n == max_sample );
-	
-	n = min_sample * 2;
-	CLAMP( n );
-	VGM_ASSERT( n == min_sample );
-	
-	VGM_ASSERT( blip_max_ratio <= time_unit );
-	VGM_ASSERT( blip_max_frame <= (fixed_t) -1 >> time_bits );
-}
-
-blip_t* blip_new( int size )
-{
-	blip_t* m;
-	VGM_ASSERT( size >= 0 );
-	
-	m = (blip_t*) VGM_MALLOC( sizeof *m + (size + buf_extra) * sizeof (buf_t) );
-	if ( m )
-	{
-		m->factor = time_unit / blip_max_ratio;
-		m->size   = size;
-		blip_clear( m );
-		check_assumptions();
-	}
-	return m;
-}
-
-void blip_delete( blip_t* m )
-{
-	if ( m != NULL )
-	{
-		/* Clear fields in case user tries to use after freeing */
-		memset( m, 0, sizeof *m );
-		VGM_FREE( m );
-	}
-}
-
-void blip_set_rates( blip_t* m, double clock_rate, double sample_rate )
-{
-	double factor = time_unit * sample_rate / clock_rate;
-	m->factor = (fixed_t) factor;
-	
-	/* Fails if clock_rate exceeds maximum, relative to sample_rate */
-	VGM_ASSERT( 0 <= factor - m->factor && factor - m->factor < 1 );
-	
-	/* Avoid requiring math.h. Equivalent to
-	m->factor = (int) ceil( factor ) */
-	if ( m->factor < factor )
-		m->factor++;
-	
-	/* At this point, factor is most likely rounded up, but could still
-	have been rounded down in the floating-point calculation. */
-}
-
-void blip_clear( blip_t* m )
-{
-	/* We could set offset to 0, factor/2, or factor-1. 0 is suitable if
-	factor is rounded up. factor-1 is suitable if factor is rounded down.
-	Since we don't know rounding direction, factor/2 accommodates either,
-	with the slight loss of showing an error in half the time. Since for
-	a 64-bit factor this is years, the halving isn't a problem. */
-	
-	m->offset     = m->factor / 2;
-	m->avail      = 0;
-	m->integrator = 0;
-	memset( SAMPLES( m ), 0, (m->size + buf_extra) * sizeof (buf_t) );
-}
-
-int blip_clocks_needed( const blip_t* m, int samples )
-{
-	fixed_t needed;
-	
-	/* Fails if buffer can't hold that many more samples */
-	VGM_ASSERT( samples >= 0 && m->avail + samples <= m->size );
-	
-	needed = (fixed_t) samples * time_unit;
-	if ( needed < m->offset )
-		return 0;
-	
-	return (int)((needed - m->offset + m->factor - 1) / m->factor);
-}
-
-void blip_end_frame( blip_t* m, unsigned t )
-{
-	fixed_t off = t * m->factor + m->offset;
-	m->avail += off >> time_bits;
-	m->offset = off & (time_unit - 1);
-	
-	/* Fails if buffer size was exceeded */
-	VGM_ASSERT( m->avail <= m->size );
-}
-
-int blip_samples_avail( const blip_t* m )
-{
-	return m->avail;
-}
-
-static void remove_samples( blip_t* m, int count )
-{
-	buf_t* buf = SAMPLES( m );
-	int remain = m->avail + buf_extra - count;
-	m->avail -= count;
-	
-	memmove( &buf [0], &buf [count], remain * sizeof buf [0] );
-	memset( &buf [remain], 0, count * sizeof buf [0] );
-}
-
-int blip_read_samples( blip_t* m, short out [], int count, int stereo )
-{
-	VGM_ASSERT( count >= 0 );
-	
-	if ( count > m->avail )
-		count = m->avail;
-	
-	if ( count )
-	{
-		int const step = stereo ? 2 : 1;
-		buf_t const* in  = SAMPLES( m );
-		buf_t const* end = in + count;
-		int sum = m->integrator;
-		do
-		{
-			/* Eliminate fraction */
-			int s = ARITH_SHIFT( sum, delta_bits );
-			
-			sum += *in++;
-			
-			CLAMP( s );
-			
-			*out = s;
-			out += step;
-			
-			/* High-pass filter */
-			sum -= s << (delta_bits - bass_shift);
-		}
-		while ( in != end );
-		m->integrator = sum;
-		
-		remove_samples( m, count );
-	}
-	
-	return count;
-}
-
-/* Things that didn't help performance on x86:
-	__attribute__((aligned(128)))
-	#define short int
-	restrict
-*/
-
-/* Sinc_Generator( 0.9, 0.55, 4.5 ) */
-static short const bl_step [phase_count + 1] [half_width] =
-{
-{   43, -115,  350, -488, 1136, -914, 5861,21022},
-{   44, -118,  348, -473, 1076, -799, 5274,21001},
-{   45, -121,  344, -454, 1011, -677, 4706,20936},
-{   46, -122,  336, -431,  942, -549, 4156,20829},
-{   47, -123,  327, -404,  868, -418, 3629,20679},
-{   47, -122,  316, -375,  792, -285, 3124,20488},
-{   47, -120,  303, -344,  714, -151, 2644,20256},
-{   46, -117,  289, -310,  634,  -17, 2188,19985},
-{   46, -114,  273, -275,  553,  117, 1758,19675},
-{   44, -108,  255, -237,  471,  247, 1356,19327},
-{   43, -103,  237, -199,  390,  373,  981,18944},
-{   42,  -98,  218, -160,  310,  495,  633,18527},
-{   40,  -91,  198, -121,  231,  611,  314,18078},
-{   38,  -84,  178,  -81,  153,  722,   22,17599},
-{   36,  -76,  157,  -43,   80,  824, -241,17092},
-{   34,  -68,  135,   -3,    8,  919, -476,16558},
-{   32,  -61,  115,   34,  -60, 1006, -683,16001},
-{   29,  -52,   94,   70, -123, 1083, -862,15422},
-{   27,  -44,   73,  106, -184, 1152,-1015,14824},
-{   25,  -36,   53,  139, -239, 1211,-1142,14210},
-{   22,  -27,   34,  170, -290, 1261,-1244,13582},
-{   20,  -20,   16,  199, -335, 1301,-1322,12942},
-{   18,  -12,   -3,  226, -375, 1331,-1376,12293},
-{   15,   -4,  -19,  250, -410, 1351,-1408,11638},
-{   13,    3,  -35,  272, -439, 1361,-1419,10979},
-{   11,    9,  -49,  292, -464, 1362,-1410,10319},
-{    9,   16,  -63,  309, -483, 1354,-1383, 9660},
-{    7,   22,  -75,  322, -496, 1337,-1339, 9005},
-{    6,   26,  -85,  333, -504, 1312,-1280, 8355},
-{    4,   31,  -94,  341, -507, 1278,-1205, 7713},
-{    3,   35, -102,  347, -506, 1238,-1119, 7082},
-{    1,   40, -110,  350, -499, 1190,-1021, 6464},
-{    0,   43, -115,  350, -488, 1136, -914, 5861}
-};
-
-/* Shifting by pre_shift allows calculation using unsigned int rather than
-possibly-wider fixed_t. On 32-bit platforms, this is likely more efficient.
-And by having pre_shift 32, a 32-bit platform can easily do the shift by
-simply ignoring the low half. */
-
-void blip_add_delta( blip_t* m, unsigned time, int delta )
-{
-	unsigned fixed = (unsigned) ((time * m->factor + m->offset) >> pre_shift);
-	buf_t* out = SAMPLES( m ) + m->avail + (fixed >> frac_bits);
-	
-	int const phase_shift = frac_bits - phase_bits;
-	int phase = fixed >> phase_shift & (phase_count - 1);
-	short const* in  = bl_step [phase];
-	short const* rev = bl_step [phase_count - phase];
-	
-	int interp = fixed >> (phase_shift - delta_bits) & (delta_unit - 1);
-	int delta2 = (delta * interp) >> delta_bits;
-	delta -= delta2;
-	
-	/* Fails if buffer size was exceeded */
-	VGM_ASSERT( out <= &SAMPLES( m ) [m->size + end_frame_extra] );
-	
-	out [0] += in[0]*delta + in[half_width+0]*delta2;
-	out [1] += in[1]*delta + in[half_width+1]*delta2;
-	out [2] += in[2]*delta + in[half_width+2]*delta2;
-	out [3] += in[3]*delta + in[half_width+3]*delta2;
-	out [4] += in[4]*delta + in[half_width+4]*delta2;
-	out [5] += in[5]*delta + in[half_width+5]*delta2;
-	out [6] += in[6]*delta + in[half_width+6]*delta2;
-	out [7] += in[7]*delta + in[half_width+7]*delta2;
-	
-	in = rev;
-	out [ 8] += in[7]*delta + in[7-half_width]*delta2;
-	out [ 9] += in[6]*delta + in[6-half_width]*delta2;
-	out [10] += in[5]*delta + in[5-half_width]*delta2;
-	out [11] += in[4]*delta + in[4-half_width]*delta2;
-	out [12] += in[3]*delta + in[3-half_width]*delta2;
-	out [13] += in[2]*delta + in[2-half_width]*delta2;
-	out [14] += in[1]*delta + in[1-half_width]*delta2;
-	out [15] += in[0]*delta + in[0-half_width]*delta2;
-}
-
-void blip_add_delta_fast( blip_t* m, unsigned time, int delta )
-{
-	unsigned fixed = (unsigned) ((time * m->factor + m->offset) >> pre_shift);
-	buf_t* out = SAMPLES( m ) + m->avail + (fixed >> frac_bits);
-	
-	int interp = fixed >> (frac_bits - delta_bits) & (delta_unit - 1);
-	int delta2 = delta * interp;
-	
-	/* Fails if buffer size was exceeded */
-	VGM_ASSERT( out <= &SAMPLES( m ) [m->size + end_frame_extra] );
-	
-	out [7] += delta * delta_unit - delta2;
-	out [8] += delta2;
-}
+/* blip_buf 1.1.0. http://www.slack.net/~ant/ */
+/* Baoshi modification:
+ * malloc -> VGM_MALLOC
+ * free -> VGM_FREE
+ * assert -> VGM_ASSERT
+ * Macro defined in vgm_conf.h
+ * Samples are kept in a power-of-two circular buffer, so reading does not
+ * move the remaining samples. Output is identical to the original.
+ * blip_add_delta() has SSE2/AVX2 and portable vector kernels, selected at
+ * run time per buffer (see blip_set_kernel()). Output is identical to the
+ * scalar kernel.
+ * blip_read_samples_ex() writes int16, int32 or float at any stride.
+ * blip_discard() drops samples without reading, for fast-forward.
+ */   
+
+#include "blip_buf.h"
+
+#include <limits.h>
+#include <string.h>
+#include <stdlib.h>
+#include "vgm_conf.h"
+
+/* Set to 0 to build the scalar kernel only */
+#ifndef BLIP_USE_SIMD
+	#define BLIP_USE_SIMD 1
+#endif
+
+#if BLIP_USE_SIMD && defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+	#define BLIP_SIMD_X86 1
+	#include <immintrin.h>
+#else
+	#define BLIP_SIMD_X86 0
+#endif
+
+/* GCC/Clang vector extensions, NEON on ARM */
+#if BLIP_USE_SIMD && (defined(__GNUC__) || defined(__clang__)) && \
+	(__GNUC__ >= 9 || defined(__clang__))
+	#define BLIP_SIMD_VECTOR 1
+#else
+	#define BLIP_SIMD_VECTOR 0
+#endif
+
+/* Library Copyright (C) 2003-2009 Shay Green. This library is free software;
+you can redistribute it and/or modify it under the terms of the GNU Lesser
+General Public License as published by the Free Software Foundation; either
+version 2.1 of the License, or (at your option) any later version. This
+library is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for more
+details. You should have received a copy of the GNU Lesser General Public
+License along with this module; if not, write to the Free Software Foundation,
+Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA */
+
+#if defined (BLARGG_TEST) && BLARGG_TEST
+	#include "blargg_test.h"
+#endif
+
+/* Equivalent to ULONG_MAX >= 0xFFFFFFFF00000000.
+Avoids constants that don't fit in 32 bits. */
+#if ULONG_MAX/0xFFFFFFFF > 0xFFFFFFFF
+	typedef unsigned long fixed_t;
+	enum { pre_shift = 32 };
+
+#elif defined(ULLONG_MAX)
+	typedef unsigned long long fixed_t;
+	enum { pre_shift = 32 };
+
+#else
+	typedef unsigned fixed_t;
+	enum { pre_shift = 0 };
+
+#endif
+
+enum { time_bits = pre_shift + 20 };
+
+static fixed_t const time_unit = (fixed_t) 1 << time_bits;
+
+enum { bass_shift  = 9 }; /* affects high-pass filter breakpoint frequency */
+enum { end_frame_extra = 2 }; /* allows deltas slightly after frame length */
+
+enum { half_width  = 8 };
+enum { buf_extra   = half_width*2 + end_frame_extra };
+enum { phase_bits  = 5 };
+enum { phase_count = 1 << phase_bits };
+enum { delta_bits  = 15 };
+enum { delta_unit  = 1 << delta_bits };
+enum { frac_bits = time_bits - pre_shift };
+
+/* We could eliminate avail and encode whole samples in offset, but that would
+limit the total buffered samples to blip_max_frame. That could only be
+increased by decreasing time_bits, which would reduce resample ratio accuracy.
+*/
+
+/** Sample buffer that resamples to output rate and accumulates samples
+until they're read out */
+struct blip_t
+{
+	fixed_t factor;
+	fixed_t offset;
+	int avail;
+	int size;
+	int integrator;
+	int pos;  /* buffer index of first sample */
+	int mask; /* buffer length - 1 */
+	int kernel; /* blip_kernel_xxx used by blip_add_delta() */
+};
+
+typedef int buf_t;
+
+/* probably not totally portable */
+#define SAMPLES( buf ) ((buf_t*) ((buf) + 1))
+
+/* Buffer length, power of 2 of at least size + buf_extra */
+#define BUF_LEN( m ) ((m)->mask + 1)
+
+/* Arithmetic (sign-preserving) right shift */
+#define ARITH_SHIFT( n, shift ) \
+	((n) >> (shift))
+
+enum { max_sample = +32767 };
+enum { min_sample = -32768 };
+
+#define CLAMP( n ) \
+	{\
+		if ( (short) n != n )\
+			n = ARITH_SHIFT( n, 16 ) ^ max_sample;\
+	}
+
+static void check_assumptions( void )
+{
+	int n;
+	
+	#if INT_MAX < 0x7FFFFFFF || UINT_MAX < 0xFFFFFFFF
+		#error "int must be at least 32 bits"
+	#endif
+	
+	VGM_ASSERT( (-3 >> 1) == -2 ); /* right shift must preserve sign */
+	
+	n = max_sample * 2;
+	CLAMP( n );
+	VGM_ASSERT( n == max_sample );
+	
+	n = min_sample * 2;
+	CLAMP( n );
+	VGM_ASSERT( n == min_sample );
+	
+	VGM_ASSERT( blip_max_ratio <= time_unit );
+	VGM_ASSERT( blip_max_frame <= (fixed_t) -1 >> time_bits );
+}
+
+blip_t* blip_new( int size )
+{
+	blip_t* m;
+	int len = 1;
+	VGM_ASSERT( size >= 0 );
+	
+	/* Buffer length and byte count must not overflow */
+	if ( size < 0 || size > (int) ((INT_MAX - sizeof *m) / sizeof (buf_t) / 2) - buf_extra )
+		return NULL;
+	
+	while ( len < size + buf_extra )
+		len <<= 1;
+	
+	m = (blip_t*) VGM_MALLOC( sizeof *m + len * sizeof (buf_t) );
+	if ( m )
+	{
+		m->factor = time_unit / blip_max_ratio;
+		m->size   = size;
+		m->mask   = len - 1;
+		blip_set_kernel( m, blip_kernel_auto );
+		blip_clear( m );
+		check_assumptions();
+	}
+	return m;
+}
+
+void blip_delete( blip_t* m )
+{
+	if ( m != NULL )
+	{
+		/* Clear fields in case user tries to use after freeing */
+		memset( m, 0, sizeof *m );
+		VGM_FREE( m );
+	}
+}
+
+void blip_set_rates( blip_t* m, double clock_rate, double sample_rate )
+{
+	double factor = time_unit * sample_rate / clock_rate;
+	m->factor = (fixed_t) factor;
+	
+	/* Fails if clock_rate exceeds maximum, relative to sample_rate */
+	VGM_ASSERT( 0 <= factor - m->factor && factor - m->factor < 1 );
+	
+	/* Avoid requiring math.h. Equivalent to
+	m->factor = (int) ceil( factor ) */
+	if ( m->factor < factor )
+		m->factor++;
+	
+	/* At this point, factor is most likely rounded up, but could still
+	have been rounded down in the floating-point calculation. */
+}
+
+void blip_clear( blip_t* m )
+{
+	/* We could set offset to 0, factor/2, or factor-1. 0 is suitable if
+	factor is rounded up. factor-1 is suitable if factor is rounded down.
+	Since we don't know rounding direction, factor/2 accommodates either,
+	with the slight loss of showing an error in half the time. Since for
+	a 64-bit factor this is years, the halving isn't a problem. */
+	
+	m->offset     = m->factor / 2;
+	m->avail      = 0;
+	m->integrator = 0;
+	m->pos        = 0;
+	memset( SAMPLES( m ), 0, BUF_LEN( m ) * sizeof (buf_t) );
+}
+
+int blip_clocks_needed( const blip_t* m, int samples )
+{
+	fixed_t needed;
+	
+	/* Fails if buffer can't hold that many more samples */
+	VGM_ASSERT( samples >= 0 && m->avail + samples <= m->size );
+	
+	needed = (fixed_t) samples * time_unit;
+	if ( needed < m->offset )
+		return 0;
+	
+	return (int)((needed - m->offset + m->factor - 1) / m->factor);
+}
+
+void blip_end_frame( blip_t* m, unsigned t )
+{
+	fixed_t off = t * m->factor + m->offset;
+	m->avail += off >> time_bits;
+	m->offset = off & (time_unit - 1);
+	
+	/* Fails if buffer size was exceeded */
+	VGM_ASSERT( m->avail <= m->size );
+}
+
+void blip_discard( blip_t* m )
+{
+	/* Only available samples and deltas just past them can be non-zero */
+	int count = m->avail + buf_extra;
+	int first = BUF_LEN( m ) - m->pos;
+	if ( first > count )
+		first = count;
+	memset( SAMPLES( m ) + m->pos, 0, first * sizeof (buf_t) );
+	memset( SAMPLES( m ), 0, (count - first) * sizeof (buf_t) );
+	
+	m->pos        = (m->pos + m->avail) & m->mask;
+	m->avail      = 0;
+	m->integrator = 0;
+}
+
+int blip_samples_avail( const blip_t* m )
+{
+	return m->avail;
+}
+
+/* Reads count samples starting at buffer index m->pos, which must not wrap.
+Read elements are cleared, as they become the end of the buffer. */
+static short* read_run( blip_t* m, short out [], int count, int step )
+{
+	buf_t* in  = SAMPLES( m ) + m->pos;
+	buf_t* end = in + count;
+	int sum = m->integrator;
+	do
+	{
+		/* Eliminate fraction */
+		int s = ARITH_SHIFT( sum, delta_bits );
+		
+		sum += *in;
+		*in++ = 0;
+		
+		CLAMP( s );
+		
+		*out = s;
+		out += step;
+		
+		/* High-pass filter */
+		sum -= s << (delta_bits - bass_shift);
+	}
+	while ( in != end );
+	m->integrator = sum;
+	m->pos = (m->pos + count) & m->mask;
+	m->avail -= count;
+	return out;
+}
+
+/* Integrator value to full scale int32 / float. Integrator has delta_bits
+fraction bits over 16-bit samples, so full scale is 1 << 30. */
+static int to_s32( int x )
+{
+	if ( x >= (1 << 30) )
+		return INT_MAX;
+	if ( x < -(1 << 30) )
+		return INT_MIN;
+	return x * 2;
+}
+
+static float to_f32( int x )
+{
+	if ( x >= (1 << 30) )
+		return 1.0f;
+	if ( x < -(1 << 30) )
+		return -1.0f;
+	return (float) x * (1.0f / (1 << 30));
+}
+
+/* Same as read_run(), writing 'type' samples converted from integrator by
+'convert' to 'channels' elements every 'stride' elements. */
+#define READ_RUN_EX( type, convert ) \
+	{\
+		type* o = (type*) out;\
+		do\
+		{\
+			int const x = sum;\
+			int s = ARITH_SHIFT( sum, delta_bits );\
+			type v;\
+			int c;\
+			\
+			sum += *in;\
+			*in++ = 0;\
+			\
+			CLAMP( s );\
+			\
+			v = convert;\
+			for ( c = 0; c < channels; c++ )\
+				o [c] = v;\
+			o += stride;\
+			\
+			/* High-pass filter */\
+			sum -= s << (delta_bits - bass_shift);\
+		}\
+		while ( in != end );\
+		out = o;\
+	}
+
+static void* read_run_ex( blip_t* m, void* out, int count, int format, int stride, int channels )
+{
+	buf_t* in  = SAMPLES( m ) + m->pos;
+	buf_t* end = in + count;
+	int sum = m->integrator;
+	switch ( format )
+	{
+	case blip_format_s32:
+		READ_RUN_EX( int, to_s32( x ) )
+		break;
+	case blip_format_f32:
+		READ_RUN_EX( float, to_f32( x ) )
+		break;
+	default:
+		READ_RUN_EX( short, ((void) x, (short) s) )
+		break;
+	}
+	m->integrator = sum;
+	m->pos = (m->pos + count) & m->mask;
+	m->avail -= count;
+	return out;
+}
+
+int blip_read_samples_ex( blip_t* m, void* out, int count, int format, int stride, int channels )
+{
+	VGM_ASSERT( count >= 0 && channels >= 1 && stride >= channels );
+	
+	if ( count > m->avail )
+		count = m->avail;
+	
+	if ( count )
+	{
+		int first = BUF_LEN( m ) - m->pos;
+		if ( first > count )
+			first = count;
+		
+		if ( format == blip_format_s16 && channels == 1 )
+		{
+			out = read_run( m, (short*) out, first, stride );
+			if ( count > first )
+				read_run( m, (short*) out, count - first, stride );
+		}
+		else
+		{
+			out = read_run_ex( m, out, first, format, stride, channels );
+			if ( count > first )
+				read_run_ex( m, out, count - first, format, stride, channels );
+		}
+	}
+	
+	return count;
+}
+
+int blip_read_samples( blip_t* m, short out [], int count, int stereo )
+{
+	VGM_ASSERT( count >= 0 );
+	
+	if ( count > m->avail )
+		count = m->avail;
+	
+	if ( count )
+	{
+		int const step = stereo ? 2 : 1;
+		int first = BUF_LEN( m ) - m->pos;
+		if ( first > count )
+			first = count;
+		
+		out = read_run( m, out, first, step );
+		if ( count > first )
+			read_run( m, out, count - first, step );
+	}
+	
+	return count;
+}
+
+void blip_save_state( const blip_t* m, blip_state_t* out )
+{
+	/* Fails if samples are still available */
+	VGM_ASSERT( m->avail == 0 );
+	VGM_ASSERT( (int) buf_extra == (int) blip_state_extra );
+	
+	out->offset     = m->offset;
+	out->integrator = m->integrator;
+	{
+		int i;
+		for ( i = 0; i < blip_state_extra; i++ )
+			out->buf [i] = SAMPLES( m ) [(m->pos + i) & m->mask];
+	}
+}
+
+void blip_load_state( blip_t* m, const blip_state_t* in )
+{
+	blip_clear( m );
+	m->offset     = (fixed_t) in->offset;
+	m->integrator = in->integrator;
+	memcpy( SAMPLES( m ), in->buf, sizeof in->buf );
+}
+
+/* Things that didn't help performance on x86:
+	__attribute__((aligned(128)))
+	#define short int
+	restrict
+*/
+
+/* Sinc_Generator( 0.9, 0.55, 4.5 ) */
+static short const bl_step [phase_count + 1] [half_width] =
+{
+{   43, -115,  350, -488, 1136, -914, 5861,21022},
+{   44, -118,  348, -473, 1076, -799, 5274,21001},
+{   45, -121,  344, -454, 1011, -677, 4706,20936},
+{   46, -122,  336, -431,  942, -549, 4156,20829},
+{   47, -123,  327, -404,  868, -418, 3629,20679},
+{   47, -122,  316, -375,  792, -285, 3124,20488},
+{   47, -120,  303, -344,  714, -151, 2644,20256},
+{   46, -117,  289, -310,  634,  -17, 2188,19985},
+{   46, -114,  273, -275,  553,  117, 1758,19675},
+{   44, -108,  255, -237,  471,  247, 1356,19327},
+{   43, -103,  237, -199,  390,  373,  981,18944},
+{   42,  -98,  218, -160,  310,  495,  633,18527},
+{   40,  -91,  198, -121,  231,  611,  314,18078},
+{   38,  -84,  178,  -81,  153,  722,   22,17599},
+{   36,  -76,  157,  -43,   80,  824, -241,17092},
+{   34,  -68,  135,   -3,    8,  919, -476,16558},
+{   32,  -61,  115,   34,  -60, 1006, -683,16001},
+{   29,  -52,   94,   70, -123, 1083, -862,15422},
+{   27,  -44,   73,  106, -184, 1152,-1015,14824},
+{   25,  -36,   53,  139, -239, 1211,-1142,14210},
+{   22,  -27,   34,  170, -290, 1261,-1244,13582},
+{   20,  -20,   16,  199, -335, 1301,-1322,12942},
+{   18,  -12,   -3,  226, -375, 1331,-1376,12293},
+{   15,   -4,  -19,  250, -410, 1351,-1408,11638},
+{   13,    3,  -35,  272, -439, 1361,-1419,10979},
+{   11,    9,  -49,  292, -464, 1362,-1410,10319},
+{    9,   16,  -63,  309, -483, 1354,-1383, 9660},
+{    7,   22,  -75,  322, -496, 1337,-1339, 9005},
+{    6,   26,  -85,  333, -504, 1312,-1280, 8355},
+{    4,   31,  -94,  341, -507, 1278,-1205, 7713},
+{    3,   35, -102,  347, -506, 1238,-1119, 7082},
+{    1,   40, -110,  350, -499, 1190,-1021, 6464},
+{    0,   43, -115,  350, -488, 1136, -914, 5861}
+};
+
+int blip_kernel_supported( int kernel )
+{
+	switch ( kernel )
+	{
+	case blip_kernel_scalar:
+		return 1;
+	#if BLIP_SIMD_VECTOR
+	case blip_kernel_vector:
+		return 1;
+	#endif
+	#if BLIP_SIMD_X86
+	case blip_kernel_sse2:
+		return __builtin_cpu_supports( "sse2" );
+	case blip_kernel_avx2:
+		return __builtin_cpu_supports( "avx2" );
+	#endif
+	default:
+		return 0;
+	}
+}
+
+int blip_set_kernel( blip_t* m, int kernel )
+{
+	if ( kernel == blip_kernel_auto )
+	{
+		/* Vector extensions only pay off where the target has SIMD */
+		static int const order [] = { blip_kernel_avx2, blip_kernel_sse2,
+			#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+			blip_kernel_vector,
+			#endif
+			blip_kernel_scalar };
+		unsigned i;
+		for ( i = 0; !blip_kernel_supported( order [i] ); i++ ) { }
+		kernel = order [i];
+	}
+	if ( !blip_kernel_supported( kernel ) )
+		return 0;
+	m->kernel = kernel;
+	return 1;
+}
+
+int blip_get_kernel( const blip_t* m )
+{
+	return m->kernel;
+}
+
+const char* blip_kernel_name( int kernel )
+{
+	switch ( kernel )
+	{
+	case blip_kernel_scalar: return "scalar";
+	case blip_kernel_vector: return "vector";
+	case blip_kernel_sse2:   return "sse2";
+	case blip_kernel_avx2:   return "avx2";
+	default:                 return "auto";
+	}
+}
+
+/* Kernels add in[0..7]*delta + in[8..15]*delta2 to out[0..7] and
+rev[7..0]*delta + rev[-1..-8]*delta2 to out[8..15]. in[8..15] and rev[-8..-1]
+are the neighbouring rows of bl_step. */
+
+#if BLIP_SIMD_X86
+
+/* delta and delta2 must fit in 16 bits, so pmaddwd gives exact sums */
+__attribute__((target("sse2")))
+static void add_delta_sse2( buf_t* out, short const* in, short const* rev, int delta, int delta2 )
+{
+	__m128i const d  = _mm_set1_epi32( (int) ((delta & 0xFFFF) | ((unsigned) delta2 << 16)) );
+	__m128i const a  = _mm_loadu_si128( (__m128i const*) in );
+	__m128i const a2 = _mm_loadu_si128( (__m128i const*) (in + half_width) );
+	__m128i const r  = _mm_loadu_si128( (__m128i const*) rev );
+	__m128i const r2 = _mm_loadu_si128( (__m128i const*) (rev - half_width) );
+	__m128i* o = (__m128i*) out;
+	
+	__m128i lo  = _mm_madd_epi16( _mm_unpacklo_epi16( a, a2 ), d );
+	__m128i hi  = _mm_madd_epi16( _mm_unpackhi_epi16( a, a2 ), d );
+	__m128i rlo = _mm_madd_epi16( _mm_unpacklo_epi16( r, r2 ), d );
+	__m128i rhi = _mm_madd_epi16( _mm_unpackhi_epi16( r, r2 ), d );
+	
+	_mm_storeu_si128( o + 0, _mm_add_epi32( _mm_loadu_si128( o + 0 ), lo ) );
+	_mm_storeu_si128( o + 1, _mm_add_epi32( _mm_loadu_si128( o + 1 ), hi ) );
+	/* rev results go out in reverse order */
+	_mm_storeu_si128( o + 2, _mm_add_epi32( _mm_loadu_si128( o + 2 ), _mm_shuffle_epi32( rhi, 0x1B ) ) );
+	_mm_storeu_si128( o + 3, _mm_add_epi32( _mm_loadu_si128( o + 3 ), _mm_shuffle_epi32( rlo, 0x1B ) ) );
+}
+
+__attribute__((target("avx2")))
+static void add_delta_avx2( buf_t* out, short const* in, short const* rev, int delta, int delta2 )
+{
+	__m256i const d  = _mm256_set1_epi32( (int) ((delta & 0xFFFF) | ((unsigned) delta2 << 16)) );
+	__m128i const a  = _mm_loadu_si128( (__m128i const*) in );
+	__m128i const a2 = _mm_loadu_si128( (__m128i const*) (in + half_width) );
+	__m128i const r  = _mm_loadu_si128( (__m128i const*) rev );
+	__m128i const r2 = _mm_loadu_si128( (__m128i const*) (rev - half_width) );
+	__m256i* o = (__m256i*) out;
+	
+	__m256i fwd = _mm256_madd_epi16( _mm256_set_m128i( _mm_unpackhi_epi16( a, a2 ),
+			_mm_unpacklo_epi16( a, a2 ) ), d );
+	__m256i bwd = _mm256_madd_epi16( _mm256_set_m128i( _mm_unpackhi_epi16( r, r2 ),
+			_mm_unpacklo_epi16( r, r2 ) ), d );
+	bwd = _mm256_permutevar8x32_epi32( bwd, _mm256_set_epi32( 0, 1, 2, 3, 4, 5, 6, 7 ) );
+	
+	_mm256_storeu_si256( o + 0, _mm256_add_epi32( _mm256_loadu_si256( o + 0 ), fwd ) );
+	_mm256_storeu_si256( o + 1, _mm256_add_epi32( _mm256_loadu_si256( o + 1 ), bwd ) );
+}
+
+#endif
+
+#if BLIP_SIMD_VECTOR
+
+typedef short blip_v8s __attribute__((vector_size(16)));
+typedef int   blip_v8i __attribute__((vector_size(32)));
+
+/* 32-bit multiplies, no limit on delta */
+static void add_delta_vector( buf_t* out, short const* in, short const* rev, int delta, int delta2 )
+{
+	blip_v8s a, a2, r, r2;
+	blip_v8i o, p;
+	memcpy( &a,  in, sizeof a );
+	memcpy( &a2, in + half_width, sizeof a2 );
+	memcpy( &r,  rev, sizeof r );
+	memcpy( &r2, rev - half_width, sizeof r2 );
+	
+	memcpy( &o, out, sizeof o );
+	o += __builtin_convertvector( a, blip_v8i ) * delta + __builtin_convertvector( a2, blip_v8i ) * delta2;
+	memcpy( out, &o, sizeof o );
+	
+	p = __builtin_convertvector( r, blip_v8i ) * delta + __builtin_convertvector( r2, blip_v8i ) * delta2;
+	memcpy( &o, out + half_width, sizeof o );
+	o += __builtin_shufflevector( p, p, 7, 6, 5, 4, 3, 2, 1, 0 );
+	memcpy( out + half_width, &o, sizeof o );
+}
+
+#endif
+
+/* Shifting by pre_shift allows calculation using unsigned int rather than
+possibly-wider fixed_t. On 32-bit platforms, this is likely more efficient.
+And by having pre_shift 32, a 32-bit platform can easily do the shift by
+simply ignoring the low half. */
+
+void blip_add_delta( blip_t* m, unsigned time, int delta )
+{
+	unsigned fixed = (unsigned) ((time * m->factor + m->offset) >> pre_shift);
+	int index = m->avail + (fixed >> frac_bits);
+	int pos = (m->pos + index) & m->mask;
+	buf_t* out = SAMPLES( m ) + pos;
+	
+	int const phase_shift = frac_bits - phase_bits;
+	int phase = fixed >> phase_shift & (phase_count - 1);
+	short const* in  = bl_step [phase];
+	short const* rev = bl_step [phase_count - phase];
+	
+	int interp = fixed >> (phase_shift - delta_bits) & (delta_unit - 1);
+	int delta2 = (delta * interp) >> delta_bits;
+	delta -= delta2;
+	
+	/* Fails if buffer size was exceeded */
+	VGM_ASSERT( index <= m->size + end_frame_extra );
+	
+	if ( pos > BUF_LEN( m ) - half_width*2 )
+	{
+		/* Kernel wraps around end of buffer */
+		buf_t* buf = SAMPLES( m );
+		int const mask = m->mask;
+		int i;
+		for ( i = 0; i < half_width; i++ )
+			buf [(pos + i) & mask] += in[i]*delta + in[half_width+i]*delta2;
+		for ( i = 0; i < half_width; i++ )
+			buf [(pos + half_width + i) & mask] += rev[half_width-1-i]*delta + rev[-1-i]*delta2;
+		return;
+	}
+	
+	switch ( m->kernel )
+	{
+	#if BLIP_SIMD_X86
+	case blip_kernel_avx2:
+		if ( (unsigned) (delta + 0x8000) <= 0xFFFF && (unsigned) (delta2 + 0x8000) <= 0xFFFF )
+		{
+			add_delta_avx2( out, in, rev, delta, delta2 );
+			return;
+		}
+		break;
+	case blip_kernel_sse2:
+		if ( (unsigned) (delta + 0x8000) <= 0xFFFF && (unsigned) (delta2 + 0x8000) <= 0xFFFF )
+		{
+			add_delta_sse2( out, in, rev, delta, delta2 );
+			return;
+		}
+		break;
+	#endif
+	#if BLIP_SIMD_VECTOR
+	case blip_kernel_vector:
+		add_delta_vector( out, in, rev, delta, delta2 );
+		return;
+	#endif
+	default:
+		break;
+	}
+	
+	/* Scalar kernel */
+	
+	out [0] += in[0]*delta + in[half_width+0]*delta2;
+	out [1] += in[1]*delta + in[half_width+1]*delta2;
+	out [2] += in[2]*delta + in[half_width+2]*delta2;
+	out [3] += in[3]*delta + in[half_width+3]*delta2;
+	out [4] += in[4]*delta + in[half_width+4]*delta2;
+	out [5] += in[5]*delta + in[half_width+5]*delta2;
+	out [6] += in[6]*delta + in[half_width+6]*delta2;
+	out [7] += in[7]*delta + in[half_width+7]*delta2;
+	
+	in = rev;
+	out [ 8] += in[7]*delta + in[7-half_width]*delta2;
+	out [ 9] += in[6]*delta + in[6-half_width]*delta2;
+	out [10] += in[5]*delta + in[5-half_width]*delta2;
+	out [11] += in[4]*delta + in[4-half_width]*delta2;
+	out [12] += in[3]*delta + in[3-half_width]*delta2;
+	out [13] += in[2]*delta + in[2-half_width]*delta2;
+	out [14] += in[1]*delta + in[1-half_width]*delta2;
+	out [15] += in[0]*delta + in[0-half_width]*delta2;
+}
+
+void blip_add_delta_fast( blip_t* m, unsigned time, int delta )
+{
+	unsigned fixed = (unsigned) ((time * m->factor + m->offset) >> pre_shift);
+	int index = m->avail + (fixed >> frac_bits);
+	buf_t* buf = SAMPLES( m );
+	
+	int interp = fixed >> (frac_bits - delta_bits) & (delta_unit - 1);
+	int delta2 = delta * interp;
+	
+	/* Fails if buffer size was exceeded */
+	VGM_ASSERT( index <= m->size + end_frame_extra );
+	
+	buf [(m->pos + index + 7) & m->mask] += delta * delta_unit - delta2;
+	buf [(m->pos + index + 8) & m->mask] += delta2;
+}
@@ -1,72 +1,124 @@
-/** \file
-Sample buffer that resamples from input clock rate to output sample rate */
-
-/* blip_buf 1.1.0 */
-#ifndef BLIP_BUF_H 
-#define BLIP_BUF_H
-
-#ifdef __cplusplus
-	extern "C" {
-#endif
-
-/** First parameter of most functions is blip_t*, or const blip_t* if nothing
-is changed. */
-typedef struct blip_t blip_t;
-
-/** Creates new buffer that can hold at most sample_count samples. Sets rates
-so that there are blip_max_ratio clocks per sample. Returns pointer to new
-buffer, or NULL if insufficient memory. */
-blip_t* blip_new( int sample_count );
-
-/** Sets approximate input clock rate and output sample rate. For every
-clock_rate input clocks, approximately sample_rate samples are generated. */
-void blip_set_rates( blip_t*, double clock_rate, double sample_rate );
-
-enum { /** Maximum clock_rate/sample_rate ratio. For a given sample_rate,
-clock_rate must not be greater than sample_rate*blip_max_ratio. */
-blip_max_ratio = 1 << 20 };
-
-/** Clears entire buffer. Afterwards, blip_samples_avail() == 0. */
-void blip_clear( blip_t* );
-
-/** Adds positive/negative delta into buffer at specified clock time. */
-void blip_add_delta( blip_t*, unsigned int clock_time, int delta );
-
-/** Same as blip_add_delta(), but uses faster, lower-quality synthesis. */
-void blip_add_delta_fast( blip_t*, unsigned int clock_time, int delta );
-
-/** Length of time frame, in clocks, needed to make sample_count additional
-samples available. */
-int blip_clocks_needed( const blip_t*, int sample_count );
-
-enum { /** Maximum number of samples that can be generated from one time frame. */
-blip_max_frame = 4000 };
-
-/** Makes input clocks before clock_duration available for reading as output
-samples. Also begins new time frame at clock_duration, so that clock time 0 in
-the new time frame specifies the same clock as clock_duration in the old time
-frame specified. Deltas can have been added slightly past clock_duration (up to
-however many clocks there are in two output samples). */
-void blip_end_frame( blip_t*, unsigned int clock_duration );
-
-/** Number of buffered samples available for reading. */
-int blip_samples_avail( const blip_t* );
-
-/** Reads and removes at most 'count' samples and writes them to 'out'. If
-'stereo' is true, writes output to every other element of 'out', allowing easy
-interleaving of two buffers into a stereo sample stream. Outputs 16-bit signed
-samples. Returns number of samples actually read.  */
-int blip_read_samples( blip_t*, short out [], int count, int stereo );
-
-/** Frees buffer. No effect if NULL is passed. */
-void blip_delete( blip_t* );
-
-
-/* Deprecated */
-typedef blip_t blip_buffer_t;
-
-#ifdef __cplusplus
-	}
-#endif
-
-#endif
+/** \file
+Sample buffer that resamples from input clock rate to output sample rate */
+
+/* blip_buf 1.1.0 */
+#ifndef BLIP_BUF_H 
+#define BLIP_BUF_H
+
+#ifdef __cplusplus
+	extern "C" {
+#endif
+
+/** First parameter of most functions is blip_t*, or const blip_t* if nothing
+is changed. */
+typedef struct blip_t blip_t;
+
+/** Creates new buffer that can hold at most sample_count samples. Sets rates
+so that there are blip_max_ratio clocks per sample. Returns pointer to new
+buffer, or NULL if insufficient memory or sample_count is too large. */
+blip_t* blip_new( int sample_count );
+
+/** Sets approximate input clock rate and output sample rate. For every
+clock_rate input clocks, approximately sample_rate samples are generated. */
+void blip_set_rates( blip_t*, double clock_rate, double sample_rate );
+
+enum { /** Maximum clock_rate/sample_rate ratio. For a given sample_rate,
+clock_rate must not be greater than sample_rate*blip_max_ratio. */
+blip_max_ratio = 1 << 20 };
+
+/** Clears entire buffer. Afterwards, blip_samples_avail() == 0. */
+void blip_clear( blip_t* );
+
+/** Adds positive/negative delta into buffer at specified clock time. */
+void blip_add_delta( blip_t*, unsigned int clock_time, int delta );
+
+/** blip_add_delta() implementations. All give identical output. */
+enum { blip_kernel_auto = 0, /**< best supported, chosen by blip_new() */
+	blip_kernel_scalar,
+	blip_kernel_vector,     /**< compiler vector extensions (NEON on ARM) */
+	blip_kernel_sse2,
+	blip_kernel_avx2 };
+
+/** Selects blip_add_delta() kernel. Returns 0 and keeps the current one if
+kernel is not available in this build or on this CPU. */
+int blip_set_kernel( blip_t*, int kernel );
+
+/** Kernel in use, never blip_kernel_auto. */
+int blip_get_kernel( const blip_t* );
+
+/** Non-zero if kernel can be used. */
+int blip_kernel_supported( int kernel );
+
+/** Name of kernel, for diagnostics. */
+const char* blip_kernel_name( int kernel );
+
+/** Same as blip_add_delta(), but uses faster, lower-quality synthesis. */
+void blip_add_delta_fast( blip_t*, unsigned int clock_time, int delta );
+
+/** Length of time frame, in clocks, needed to make sample_count additional
+samples available. */
+int blip_clocks_needed( const blip_t*, int sample_count );
+
+enum { /** Maximum number of samples that can be generated from one time frame. */
+blip_max_frame = 4000 };
+
+/** Makes input clocks before clock_duration available for reading as output
+samples. Also begins new time frame at clock_duration, so that clock time 0 in
+the new time frame specifies the same clock as clock_duration in the old time
+frame specified. Deltas can have been added slightly past clock_duration (up to
+however many clocks there are in two output samples). */
+void blip_end_frame( blip_t*, unsigned int clock_duration );
+
+/** Removes available samples and pending deltas without reading them, as if
+output had settled. Resampling phase is kept, so clocks stay in step with
+blip_end_frame() calls. */
+void blip_discard( blip_t* );
+
+/** Number of buffered samples available for reading. */
+int blip_samples_avail( const blip_t* );
+
+/** Reads and removes at most 'count' samples and writes them to 'out'. If
+'stereo' is true, writes output to every other element of 'out', allowing easy
+interleaving of two buffers into a stereo sample stream. Outputs 16-bit signed
+samples. Returns number of samples actually read.  */
+int blip_read_samples( blip_t*, short out [], int count, int stereo );
+
+/** Output formats of blip_read_samples_ex(). int32 and float are full
+scale, with the fraction bits 16-bit output drops. */
+enum { blip_format_s16 = 0, blip_format_s32 = 1, blip_format_f32 = 2 };
+
+/** Same as blip_read_samples(), but writes 'format' samples, each one to
+'channels' consecutive elements, 'stride' elements apart. */
+int blip_read_samples_ex( blip_t*, void* out, int count, int format, int stride, int channels );
+
+/** Frees buffer. No effect if NULL is passed. */
+void blip_delete( blip_t* );
+
+enum { /** Number of pending buffer elements kept in blip_state_t. */
+blip_state_extra = 18 };
+
+/** Buffer state, for seeking and saving/restoring playback. */
+typedef struct blip_state_t
+{
+	unsigned long long offset;
+	int integrator;
+	int buf [blip_state_extra];
+} blip_state_t;
+
+/** Saves state of buffer into 'out'. Buffer must have no samples available,
+i.e. all samples of the last time frame have been read. */
+void blip_save_state( const blip_t*, blip_state_t* out );
+
+/** Restores state saved by blip_save_state(). Rates of both buffers must be
+the same. */
+void blip_load_state( blip_t*, const blip_state_t* in );
+
+
+/* Deprecated */
+typedef blip_t blip_buffer_t;
+
+#ifdef __cplusplus
+	}
+#endif
+
+#endif
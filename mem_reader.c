@@ -0,0 +1,119 @@
+#include <stdbool.h>
+#include <memory.h>
+#include "vgm_conf.h"
+#include "mem_reader.h"
+
+#if defined(__unix__) || defined(__APPLE__)
+# define MEM_READER_MMAP 1
+# include <fcntl.h>
+# include <unistd.h>
+# include <sys/mman.h>
+# include <sys/stat.h>
+#else
+# define MEM_READER_MMAP 0
+#endif
+
+
+typedef struct mem_reader_s
+{
+    file_reader_t reader;   // must be first
+    const uint8_t *data;
+    size_t size;
+    bool mapped;            // data is mapped by mem_reader_map_file
+} mem_reader_t;
+
+
+static size_t mem_reader_read(file_reader_t *reader, uint8_t *buf, size_t offset, size_t len)
+{
+    mem_reader_t *mr = (mem_reader_t *)reader;
+    if (offset >= mr->size) return 0;
+    if (len > mr->size - offset) len = mr->size - offset;
+    memcpy(buf, mr->data + offset, len);
+    return len;
+}
+
+
+static size_t mem_reader_size(file_reader_t *reader)
+{
+    return ((mem_reader_t *)reader)->size;
+}
+
+
+#if VGM_READER_BORROW
+static const uint8_t * mem_reader_borrow(file_reader_t *reader, size_t offset, size_t len)
+{
+    mem_reader_t *mr = (mem_reader_t *)reader;
+    if ((offset > mr->size) || (len > mr->size - offset)) return NULL;
+    return mr->data + offset;
+}
+#endif
+
+
+static mem_reader_t * mem_reader_new(const uint8_t *data, size_t size)
+{
+    mem_reader_t *mr = (mem_reader_t *)VGM_MALLOC(sizeof(mem_reader_t));
+    if (NULL == mr)
+        return NULL;
+    memset(mr, 0, sizeof(mem_reader_t));
+    mr->reader.read = mem_reader_read;
+    mr->reader.size = mem_reader_size;
+#if VGM_READER_BORROW
+    mr->reader.borrow = mem_reader_borrow;
+#endif
+    mr->data = data;
+    mr->size = size;
+    return mr;
+}
+
+
+file_reader_t * mem_reader_create(const uint8_t *data, size_t size)
+{
+    mem_reader_t *mr = mem_reader_new(data, size);
+    return mr ? &(mr->reader) : NULL;
+}
+
+
+file_reader_t * mem_reader_map_file(const char *path)
+{
+#if MEM_READER_MMAP
+    mem_reader_t *mr = NULL;
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return NULL;
+    do
+    {
+        struct stat st;
+        if (fstat(fd, &st) != 0) break;
+        if (st.st_size <= 0) break;
+        void *data = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (MAP_FAILED == data) break;
+        // Player reads mostly forward, let kernel read ahead
+        madvise(data, (size_t)st.st_size, MADV_WILLNEED);
+        mr = mem_reader_new((const uint8_t *)data, (size_t)st.st_size);
+        if (NULL == mr)
+        {
+            munmap(data, (size_t)st.st_size);
+            break;
+        }
+        mr->mapped = true;
+    } while (0);
+    close(fd);
+    return mr ? &(mr->reader) : NULL;
+#else
+    (void)path;
+    return NULL;
+#endif
+}
+
+
+void mem_reader_destroy(file_reader_t *reader)
+{
+    mem_reader_t *mr = (mem_reader_t *)reader;
+    if (mr)
+    {
+#if MEM_READER_MMAP
+        if (mr->mapped) munmap((void *)mr->data, mr->size);
+#endif
+        VGM_FREE(mr);
+    }
+}
@@ -0,0 +1,24 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include "file_reader.h"
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+// file_reader_t over a memory buffer. Buffer is not copied and must stay valid until the reader is destroyed.
+file_reader_t * mem_reader_create(const uint8_t *data, size_t size);
+
+// file_reader_t over a read-only memory mapped file. Only available on POSIX systems, returns NULL otherwise.
+file_reader_t * mem_reader_map_file(const char *path);
+
+void mem_reader_destroy(file_reader_t *reader);
+
+
+#ifdef __cplusplus
+}
+#endif
@@ -1,1254 +1,2769 @@
-#include <stdlib.h>
-#include <memory.h>
-#include "nesapu.h"
-
-
-//
-// Length Counter (Pulse1, Pulse2, Triangle, Noise)
-// https://www.nesdev.org/wiki/APU_Length_Counter
-//
-static const unsigned int length_counter_table[32] = 
-{
-    10, 254, 20,  2, 40,  4, 80,  6, 160,  8, 60, 10, 14, 12, 26, 14,
-    12,  16, 24, 18, 48, 20, 96, 22, 192, 24, 72, 26, 16, 28, 32, 30
-};
-
-
-// Pulse channel
-// Duty lookup table, see wiki "Implementation details"
-static const bool pulse_waveform_table[][8] = 
-{
-    { 0, 0, 0, 0, 0, 0, 0, 1 }, // 12.5%
-    { 0, 0, 0, 0, 0, 0, 1, 1 }, // 25%
-    { 0, 0, 0, 0, 1, 1, 1, 1 }, // 50%
-    { 1, 1, 1, 1, 1, 1, 0, 0 }  // 25% negated
-};
-
-
-//
-// Triangle wave table
-// https://www.nesdev.org/wiki/APU_Triangle
-//
-static const unsigned int triangle_waveform_table[32] = 
-{
-    15, 14, 13, 12, 11, 10,  9,  8,  7,  6,  5,  4,  3,  2,  1,  0,
-     0,  1,  2,  3,  4,  5,  6,  7,  8,  9, 10, 11, 12, 13, 14, 15
-};
-
-
-//
-// DMC channel 
-// https://www.nesdev.org/wiki/APU_DMC
-static const uint16_t dmc_timer_period_ntsc[16] =
-{
-    428, 380, 340, 320, 286, 254, 226, 214, 190, 160, 142, 128, 106,  84, 72, 54
-};
-
-static const uint16_t dmc_timer_period_pal[16] =
-{
-    398, 354, 316, 298, 276, 236, 210, 198, 176, 148, 132, 118,  98,  78,  66,  50
-};
-
-
-//
-// Mixer
-// https://www.nesdev.org/wiki/APU_Mixer
-//
-// Generate table using make_const_tables.c
-
-
-static const q29_t mixer_pulse_table[31] =
-{
-             0,    6232609,   12315540,   18254120,   24053428,   29718306,   35253376,   40663044,
-      45951532,   51122860,   56180880,   61129276,   65971580,   70711160,   75351248,   79894960,
-      84345240,   88704968,   92976872,   97163576,  101267592,  105291368,  109237216,  113107392,
-     116904048,  120629256,  124285008,  127873240,  131395816,  134854496,  138251008
-};
-
-
-static const q29_t mixer_tnd_table[203] =
-{
-             0,    3596940,    7164553,   10703196,   14213217,   17694966,   21148782,   24574998,
-      27973946,   31345950,   34691328,   38010392,   41303460,   44570820,   47812788,   51029652,
-      54221704,   57389228,   60532508,   63651820,   66747436,   69819624,   72868656,   75894784,
-      78898280,   81879376,   84838328,   87775384,   90690792,   93584784,   96457600,   99309472,
-     102140624,  104951272,  107741656,  110511992,  113262480,  115993344,  118704800,  121397032,
-     124070264,  126724680,  129360504,  131977904,  134577088,  137158224,  139721536,  142267184,
-     144795360,  147306224,  149799968,  152276768,  154736784,  157180208,  159607168,  162017872,
-     164412480,  166791120,  169153984,  171501200,  173832960,  176149376,  178450624,  180736848,
-     183008176,  185264784,  187506800,  189734352,  191947600,  194146672,  196331728,  198502848,
-     200660208,  202803920,  204934128,  207050944,  209154512,  211244944,  213322352,  215386864,
-     217438624,  219477696,  221504256,  223518400,  225520224,  227509856,  229487408,  231452976,
-     233406688,  235348624,  237278928,  239197680,  241104976,  243000944,  244885648,  246759232,
-     248621760,  250473328,  252314064,  254144032,  255963376,  257772096,  259570384,  261358256,
-     263135856,  264903216,  266660496,  268407712,  270144992,  271872416,  273590048,  275297984,
-     276996320,  278685088,  280364448,  282034432,  283695072,  285346528,  286988832,  288622080,
-     290246336,  291861696,  293468160,  295065888,  296654912,  298235264,  299807136,  301370464,
-     302925376,  304471968,  306010240,  307540288,  309062208,  310576032,  312081824,  313579648,
-     315069568,  316551680,  318025984,  319492608,  320951584,  322402944,  323846752,  325283104,
-     326712064,  328133664,  329547904,  330954912,  332354784,  333747488,  335133088,  336511680,
-     337883296,  339248000,  340605792,  341956800,  343301056,  344638560,  345969408,  347293664,
-     348611328,  349922464,  351227136,  352525408,  353817280,  355102848,  356382112,  357655168,
-     358922016,  360182720,  361437312,  362685856,  363928384,  365164960,  366395584,  367620320,
-     368839232,  370052352,  371259680,  372461344,  373657280,  374847584,  376032320,  377211456,
-     378385120,  379553280,  380716000,  381873312,  383025248,  384171872,  385313216,  386449280,
-     387580128,  388705792,  389826272,  390941696,  392052032,  393157312,  394257568,  395352864,
-     396443264,  397528704,  398609248
-};
-
-
-
-#define NESAPU_FADE_STEPS       256
-static const q29_t fadeout_table[NESAPU_FADE_STEPS] =
-{
-             0,    2105376,    4210752,    6316128,    8421505,   10526881,   12632257,   14737633, 
-      16843010,   18948386,   21053762,   23159138,   25264514,   27369890,   29475266,   31580642, 
-      33686020,   35791396,   37896772,   40002148,   42107524,   44212900,   46318276,   48423652, 
-      50529028,   52634404,   54739780,   56845156,   58950532,   61055908,   63161284,   65266660, 
-      67372040,   69477416,   71582792,   73688168,   75793544,   77898920,   80004296,   82109672, 
-      84215048,   86320424,   88425800,   90531176,   92636552,   94741928,   96847304,   98952680, 
-     101058056,  103163432,  105268808,  107374184,  109479560,  111584936,  113690312,  115795688, 
-     117901064,  120006440,  122111816,  124217192,  126322568,  128427944,  130533320,  132638696, 
-     134744080,  136849456,  138954832,  141060208,  143165584,  145270960,  147376336,  149481712, 
-     151587088,  153692464,  155797840,  157903216,  160008592,  162113968,  164219344,  166324720, 
-     168430096,  170535472,  172640848,  174746224,  176851600,  178956976,  181062352,  183167728, 
-     185273104,  187378480,  189483856,  191589232,  193694608,  195799984,  197905360,  200010736, 
-     202116112,  204221488,  206326864,  208432240,  210537616,  212642992,  214748368,  216853744, 
-     218959120,  221064496,  223169872,  225275248,  227380624,  229486000,  231591376,  233696752, 
-     235802128,  237907504,  240012880,  242118256,  244223632,  246329008,  248434384,  250539760, 
-     252645136,  254750512,  256855888,  258961264,  261066640,  263172016,  265277392,  267382768, 
-     269488160,  271593536,  273698912,  275804288,  277909664,  280015040,  282120416,  284225792, 
-     286331168,  288436544,  290541920,  292647296,  294752672,  296858048,  298963424,  301068800, 
-     303174176,  305279552,  307384928,  309490304,  311595680,  313701056,  315806432,  317911808, 
-     320017184,  322122560,  324227936,  326333312,  328438688,  330544064,  332649440,  334754816, 
-     336860192,  338965568,  341070944,  343176320,  345281696,  347387072,  349492448,  351597824, 
-     353703200,  355808576,  357913952,  360019328,  362124704,  364230080,  366335456,  368440832, 
-     370546208,  372651584,  374756960,  376862336,  378967712,  381073088,  383178464,  385283840, 
-     387389216,  389494592,  391599968,  393705344,  395810720,  397916096,  400021472,  402126848, 
-     404232224,  406337600,  408442976,  410548352,  412653728,  414759104,  416864480,  418969856, 
-     421075232,  423180608,  425285984,  427391360,  429496736,  431602112,  433707488,  435812864, 
-     437918240,  440023616,  442128992,  444234368,  446339744,  448445120,  450550496,  452655872, 
-     454761248,  456866624,  458972000,  461077376,  463182752,  465288128,  467393504,  469498880, 
-     471604256,  473709632,  475815008,  477920384,  480025760,  482131136,  484236512,  486341888, 
-     488447264,  490552640,  492658016,  494763392,  496868768,  498974144,  501079520,  503184896, 
-     505290272,  507395648,  509501024,  511606400,  513711776,  515817152,  517922528,  520027904, 
-     522133280,  524238656,  526344032,  528449408,  530554784,  532660160,  534765536,  536870912 
-};
-
-//
-// Noise channel
-// https://www.nesdev.org/wiki/APU_Noise
-static const uint16_t noise_timer_period_ntsc[16] =
-{
-    4, 8, 16, 32, 64, 96, 128, 160, 202, 254, 380, 508, 762, 1016, 2034, 4068
-};
-
-static const uint16_t noise_timer_period_pal[16] =
-{
-    4, 8, 14, 30, 60, 88, 118, 148, 188, 236, 354, 472, 708,  944, 1890, 3778
-};
-
-
-
-/**
- * @brief Count down timer
- * 
- * @param counter       Input initial counter value. When counting finish, return finish counter value.
- * @param period        Counting period.
- * @return unsigned int Number of times counter has reloaded from 0 to next period
- * 
- * @note Most cases \param cycles < \param period, it is faster we use while loop than divide
- *
- */
-static inline unsigned int timer_count_down(unsigned int *counter, unsigned int period, unsigned int cycles)
-{
-    unsigned int clocks = 0;
-    while (cycles >= period)
-    {
-        cycles -= period;
-        ++clocks;
-    }
-    unsigned int extra = cycles;
-    if (extra > *counter)
-    {
-        *counter = *counter + period - extra;
-        ++clocks;
-    }
-    else
-    {
-        *counter = *counter - extra;
-    }
-    return clocks;
-}
-
-
-/**
- * @brief Count up timer
- * 
- * @param counter       Input initial counter value. When counting finish, return finish counter value
- * @param period        Countering period
- * @return unsigned int Number of times counter has reloaded from period to 0
- *
- */
-static inline unsigned int timer_count_up(unsigned int *counter, unsigned int period, unsigned int cycles)
-{
-    unsigned int clocks = cycles / period;
-    unsigned int extra = cycles % period;
-    if (*counter + extra >= period)
-    {
-        *counter = *counter + extra - period;
-        ++clocks;
-    }
-    else
-    {
-        *counter = *counter + extra;
-    }
-    return clocks;
-}
-
-
-static inline void update_frame_counter(nesapu_t *apu, unsigned int cycles)
-{
-    //
-    // https://www.nesdev.org/wiki/APU_Frame_Counter
-    //
-    // Frame counter clocks 4 or 5 sequencer at 240Hz or 7457.38 CPU clocks.
-    // Fixed point is used here to increase accuracy.
-    if (apu->frame_force_clock)
-    {
-        apu->quarter_frame = true;
-        apu->half_frame = true;
-        apu->frame_force_clock = false;
-    }
-    else
-    {
-        apu->quarter_frame = false;
-        apu->half_frame = false;
-    }
-    q16_t cycles_fp = int_to_q16(cycles);
-    apu->frame_accu_fp += cycles_fp;
-    if (apu->frame_accu_fp >= apu->frame_period_fp)
-    {
-        apu->frame_accu_fp -= apu->frame_period_fp;
-        ++apu->sequencer_step;
-        if (apu->sequence_mode)
-        {
-            // 5 step mode
-            // step      quarter_frame         half_frame
-            //  1          clock                  -
-            //  2          clock                clock
-            //  3          clock                  -
-            //  4            -                    -
-            //  5          clock                clock
-            switch (apu->sequencer_step)
-            {
-            case 1:
-                apu->quarter_frame = true;
-                break;
-            case 2:
-                apu->quarter_frame = true;
-                apu->half_frame = true;
-                break;
-            case 3:
-                apu->quarter_frame = true;
-                break;
-            case 4:
-                apu->quarter_frame = false;
-                break;
-            case 5:
-                apu->quarter_frame = true;
-                apu->half_frame = true;
-                apu->sequencer_step = 0;
-                break;
-            }
-        }
-        else
-        {
-            // 4 step mode
-            // step      quarter_frame         half_frame
-            //  1          clock                  -
-            //  2          clock                clock
-            //  3          clock                  -
-            //  4          clock                clock
-            switch (apu->sequencer_step)
-            {
-            case 1:
-                apu->quarter_frame = true;
-                break;
-            case 2:
-                apu->quarter_frame = true;
-                apu->half_frame = true;
-                break;
-            case 3:
-                apu->quarter_frame = true;
-                break;
-            case 4:
-                apu->quarter_frame = true;
-                apu->half_frame = true;
-                apu->sequencer_step = 0;
-                break;
-            }
-        }
-    }
-}
-
-
-/*
- * https://www.nesdev.org/wiki/APU_Pulse
- *
- *                  Sweep -----> Timer
- *                    |            |
- *                    |            |
- *                    |            v
- *                    |        Sequencer   Length Counter
- *                    |            |             |
- *                    |            |             |
- *                    v            v             v
- * Envelope -------> Gate -----> Gate -------> Gate ---> (to mixer)
- */
-static inline unsigned int update_pulse(nesapu_t *apu, int ch, unsigned int cycles)
-{
-    //
-    // Clock envelope @ quater frame
-    // https://www.nesdev.org/wiki/APU_Envelope
-    if (apu->quarter_frame)
-    {
-        if (apu->pulse[ch].envelope_start)
-        {
-            apu->pulse[ch].envelope_decay = 15;
-            apu->pulse[ch].envelope_value = apu->pulse[ch].volume_envperiod;
-            apu->pulse[ch].envelope_start = false;
-        }
-        else
-        {
-            if (apu->pulse[ch].envelope_value)
-            {
-                --(apu->pulse[ch].envelope_value);
-            }
-            else
-            {
-                apu->pulse[ch].envelope_value = apu->pulse[ch].volume_envperiod;
-                if (apu->pulse[ch].envelope_decay)
-                {
-                    --(apu->pulse[ch].envelope_decay);
-                }
-                else if (apu->pulse[ch].lenhalt_envloop)
-                {
-                    apu->pulse[ch].envelope_decay = 15;
-                }
-            }
-        }
-    }
-    //
-    // Clock sweep unit @ half frame 
-    // https://www.nesdev.org/wiki/APU_Sweep
-    //
-    if (apu->half_frame)
-    {
-        // 1. If the divider's counter is zero, the sweep is enabled, and the sweep unit is not muting the channel: The pulse's period is set to the target period.
-        // 2. If the divider's counter is zero or the reload flag is true: The divider counter is set to P and the reload flag is cleared.
-        //    Otherwise, the divider counter is decremented.
-        if (apu->pulse[ch].sweep_reload)
-        {
-            apu->pulse[ch].sweep_value = apu->pulse[ch].sweep_period;
-            apu->pulse[ch].sweep_reload = false;
-        }
-        else 
-        {
-            if (apu->pulse[ch].sweep_value)
-            {
-                --(apu->pulse[ch].sweep_value);
-            } 
-            else if (apu->pulse[ch].sweep_enabled && apu->pulse[ch].sweep_shift)  // TODO: Not sure if pulse_sweep_enabled must be true
-            {
-                // Calculate target period.
-                unsigned int c = apu->pulse[ch].timer_period >> apu->pulse[ch].sweep_shift;
-                if (apu->pulse[ch].sweep_negate)
-                {
-                    if (ch == 0) apu->pulse[ch].sweep_target -= c + 1;
-                    else if (ch == 1) apu->pulse[ch].sweep_target -= c;
-                }
-                else
-                {
-                    apu->pulse[ch].sweep_target += c;
-                }
-                if (!apu->pulse[ch].sweep_timer_mute)
-                {
-                    // When the sweep unit is muting a pulse channel, the channel's current period remains unchanged.
-                    apu->pulse[ch].timer_period = apu->pulse[ch].sweep_target;
-                }
-                // Two conditions cause the sweep unit to mute the channel:
-                // 1. If the current period is less than 8, the sweep unit mutes the channel.
-                // 2. If at any time the target period is greater than $7FF, the sweep unit mutes the channel.
-                apu->pulse[ch].sweep_timer_mute = ((apu->pulse[ch].timer_period < 8) || (apu->pulse[ch].sweep_target > 0x7ff));
-                // Reload divider
-                apu->pulse[ch].sweep_value = apu->pulse[ch].sweep_period;
-            }
-        }
-    }
-    //
-    // Clock pulse channel timer and update sequencer
-    // https://www.nesdev.org/wiki/APU_Pulse
-    // Timer counting downwards from 0 at every other CPU cycle. So we set timer limit to  2x (timer_period + 1).
-    if (!apu->pulse[ch].sweep_timer_mute)
-    {
-        unsigned int seq_clk = timer_count_down(&(apu->pulse[ch].timer_value), (apu->pulse[ch].timer_period + 1) << 1, cycles);
-        if (seq_clk) timer_count_down(&(apu->pulse[ch].sequencer_value), 8, seq_clk);
-    }
-    // 
-    // Clock length counter @ half frame if not halted
-    // https://www.nesdev.org/wiki/APU_Length_Counter
-    if (!apu->pulse[ch].lenhalt_envloop && apu->pulse[ch].length_value && apu->half_frame)
-    {
-        --(apu->pulse[ch].length_value);
-    }
-    // Determine Pulse channel output
-    if (!apu->pulse[ch].enabled) return 0;
-    if (!apu->pulse[ch].length_value) return 0;
-    if (apu->pulse[ch].sweep_timer_mute) return 0;
-    if (!pulse_waveform_table[apu->pulse[ch].duty][apu->pulse[ch].sequencer_value]) return 0;
-    return (apu->pulse[ch].constant_volume ? apu->pulse[ch].volume_envperiod : apu->pulse[ch].envelope_decay);
-}
-
-
-/*
- * https://www.nesdev.org/wiki/APU_Triangle
- *
- *       Linear Counter    Length Counter
- *              |                |
- *              v                v
- *  Timer ---> Gate ----------> Gate ---> Sequencer ---> (to mixer)
- */
-static inline unsigned int update_triangle(nesapu_t *apu, unsigned int cycles)
-{
-    //
-    // Clock linear counter @ quater frame
-    // https://www.nesdev.org/wiki/APU_Triangle
-    if (apu->quarter_frame)
-    {
-        // In order:
-        // 1. If the linear counter reload flag is set, the linear counter is reloaded with the counter reload value,
-        //    otherwise if the linear counter is non-zero, it is decremented.
-        // 2. If the control flag is clear, the linear counter reload flag is cleared.
-        if (apu->triangle_linear_reload)
-        {
-            apu->triangle_linear_value = apu->triangle_linear_period;
-        }
-        else if (apu->triangle_linear_value)
-        {
-            --(apu->triangle_linear_value);
-        }
-        if (!apu->triangle_lnrctl_lenhalt)
-        {
-            apu->triangle_linear_reload = false;
-        }
-    }
-    // 
-    // Clock length counter @ half frame if not halted
-    // https://www.nesdev.org/wiki/APU_Length_Counter
-    if (!apu->triangle_lnrctl_lenhalt && apu->triangle_length_value && apu->half_frame)
-    {
-        --(apu->triangle_length_value);
-    }
-    // Clock triangle channel timer and return
-    // Trick: Just keep sequencer unchanged if the channel should be silenced, it minizes pop
-    if (apu->triangle_enabled 
-        &&
-        !apu->triangle_timer_period_bad
-        &&
-        apu->triangle_length_value
-        &&
-        apu->triangle_linear_value)
-    {
-        unsigned int seq_clk = timer_count_down(&(apu->triangle_timer_value), apu->triangle_timer_period + 1, cycles);
-        if (seq_clk) timer_count_up(&(apu->triangle_sequencer_value), 32, seq_clk);
-    }
-    return triangle_waveform_table[apu->triangle_sequencer_value];
-}
-
-
-/*
- * https://www.nesdev.org/wiki/APU_Noise
- * 
- *     Timer --> Shift Register   Length Counter
- *                    |                |
- *                    v                v
- * Envelope -------> Gate ----------> Gate --> (to mixer)
- */
-static inline unsigned int update_noise(nesapu_t* apu, unsigned int cycles)
-{
-    //
-    // Clock envelope @ quater frame
-    // https://www.nesdev.org/wiki/APU_Envelope
-    if (apu->quarter_frame)
-    {
-        if (apu->noise_envelope_start)
-        {
-            apu->noise_envelope_decay = 15;
-            apu->noise_envelope_value = apu->noise_volume_envperiod;
-            apu->noise_envelope_start = false;
-        }
-        else
-        {
-            if (apu->noise_envelope_value)
-            {
-                --(apu->noise_envelope_value);
-            }
-            else
-            {
-                apu->noise_envelope_value = apu->noise_volume_envperiod;
-                if (apu->noise_envelope_decay)
-                {
-                    --(apu->noise_envelope_decay);
-                }
-                else if (apu->noise_lenhalt_envloop)
-                {
-                    apu->noise_envelope_decay = 15;
-                }
-            }
-        }
-    }
-    // Clock noise channel timer
-    if (apu->noise_timer_period > 0)
-    {
-        unsigned int clocks = timer_count_down(&(apu->noise_timer_value), apu->noise_timer_period + 1, cycles);
-        while (clocks)
-        {
-            // When the timer clocks the shift register, the following occur in order:
-            // 1) Feedback is calculated as the exclusive-OR of bit 0 and one other bit: bit 6 if Mode flag is set, otherwise bit 1.
-            uint16_t feedback;
-            if (apu->noise_mode)
-            {
-                feedback = ((apu->noise_shift_reg) ^ (apu->noise_shift_reg >> 6)) & 0x0001;
-            }
-            else
-            {
-                feedback = ((apu->noise_shift_reg) ^ (apu->noise_shift_reg >> 1)) & 0x0001;
-            }
-            // 2) The shift register is shifted right by one bit.
-            apu->noise_shift_reg = apu->noise_shift_reg >> 1;
-            // 3) Bit 14, the leftmost bit, is set to the feedback calculated earlier.
-            if (feedback)
-            {
-                apu->noise_shift_reg |= 0x4000;  // 100 0000 0000 0000
-            }
-            else
-            {
-                apu->noise_shift_reg &= 0x3fff; // 011 1111 1111 1111
-            }
-            --clocks;
-        }
-    }
-    // 
-    // Clock length counter @ half frame if not halted
-    // https://www.nesdev.org/wiki/APU_Length_Counter
-    if (!apu->noise_lenhalt_envloop && apu->noise_length_value && apu->half_frame)
-    {
-        --(apu->noise_length_value);
-    }
-    // return value
-    if (!apu->noise_enabled) return 0;
-    // The mixer receives the current envelope volume except when bit 0 of the shift register is set, or the length counter is 0
-    if (apu->noise_shift_reg & 0x01) return 0;
-    if (!apu->noise_length_value) return 0;
-    return (apu->noise_constant_volume ? apu->noise_volume_envperiod : apu->noise_envelope_decay);
-}
-
-
-static void dmc_transfer(nesapu_t *apu)
-{
-    if (apu->dmc_read_buffer_empty && apu->dmc_read_remaining)
-    {
-        // 1. The CPU is stalled for up to 4 CPU cycles to allow the longest
-        //    possible write (the return address and write after an IRQ) to
-        //    finish. (not important as we are playing recording)
-        // 2. The sample buffer is filled with the next sample byte read from the current address
-        apu->dmc_read_buffer = nesapu_read_ram(apu, apu->dmc_read_addr);
-        apu->dmc_read_buffer_empty = false;
-        // 3. The address is incremented. If it exceeds $FFFF, it wraps to $8000
-        ++(apu->dmc_read_addr);
-        if (apu->dmc_read_addr == 0x0000)
-            apu->dmc_read_addr = 0x8000;
-        // 4. The bytes remaining counter is decremented. If it becomes zero and the loop flag is set, the sample is
-        //    restarted; otherwise, if the bytes remaining counter becomes zero and the IRQ enabled flag is set,
-        //    the interrupt flag is set.
-        --(apu->dmc_read_remaining);
-        if (apu->dmc_read_remaining == 0)
-        {
-            if (apu->dmc_loop)
-            {
-                apu->dmc_read_addr = apu->dmc_sample_addr;
-                apu->dmc_read_remaining = apu->dmc_sample_len;
-            }
-        }
-    }
-}
-
-
-/*
- * https://www.nesdev.org/wiki/APU_DMC
- *
- *                          Timer
- *                            |
- *                            v
- * Reader ---> Buffer ---> Shifter ---> Output level ---> (to the mixer)
- */
-static inline unsigned int update_dmc(nesapu_t* apu, unsigned int cycles)
-{
-    if (!apu->dmc_enabled) return 0;
-    // Check DMC setup. Some bad VGM errornously enables DMC without setting it up (Double Dragon)
-    if (apu->dmc_timer_period == 0) return 0;   
-    if (apu->dmc_read_addr < 0x8000) return 0;
-    // clock channel clock
-    unsigned int clocks = timer_count_down(&(apu->dmc_timer_value), apu->dmc_timer_period + 1, cycles);
-    while (clocks)
-    {
-        // When the timer outputs a clock, the following actions occur in order: 
-        // 1. If the silence flag is clear, the output level changes based on bit 0 of the shift register.
-        //    If the bit is 1, add 2; otherwise, subtract 2.
-        //    But if adding or subtracting 2 would cause the output level to leave the 0-127 range,
-        //    leave the output level unchanged. This means subtract 2 only if the current level is at least 2,
-        //    or add 2 only if the current level is at most 125.
-        if (!apu->dmc_output_silence)
-        {
-            if (apu->dmc_output_shift_reg & 0x01)
-                apu->dmc_output += (apu->dmc_output <= 125) ? 2 : 0;
-            else
-                apu->dmc_output -= (apu->dmc_output >= 2) ? 2 : 0;
-        }
-        // 2. The right shift register is clocked
-        apu->dmc_output_shift_reg >>= 1;
-        // 3. As stated above, the bits - remaining counter is decremented. If it becomes zero, a new output cycle is started.
-        if (apu->dmc_output_bits_remaining > 0)
-        {
-            --(apu->dmc_output_bits_remaining);
-        }
-        if (apu->dmc_output_bits_remaining == 0)
-        {
-            // A new cycle is started as follows :
-            // 1. The bits-remaining counter is loaded with 8.
-            apu->dmc_output_bits_remaining = 8;
-            // 2. If the sample buffer is empty, then the silence flag is set; 
-            //    otherwise, the silence flag is cleared and the sample buffer is emptied into the shift register.
-            if (apu->dmc_read_buffer_empty)
-            {
-                apu->dmc_output_silence = true;
-            }
-            else
-            {
-                apu->dmc_output_silence = false;
-                apu->dmc_output_shift_reg = apu->dmc_read_buffer;
-                apu->dmc_read_buffer_empty = true;
-                // Perform memory read
-                dmc_transfer(apu);
-            }
-        }
-        --clocks;
-    }
-    return (apu->dmc_output);
-}
-
-
-nesapu_t * nesapu_create(file_reader_t *reader, bool format, unsigned int clock, unsigned int sample_rate)
-{
-    nesapu_t *apu = (nesapu_t*)VGM_MALLOC(sizeof(nesapu_t));
-    if (NULL == apu)
-        return NULL;
-    memset(apu, 0, sizeof(nesapu_t));
-    apu->reader = reader;
-    apu->format = format;
-    apu->clock_rate = clock;
-#if NESAPU_USE_BLIPBUF
-    // blip
-    apu->blip = blip_new(NESAPU_MAX_SAMPLES);
-    blip_set_rates(apu->blip, apu->clock_rate, sample_rate);
-    apu->frame_period_fp = float_to_q16((float)apu->clock_rate / 240.0f);  // 240Hz frame counter period
-#else
-    // Sampling
-    apu->sample_period_fp = float_to_q16((float)apu->clock_rate / sample_rate);
-#endif
-    // ram
-    apu->ram_list = NULL;
-    apu->ram_active = NULL;
-    apu->ram_cache = NULL;
-    nesapu_reset(apu);
-    return apu;
-}
-
-
-void nesapu_destroy(nesapu_t *apu)
-{
-    if (apu != NULL)
-    {
-        // Free ram list
-        nesapu_ram_t *ram = apu->ram_list, *tram;
-        while (ram)
-        {
-            tram = ram;
-            ram = ram->next;
-            VGM_FREE(tram);
-        }
-        if (apu->ram_cache)
-        {
-            VGM_FREE(apu->ram_cache);
-        }
-#if NESAPU_USE_BLIPBUF        
-        // Free blip
-        if (apu->blip)
-        {
-            blip_delete(apu->blip);
-            apu->blip = 0;
-        }
-#endif
-        VGM_FREE(apu);
-    }
-}
-
-
-void nesapu_reset(nesapu_t* apu)
-{
-#if !NESAPU_USE_BLIPBUF
-    // samplling
-    apu->sample_accu_fp = 0;
-#endif
-    // channel mask
-    apu->mask_pulse1 = false;
-    apu->mask_pulse2 = false;
-    apu->mask_triangle = false;
-    apu->mask_noise = false;
-    apu->mask_dmc = false;
-    // fade control
-    apu->fadeout_enabled = false;
-    apu->fadeout_period_fp = 0;
-    apu->fadeout_accu_fp = 0;
-    apu->fadeout_sequencer_value = 0;
-    // frame counter
-    apu->sequencer_step = 0;
-    apu->sequence_mode = false;
-    apu->quarter_frame = false;
-    apu->half_frame = false;
-    apu->frame_accu_fp = 0;
-    //
-    // Enable Channel NT21 on startup
-    // From: https://www.nesdev.org/wiki/Talk:NSF
-    // Regarding 4015h, well... it's empirical. My experience says that setting 4015h to 0Fh
-    // is required in order to get *a lot of* tunes starting playing. I don't remember of *any* broken
-    // tune by setting such value. So, it's recommended *to follow* such thing. --Zepper 14:25, 29 March 2012 (PDT)
-    // 
-    // Pulse1
-    apu->pulse[0].enabled = true;
-    apu->pulse[0].duty = 0;
-    apu->pulse[0].lenhalt_envloop = false;
-    apu->pulse[0].constant_volume = false;
-    apu->pulse[0].envelope_start = false;
-    apu->pulse[0].envelope_value = 0;
-    apu->pulse[0].volume_envperiod = 0;
-    apu->pulse[0].sweep_enabled = false;
-    apu->pulse[0].sweep_period = 0;
-    apu->pulse[0].sweep_value = 0;
-    apu->pulse[0].sweep_negate = false;
-    apu->pulse[0].sweep_shift = 0;
-    apu->pulse[0].sweep_target = 0;
-    apu->pulse[0].sweep_reload = false;
-    apu->pulse[0].timer_period = 0;
-    apu->pulse[0].timer_value = 0;
-    apu->pulse[0].sequencer_value = 0;
-    apu->pulse[0].sweep_timer_mute = true;
-    // Pulse2
-    apu->pulse[1].enabled = true;
-    apu->pulse[1].duty = 0;
-    apu->pulse[1].lenhalt_envloop = false;
-    apu->pulse[1].constant_volume = false;
-    apu->pulse[1].envelope_start = false;
-    apu->pulse[1].envelope_value = 0;
-    apu->pulse[1].volume_envperiod = 0;
-    apu->pulse[1].sweep_enabled = false;
-    apu->pulse[1].sweep_period = 0;
-    apu->pulse[1].sweep_value = 0;
-    apu->pulse[1].sweep_negate = false;
-    apu->pulse[1].sweep_shift = 0;
-    apu->pulse[1].sweep_target = 0;
-    apu->pulse[1].sweep_reload = false;
-    apu->pulse[1].timer_period = 0;
-    apu->pulse[1].timer_value = 0;
-    apu->pulse[1].sequencer_value = 0;
-    apu->pulse[1].sweep_timer_mute = true;
-    // Triangle
-    apu->triangle_enabled = true;
-    apu->triangle_length_value = 0;
-    apu->triangle_lnrctl_lenhalt = false;
-    apu->triangle_linear_period = 0;
-    apu->triangle_linear_value = 0;
-    apu->triangle_linear_reload = false;
-    apu->triangle_timer_period = 0;
-    apu->triangle_timer_period_bad = true;
-    apu->triangle_timer_value = 0;
-    apu->triangle_sequencer_value = 0;
-    // Noise
-    apu->noise_enabled = true;
-    apu->noise_lenhalt_envloop = false;
-    apu->noise_constant_volume = false;
-    apu->noise_constant_volume = 0;
-    apu->noise_volume_envperiod = 0;
-    apu->noise_mode = false;
-    apu->noise_envelope_start = false;
-    apu->noise_envelope_decay = 0;
-    apu->noise_envelope_value = 0;
-    apu->noise_length_value = 0;
-    apu->noise_timer_period = 0;
-    apu->noise_timer_value = 0;
-    apu->noise_shift_reg = 1;
-    // DMC
-    apu->dmc_enabled = false;
-    apu->dmc_loop = false;
-    apu->dmc_output = 0;
-    apu->dmc_sample_addr = 0;
-    apu->dmc_sample_len = 0;
-    apu->dmc_timer_period = 0;
-    apu->dmc_timer_value = 0;
-    apu->dmc_read_buffer = 0;
-    apu->dmc_read_buffer_empty = true;
-    apu->dmc_read_addr = 0;
-    apu->dmc_read_remaining = 0;
-    apu->dmc_output_shift_reg = 0;
-    apu->dmc_output_bits_remaining = 0;
-    apu->dmc_output_silence = true;
-}
-
-
-static inline int16_t nesapu_run_and_sample(nesapu_t *apu, unsigned int cycles)
-{
-    update_frame_counter(apu, cycles);
-    unsigned int p1 = update_pulse(apu, 0, cycles);
-    unsigned int p2 = update_pulse(apu, 1, cycles);
-    unsigned int tr = update_triangle(apu, cycles);
-    unsigned int ns = update_noise(apu, cycles);
-    unsigned int dm = update_dmc(apu, cycles);
-    if (apu->mask_pulse1) p1 = 0;
-    if (apu->mask_pulse2) p2 = 0;
-    if (apu->mask_triangle) tr = 0;
-    if (apu->mask_noise) ns = 0;
-    if (apu->mask_dmc) dm = 0;
-    q29_t f = mixer_pulse_table[p1 + p2] + mixer_tnd_table[3 * tr + 2 * ns + dm];
-    if (apu->fadeout_enabled)
-    {
-        if (apu->fadeout_sequencer_value > 0)
-        {
-             apu->fadeout_accu_fp += int_to_q16(1);
-             if (apu->fadeout_accu_fp >= apu->fadeout_period_fp)
-             {
-                apu->fadeout_accu_fp -= apu->fadeout_period_fp;
-                --(apu->fadeout_sequencer_value);
-             }
-        }
-        f = q29_mul(f, fadeout_table[apu->fadeout_sequencer_value]);
-    }
-    return q29_to_sample(f);
-}
-
-
-#if NESAPU_USE_BLIPBUF
-
-void nesapu_get_samples(nesapu_t *apu, int16_t *buf, unsigned int samples)
-{
-    unsigned int cycles = (unsigned int)blip_clocks_needed(apu->blip, (int)samples);
-    unsigned int period = cycles / samples; // rough sampling period. blip helps resampling
-    unsigned int time = 0;
-    int16_t s;
-    int delta;
-    while (cycles > period)
-    {
-        // run period clocks
-        s = nesapu_run_and_sample(apu, period);
-        delta = s - apu->blip_last_sample;
-        apu->blip_last_sample = s;
-        time += period;
-        blip_add_delta(apu->blip, time, delta);
-        cycles -= period;
-    }
-    // run remaining clocks
-    s = nesapu_run_and_sample(apu, cycles);
-    delta = s - apu->blip_last_sample;
-    apu->blip_last_sample = s;
-    time += cycles;
-    blip_add_delta(apu->blip, time, delta);
-    blip_end_frame(apu->blip, time);
-    blip_read_samples(apu->blip, (short *)buf, (int)samples, 0);
-}
-
-#else
-
-void nesapu_get_samples(nesapu_t *apu, int16_t *buf, unsigned int samples)
-{
-    static int32_t prev = 0;
-    int32_t t, s;
-    for (unsigned int i = 0; i < samples; ++i)
-    {
-        apu->sample_accu_fp += apu->sample_period_fp;
-        unsigned int cycles = (unsigned int)(q16_to_int(apu->sample_accu_fp));
-        s = nesapu_run_and_sample(apu, cycles);
-        // simple weighted filter
-        t = s;
-        s = (s + s + s + prev) >> 2;
-        prev = t;
-        buf[i] = (int16_t)s;
-        apu->sample_accu_fp -= int_to_q16(cycles);
-    }
-}
-
-#endif
-
-
-void nesapu_write_reg(nesapu_t *apu, uint16_t reg, uint8_t val)
-{
-    switch (reg)
-    {
-    // Pulse1 regs
-    case 0x00:  // $4000: DDLC VVVV, Duty (D), envelope loop / length counter halt (L), constant volume (C), volume/envelope (V)
-        apu->pulse[0].duty = (val & 0xc0) >> 6;         // Duty (DD), index to tbl_pulse_waveform
-        apu->pulse[0].lenhalt_envloop = (val & 0x20);     // Length counter halt or Envelope loop (L)
-        apu->pulse[0].constant_volume = (val & 0x10);   // Constant volume (true) or Envelope enable (false) (C)
-        apu->pulse[0].volume_envperiod = (val & 0xf);    // Volume or period of envelope (VVVV)
-        break;
-    case 0x01:  // $4001: EPPP NSSS, Sweep unit: enabled (E), period (P), negate (N), shift (S)
-        apu->pulse[0].sweep_enabled = (val & 0x80);     // Sweep enable (E)
-        apu->pulse[0].sweep_period = (val & 0x70) >> 4; // Sweep period (PPP)
-        apu->pulse[0].sweep_negate = (val & 0x08);      // Sweep negate (N)
-        apu->pulse[0].sweep_shift = val & 0x07;         // Sweep shift (SSS)
-        apu->pulse[0].sweep_reload = true;              // Side effects : Sets reload flag 
-        break;
-    case 0x02:  // $4002: LLLL LLLL, Timer low (T)
-        apu->pulse[0].timer_period &= 0xff00;
-        apu->pulse[0].timer_period |= val;                          // Pulse1 timer period low (TTTT TTTT)
-        apu->pulse[0].sweep_target = apu->pulse[0].timer_period;    // Whenever the current period changes, the target period also changes
-        apu->pulse[0].sweep_timer_mute = ((apu->pulse[0].timer_period < 8) || (apu->pulse[0].sweep_target > 0x7ff));
-        break;
-    case 0x03:  // $4003: llll lHHH, Length counter load (L), timer high (T)
-        apu->pulse[0].length_value = length_counter_table[(val & 0xf8) >> 3]; // Length counter load (lllll) 
-        apu->pulse[0].timer_period &= 0x00ff;
-        apu->pulse[0].timer_period |= ((unsigned int)(val & 0x07)) << 8;        // Pulse1 timer period high 3 bits (TTT)
-        apu->pulse[0].sweep_target = apu->pulse[0].timer_period;    // Whenever the current period changes, the target period also changes
-        apu->pulse[0].sweep_timer_mute = ((apu->pulse[0].timer_period < 8) || (apu->pulse[0].sweep_target > 0x7ff));
-        // Side effects : The sequencer is immediately restarted at the first value of the current sequence. 
-        // The envelope is also restarted. The period divider is not reset.
-        apu->pulse[0].envelope_start = true;
-        apu->pulse[0].sequencer_value = 0;
-        break;
-    // Pulse2
-    case 0x04:  // $4004: DDLC VVVV, Duty (D), envelope loop / length counter halt (L), constant volume (C), volume/envelope (V)
-        apu->pulse[1].duty = (val & 0xc0) >> 6;               // Duty (DD), index to tbl_pulse_waveform
-        apu->pulse[1].lenhalt_envloop = (val & 0x20);         // Length counter halt or Envelope loop (L)
-        apu->pulse[1].constant_volume = (val & 0x10);         // Constant volume (true) or Envelope enable (false) (C)
-        apu->pulse[1].volume_envperiod = (val & 0xf);         // Volume or period of envelope (VVVV)
-        break;
-    case 0x05:  // $4005: EPPP NSSS, Sweep unit: enabled (E), period (P), negate (N), shift (S)
-        apu->pulse[1].sweep_enabled = (val & 0x80);           // Sweep enable (E)
-        apu->pulse[1].sweep_period = (val & 0x70) >> 4;       // Sweep period (PPP)
-        apu->pulse[1].sweep_negate = (val & 0x08);            // Sweep negate (N)
-        apu->pulse[1].sweep_shift = val & 0x07;               // Sweep shift (SSS)
-        apu->pulse[1].sweep_reload = true;                    // Side effects : Sets reload flag 
-        break;
-    case 0x06:  // $4006: LLLL LLLL, Timer low (T)
-        apu->pulse[1].timer_period &= 0xff00;
-        apu->pulse[1].timer_period |= val;                          // Pulse2 timer period low (TTTT TTTT)
-        apu->pulse[1].sweep_target = apu->pulse[1].timer_period;    // Whenever the current period changes, the target period also changes
-        apu->pulse[1].sweep_timer_mute = ((apu->pulse[1].timer_period < 8) || (apu->pulse[1].sweep_target > 0x7ff));
-        break;
-    case 0x07:  // $4007: llll lHHH, Length counter load (L), timer high (T)
-        apu->pulse[1].length_value = length_counter_table[(val & 0xf8) >> 3];   // Length counter load (lllll) 
-        apu->pulse[1].timer_period &= 0x00ff;
-        apu->pulse[1].timer_period |= ((unsigned int)(val & 0x07)) << 8;          // Pulse2 timer period high 3 bits (TTT)
-        apu->pulse[1].sweep_target = apu->pulse[1].timer_period;    // Whenever the current period changes, the target period also changes
-        apu->pulse[1].sweep_timer_mute = ((apu->pulse[1].timer_period < 8) || (apu->pulse[1].sweep_target > 0x7ff));
-        // Side effects : The sequencer is immediately restarted at the first value of the current sequence. 
-        // The envelope is also restarted. The period divider is not reset.
-        apu->pulse[1].envelope_start = true;
-        apu->pulse[1].sequencer_value = 0;
-        break;
-    // Triangle
-    case 0x08:  // $4008: CRRR RRRR, Linear counter setup
-        apu->triangle_lnrctl_lenhalt = (val & 0x80);    // Control flag / length counter halt
-        apu->triangle_linear_period = (val & 0x7f);     // Linear counter reload value 
-        break;
-    case 0x09:  // Not used
-        break;
-    case 0x0a:  // $400A: LLLL LLLL, Timer low (write) 
-        apu->triangle_timer_period &= 0xff00;
-        apu->triangle_timer_period |= val;  // Timer low (LLLL LLLL)
-        apu->triangle_timer_period_bad = ((apu->triangle_timer_period >= 0x7fe) || (apu->triangle_timer_period <= 1));
-        break;
-    case 0x0b:  // $400B: llll lHHH, Length counter load and timer high
-        apu->triangle_timer_period &= 0x00ff;
-        apu->triangle_timer_period |= ((unsigned int)(val & 0x07)) << 8;        // Timer period high (HHH)
-        apu->triangle_timer_period_bad = ((apu->triangle_timer_period >= 0x7fe) || (apu->triangle_timer_period <= 1));
-        apu->triangle_length_value = length_counter_table[(val & 0xf8) >> 3]; // Length counter load (lllll)
-        apu->triangle_linear_reload = true;  // site effect: sets the linear counter reload flag 
-        //apu->triangle_timer_value = apu->triangle_timer_period;
-        break;
-    // Noise
-    case 0x0c:  // $400C: --LC VVVV, Length counter halt, constant volume/envelope flag, and volume/envelope divider period
-        apu->noise_lenhalt_envloop = (val & 0x20);      // Envelope loop/length counter halt (L)
-        apu->noise_constant_volume = (val & 0x10);      // Constant volume (C)
-        apu->noise_volume_envperiod = (val & 0x0f);     // Volume / Envelope period (VVVV)
-        break;
-    case 0x0d:  // Not used
-        break;
-    case 0x0e:  // $400E: M--- PPPP, Mode and period
-        apu->noise_mode = (val & 0x80); // Mode Flag (M)
-        if (apu->format)    // PAL
-        {
-            apu->noise_timer_period = noise_timer_period_pal[val & 0x0f];   // Noise period (PPPP) 
-        }
-        else
-        {
-            apu->noise_timer_period = noise_timer_period_ntsc[val & 0x0f];  // Noise period (PPPP)
-        }
-        break;
-    case 0x0f:  // $400F: llll l---, Length counter load and envelope restart 
-        apu->noise_length_value = length_counter_table[(val & 0xf8) >> 3];  // Length counter value (lllll)
-        apu->noise_envelope_start = true;   //Side effects: Sets start flag
-        break;
-    // DMC
-    case 0x10:  // $4010: IL-- RRRR, Flags and Rate
-        apu->dmc_loop = (val & 0x40);   // Loop flag (L)
-        if (apu->format)
-        {
-            apu->dmc_timer_period = dmc_timer_period_ntsc[val & 0x0f];  // Rate index (RRRR)
-        }
-        else
-        {
-            apu->dmc_timer_period = dmc_timer_period_pal[val & 0x0f];  // Rate index (RRRR)
-        }
-        break;
-    case 0x11:  // $4011: -DDD DDDD, Direct load
-        apu->dmc_output = val & 0x7f;   // Direct load (DDD DDDD)
-        break;
-    case 0x12:  // $4012: AAAA AAAA, Sample address
-        apu->dmc_sample_addr = (uint16_t)(0xc000 + ((uint16_t)val << 6)); // Sample address = %11AAAAAA.AA000000 = $C000 + (A * 64)
-        break;
-    case 0x13:  // $4013: LLLL LLLL, Sample length
-        apu->dmc_sample_len = (uint16_t)(((uint16_t)val << 4) + 1); // Sample length = %LLLL.LLLL0001 = (L * 16) + 1 bytes
-        break;
-    // Status
-    case 0x15:  // $4015: ---D NT21, Enable DMC (D), noise (N), triangle (T), and pulse channels (2/1)
-        if (val & 0x01)
-        {
-            apu->pulse[0].enabled = true;
-        }
-        else
-        {
-            // Writing a zero to any of the channel enable bits will silence that channel and immediately set its length counter to 0.
-            apu->pulse[0].enabled = false;
-            apu->pulse[0].length_value = 0;
-        }
-        if (val & 0x02)
-        {
-            apu->pulse[1].enabled = true;
-        }
-        else
-        {
-            // Writing a zero to any of the channel enable bits will silence that channel and immediately set its length counter to 0.
-            apu->pulse[1].enabled = false;
-            apu->pulse[1].length_value = 0;
-        }
-        if (val & 0x04)
-        {
-            apu->triangle_enabled = true;
-        }
-        else
-        {
-            apu->triangle_enabled = false;
-            apu->triangle_length_value = 0;
-        }
-        if (val & 0x08)
-        {
-            apu->noise_enabled = true;
-        }
-        else
-        {
-            // Writing a zero to any of the channel enable bits will silence that channel and immediately set its length counter to 0.
-            apu->noise_enabled = false;
-            apu->noise_length_value = 0;
-        }
-        if (val & 0x10)
-        {
-            apu->dmc_enabled = true;
-            // If the DMC bit is set, the DMC sample will be restarted only if its bytes remaining is 0.
-            if (0 == apu->dmc_read_remaining)
-            {
-                apu->dmc_read_addr = apu->dmc_sample_addr;
-                apu->dmc_read_remaining = apu->dmc_sample_len;
-                if (!apu->dmc_output_shift_reg) 
-                {
-                    dmc_transfer(apu);
-                }
-            }
-            else
-            {
-                // If there are bits remaining in the 1-byte sample buffer, these will finish playing before the next sample is fetched.
-            }
-        }
-        else
-        {
-            apu->dmc_enabled = false;
-            // If the DMC bit is clear, the DMC bytes remaining will be set to 0 and the DMC will silence when it empties
-            apu->dmc_read_remaining = 0;
-        }
-        break;
-    // Frame counter
-    case 0x17:  // $4017:
-        apu->sequence_mode = (val & 0x80);
-        apu->sequencer_step = 0;
-        apu->frame_accu_fp = 0;
-        // TODO: Needs test
-        // Writing to $4017 with bit 7 set ($80) will immediately clock all of its controlled units at the beginning of the 5-step sequence;
-        // with bit 7 clear, only the sequence is reset without clocking any of its units. 
-        if (apu->sequence_mode)
-        {
-            apu->frame_force_clock = true;
-        }
-        else
-        {
-            apu->frame_force_clock = false;
-        }
-        break;
-    }
-}
-
-
-void nesapu_add_ram(nesapu_t *apu, size_t offset, uint16_t addr, uint16_t len)
-{
-    if (len == 0)
-        return;
-    // We only have one ram cache. If it is used by other ram block, remove it.
-    if (apu->ram_active)
-    {
-        apu->ram_active->cache = NULL;
-        apu->ram_active->cache_addr = 0;
-        apu->ram_active->cache_len = 0;
-    }
-    // Allocate cache if not already allocated
-    if (!apu->ram_cache)
-    {
-        apu->ram_cache = (uint8_t *)VGM_MALLOC(NESAPU_RAM_CACHE_SIZE);
-    }
-    if (apu->ram_cache)
-    {
-        // Allocate new ram structure and read first cache
-        nesapu_ram_t *ram = (nesapu_ram_t *)VGM_MALLOC(sizeof(nesapu_ram_t));
-        if (ram)
-        {
-            ram->offset = offset;
-            ram->addr = addr;
-            ram->len = len;
-            uint16_t toread = len > NESAPU_RAM_CACHE_SIZE ? NESAPU_RAM_CACHE_SIZE : len;
-            if (apu->reader->read(apu->reader, apu->ram_cache, offset, toread) == toread)
-            {
-                ram->cache = apu->ram_cache;
-                ram->cache_addr = addr;
-                ram->cache_len = toread;
-            }
-            else
-            {
-                VGM_FREE(ram);
-                ram = NULL;
-            }
-        }
-        if (ram)
-        {
-            // Insert into ram list
-            ram->next = apu->ram_list;
-            apu->ram_list = ram;
-            apu->ram_active = ram;
-        }
-    }
-    // If anything error (out of memory, cannt read file, etc), just treat the ram does not exist. Music still plays
-    // only DMC channel cannot output sample.
-}
-
-
-uint8_t nesapu_read_ram(nesapu_t *apu, uint16_t addr)
-{
-    // 1. Find which ram block is responsible for the address
-    nesapu_ram_t *ram = NULL;
-    do
-    {
-        ram = apu->ram_active;
-        if (ram)
-        {
-            if ((addr >= ram->addr) && (addr < ram->addr + ram->len))
-                break;
-        }
-        ram = apu->ram_list;
-        while (ram)
-        {
-            if ((addr >= ram->addr) && (addr < ram->addr + ram->len))
-                break;
-            ram = ram->next;
-        }
-    } while (0);
-    if (!ram)
-    {
-        VGM_PRINTDBG("APU: RAM read at 0x%04x not found\n", addr);
-        return 0;
-    }
-    // 2. Test if we need to refetch ram
-    bool refetch = true;
-    if (ram == apu->ram_active)
-    {
-        // If read from active ram, check cache range
-        if ((addr >= ram->cache_addr) && (addr < ram->cache_addr + ram->cache_len))
-            refetch = false;
-    }
-    else
-    {
-        // If not read from active ram, switch active ram
-        apu->ram_active->cache = NULL;
-        apu->ram_active->cache_addr = 0;
-        apu->ram_active->cache_len = 0;
-        apu->ram_active = ram;
-    }
-    // 3. Refetch
-    if (refetch)
-    {
-        size_t offset = ram->offset + addr - ram->addr;
-        uint16_t avail = (uint16_t)(ram->addr + ram->len - addr);
-        uint16_t toread = avail > NESAPU_RAM_CACHE_SIZE ? NESAPU_RAM_CACHE_SIZE : avail;
-        if (apu->reader->read(apu->reader, apu->ram_cache, offset, toread) == toread)
-        {
-            ram->cache = apu->ram_cache;
-            ram->cache_addr = addr;
-            ram->cache_len = toread;
-        }
-        else
-        {
-            ram->cache = NULL;
-            ram->cache_addr = 0;
-            ram->cache_len = 0;
-        }
-    }
-    // 4. Read
-    uint8_t read = ram->cache ? ram->cache[addr - ram->cache_addr] : 0;
-    return read;
-}
-
-
-void nesapu_enable_fade(nesapu_t *apu, unsigned int samples)
-{
-    if (apu->fadeout_enabled) return;
-    apu->fadeout_sequencer_value = NESAPU_FADE_STEPS - 1;
-    // We want to decrease fadeout_sequencer_value to 0 in the next samples
-    apu->fadeout_period_fp = float_to_q16((float)samples / NESAPU_FADE_STEPS);
-    apu->fadeout_accu_fp = 0;
-    apu->fadeout_enabled = true;
-}
-
-
-void nesapu_enable_channel(nesapu_t *apu, uint8_t mask, bool enable)
-{
-    if (mask & NESAPU_CHANNEL_PULSE1) apu->mask_pulse1 = !enable;
-    if (mask & NESAPU_CHANNEL_PULSE2) apu->mask_pulse2 = !enable;
-    if (mask & NESAPU_CHANNEL_TRIANGLE) apu->mask_triangle = !enable;
-    if (mask & NESAPU_CHANNEL_NOISE) apu->mask_noise = !enable;
-    if (mask & NESAPU_CHANNEL_DMC) apu->mask_dmc = !enable;
-}
+#include <stdlib.h>
+#include <memory.h>
+#include "nesapu.h"
+
+
+//
+// Length Counter (Pulse1, Pulse2, Triangle, Noise)
+// https://www.nesdev.org/wiki/APU_Length_Counter
+//
+static const unsigned int length_counter_table[32] = 
+{
+    10, 254, 20,  2, 40,  4, 80,  6, 160,  8, 60, 10, 14, 12, 26, 14,
+    12,  16, 24, 18, 48, 20, 96, 22, 192, 24, 72, 26, 16, 28, 32, 30
+};
+
+
+// Pulse channel
+// Duty lookup table, see wiki "Implementation details"
+static const bool pulse_waveform_table[][8] = 
+{
+    { 0, 0, 0, 0, 0, 0, 0, 1 }, // 12.5%
+    { 0, 0, 0, 0, 0, 0, 1, 1 }, // 25%
+    { 0, 0, 0, 0, 1, 1, 1, 1 }, // 50%
+    { 1, 1, 1, 1, 1, 1, 0, 0 }  // 25% negated
+};
+
+
+//
+// Triangle wave table
+// https://www.nesdev.org/wiki/APU_Triangle
+//
+static const unsigned int triangle_waveform_table[32] = 
+{
+    15, 14, 13, 12, 11, 10,  9,  8,  7,  6,  5,  4,  3,  2,  1,  0,
+     0,  1,  2,  3,  4,  5,  6,  7,  8,  9, 10, 11, 12, 13, 14, 15
+};
+
+
+//
+// DMC channel 
+// https://www.nesdev.org/wiki/APU_DMC
+static const uint16_t dmc_timer_period_ntsc[16] =
+{
+    428, 380, 340, 320, 286, 254, 226, 214, 190, 160, 142, 128, 106,  84, 72, 54
+};
+
+static const uint16_t dmc_timer_period_pal[16] =
+{
+    398, 354, 316, 298, 276, 236, 210, 198, 176, 148, 132, 118,  98,  78,  66,  50
+};
+
+
+//
+// Mixer
+// https://www.nesdev.org/wiki/APU_Mixer
+//
+// Generate table using make_const_tables.c
+
+
+static const q29_t mixer_pulse_table[31] =
+{
+             0,    6232609,   12315540,   18254120,   24053428,   29718306,   35253376,   40663044,
+      45951532,   51122860,   56180880,   61129276,   65971580,   70711160,   75351248,   79894960,
+      84345240,   88704968,   92976872,   97163576,  101267592,  105291368,  109237216,  113107392,
+     116904048,  120629256,  124285008,  127873240,  131395816,  134854496,  138251008
+};
+
+
+static const q29_t mixer_tnd_table[203] =
+{
+             0,    3596940,    7164553,   10703196,   14213217,   17694966,   21148782,   24574998,
+      27973946,   31345950,   34691328,   38010392,   41303460,   44570820,   47812788,   51029652,
+      54221704,   57389228,   60532508,   63651820,   66747436,   69819624,   72868656,   75894784,
+      78898280,   81879376,   84838328,   87775384,   90690792,   93584784,   96457600,   99309472,
+     102140624,  104951272,  107741656,  110511992,  113262480,  115993344,  118704800,  121397032,
+     124070264,  126724680,  129360504,  131977904,  134577088,  137158224,  139721536,  142267184,
+     144795360,  147306224,  149799968,  152276768,  154736784,  157180208,  159607168,  162017872,
+     164412480,  166791120,  169153984,  171501200,  173832960,  176149376,  178450624,  180736848,
+     183008176,  185264784,  187506800,  189734352,  191947600,  194146672,  196331728,  198502848,
+     200660208,  202803920,  204934128,  207050944,  209154512,  211244944,  213322352,  215386864,
+     217438624,  219477696,  221504256,  223518400,  225520224,  227509856,  229487408,  231452976,
+     233406688,  235348624,  237278928,  239197680,  241104976,  243000944,  244885648,  246759232,
+     248621760,  250473328,  252314064,  254144032,  255963376,  257772096,  259570384,  261358256,
+     263135856,  264903216,  266660496,  268407712,  270144992,  271872416,  273590048,  275297984,
+     276996320,  278685088,  280364448,  282034432,  283695072,  285346528,  286988832,  288622080,
+     290246336,  291861696,  293468160,  295065888,  296654912,  298235264,  299807136,  301370464,
+     302925376,  304471968,  306010240,  307540288,  309062208,  310576032,  312081824,  313579648,
+     315069568,  316551680,  318025984,  319492608,  320951584,  322402944,  323846752,  325283104,
+     326712064,  328133664,  329547904,  330954912,  332354784,  333747488,  335133088,  336511680,
+     337883296,  339248000,  340605792,  341956800,  343301056,  344638560,  345969408,  347293664,
+     348611328,  349922464,  351227136,  352525408,  353817280,  355102848,  356382112,  357655168,
+     358922016,  360182720,  361437312,  362685856,  363928384,  365164960,  366395584,  367620320,
+     368839232,  370052352,  371259680,  372461344,  373657280,  374847584,  376032320,  377211456,
+     378385120,  379553280,  380716000,  381873312,  383025248,  384171872,  385313216,  386449280,
+     387580128,  388705792,  389826272,  390941696,  392052032,  393157312,  394257568,  395352864,
+     396443264,  397528704,  398609248
+};
+
+
+
+#define NESAPU_FADE_STEPS       256
+static const q29_t fadeout_table[NESAPU_FADE_STEPS] =
+{
+             0,    2105376,    4210752,    6316128,    8421505,   10526881,   12632257,   14737633, 
+      16843010,   18948386,   21053762,   23159138,   25264514,   27369890,   29475266,   31580642, 
+      33686020,   35791396,   37896772,   40002148,   42107524,   44212900,   46318276,   48423652, 
+      50529028,   52634404,   54739780,   56845156,   58950532,   61055908,   63161284,   65266660, 
+      67372040,   69477416,   71582792,   73688168,   75793544,   77898920,   80004296,   82109672, 
+      84215048,   86320424,   88425800,   90531176,   92636552,   94741928,   96847304,   98952680, 
+     101058056,  103163432,  105268808,  107374184,  109479560,  111584936,  113690312,  115795688, 
+     117901064,  120006440,  122111816,  124217192,  126322568,  128427944,  130533320,  132638696, 
+     134744080,  136849456,  138954832,  141060208,  143165584,  145270960,  147376336,  149481712, 
+     151587088,  153692464,  155797840,  157903216,  160008592,  162113968,  164219344,  166324720, 
+     168430096,  170535472,  172640848,  174746224,  176851600,  178956976,  181062352,  183167728, 
+     185273104,  187378480,  189483856,  191589232,  193694608,  195799984,  197905360,  200010736, 
+     202116112,  204221488,  206326864,  208432240,  210537616,  212642992,  214748368,  216853744, 
+     218959120,  221064496,  223169872,  225275248,  227380624,  229486000,  231591376,  233696752, 
+     235802128,  237907504,  240012880,  242118256,  244223632,  246329008,  248434384,  250539760, 
+     252645136,  254750512,  256855888,  258961264,  261066640,  263172016,  265277392,  267382768, 
+     269488160,  271593536,  273698912,  275804288,  277909664,  280015040,  282120416,  284225792, 
+     286331168,  288436544,  290541920,  292647296,  294752672,  296858048,  298963424,  301068800, 
+     303174176,  305279552,  307384928,  309490304,  311595680,  313701056,  315806432,  317911808, 
+     320017184,  322122560,  324227936,  326333312,  328438688,  330544064,  332649440,  334754816, 
+     336860192,  338965568,  341070944,  343176320,  345281696,  347387072,  349492448,  351597824, 
+     353703200,  355808576,  357913952,  360019328,  362124704,  364230080,  366335456,  368440832, 
+     370546208,  372651584,  374756960,  376862336,  378967712,  381073088,  383178464,  385283840, 
+     387389216,  389494592,  391599968,  393705344,  395810720,  397916096,  400021472,  402126848, 
+     404232224,  406337600,  408442976,  410548352,  412653728,  414759104,  416864480,  418969856, 
+     421075232,  423180608,  425285984,  427391360,  429496736,  431602112,  433707488,  435812864, 
+     437918240,  440023616,  442128992,  444234368,  446339744,  448445120,  450550496,  452655872, 
+     454761248,  456866624,  458972000,  461077376,  463182752,  465288128,  467393504,  469498880, 
+     471604256,  473709632,  475815008,  477920384,  480025760,  482131136,  484236512,  486341888, 
+     488447264,  490552640,  492658016,  494763392,  496868768,  498974144,  501079520,  503184896, 
+     505290272,  507395648,  509501024,  511606400,  513711776,  515817152,  517922528,  520027904, 
+     522133280,  524238656,  526344032,  528449408,  530554784,  532660160,  534765536,  536870912 
+};
+
+//
+// Noise channel
+// https://www.nesdev.org/wiki/APU_Noise
+static const uint16_t noise_timer_period_ntsc[16] =
+{
+    4, 8, 16, 32, 64, 96, 128, 160, 202, 254, 380, 508, 762, 1016, 2034, 4068
+};
+
+static const uint16_t noise_timer_period_pal[16] =
+{
+    4, 8, 14, 30, 60, 88, 118, 148, 188, 236, 354, 472, 708,  944, 1890, 3778
+};
+
+// Long mode (mode 0) sequence: bit 0 of the shift register from power up value 1 through its 32767 clock
+// cycle, bit i of the table at byte i / 8, LSB first. The register after i clocks is bits i to i + 14. The
+// first 16 bits are repeated after the cycle, so 16 bits from any index are in the table.
+#define NOISE_LONG_PERIOD   32767
+static const uint8_t noise_long_bits[4100] =
+{
+    0x01, 0x80, 0x00, 0x60, 0x00, 0x28, 0x00, 0x1e, 0x80, 0x08, 0x60, 0x06, 0xa8, 0x02, 0xfe, 0x81,
+    0x80, 0x60, 0x60, 0x28, 0x28, 0x1e, 0x9e, 0x88, 0x68, 0x66, 0xae, 0xaa, 0xfc, 0x7f, 0x01, 0xe0,
+    0x00, 0x48, 0x00, 0x36, 0x80, 0x16, 0xe0, 0x0e, 0xc8, 0x04, 0x56, 0x83, 0x7e, 0xe1, 0xe0, 0x48,
+    0x48, 0x36, 0xb6, 0x96, 0xf6, 0xee, 0xc6, 0xcc, 0x52, 0xd5, 0xfd, 0x9f, 0x01, 0xa8, 0x00, 0x7e,
+    0x80, 0x20, 0x60, 0x18, 0x28, 0x0a, 0x9e, 0x87, 0x28, 0x62, 0x9e, 0xa9, 0xa8, 0x7e, 0xfe, 0xa0,
+    0x40, 0x78, 0x30, 0x22, 0x94, 0x19, 0xaf, 0x4a, 0xfc, 0x37, 0x01, 0xd6, 0x80, 0x5e, 0xe0, 0x38,
+    0x48, 0x12, 0xb6, 0x8d, 0xb6, 0xe5, 0xb6, 0xcb, 0x36, 0xd7, 0x56, 0xde, 0xbe, 0xd8, 0x70, 0x5a,
+    0xa4, 0x3b, 0x3b, 0x53, 0x53, 0x7d, 0xfd, 0xe1, 0x81, 0x88, 0x60, 0x66, 0xa8, 0x2a, 0xfe, 0x9f,
+    0x00, 0x68, 0x00, 0x2e, 0x80, 0x1c, 0x60, 0x09, 0xe8, 0x06, 0xce, 0x82, 0xd4, 0x61, 0x9f, 0x68,
+    0x68, 0x2e, 0xae, 0x9c, 0x7c, 0x69, 0xe1, 0xee, 0xc8, 0x4c, 0x56, 0xb5, 0xfe, 0xf7, 0x00, 0x46,
+    0x80, 0x32, 0xe0, 0x15, 0x88, 0x0f, 0x26, 0x84, 0x1a, 0xe3, 0x4b, 0x09, 0xf7, 0x46, 0xc6, 0xb2,
+    0xd2, 0xf5, 0x9d, 0x87, 0x29, 0xa2, 0x9e, 0xf9, 0xa8, 0x42, 0xfe, 0xb1, 0x80, 0x74, 0x60, 0x27,
+    0x68, 0x1a, 0xae, 0x8b, 0x3c, 0x67, 0x51, 0xea, 0xbc, 0x4f, 0x31, 0xf4, 0x14, 0x47, 0x4f, 0x72,
+    0xb4, 0x25, 0xb7, 0x5b, 0x36, 0xbb, 0x56, 0xf3, 0x7e, 0xc5, 0xe0, 0x53, 0x08, 0x3d, 0xc6, 0x91,
+    0x92, 0xec, 0x6d, 0x8d, 0xed, 0xa5, 0x8d, 0xbb, 0x25, 0xb3, 0x5b, 0x35, 0xfb, 0x57, 0x03, 0x7e,
+    0x81, 0xe0, 0x60, 0x48, 0x28, 0x36, 0x9e, 0x96, 0xe8, 0x6e, 0xce, 0xac, 0x54, 0x7d, 0xff, 0x61,
+    0x80, 0x28, 0x60, 0x1e, 0xa8, 0x08, 0x7e, 0x86, 0xa0, 0x62, 0xf8, 0x29, 0x82, 0x9e, 0xe1, 0xa8,
+    0x48, 0x7e, 0xb6, 0xa0, 0x76, 0xf8, 0x26, 0xc2, 0x9a, 0xd1, 0xab, 0x1c, 0x7f, 0x49, 0xe0, 0x36,
+    0xc8, 0x16, 0xd6, 0x8e, 0xde, 0xe4, 0x58, 0x4b, 0x7a, 0xb7, 0x63, 0x36, 0xa9, 0xd6, 0xfe, 0xde,
+    0xc0, 0x58, 0x50, 0x3a, 0xbc, 0x13, 0x31, 0xcd, 0xd4, 0x55, 0x9f, 0x7f, 0x28, 0x20, 0x1e, 0x98,
+    0x08, 0x6a, 0x86, 0xaf, 0x22, 0xfc, 0x19, 0x81, 0xca, 0xe0, 0x57, 0x08, 0x3e, 0x86, 0x90, 0x62,
+    0xec, 0x29, 0x8d, 0xde, 0xe5, 0x98, 0x4b, 0x2a, 0xb7, 0x5f, 0x36, 0xb8, 0x16, 0xf2, 0x8e, 0xc5,
+    0xa4, 0x53, 0x3b, 0x7d, 0xd3, 0x61, 0x9d, 0xe8, 0x69, 0x8e, 0xae, 0xe4, 0x7c, 0x4b, 0x61, 0xf7,
+    0x68, 0x46, 0xae, 0xb2, 0xfc, 0x75, 0x81, 0xe7, 0x20, 0x4a, 0x98, 0x37, 0x2a, 0x96, 0x9f, 0x2e,
+    0xe8, 0x1c, 0x4e, 0x89, 0xf4, 0x66, 0xc7, 0x6a, 0xd2, 0xaf, 0x1d, 0xbc, 0x09, 0xb1, 0xc6, 0xf4,
+    0x52, 0xc7, 0x7d, 0x92, 0xa1, 0xad, 0xb8, 0x7d, 0xb2, 0xa1, 0xb5, 0xb8, 0x77, 0x32, 0xa6, 0x95,
+    0xba, 0xef, 0x33, 0x0c, 0x15, 0xc5, 0xcf, 0x13, 0x14, 0x0d, 0xcf, 0x45, 0x94, 0x33, 0x2f, 0x55,
+    0xdc, 0x3f, 0x19, 0xd0, 0x0a, 0xdc, 0x07, 0x19, 0xc2, 0x8a, 0xd1, 0xa7, 0x1c, 0x7a, 0x89, 0xe3,
+    0x26, 0xc9, 0xda, 0xd6, 0xdb, 0x1e, 0xdb, 0x48, 0x5b, 0x76, 0xbb, 0x66, 0xf3, 0x6a, 0xc5, 0xef,
+    0x13, 0x0c, 0x0d, 0xc5, 0xc5, 0x93, 0x13, 0x2d, 0xcd, 0xdd, 0x95, 0x99, 0xaf, 0x2a, 0xfc, 0x1f,
+    0x01, 0xc8, 0x00, 0x56, 0x80, 0x3e, 0xe0, 0x10, 0x48, 0x0c, 0x36, 0x85, 0xd6, 0xe3, 0x1e, 0xc9,
+    0xc8, 0x56, 0xd6, 0xbe, 0xde, 0xf0, 0x58, 0x44, 0x3a, 0xb3, 0x53, 0x35, 0xfd, 0xd7, 0x01, 0x9e,
+    0x80, 0x68, 0x60, 0x2e, 0xa8, 0x1c, 0x7e, 0x89, 0xe0, 0x66, 0xc8, 0x2a, 0xd6, 0x9f, 0x1e, 0xe8,
+    0x08, 0x4e, 0x86, 0xb4, 0x62, 0xf7, 0x69, 0x86, 0xae, 0xe2, 0xfc, 0x49, 0x81, 0xf6, 0xe0, 0x46,
+    0xc8, 0x32, 0xd6, 0x95, 0x9e, 0xef, 0x28, 0x4c, 0x1e, 0xb5, 0xc8, 0x77, 0x16, 0xa6, 0x8e, 0xfa,
+    0xe4, 0x43, 0x0b, 0x71, 0xc7, 0x64, 0x52, 0xab, 0x7d, 0xbf, 0x61, 0xb0, 0x28, 0x74, 0x1e, 0xa7,
+    0x48, 0x7a, 0xb6, 0xa3, 0x36, 0xf9, 0xd6, 0xc2, 0xde, 0xd1, 0x98, 0x5c, 0x6a, 0xb9, 0xef, 0x32,
+    0xcc, 0x15, 0x95, 0xcf, 0x2f, 0x14, 0x1c, 0x0f, 0x49, 0xc4, 0x36, 0xd3, 0x56, 0xdd, 0xfe, 0xd9,
+    0x80, 0x5a, 0xe0, 0x3b, 0x08, 0x13, 0x46, 0x8d, 0xf2, 0xe5, 0x85, 0x8b, 0x23, 0x27, 0x59, 0xda,
+    0xba, 0xdb, 0x33, 0x1b, 0x55, 0xcb, 0x7f, 0x17, 0x60, 0x0e, 0xa8, 0x04, 0x7e, 0x83, 0x60, 0x61,
+    0xe8, 0x28, 0x4e, 0x9e, 0xb4, 0x68, 0x77, 0x6e, 0xa6, 0xac, 0x7a, 0xfd, 0xe3, 0x01, 0x89, 0xc0,
+    0x66, 0xd0, 0x2a, 0xdc, 0x1f, 0x19, 0xc8, 0x0a, 0xd6, 0x87, 0x1e, 0xe2, 0x88, 0x49, 0xa6, 0xb6,
+    0xfa, 0xf6, 0xc3, 0x06, 0xd1, 0xc2, 0xdc, 0x51, 0x99, 0xfc, 0x6a, 0xc1, 0xef, 0x10, 0x4c, 0x0c,
+    0x35, 0xc5, 0xd7, 0x13, 0x1e, 0x8d, 0xc8, 0x65, 0x96, 0xab, 0x2e, 0xff, 0x5c, 0x40, 0x39, 0xf0,
+    0x12, 0xc4, 0x0d, 0x93, 0x45, 0xad, 0xf3, 0x3d, 0x85, 0xd1, 0xa3, 0x1c, 0x79, 0xc9, 0xe2, 0xd6,
+    0xc9, 0x9e, 0xd6, 0xe8, 0x5e, 0xce, 0xb8, 0x54, 0x72, 0xbf, 0x65, 0xb0, 0x2b, 0x34, 0x1f, 0x57,
+    0x48, 0x3e, 0xb6, 0x90, 0x76, 0xec, 0x26, 0xcd, 0xda, 0xd5, 0x9b, 0x1f, 0x2b, 0x48, 0x1f, 0x76,
+    0x88, 0x26, 0xe6, 0x9a, 0xca, 0xeb, 0x17, 0x0f, 0x4e, 0x84, 0x34, 0x63, 0x57, 0x69, 0xfe, 0xae,
+    0xc0, 0x7c, 0x50, 0x21, 0xfc, 0x18, 0x41, 0xca, 0xb0, 0x57, 0x34, 0x3e, 0x97, 0x50, 0x6e, 0xbc,
+    0x2c, 0x71, 0xdd, 0xe4, 0x59, 0x8b, 0x7a, 0xe7, 0x63, 0x0a, 0xa9, 0xc7, 0x3e, 0xd2, 0x90, 0x5d,
+    0xac, 0x39, 0xbd, 0xd2, 0xf1, 0x9d, 0x84, 0x69, 0xa3, 0x6e, 0xf9, 0xec, 0x42, 0xcd, 0xf1, 0x95,
+    0x84, 0x6f, 0x23, 0x6c, 0x19, 0xed, 0xca, 0xcd, 0x97, 0x15, 0xae, 0x8f, 0x3c, 0x64, 0x11, 0xeb,
+    0x4c, 0x4f, 0x75, 0xf4, 0x27, 0x07, 0x5a, 0x82, 0xbb, 0x21, 0xb3, 0x58, 0x75, 0xfa, 0xa7, 0x03,
+    0x3a, 0x81, 0xd3, 0x20, 0x5d, 0xd8, 0x39, 0x9a, 0x92, 0xeb, 0x2d, 0x8f, 0x5d, 0xa4, 0x39, 0xbb,
+    0x52, 0xf3, 0x7d, 0x85, 0xe1, 0xa3, 0x08, 0x79, 0xc6, 0xa2, 0xd2, 0xf9, 0x9d, 0x82, 0xe9, 0xa1,
+    0x8e, 0xf8, 0x64, 0x42, 0xab, 0x71, 0xbf, 0x64, 0x70, 0x2b, 0x64, 0x1f, 0x6b, 0x48, 0x2f, 0x76,
+    0x9c, 0x26, 0xe9, 0xda, 0xce, 0xdb, 0x14, 0x5b, 0x4f, 0x7b, 0x74, 0x23, 0x67, 0x59, 0xea, 0xba,
+    0xcf, 0x33, 0x14, 0x15, 0xcf, 0x4f, 0x14, 0x34, 0x0f, 0x57, 0x44, 0x3e, 0xb3, 0x50, 0x75, 0xfc,
+    0x27, 0x01, 0xda, 0x80, 0x5b, 0x20, 0x3b, 0x58, 0x13, 0x7a, 0x8d, 0xe3, 0x25, 0x89, 0xdb, 0x26,
+    0xdb, 0x5a, 0xdb, 0x7b, 0x1b, 0x63, 0x4b, 0x69, 0xf7, 0x6e, 0xc6, 0xac, 0x52, 0xfd, 0xfd, 0x81,
+    0x81, 0xa0, 0x60, 0x78, 0x28, 0x22, 0x9e, 0x99, 0xa8, 0x6a, 0xfe, 0xaf, 0x00, 0x7c, 0x00, 0x21,
+    0xc0, 0x18, 0x50, 0x0a, 0xbc, 0x07, 0x31, 0xc2, 0x94, 0x51, 0xaf, 0x7c, 0x7c, 0x21, 0xe1, 0xd8,
+    0x48, 0x5a, 0xb6, 0xbb, 0x36, 0xf3, 0x56, 0xc5, 0xfe, 0xd3, 0x00, 0x5d, 0xc0, 0x39, 0x90, 0x12,
+    0xec, 0x0d, 0x8d, 0xc5, 0xa5, 0x93, 0x3b, 0x2d, 0xd3, 0x5d, 0x9d, 0xf9, 0xa9, 0x82, 0xfe, 0xe1,
+    0x80, 0x48, 0x60, 0x36, 0xa8, 0x16, 0xfe, 0x8e, 0xc0, 0x64, 0x50, 0x2b, 0x7c, 0x1f, 0x61, 0xc8,
+    0x28, 0x56, 0x9e, 0xbe, 0xe8, 0x70, 0x4e, 0xa4, 0x34, 0x7b, 0x57, 0x63, 0x7e, 0xa9, 0xe0, 0x7e,
+    0xc8, 0x20, 0x56, 0x98, 0x3e, 0xea, 0x90, 0x4f, 0x2c, 0x34, 0x1d, 0xd7, 0x49, 0x9e, 0xb6, 0xe8,
+    0x76, 0xce, 0xa6, 0xd4, 0x7a, 0xdf, 0x63, 0x18, 0x29, 0xca, 0x9e, 0xd7, 0x28, 0x5e, 0x9e, 0xb8,
+    0x68, 0x72, 0xae, 0xa5, 0xbc, 0x7b, 0x31, 0xe3, 0x54, 0x49, 0xff, 0x76, 0xc0, 0x26, 0xd0, 0x1a,
+    0xdc, 0x0b, 0x19, 0xc7, 0x4a, 0xd2, 0xb7, 0x1d, 0xb6, 0x89, 0xb6, 0xe6, 0xf6, 0xca, 0xc6, 0xd7,
+    0x12, 0xde, 0x8d, 0x98, 0x65, 0xaa, 0xab, 0x3f, 0x3f, 0x50, 0x10, 0x3c, 0x0c, 0x11, 0xc5, 0xcc,
+    0x53, 0x15, 0xfd, 0xcf, 0x01, 0x94, 0x00, 0x6f, 0x40, 0x2c, 0x30, 0x1d, 0xd4, 0x09, 0x9f, 0x46,
+    0xe8, 0x32, 0xce, 0x95, 0x94, 0x6f, 0x2f, 0x6c, 0x1c, 0x2d, 0xc9, 0xdd, 0x96, 0xd9, 0xae, 0xda,
+    0xfc, 0x5b, 0x01, 0xfb, 0x40, 0x43, 0x70, 0x31, 0xe4, 0x14, 0x4b, 0x4f, 0x77, 0x74, 0x26, 0xa7,
+    0x5a, 0xfa, 0xbb, 0x03, 0x33, 0x41, 0xd5, 0xf0, 0x5f, 0x04, 0x38, 0x03, 0x52, 0x81, 0xfd, 0xa0,
+    0x41, 0xb8, 0x30, 0x72, 0x94, 0x25, 0xaf, 0x5b, 0x3c, 0x3b, 0x51, 0xd3, 0x7c, 0x5d, 0xe1, 0xf9,
+    0x88, 0x42, 0xe6, 0xb1, 0x8a, 0xf4, 0x67, 0x07, 0x6a, 0x82, 0xaf, 0x21, 0xbc, 0x18, 0x71, 0xca,
+    0xa4, 0x57, 0x3b, 0x7e, 0x93, 0x60, 0x6d, 0xe8, 0x2d, 0x8e, 0x9d, 0xa4, 0x69, 0xbb, 0x6e, 0xf3,
+    0x6c, 0x45, 0xed, 0xf3, 0x0d, 0x85, 0xc5, 0xa3, 0x13, 0x39, 0xcd, 0xd2, 0xd5, 0x9d, 0x9f, 0x29,
+    0xa8, 0x1e, 0xfe, 0x88, 0x40, 0x66, 0xb0, 0x2a, 0xf4, 0x1f, 0x07, 0x48, 0x02, 0xb6, 0x81, 0xb6,
+    0xe0, 0x76, 0xc8, 0x26, 0xd6, 0x9a, 0xde, 0xeb, 0x18, 0x4f, 0x4a, 0xb4, 0x37, 0x37, 0x56, 0x96,
+    0xbe, 0xee, 0xf0, 0x4c, 0x44, 0x35, 0xf3, 0x57, 0x05, 0xfe, 0x83, 0x00, 0x61, 0xc0, 0x28, 0x50,
+    0x1e, 0xbc, 0x08, 0x71, 0xc6, 0xa4, 0x52, 0xfb, 0x7d, 0x83, 0x61, 0xa1, 0xe8, 0x78, 0x4e, 0xa2,
+    0xb4, 0x79, 0xb7, 0x62, 0xf6, 0xa9, 0x86, 0xfe, 0xe2, 0xc0, 0x49, 0x90, 0x36, 0xec, 0x16, 0xcd,
+    0xce, 0xd5, 0x94, 0x5f, 0x2f, 0x78, 0x1c, 0x22, 0x89, 0xd9, 0xa6, 0xda, 0xfa, 0xdb, 0x03, 0x1b,
+    0x41, 0xcb, 0x70, 0x57, 0x64, 0x3e, 0xab, 0x50, 0x7f, 0x7c, 0x20, 0x21, 0xd8, 0x18, 0x5a, 0x8a,
+    0xbb, 0x27, 0x33, 0x5a, 0x95, 0xfb, 0x2f, 0x03, 0x5c, 0x01, 0xf9, 0xc0, 0x42, 0xd0, 0x31, 0x9c,
+    0x14, 0x69, 0xcf, 0x6e, 0xd4, 0x2c, 0x5f, 0x5d, 0xf8, 0x39, 0x82, 0x92, 0xe1, 0xad, 0x88, 0x7d,
+    0xa6, 0xa1, 0xba, 0xf8, 0x73, 0x02, 0xa5, 0xc1, 0xbb, 0x10, 0x73, 0x4c, 0x25, 0xf5, 0xdb, 0x07,
+    0x1b, 0x42, 0x8b, 0x71, 0xa7, 0x64, 0x7a, 0xab, 0x63, 0x3f, 0x69, 0xd0, 0x2e, 0xdc, 0x1c, 0x59,
+    0xc9, 0xfa, 0xd6, 0xc3, 0x1e, 0xd1, 0xc8, 0x5c, 0x56, 0xb9, 0xfe, 0xf2, 0xc0, 0x45, 0x90, 0x33,
+    0x2c, 0x15, 0xdd, 0xcf, 0x19, 0x94, 0x0a, 0xef, 0x47, 0x0c, 0x32, 0x85, 0xd5, 0xa3, 0x1f, 0x39,
+    0xc8, 0x12, 0xd6, 0x8d, 0x9e, 0xe5, 0xa8, 0x4b, 0x3e, 0xb7, 0x50, 0x76, 0xbc, 0x26, 0xf1, 0xda,
+    0xc4, 0x5b, 0x13, 0x7b, 0x4d, 0xe3, 0x75, 0x89, 0xe7, 0x26, 0xca, 0x9a, 0xd7, 0x2b, 0x1e, 0x9f,
+    0x48, 0x68, 0x36, 0xae, 0x96, 0xfc, 0x6e, 0xc1, 0xec, 0x50, 0x4d, 0xfc, 0x35, 0x81, 0xd7, 0x20,
+    0x5e, 0x98, 0x38, 0x6a, 0x92, 0xaf, 0x2d, 0xbc, 0x1d, 0xb1, 0xc9, 0xb4, 0x56, 0xf7, 0x7e, 0xc6,
+    0xa0, 0x52, 0xf8, 0x3d, 0x82, 0x91, 0xa1, 0xac, 0x78, 0x7d, 0xe2, 0xa1, 0x89, 0xb8, 0x66, 0xf2,
+    0xaa, 0xc5, 0xbf, 0x13, 0x30, 0x0d, 0xd4, 0x05, 0x9f, 0x43, 0x28, 0x31, 0xde, 0x94, 0x58, 0x6f,
+    0x7a, 0xac, 0x23, 0x3d, 0xd9, 0xd1, 0x9a, 0xdc, 0x6b, 0x19, 0xef, 0x4a, 0xcc, 0x37, 0x15, 0xd6,
+    0x8f, 0x1e, 0xe4, 0x08, 0x4b, 0x46, 0xb7, 0x72, 0xf6, 0xa5, 0x86, 0xfb, 0x22, 0xc3, 0x59, 0x91,
+    0xfa, 0xec, 0x43, 0x0d, 0xf1, 0xc5, 0x84, 0x53, 0x23, 0x7d, 0xd9, 0xe1, 0x9a, 0xc8, 0x6b, 0x16,
+    0xaf, 0x4e, 0xfc, 0x34, 0x41, 0xd7, 0x70, 0x5e, 0xa4, 0x38, 0x7b, 0x52, 0xa3, 0x7d, 0xb9, 0xe1,
+    0xb2, 0xc8, 0x75, 0x96, 0xa7, 0x2e, 0xfa, 0x9c, 0x43, 0x29, 0xf1, 0xde, 0xc4, 0x58, 0x53, 0x7a,
+    0xbd, 0xe3, 0x31, 0x89, 0xd4, 0x66, 0xdf, 0x6a, 0xd8, 0x2f, 0x1a, 0x9c, 0x0b, 0x29, 0xc7, 0x5e,
+    0xd2, 0xb8, 0x5d, 0xb2, 0xb9, 0xb5, 0xb2, 0xf7, 0x35, 0x86, 0x97, 0x22, 0xee, 0x99, 0x8c, 0x6a,
+    0xe5, 0xef, 0x0b, 0x0c, 0x07, 0x45, 0xc2, 0xb3, 0x11, 0xb5, 0xcc, 0x77, 0x15, 0xe6, 0x8f, 0x0a,
+    0xe4, 0x07, 0x0b, 0x42, 0x87, 0x71, 0xa2, 0xa4, 0x79, 0xbb, 0x62, 0xf3, 0x69, 0x85, 0xee, 0xe3,
+    0x0c, 0x49, 0xc5, 0xf6, 0xd3, 0x06, 0xdd, 0xc2, 0xd9, 0x91, 0x9a, 0xec, 0x6b, 0x0d, 0xef, 0x45,
+    0x8c, 0x33, 0x25, 0xd5, 0xdb, 0x1f, 0x1b, 0x48, 0x0b, 0x76, 0x87, 0x66, 0xe2, 0xaa, 0xc9, 0xbf,
+    0x16, 0xf0, 0x0e, 0xc4, 0x04, 0x53, 0x43, 0x7d, 0xf1, 0xe1, 0x84, 0x48, 0x63, 0x76, 0xa9, 0xe6,
+    0xfe, 0xca, 0xc0, 0x57, 0x10, 0x3e, 0x8c, 0x10, 0x65, 0xcc, 0x2b, 0x15, 0xdf, 0x4f, 0x18, 0x34,
+    0x0a, 0x97, 0x47, 0x2e, 0xb2, 0x9c, 0x75, 0xa9, 0xe7, 0x3e, 0xca, 0x90, 0x57, 0x2c, 0x3e, 0x9d,
+    0xd0, 0x69, 0x9c, 0x2e, 0xe9, 0xdc, 0x4e, 0xd9, 0xf4, 0x5a, 0xc7, 0x7b, 0x12, 0xa3, 0x4d, 0xb9,
+    0xf5, 0xb2, 0xc7, 0x35, 0x92, 0x97, 0x2d, 0xae, 0x9d, 0xbc, 0x69, 0xb1, 0xee, 0xf4, 0x4c, 0x47,
+    0x75, 0xf2, 0xa7, 0x05, 0xba, 0x83, 0x33, 0x21, 0xd5, 0xd8, 0x5f, 0x1a, 0xb8, 0x0b, 0x32, 0x87,
+    0x55, 0xa2, 0xbf, 0x39, 0xb0, 0x12, 0xf4, 0x0d, 0x87, 0x45, 0xa2, 0xb3, 0x39, 0xb5, 0xd2, 0xf7,
+    0x1d, 0x86, 0x89, 0xa2, 0xe6, 0xf9, 0x8a, 0xc2, 0xe7, 0x11, 0x8a, 0x8c, 0x67, 0x25, 0xea, 0x9b,
+    0x0f, 0x2b, 0x44, 0x1f, 0x73, 0x48, 0x25, 0xf6, 0x9b, 0x06, 0xeb, 0x42, 0xcf, 0x71, 0x94, 0x24,
+    0x6f, 0x5b, 0x6c, 0x3b, 0x6d, 0xd3, 0x6d, 0x9d, 0xed, 0xa9, 0x8d, 0xbe, 0xe5, 0xb0, 0x4b, 0x34,
+    0x37, 0x57, 0x56, 0xbe, 0xbe, 0xf0, 0x70, 0x44, 0x24, 0x33, 0x5b, 0x55, 0xfb, 0x7f, 0x03, 0x60,
+    0x01, 0xe8, 0x00, 0x4e, 0x80, 0x34, 0x60, 0x17, 0x68, 0x0e, 0xae, 0x84, 0x7c, 0x63, 0x61, 0xe9,
+    0xe8, 0x4e, 0xce, 0xb4, 0x54, 0x77, 0x7f, 0x66, 0xa0, 0x2a, 0xf8, 0x1f, 0x02, 0x88, 0x01, 0xa6,
+    0x80, 0x7a, 0xe0, 0x23, 0x08, 0x19, 0xc6, 0x8a, 0xd2, 0xe7, 0x1d, 0x8a, 0x89, 0xa7, 0x26, 0xfa,
+    0x9a, 0xc3, 0x2b, 0x11, 0xdf, 0x4c, 0x58, 0x35, 0xfa, 0x97, 0x03, 0x2e, 0x81, 0xdc, 0x60, 0x59,
+    0xe8, 0x3a, 0xce, 0x93, 0x14, 0x6d, 0xcf, 0x6d, 0x94, 0x2d, 0xaf, 0x5d, 0xbc, 0x39, 0xb1, 0xd2,
+    0xf4, 0x5d, 0x87, 0x79, 0xa2, 0xa2, 0xf9, 0xb9, 0x82, 0xf2, 0xe1, 0x85, 0x88, 0x63, 0x26, 0xa9,
+    0xda, 0xfe, 0xdb, 0x00, 0x5b, 0x40, 0x3b, 0x70, 0x13, 0x64, 0x0d, 0xeb, 0x45, 0x8f, 0x73, 0x24,
+    0x25, 0xdb, 0x5b, 0x1b, 0x7b, 0x4b, 0x63, 0x77, 0x69, 0xe6, 0xae, 0xca, 0xfc, 0x57, 0x01, 0xfe,
+    0x80, 0x40, 0x60, 0x30, 0x28, 0x14, 0x1e, 0x8f, 0x48, 0x64, 0x36, 0xab, 0x56, 0xff, 0x7e, 0xc0,
+    0x20, 0x50, 0x18, 0x3c, 0x0a, 0x91, 0xc7, 0x2c, 0x52, 0x9d, 0xfd, 0xa9, 0x81, 0xbe, 0xe0, 0x70,
+    0x48, 0x24, 0x36, 0x9b, 0x56, 0xeb, 0x7e, 0xcf, 0x60, 0x54, 0x28, 0x3f, 0x5e, 0x90, 0x38, 0x6c,
+    0x12, 0xad, 0xcd, 0xbd, 0x95, 0xb1, 0xaf, 0x34, 0x7c, 0x17, 0x61, 0xce, 0xa8, 0x54, 0x7e, 0xbf,
+    0x60, 0x70, 0x28, 0x24, 0x1e, 0x9b, 0x48, 0x6b, 0x76, 0xaf, 0x66, 0xfc, 0x2a, 0xc1, 0xdf, 0x10,
+    0x58, 0x0c, 0x3a, 0x85, 0xd3, 0x23, 0x1d, 0xd9, 0xc9, 0x9a, 0xd6, 0xeb, 0x1e, 0xcf, 0x48, 0x54,
+    0x36, 0xbf, 0x56, 0xf0, 0x3e, 0xc4, 0x10, 0x53, 0x4c, 0x3d, 0xf5, 0xd1, 0x87, 0x1c, 0x62, 0x89,
+    0xe9, 0xa6, 0xce, 0xfa, 0xd4, 0x43, 0x1f, 0x71, 0xc8, 0x24, 0x56, 0x9b, 0x7e, 0xeb, 0x60, 0x4f,
+    0x68, 0x34, 0x2e, 0x97, 0x5c, 0x6e, 0xb9, 0xec, 0x72, 0xcd, 0xe5, 0x95, 0x8b, 0x2f, 0x27, 0x5c,
+    0x1a, 0xb9, 0xcb, 0x32, 0xd7, 0x55, 0x9e, 0xbf, 0x28, 0x70, 0x1e, 0xa4, 0x08, 0x7b, 0x46, 0xa3,
+    0x72, 0xf9, 0xe5, 0x82, 0xcb, 0x21, 0x97, 0x58, 0x6e, 0xba, 0xac, 0x73, 0x3d, 0xe5, 0xd1, 0x8b,
+    0x1c, 0x67, 0x49, 0xea, 0xb6, 0xcf, 0x36, 0xd4, 0x16, 0xdf, 0x4e, 0xd8, 0x34, 0x5a, 0x97, 0x7b,
+    0x2e, 0xa3, 0x5c, 0x79, 0xf9, 0xe2, 0xc2, 0xc9, 0x91, 0x96, 0xec, 0x6e, 0xcd, 0xec, 0x55, 0x8d,
+    0xff, 0x25, 0x80, 0x1b, 0x20, 0x0b, 0x58, 0x07, 0x7a, 0x82, 0xa3, 0x21, 0xb9, 0xd8, 0x72, 0xda,
+    0xa5, 0x9b, 0x3b, 0x2b, 0x53, 0x5f, 0x7d, 0xf8, 0x21, 0x82, 0x98, 0x61, 0xaa, 0xa8, 0x7f, 0x3e,
+    0xa0, 0x10, 0x78, 0x0c, 0x22, 0x85, 0xd9, 0xa3, 0x1a, 0xf9, 0xcb, 0x02, 0xd7, 0x41, 0x9e, 0xb0,
+    0x68, 0x74, 0x2e, 0xa7, 0x5c, 0x7a, 0xb9, 0xe3, 0x32, 0xc9, 0xd5, 0x96, 0xdf, 0x2e, 0xd8, 0x1c,
+    0x5a, 0x89, 0xfb, 0x26, 0xc3, 0x5a, 0xd1, 0xfb, 0x1c, 0x43, 0x49, 0xf1, 0xf6, 0xc4, 0x46, 0xd3,
+    0x72, 0xdd, 0xe5, 0x99, 0x8b, 0x2a, 0xe7, 0x5f, 0x0a, 0xb8, 0x07, 0x32, 0x82, 0x95, 0xa1, 0xaf,
+    0x38, 0x7c, 0x12, 0xa1, 0xcd, 0xb8, 0x55, 0xb2, 0xbf, 0x35, 0xb0, 0x17, 0x34, 0x0e, 0x97, 0x44,
+    0x6e, 0xb3, 0x6c, 0x75, 0xed, 0xe7, 0x0d, 0x8a, 0x85, 0xa7, 0x23, 0x3a, 0x99, 0xd3, 0x2a, 0xdd,
+    0xdf, 0x19, 0x98, 0x0a, 0xea, 0x87, 0x0f, 0x22, 0x84, 0x19, 0xa3, 0x4a, 0xf9, 0xf7, 0x02, 0xc6,
+    0x81, 0x92, 0xe0, 0x6d, 0x88, 0x2d, 0xa6, 0x9d, 0xba, 0xe9, 0xb3, 0x0e, 0xf5, 0xc4, 0x47, 0x13,
+    0x72, 0x8d, 0xe5, 0xa5, 0x8b, 0x3b, 0x27, 0x53, 0x5a, 0xbd, 0xfb, 0x31, 0x83, 0x54, 0x61, 0xff,
+    0x68, 0x40, 0x2e, 0xb0, 0x1c, 0x74, 0x09, 0xe7, 0x46, 0xca, 0xb2, 0xd7, 0x35, 0x9e, 0x97, 0x28,
+    0x6e, 0x9e, 0xac, 0x68, 0x7d, 0xee, 0xa1, 0x8c, 0x78, 0x65, 0xe2, 0xab, 0x09, 0xbf, 0x46, 0xf0,
+    0x32, 0xc4, 0x15, 0x93, 0x4f, 0x2d, 0xf4, 0x1d, 0x87, 0x49, 0xa2, 0xb6, 0xf9, 0xb6, 0xc2, 0xf6,
+    0xd1, 0x86, 0xdc, 0x62, 0xd9, 0xe9, 0x9a, 0xce, 0xeb, 0x14, 0x4f, 0x4f, 0x74, 0x34, 0x27, 0x57,
+    0x5a, 0xbe, 0xbb, 0x30, 0x73, 0x54, 0x25, 0xff, 0x5b, 0x00, 0x3b, 0x40, 0x13, 0x70, 0x0d, 0xe4,
+    0x05, 0x8b, 0x43, 0x27, 0x71, 0xda, 0xa4, 0x5b, 0x3b, 0x7b, 0x53, 0x63, 0x7d, 0xe9, 0xe1, 0x8e,
+    0xc8, 0x64, 0x56, 0xab, 0x7e, 0xff, 0x60, 0x40, 0x28, 0x30, 0x1e, 0x94, 0x08, 0x6f, 0x46, 0xac,
+    0x32, 0xfd, 0xd5, 0x81, 0x9f, 0x20, 0x68, 0x18, 0x2e, 0x8a, 0x9c, 0x67, 0x29, 0xea, 0x9e, 0xcf,
+    0x28, 0x54, 0x1e, 0xbf, 0x48, 0x70, 0x36, 0xa4, 0x16, 0xfb, 0x4e, 0xc3, 0x74, 0x51, 0xe7, 0x7c,
+    0x4a, 0xa1, 0xf7, 0x38, 0x46, 0x92, 0xb2, 0xed, 0xb5, 0x8d, 0xb7, 0x25, 0xb6, 0x9b, 0x36, 0xeb,
+    0x56, 0xcf, 0x7e, 0xd4, 0x20, 0x5f, 0x58, 0x38, 0x3a, 0x92, 0x93, 0x2d, 0xad, 0xdd, 0xbd, 0x99,
+    0xb1, 0xaa, 0xf4, 0x7f, 0x07, 0x60, 0x02, 0xa8, 0x01, 0xbe, 0x80, 0x70, 0x60, 0x24, 0x28, 0x1b,
+    0x5e, 0x8b, 0x78, 0x67, 0x62, 0xaa, 0xa9, 0xbf, 0x3e, 0xf0, 0x10, 0x44, 0x0c, 0x33, 0x45, 0xd5,
+    0xf3, 0x1f, 0x05, 0xc8, 0x03, 0x16, 0x81, 0xce, 0xe0, 0x54, 0x48, 0x3f, 0x76, 0x90, 0x26, 0xec,
+    0x1a, 0xcd, 0xcb, 0x15, 0x97, 0x4f, 0x2e, 0xb4, 0x1c, 0x77, 0x49, 0xe6, 0xb6, 0xca, 0xf6, 0xd7,
+    0x06, 0xde, 0x82, 0xd8, 0x61, 0x9a, 0xa8, 0x6b, 0x3e, 0xaf, 0x50, 0x7c, 0x3c, 0x21, 0xd1, 0xd8,
+    0x5c, 0x5a, 0xb9, 0xfb, 0x32, 0xc3, 0x55, 0x91, 0xff, 0x2c, 0x40, 0x1d, 0xf0, 0x09, 0x84, 0x06,
+    0xe3, 0x42, 0xc9, 0xf1, 0x96, 0xc4, 0x6e, 0xd3, 0x6c, 0x5d, 0xed, 0xf9, 0x8d, 0x82, 0xe5, 0xa1,
+    0x8b, 0x38, 0x67, 0x52, 0xaa, 0xbd, 0xbf, 0x31, 0xb0, 0x14, 0x74, 0x0f, 0x67, 0x44, 0x2a, 0xb3,
+    0x5f, 0x35, 0xf8, 0x17, 0x02, 0x8e, 0x81, 0xa4, 0x60, 0x7b, 0x68, 0x23, 0x6e, 0x99, 0xec, 0x6a,
+    0xcd, 0xef, 0x15, 0x8c, 0x0f, 0x25, 0xc4, 0x1b, 0x13, 0x4b, 0x4d, 0xf7, 0x75, 0x86, 0xa7, 0x22,
+    0xfa, 0x99, 0x83, 0x2a, 0xe1, 0xdf, 0x08, 0x58, 0x06, 0xba, 0x82, 0xf3, 0x21, 0x85, 0xd8, 0x63,
+    0x1a, 0xa9, 0xcb, 0x3e, 0xd7, 0x50, 0x5e, 0xbc, 0x38, 0x71, 0xd2, 0xa4, 0x5d, 0xbb, 0x79, 0xb3,
+    0x62, 0xf5, 0xe9, 0x87, 0x0e, 0xe2, 0x84, 0x49, 0xa3, 0x76, 0xf9, 0xe6, 0xc2, 0xca, 0xd1, 0x97,
+    0x1c, 0x6e, 0x89, 0xec, 0x66, 0xcd, 0xea, 0xd5, 0x8f, 0x1f, 0x24, 0x08, 0x1b, 0x46, 0x8b, 0x72,
+    0xe7, 0x65, 0x8a, 0xab, 0x27, 0x3f, 0x5a, 0x90, 0x3b, 0x2c, 0x13, 0x5d, 0xcd, 0xf9, 0x95, 0x82,
+    0xef, 0x21, 0x8c, 0x18, 0x65, 0xca, 0xab, 0x17, 0x3f, 0x4e, 0x90, 0x34, 0x6c, 0x17, 0x6d, 0xce,
+    0xad, 0x94, 0x7d, 0xaf, 0x61, 0xbc, 0x28, 0x71, 0xde, 0xa4, 0x58, 0x7b, 0x7a, 0xa3, 0x63, 0x39,
+    0xe9, 0xd2, 0xce, 0xdd, 0x94, 0x59, 0xaf, 0x7a, 0xfc, 0x23, 0x01, 0xd9, 0xc0, 0x5a, 0xd0, 0x3b,
+    0x1c, 0x13, 0x49, 0xcd, 0xf6, 0xd5, 0x86, 0xdf, 0x22, 0xd8, 0x19, 0x9a, 0x8a, 0xeb, 0x27, 0x0f,
+    0x5a, 0x84, 0x3b, 0x23, 0x53, 0x59, 0xfd, 0xfa, 0xc1, 0x83, 0x10, 0x61, 0xcc, 0x28, 0x55, 0xde,
+    0xbf, 0x18, 0x70, 0x0a, 0xa4, 0x07, 0x3b, 0x42, 0x93, 0x71, 0xad, 0xe4, 0x7d, 0x8b, 0x61, 0xa7,
+    0x68, 0x7a, 0xae, 0xa3, 0x3c, 0x79, 0xd1, 0xe2, 0xdc, 0x49, 0x99, 0xf6, 0xea, 0xc6, 0xcf, 0x12,
+    0xd4, 0x0d, 0x9f, 0x45, 0xa8, 0x33, 0x3e, 0x95, 0xd0, 0x6f, 0x1c, 0x2c, 0x09, 0xdd, 0xc6, 0xd9,
+    0x92, 0xda, 0xed, 0x9b, 0x0d, 0xab, 0x45, 0xbf, 0x73, 0x30, 0x25, 0xd4, 0x1b, 0x1f, 0x4b, 0x48,
+    0x37, 0x76, 0x96, 0xa6, 0xee, 0xfa, 0xcc, 0x43, 0x15, 0xf1, 0xcf, 0x04, 0x54, 0x03, 0x7f, 0x41,
+    0xe0, 0x30, 0x48, 0x14, 0x36, 0x8f, 0x56, 0xe4, 0x3e, 0xcb, 0x50, 0x57, 0x7c, 0x3e, 0xa1, 0xd0,
+    0x78, 0x5c, 0x22, 0xb9, 0xd9, 0xb2, 0xda, 0xf5, 0x9b, 0x07, 0x2b, 0x42, 0x9f, 0x71, 0xa8, 0x24,
+    0x7e, 0x9b, 0x60, 0x6b, 0x68, 0x2f, 0x6e, 0x9c, 0x2c, 0x69, 0xdd, 0xee, 0xd9, 0x8c, 0x5a, 0xe5,
+    0xfb, 0x0b, 0x03, 0x47, 0x41, 0xf2, 0xb0, 0x45, 0xb4, 0x33, 0x37, 0x55, 0xd6, 0xbf, 0x1e, 0xf0,
+    0x08, 0x44, 0x06, 0xb3, 0x42, 0xf5, 0xf1, 0x87, 0x04, 0x62, 0x83, 0x69, 0xa1, 0xee, 0xf8, 0x4c,
+    0x42, 0xb5, 0xf1, 0xb7, 0x04, 0x76, 0x83, 0x66, 0xe1, 0xea, 0xc8, 0x4f, 0x16, 0xb4, 0x0e, 0xf7,
+    0x44, 0x46, 0xb3, 0x72, 0xf5, 0xe5, 0x87, 0x0b, 0x22, 0x87, 0x59, 0xa2, 0xba, 0xf9, 0xb3, 0x02,
+    0xf5, 0xc1, 0x87, 0x10, 0x62, 0x8c, 0x29, 0xa5, 0xde, 0xfb, 0x18, 0x43, 0x4a, 0xb1, 0xf7, 0x34,
+    0x46, 0x97, 0x72, 0xee, 0xa5, 0x8c, 0x7b, 0x25, 0xe3, 0x5b, 0x09, 0xfb, 0x46, 0xc3, 0x72, 0xd1,
+    0xe5, 0x9c, 0x4b, 0x29, 0xf7, 0x5e, 0xc6, 0xb8, 0x52, 0xf2, 0xbd, 0x85, 0xb1, 0xa3, 0x34, 0x79,
+    0xd7, 0x62, 0xde, 0xa9, 0x98, 0x7e, 0xea, 0xa0, 0x4f, 0x38, 0x34, 0x12, 0x97, 0x4d, 0xae, 0xb5,
+    0xbc, 0x77, 0x31, 0xe6, 0x94, 0x4a, 0xef, 0x77, 0x0c, 0x26, 0x85, 0xda, 0xe3, 0x1b, 0x09, 0xcb,
+    0x46, 0xd7, 0x72, 0xde, 0xa5, 0x98, 0x7b, 0x2a, 0xa3, 0x5f, 0x39, 0xf8, 0x12, 0xc2, 0x8d, 0x91,
+    0xa5, 0xac, 0x7b, 0x3d, 0xe3, 0x51, 0x89, 0xfc, 0x66, 0xc1, 0xea, 0xd0, 0x4f, 0x1c, 0x34, 0x09,
+    0xd7, 0x46, 0xde, 0xb2, 0xd8, 0x75, 0x9a, 0xa7, 0x2b, 0x3a, 0x9f, 0x53, 0x28, 0x3d, 0xde, 0x91,
+    0x98, 0x6c, 0x6a, 0xad, 0xef, 0x3d, 0x8c, 0x11, 0xa5, 0xcc, 0x7b, 0x15, 0xe3, 0x4f, 0x09, 0xf4,
+    0x06, 0xc7, 0x42, 0xd2, 0xb1, 0x9d, 0xb4, 0x69, 0xb7, 0x6e, 0xf6, 0xac, 0x46, 0xfd, 0xf2, 0xc1,
+    0x85, 0x90, 0x63, 0x2c, 0x29, 0xdd, 0xde, 0xd9, 0x98, 0x5a, 0xea, 0xbb, 0x0f, 0x33, 0x44, 0x15,
+    0xf3, 0x4f, 0x05, 0xf4, 0x03, 0x07, 0x41, 0xc2, 0xb0, 0x51, 0xb4, 0x3c, 0x77, 0x51, 0xe6, 0xbc,
+    0x4a, 0xf1, 0xf7, 0x04, 0x46, 0x83, 0x72, 0xe1, 0xe5, 0x88, 0x4b, 0x26, 0xb7, 0x5a, 0xf6, 0xbb,
+    0x06, 0xf3, 0x42, 0xc5, 0xf1, 0x93, 0x04, 0x6d, 0xc3, 0x6d, 0x91, 0xed, 0xac, 0x4d, 0xbd, 0xf5,
+    0xb1, 0x87, 0x34, 0x62, 0x97, 0x69, 0xae, 0xae, 0xfc, 0x7c, 0x41, 0xe1, 0xf0, 0x48, 0x44, 0x36,
+    0xb3, 0x56, 0xf5, 0xfe, 0xc7, 0x00, 0x52, 0x80, 0x3d, 0xa0, 0x11, 0xb8, 0x0c, 0x72, 0x85, 0xe5,
+    0xa3, 0x0b, 0x39, 0xc7, 0x52, 0xd2, 0xbd, 0x9d, 0xb1, 0xa9, 0xb4, 0x7e, 0xf7, 0x60, 0x46, 0xa8,
+    0x32, 0xfe, 0x95, 0x80, 0x6f, 0x20, 0x2c, 0x18, 0x1d, 0xca, 0x89, 0x97, 0x26, 0xee, 0x9a, 0xcc,
+    0x6b, 0x15, 0xef, 0x4f, 0x0c, 0x34, 0x05, 0xd7, 0x43, 0x1e, 0xb1, 0xc8, 0x74, 0x56, 0xa7, 0x7e,
+    0xfa, 0xa0, 0x43, 0x38, 0x31, 0xd2, 0x94, 0x5d, 0xaf, 0x79, 0xbc, 0x22, 0xf1, 0xd9, 0x84, 0x5a,
+    0xe3, 0x7b, 0x09, 0xe3, 0x46, 0xc9, 0xf2, 0xd6, 0xc5, 0x9e, 0xd3, 0x28, 0x5d, 0xde, 0xb9, 0x98,
+    0x72, 0xea, 0xa5, 0x8f, 0x3b, 0x24, 0x13, 0x5b, 0x4d, 0xfb, 0x75, 0x83, 0x67, 0x21, 0xea, 0x98,
+    0x4f, 0x2a, 0xb4, 0x1f, 0x37, 0x48, 0x16, 0xb6, 0x8e, 0xf6, 0xe4, 0x46, 0xcb, 0x72, 0xd7, 0x65,
+    0x9e, 0xab, 0x28, 0x7f, 0x5e, 0xa0, 0x38, 0x78, 0x12, 0xa2, 0x8d, 0xb9, 0xa5, 0xb2, 0xfb, 0x35,
+    0x83, 0x57, 0x21, 0xfe, 0x98, 0x40, 0x6a, 0xb0, 0x2f, 0x34, 0x1c, 0x17, 0x49, 0xce, 0xb6, 0xd4,
+    0x76, 0xdf, 0x66, 0xd8, 0x2a, 0xda, 0x9f, 0x1b, 0x28, 0x0b, 0x5e, 0x87, 0x78, 0x62, 0xa2, 0xa9,
+    0xb9, 0xbe, 0xf2, 0xf0, 0x45, 0x84, 0x33, 0x23, 0x55, 0xd9, 0xff, 0x1a, 0xc0, 0x0b, 0x10, 0x07,
+    0x4c, 0x02, 0xb5, 0xc1, 0xb7, 0x10, 0x76, 0x8c, 0x26, 0xe5, 0xda, 0xcb, 0x1b, 0x17, 0x4b, 0x4e,
+    0xb7, 0x74, 0x76, 0xa7, 0x66, 0xfa, 0xaa, 0xc3, 0x3f, 0x11, 0xd0, 0x0c, 0x5c, 0x05, 0xf9, 0xc3,
+    0x02, 0xd1, 0xc1, 0x9c, 0x50, 0x69, 0xfc, 0x2e, 0xc1, 0xdc, 0x50, 0x59, 0xfc, 0x3a, 0xc1, 0xd3,
+    0x10, 0x5d, 0xcc, 0x39, 0x95, 0xd2, 0xef, 0x1d, 0x8c, 0x09, 0xa5, 0xc6, 0xfb, 0x12, 0xc3, 0x4d,
+    0x91, 0xf5, 0xac, 0x47, 0x3d, 0xf2, 0x91, 0x85, 0xac, 0x63, 0x3d, 0xe9, 0xd1, 0x8e, 0xdc, 0x64,
+    0x59, 0xeb, 0x7a, 0xcf, 0x63, 0x14, 0x29, 0xcf, 0x5e, 0xd4, 0x38, 0x5f, 0x52, 0xb8, 0x3d, 0xb2,
+    0x91, 0xb5, 0xac, 0x77, 0x3d, 0xe6, 0x91, 0x8a, 0xec, 0x67, 0x0d, 0xea, 0x85, 0x8f, 0x23, 0x24,
+    0x19, 0xdb, 0x4a, 0xdb, 0x77, 0x1b, 0x66, 0x8b, 0x6a, 0xe7, 0x6f, 0x0a, 0xac, 0x07, 0x3d, 0xc2,
+    0x91, 0x91, 0xac, 0x6c, 0x7d, 0xed, 0xe1, 0x8d, 0x88, 0x65, 0xa6, 0xab, 0x3a, 0xff, 0x53, 0x00,
+    0x3d, 0xc0, 0x11, 0x90, 0x0c, 0x6c, 0x05, 0xed, 0xc3, 0x0d, 0x91, 0xc5, 0xac, 0x53, 0x3d, 0xfd,
+    0xd1, 0x81, 0x9c, 0x60, 0x69, 0xe8, 0x2e, 0xce, 0x9c, 0x54, 0x69, 0xff, 0x6e, 0xc0, 0x2c, 0x50,
+    0x1d, 0xfc, 0x09, 0x81, 0xc6, 0xe0, 0x52, 0xc8, 0x3d, 0x96, 0x91, 0xae, 0xec, 0x7c, 0x4d, 0xe1,
+    0xf5, 0x88, 0x47, 0x26, 0xb2, 0x9a, 0xf5, 0xab, 0x07, 0x3f, 0x42, 0x90, 0x31, 0xac, 0x14, 0x7d,
+    0xcf, 0x61, 0x94, 0x28, 0x6f, 0x5e, 0xac, 0x38, 0x7d, 0xd2, 0xa1, 0x9d, 0xb8, 0x69, 0xb2, 0xae,
+    0xf5, 0xbc, 0x47, 0x31, 0xf2, 0x94, 0x45, 0xaf, 0x73, 0x3c, 0x25, 0xd1, 0xdb, 0x1c, 0x5b, 0x49,
+    0xfb, 0x76, 0xc3, 0x66, 0xd1, 0xea, 0xdc, 0x4f, 0x19, 0xf4, 0x0a, 0xc7, 0x47, 0x12, 0xb2, 0x8d,
+    0xb5, 0xa5, 0xb7, 0x3b, 0x36, 0x93, 0x56, 0xed, 0xfe, 0xcd, 0x80, 0x55, 0xa0, 0x3f, 0x38, 0x10,
+    0x12, 0x8c, 0x0d, 0xa5, 0xc5, 0xbb, 0x13, 0x33, 0x4d, 0xd5, 0xf5, 0x9f, 0x07, 0x28, 0x02, 0x9e,
+    0x81, 0xa8, 0x60, 0x7e, 0xa8, 0x20, 0x7e, 0x98, 0x20, 0x6a, 0x98, 0x2f, 0x2a, 0x9c, 0x1f, 0x29,
+    0xc8, 0x1e, 0xd6, 0x88, 0x5e, 0xe6, 0xb8, 0x4a, 0xf2, 0xb7, 0x05, 0xb6, 0x83, 0x36, 0xe1, 0xd6,
+    0xc8, 0x5e, 0xd6, 0xb8, 0x5e, 0xf2, 0xb8, 0x45, 0xb2, 0xb3, 0x35, 0xb5, 0xd7, 0x37, 0x1e, 0x96,
+    0x88, 0x6e, 0xe6, 0xac, 0x4a, 0xfd, 0xf7, 0x01, 0x86, 0x80, 0x62, 0xe0, 0x29, 0x88, 0x1e, 0xe6,
+    0x88, 0x4a, 0xe6, 0xb7, 0x0a, 0xf6, 0x87, 0x06, 0xe2, 0x82, 0xc9, 0xa1, 0x96, 0xf8, 0x6e, 0xc2,
+    0xac, 0x51, 0xbd, 0xfc, 0x71, 0x81, 0xe4, 0x60, 0x4b, 0x68, 0x37, 0x6e, 0x96, 0xac, 0x6e, 0xfd,
+    0xec, 0x41, 0x8d, 0xf0, 0x65, 0x84, 0x2b, 0x23, 0x5f, 0x59, 0xf8, 0x3a, 0xc2, 0x93, 0x11, 0xad,
+    0xcc, 0x7d, 0x95, 0xe1, 0xaf, 0x08, 0x7c, 0x06, 0xa1, 0xc2, 0xf8, 0x51, 0x82, 0xbc, 0x61, 0xb1,
+    0xe8, 0x74, 0x4e, 0xa7, 0x74, 0x7a, 0xa7, 0x63, 0x3a, 0xa9, 0xd3, 0x3e, 0xdd, 0xd0, 0x59, 0x9c,
+    0x3a, 0xe9, 0xd3, 0x0e, 0xdd, 0xc4, 0x59, 0x93, 0x7a, 0xed, 0xe3, 0x0d, 0x89, 0xc5, 0xa6, 0xd3,
+    0x3a, 0xdd, 0xd3, 0x19, 0x9d, 0xca, 0xe9, 0x97, 0x0e, 0xee, 0x84, 0x4c, 0x63, 0x75, 0xe9, 0xe7,
+    0x0e, 0xca, 0x84, 0x57, 0x23, 0x7e, 0x99, 0xe0, 0x6a, 0xc8, 0x2f, 0x16, 0x9c, 0x0e, 0xe9, 0xc4,
+    0x4e, 0xd3, 0x74, 0x5d, 0xe7, 0x79, 0x8a, 0xa2, 0xe7, 0x39, 0x8a, 0x92, 0xe7, 0x2d, 0x8a, 0x9d,
+    0xa7, 0x29, 0xba, 0x9e, 0xf3, 0x28, 0x45, 0xde, 0xb3, 0x18, 0x75, 0xca, 0xa7, 0x17, 0x3a, 0x8e,
+    0x93, 0x24, 0x6d, 0xdb, 0x6d, 0x9b, 0x6d, 0xab, 0x6d, 0xbf, 0x6d, 0xb0, 0x2d, 0xb4, 0x1d, 0xb7,
+    0x49, 0xb6, 0xb6, 0xf6, 0xf6, 0xc6, 0xc6, 0xd2, 0xd2, 0xdd, 0x9d, 0x99, 0xa9, 0xaa, 0xfe, 0xff,
+    0x00, 0x40, 0x00, 0x00
+};
+
+// Long mode register every 128 clocks of the cycle, sorted, and its index in noise_long_bits
+#define NOISE_ANCHOR_COUNT  256
+static const uint16_t noise_anchor_reg[NOISE_ANCHOR_COUNT] =
+{
+        1,   295,   314,   465,   588,  1114,  1565,  1745,  1969,  2020,  2293,  2394,  2821,  2910,  2979,  3036,
+     3067,  3090,  3091,  3160,  3442,  3540,  3564,  4229,  4256,  4497,  4680,  4737,  4808,  4892,  5293,  5420,
+     5459,  5483,  5580,  5832,  5898,  5958,  6238,  6335,  6336,  6623,  6650,  6760,  7038,  7077,  7397,  7400,
+     7790,  7823,  7848,  7880,  7881,  8179,  8320,  8321,  8392,  8442,  8522,  8614,  8687,  8789,  9006,  9288,
+     9363,  9652,  9653,  9727,  9864,  9884,  9961, 10171, 10368, 10369, 10472, 10522, 10663, 10732, 10831, 10929,
+    11023, 11166, 11386, 11429, 11538, 11880, 12512, 12928, 13000, 13032, 13045, 13166, 13196, 13263, 13416, 13634,
+    13663, 13713, 13896, 13897, 14401, 14475, 14546, 14618, 14764, 15080, 15268, 15390, 15605, 15944, 15962, 16057,
+    16182, 16348, 16445, 16488, 16512, 16876, 16885, 16923, 17032, 17123, 17306, 17380, 17416, 17426, 17458, 17717,
+    17772, 17834, 17988, 18024, 18135, 18182, 18258, 18432, 18433, 18560, 18610, 18700, 18726, 18958, 19080, 19198,
+    19265, 19738, 19976, 20086, 20143, 20200, 20300, 20310, 20467, 20512, 20582, 20738, 20908, 21152, 21225, 21326,
+    21412, 21544, 21966, 22056, 22195, 22216, 22327, 22342, 22403, 22436, 22720, 23112, 23132, 23168, 23186, 23259,
+    23321, 23333, 23407, 23482, 23492, 23548, 23672, 23824, 23866, 23922, 24052, 24070, 24082, 24264, 24438, 24704,
+    24705, 25039, 25303, 25533, 25800, 26087, 26396, 26624, 26625, 26696, 26752, 26900, 26938, 27088, 27144, 27250,
+    27481, 27794, 27800, 27898, 28188, 28296, 28350, 28548, 28602, 28621, 28645, 28694, 28768, 28972, 29002, 29288,
+    29301, 29446, 29522, 29800, 29879, 29928, 30050, 30097, 30162, 30263, 30432, 30458, 30459, 30652, 30784, 30862,
+    31090, 31156, 31304, 31322, 31336, 31360, 31433, 31715, 31773, 31800, 31936, 32050, 32204, 32306, 32328, 32474
+};
+
+static const uint16_t noise_anchor_index[NOISE_ANCHOR_COUNT] =
+{
+        0,  7424,  6784, 29696, 28416, 23296, 14848, 19840, 26752, 13568, 29952, 18560, 20096, 20992, 27008,  8832,
+    24448, 30592,  3712, 17024, 19328, 23680,  8064, 26240, 18304, 29440,   768, 19200, 11776, 23168, 22912, 11648,
+     9088, 27264,  4736,  2304, 14208, 25088, 12160, 23424,  7808, 19072, 22144,  1536, 24320, 18176, 25216,  3072,
+    19584, 12672, 10112, 30848,  5760, 21120,   512,  7680,  8448, 27392, 20608, 11264, 22784, 14720, 17920, 16640,
+    32512,  1664, 30464, 18048,  6016,  7168, 17280, 11008,  2048, 30720,  5120, 22272, 32384,  2688, 27776, 20864,
+    14976, 27904, 12544, 25728, 16768,  1152, 24064,  1280,  4352,  9216, 14464, 18944, 13824,  7296, 17408, 24704,
+    21888, 29184,   384, 32640,  9600, 21760, 13312, 17536,  6400, 15872,   896, 10496, 30208,  5888, 19968, 28288,
+    17152,  3456, 29568, 19456, 16384, 31488, 24960, 11392,  9728, 21632, 15744,  4480, 24576,  5632, 19712,  5504,
+     9984, 12416, 24832,  2944, 25856, 26112,  3200,   256,  3840,  8192, 13056, 13696,  3584, 32128, 31232, 14080,
+    10880, 21248,  4224,  8576, 12928, 15488,  6656, 20736, 26368, 16512,  5248, 28672, 31360, 12288, 23040, 32256,
+     2816, 20480, 10752,  8320, 26880,  3968, 15232, 25600, 28032,  9856,  2432,  7936, 21504,  4864, 23808,  7552,
+    29312, 16256, 15104,  4992, 11904,  9344, 24192, 28800, 32000, 18688, 16000, 21376,  8960, 30976, 28160,   128,
+     1920, 30080, 25344, 13184, 20224, 22656, 17792,  1024, 15360, 12032,  4096, 11136, 31872, 14336,  2560, 27648,
+    29056,  1792, 25984, 12800, 22528, 31104, 10368,  6528,  3328, 22016, 13440, 13952, 16896,  6272, 26496,  8704,
+    14592, 26624,  6912, 18432, 28544, 31744, 22400, 28928,  1408, 23936, 10240,  5376, 30336, 25472,   640,  7040,
+    17664, 10624,  4608,  9472, 23552, 15616, 11520, 27520, 29824, 18816,  6144, 20352, 31616, 27136,  2176, 16128
+};
+
+
+// 16 sequence bits from index i
+static inline unsigned int noise_window(const uint8_t *bits, unsigned int i)
+{
+    const uint8_t *p = bits + (i >> 3);
+    uint32_t w = (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16);
+    return (unsigned int)(w >> (i & 7)) & 0xffff;
+}
+
+
+static inline const uint8_t * noise_bits(const nesapu_t *apu)
+{
+    return apu->noise_mode ? apu->noise_short_bits : noise_long_bits;
+}
+
+
+// Shift register value at current position
+static uint16_t noise_shift_reg(const nesapu_t *apu)
+{
+    return (uint16_t)(noise_window(noise_bits(apu), apu->noise_index) & 0x7fff);
+}
+
+
+// When the timer clocks the shift register, the following occur in order:
+// 1) Feedback is calculated as the exclusive-OR of bit 0 and one other bit: bit 6 if Mode flag is set, otherwise bit 1.
+// 2) The shift register is shifted right by one bit.
+// 3) Bit 14, the leftmost bit, is set to the feedback calculated earlier.
+static inline uint16_t noise_clock(uint16_t reg, unsigned int tap)
+{
+    uint16_t feedback = (reg ^ (reg >> tap)) & 0x0001;
+    return (uint16_t)((reg >> 1) | (feedback << 14));
+}
+
+
+// Find position of shift register value reg in sequence of current mode
+static void noise_set_shift_reg(nesapu_t *apu, uint16_t reg)
+{
+    reg &= 0x7fff;
+    if (0 == reg) reg = 1;  // 0 never leaves 0 and is not on any sequence, not reachable from power up
+    if (apu->noise_mode)
+    {
+        // Short mode register is on one of many cycles of 93 clocks (or the one of 31), record it from here
+        uint16_t r = reg;
+        unsigned int n = 0, period = 0;
+        memset(apu->noise_short_bits, 0, sizeof(apu->noise_short_bits));
+        while (0 == period || n < period + 16)
+        {
+            if (r & 0x01) apu->noise_short_bits[n >> 3] |= (uint8_t)(1 << (n & 7));
+            r = noise_clock(r, 6);
+            ++n;
+            if (0 == period && r == reg) period = n;
+        }
+        apu->noise_short_period = (uint8_t)period;
+        apu->noise_index = 0;
+    }
+    else
+    {
+        // Clock register up to the next anchor, at most 127 clocks
+        for (unsigned int clocks = 0; ; ++clocks)
+        {
+            int lo = 0, hi = NOISE_ANCHOR_COUNT - 1;
+            while (lo <= hi)
+            {
+                int mid = (lo + hi) / 2;
+                if (noise_anchor_reg[mid] == reg)
+                {
+                    apu->noise_index = (uint16_t)((noise_anchor_index[mid] + NOISE_LONG_PERIOD - clocks) % NOISE_LONG_PERIOD);
+                    return;
+                }
+                if (noise_anchor_reg[mid] < reg)
+                    lo = mid + 1;
+                else
+                    hi = mid - 1;
+            }
+            reg = noise_clock(reg, 1);
+        }
+    }
+}
+
+
+
+/**
+ * @brief Reciprocal of timer period for timer_count_down(), floor((2^32 - 1) / period)
+ *
+ * @note Quotient of any 32-bit count by period is (count * recip) >> 32 or one more.
+ */
+static inline uint32_t timer_reciprocal(unsigned int period)
+{
+    return 0xffffffffu / period;
+}
+
+
+// Divide cycles by period with its reciprocal, return quotient and leave remainder in cycles
+static inline unsigned int timer_divide(unsigned int *cycles, unsigned int period, uint32_t recip)
+{
+    // Short spans from sample by sample synthesis are mostly within one period
+    if (*cycles < period) return 0;
+    unsigned int q = (unsigned int)(((uint64_t)(*cycles) * recip) >> 32);
+    *cycles -= q * period;
+    if (*cycles >= period)
+    {
+        *cycles -= period;
+        ++q;
+    }
+    return q;
+}
+
+
+#if NESAPU_USE_EVENT_SYNTH
+// Event driven synthesis runs arbitrary spans, so also count exactly when counter is above period
+// (period shortened by register write or sweep). Same result as below otherwise.
+static inline unsigned int timer_count_down(unsigned int *counter, unsigned int period, uint32_t recip, unsigned int cycles)
+{
+    if (cycles <= *counter)
+    {
+        *counter -= cycles;
+        return 0;
+    }
+    cycles -= *counter + 1;
+    unsigned int clocks = timer_divide(&cycles, period, recip);
+    *counter = period - 1 - cycles;
+    return 1 + clocks;
+}
+#else
+/**
+ * @brief Count down timer
+ * 
+ * @param counter       Input initial counter value. When counting finish, return finish counter value.
+ * @param period        Counting period.
+ * @param recip         timer_reciprocal(period)
+ * @return unsigned int Number of times counter has reloaded from 0 to next period
+ * 
+ * @note Takes the same time for any \param cycles, so spans of any length can be run in one call.
+ *
+ */
+static inline unsigned int timer_count_down(unsigned int *counter, unsigned int period, uint32_t recip, unsigned int cycles)
+{
+    unsigned int clocks = timer_divide(&cycles, period, recip);
+    unsigned int extra = cycles;
+    if (extra > *counter)
+    {
+        *counter = *counter + period - extra;
+        ++clocks;
+    }
+    else
+    {
+        *counter = *counter - extra;
+    }
+    return clocks;
+}
+#endif
+
+
+static inline void update_frame_counter(nesapu_t *apu, unsigned int cycles)
+{
+    //
+    // https://www.nesdev.org/wiki/APU_Frame_Counter
+    //
+    // Frame counter clocks 4 or 5 sequencer at 240Hz or 7457.38 CPU clocks.
+    // Fixed point is used here to increase accuracy.
+    if (apu->frame_force_clock)
+    {
+        apu->quarter_frame = true;
+        apu->half_frame = true;
+        apu->frame_force_clock = false;
+    }
+    else
+    {
+        apu->quarter_frame = false;
+        apu->half_frame = false;
+    }
+    q16_t cycles_fp = int_to_q16(cycles);
+    apu->frame_accu_fp += cycles_fp;
+    if (apu->frame_accu_fp >= apu->frame_period_fp)
+    {
+        apu->frame_accu_fp -= apu->frame_period_fp;
+        ++apu->sequencer_step;
+        if (apu->sequence_mode)
+        {
+            // 5 step mode
+            // step      quarter_frame         half_frame
+            //  1          clock                  -
+            //  2          clock                clock
+            //  3          clock                  -
+            //  4            -                    -
+            //  5          clock                clock
+            switch (apu->sequencer_step)
+            {
+            case 1:
+                apu->quarter_frame = true;
+                break;
+            case 2:
+                apu->quarter_frame = true;
+                apu->half_frame = true;
+                break;
+            case 3:
+                apu->quarter_frame = true;
+                break;
+            case 4:
+                apu->quarter_frame = false;
+                break;
+            case 5:
+                apu->quarter_frame = true;
+                apu->half_frame = true;
+                apu->sequencer_step = 0;
+                break;
+            }
+        }
+        else
+        {
+            // 4 step mode
+            // step      quarter_frame         half_frame
+            //  1          clock                  -
+            //  2          clock                clock
+            //  3          clock                  -
+            //  4          clock                clock
+            switch (apu->sequencer_step)
+            {
+            case 1:
+                apu->quarter_frame = true;
+                break;
+            case 2:
+                apu->quarter_frame = true;
+                apu->half_frame = true;
+                break;
+            case 3:
+                apu->quarter_frame = true;
+                break;
+            case 4:
+                apu->quarter_frame = true;
+                apu->half_frame = true;
+                apu->sequencer_step = 0;
+                break;
+            }
+        }
+    }
+}
+
+
+// Cycles to run before next frame counter clock. Frame counter clock takes effect at start of the
+// run crossing it, so stop one clock before and cross it with a run of 1 clock.
+static inline unsigned int next_frame_event(nesapu_t *apu)
+{
+    q16_t left = apu->frame_period_fp - apu->frame_accu_fp;
+    if (left <= int_to_q16(2)) return 1;
+    return (unsigned int)((left + 0xffff) >> 16) - 1;
+}
+
+
+// Cycles to run in frame clock steps: to one clock before next frame counter clock as above, or when
+// the run crosses it in its first clock, on to one clock before the clock after.
+static inline unsigned int next_frame_step(nesapu_t *apu)
+{
+    q16_t left = apu->frame_period_fp - apu->frame_accu_fp;
+    if (left > int_to_q16(1)) return next_frame_event(apu);
+    left += apu->frame_period_fp - int_to_q16(1);
+    return (unsigned int)((left + 0xffff) >> 16);
+}
+
+
+/*
+ * https://www.nesdev.org/wiki/APU_Pulse
+ *
+ *                  Sweep -----> Timer
+ *                    |            |
+ *                    |            |
+ *                    |            v
+ *                    |        Sequencer   Length Counter
+ *                    |            |             |
+ *                    |            |             |
+ *                    v            v             v
+ * Envelope -------> Gate -----> Gate -------> Gate ---> (to mixer)
+ */
+static inline unsigned int update_pulse(nesapu_t *apu, int ch, unsigned int cycles)
+{
+    //
+    // Clock envelope @ quater frame
+    // https://www.nesdev.org/wiki/APU_Envelope
+    if (apu->quarter_frame)
+    {
+        if (apu->pulse[ch].envelope_start)
+        {
+            apu->pulse[ch].envelope_decay = 15;
+            apu->pulse[ch].envelope_value = apu->pulse[ch].volume_envperiod;
+            apu->pulse[ch].envelope_start = false;
+        }
+        else
+        {
+            if (apu->pulse[ch].envelope_value)
+            {
+                --(apu->pulse[ch].envelope_value);
+            }
+            else
+            {
+                apu->pulse[ch].envelope_value = apu->pulse[ch].volume_envperiod;
+                if (apu->pulse[ch].envelope_decay)
+                {
+                    --(apu->pulse[ch].envelope_decay);
+                }
+                else if (apu->pulse[ch].lenhalt_envloop)
+                {
+                    apu->pulse[ch].envelope_decay = 15;
+                }
+            }
+        }
+    }
+    //
+    // Clock sweep unit @ half frame 
+    // https://www.nesdev.org/wiki/APU_Sweep
+    //
+    if (apu->half_frame)
+    {
+        // 1. If the divider's counter is zero, the sweep is enabled, and the sweep unit is not muting the channel: The pulse's period is set to the target period.
+        // 2. If the divider's counter is zero or the reload flag is true: The divider counter is set to P and the reload flag is cleared.
+        //    Otherwise, the divider counter is decremented.
+        if (apu->pulse[ch].sweep_reload)
+        {
+            apu->pulse[ch].sweep_value = apu->pulse[ch].sweep_period;
+            apu->pulse[ch].sweep_reload = false;
+        }
+        else 
+        {
+            if (apu->pulse[ch].sweep_value)
+            {
+                --(apu->pulse[ch].sweep_value);
+            } 
+            else if (apu->pulse[ch].sweep_enabled && apu->pulse[ch].sweep_shift)  // TODO: Not sure if pulse_sweep_enabled must be true
+            {
+                // Calculate target period.
+                unsigned int c = apu->pulse[ch].timer_period >> apu->pulse[ch].sweep_shift;
+                if (apu->pulse[ch].sweep_negate)
+                {
+                    if (ch == 0) apu->pulse[ch].sweep_target -= c + 1;
+                    else if (ch == 1) apu->pulse[ch].sweep_target -= c;
+                }
+                else
+                {
+                    apu->pulse[ch].sweep_target += c;
+                }
+                if (!apu->pulse[ch].sweep_timer_mute)
+                {
+                    // When the sweep unit is muting a pulse channel, the channel's current period remains unchanged.
+                    apu->pulse[ch].timer_period = apu->pulse[ch].sweep_target;
+                    apu->pulse[ch].timer_recip = timer_reciprocal((apu->pulse[ch].timer_period + 1) << 1);
+                }
+                // Two conditions cause the sweep unit to mute the channel:
+                // 1. If the current period is less than 8, the sweep unit mutes the channel.
+                // 2. If at any time the target period is greater than $7FF, the sweep unit mutes the channel.
+                apu->pulse[ch].sweep_timer_mute = ((apu->pulse[ch].timer_period < 8) || (apu->pulse[ch].sweep_target > 0x7ff));
+                // Reload divider
+                apu->pulse[ch].sweep_value = apu->pulse[ch].sweep_period;
+            }
+        }
+    }
+    //
+    // Clock pulse channel timer and update sequencer
+    // https://www.nesdev.org/wiki/APU_Pulse
+    // Timer counting downwards from 0 at every other CPU cycle. So we set timer limit to  2x (timer_period + 1).
+    if (!apu->pulse[ch].sweep_timer_mute)
+    {
+        unsigned int seq_clk = timer_count_down(&(apu->pulse[ch].timer_value), (apu->pulse[ch].timer_period + 1) << 1,
+                                                apu->pulse[ch].timer_recip, cycles);
+        // Sequencer counts down through 8 steps
+        apu->pulse[ch].sequencer_value = (apu->pulse[ch].sequencer_value - seq_clk) & 7;
+    }
+    // 
+    // Clock length counter @ half frame if not halted
+    // https://www.nesdev.org/wiki/APU_Length_Counter
+    if (!apu->pulse[ch].lenhalt_envloop && apu->pulse[ch].length_value && apu->half_frame)
+    {
+        --(apu->pulse[ch].length_value);
+    }
+    // Determine Pulse channel output
+    if (!apu->pulse[ch].enabled) return 0;
+    if (!apu->pulse[ch].length_value) return 0;
+    if (apu->pulse[ch].sweep_timer_mute) return 0;
+    if (!pulse_waveform_table[apu->pulse[ch].duty][apu->pulse[ch].sequencer_value]) return 0;
+    return (apu->pulse[ch].constant_volume ? apu->pulse[ch].volume_envperiod : apu->pulse[ch].envelope_decay);
+}
+
+
+/*
+ * https://www.nesdev.org/wiki/APU_Triangle
+ *
+ *       Linear Counter    Length Counter
+ *              |                |
+ *              v                v
+ *  Timer ---> Gate ----------> Gate ---> Sequencer ---> (to mixer)
+ */
+static inline unsigned int update_triangle(nesapu_t *apu, unsigned int cycles)
+{
+    //
+    // Clock linear counter @ quater frame
+    // https://www.nesdev.org/wiki/APU_Triangle
+    if (apu->quarter_frame)
+    {
+        // In order:
+        // 1. If the linear counter reload flag is set, the linear counter is reloaded with the counter reload value,
+        //    otherwise if the linear counter is non-zero, it is decremented.
+        // 2. If the control flag is clear, the linear counter reload flag is cleared.
+        if (apu->triangle_linear_reload)
+        {
+            apu->triangle_linear_value = apu->triangle_linear_period;
+        }
+        else if (apu->triangle_linear_value)
+        {
+            --(apu->triangle_linear_value);
+        }
+        if (!apu->triangle_lnrctl_lenhalt)
+        {
+            apu->triangle_linear_reload = false;
+        }
+    }
+    // 
+    // Clock length counter @ half frame if not halted
+    // https://www.nesdev.org/wiki/APU_Length_Counter
+    if (!apu->triangle_lnrctl_lenhalt && apu->triangle_length_value && apu->half_frame)
+    {
+        --(apu->triangle_length_value);
+    }
+    // Clock triangle channel timer and return
+    // Trick: Just keep sequencer unchanged if the channel should be silenced, it minizes pop
+    if (apu->triangle_enabled 
+        &&
+        !apu->triangle_timer_period_bad
+        &&
+        apu->triangle_length_value
+        &&
+        apu->triangle_linear_value)
+    {
+        unsigned int seq_clk = timer_count_down(&(apu->triangle_timer_value), apu->triangle_timer_period + 1,
+                                                apu->triangle_timer_recip, cycles);
+        // Sequencer counts up through 32 steps
+        apu->triangle_sequencer_value = (apu->triangle_sequencer_value + seq_clk) & 31;
+    }
+    return triangle_waveform_table[apu->triangle_sequencer_value];
+}
+
+
+/*
+ * https://www.nesdev.org/wiki/APU_Noise
+ * 
+ *     Timer --> Shift Register   Length Counter
+ *                    |                |
+ *                    v                v
+ * Envelope -------> Gate ----------> Gate --> (to mixer)
+ */
+static inline unsigned int update_noise(nesapu_t* apu, unsigned int cycles)
+{
+    //
+    // Clock envelope @ quater frame
+    // https://www.nesdev.org/wiki/APU_Envelope
+    if (apu->quarter_frame)
+    {
+        if (apu->noise_envelope_start)
+        {
+            apu->noise_envelope_decay = 15;
+            apu->noise_envelope_value = apu->noise_volume_envperiod;
+            apu->noise_envelope_start = false;
+        }
+        else
+        {
+            if (apu->noise_envelope_value)
+            {
+                --(apu->noise_envelope_value);
+            }
+            else
+            {
+                apu->noise_envelope_value = apu->noise_volume_envperiod;
+                if (apu->noise_envelope_decay)
+                {
+                    --(apu->noise_envelope_decay);
+                }
+                else if (apu->noise_lenhalt_envloop)
+                {
+                    apu->noise_envelope_decay = 15;
+                }
+            }
+        }
+    }
+    // Clock noise channel timer
+    if (apu->noise_timer_period > 0)
+    {
+        unsigned int clocks = timer_count_down(&(apu->noise_timer_value), apu->noise_timer_period + 1,
+                                               apu->noise_timer_recip, cycles);
+        if (clocks)
+        {
+            // Shift register clocks only move along the sequence
+            unsigned int period = apu->noise_mode ? apu->noise_short_period : NOISE_LONG_PERIOD;
+            unsigned int index = apu->noise_index + clocks;
+            apu->noise_index = (uint16_t)((index < period) ? index : index % period);
+        }
+    }
+    // 
+    // Clock length counter @ half frame if not halted
+    // https://www.nesdev.org/wiki/APU_Length_Counter
+    if (!apu->noise_lenhalt_envloop && apu->noise_length_value && apu->half_frame)
+    {
+        --(apu->noise_length_value);
+    }
+    // return value
+    if (!apu->noise_enabled) return 0;
+    // The mixer receives the current envelope volume except when bit 0 of the shift register is set, or the length counter is 0
+    if (noise_window(noise_bits(apu), apu->noise_index) & 0x01) return 0;
+    if (!apu->noise_length_value) return 0;
+    return (apu->noise_constant_volume ? apu->noise_volume_envperiod : apu->noise_envelope_decay);
+}
+
+
+static void dmc_transfer(nesapu_t *apu)
+{
+    if (apu->dmc_read_buffer_empty && apu->dmc_read_remaining)
+    {
+        // 1. The CPU is stalled for up to 4 CPU cycles to allow the longest
+        //    possible write (the return address and write after an IRQ) to
+        //    finish. (not important as we are playing recording)
+        // 2. The sample buffer is filled with the next sample byte read from the current address
+#if NESAPU_USE_RAM_IMAGE
+        // DMC addresses are $8000-$FFFF
+        apu->dmc_read_buffer = apu->ram_image ? apu->ram_image[apu->dmc_read_addr & (NESAPU_RAM_IMAGE_SIZE - 1)] : 0;
+#else
+        apu->dmc_read_buffer = nesapu_read_ram(apu, apu->dmc_read_addr);
+#endif
+        apu->dmc_read_buffer_empty = false;
+        // 3. The address is incremented. If it exceeds $FFFF, it wraps to $8000
+        ++(apu->dmc_read_addr);
+        if (apu->dmc_read_addr == 0x0000)
+            apu->dmc_read_addr = 0x8000;
+        // 4. The bytes remaining counter is decremented. If it becomes zero and the loop flag is set, the sample is
+        //    restarted; otherwise, if the bytes remaining counter becomes zero and the IRQ enabled flag is set,
+        //    the interrupt flag is set.
+        --(apu->dmc_read_remaining);
+        if (apu->dmc_read_remaining == 0)
+        {
+            if (apu->dmc_loop)
+            {
+                apu->dmc_read_addr = apu->dmc_sample_addr;
+                apu->dmc_read_remaining = apu->dmc_sample_len;
+            }
+        }
+    }
+}
+
+
+/*
+ * https://www.nesdev.org/wiki/APU_DMC
+ *
+ *                          Timer
+ *                            |
+ *                            v
+ * Reader ---> Buffer ---> Shifter ---> Output level ---> (to the mixer)
+ */
+static inline unsigned int update_dmc(nesapu_t* apu, unsigned int cycles)
+{
+    if (!apu->dmc_enabled) return 0;
+    // Check DMC setup. Some bad VGM errornously enables DMC without setting it up (Double Dragon)
+    if (apu->dmc_timer_period == 0) return 0;   
+    if (apu->dmc_read_addr < 0x8000) return 0;
+    // clock channel clock
+    unsigned int clocks = timer_count_down(&(apu->dmc_timer_value), apu->dmc_timer_period + 1,
+                                           apu->dmc_timer_recip, cycles);
+    if (clocks > 8 && apu->dmc_output_silence && apu->dmc_read_buffer_empty && !apu->dmc_read_remaining)
+    {
+        // Sample finished: output level holds, only the empty shifter and bit counter run
+        unsigned int bits = apu->dmc_output_bits_remaining ? apu->dmc_output_bits_remaining : 1;
+        apu->dmc_output_shift_reg = 0;
+        apu->dmc_output_bits_remaining = (bits + 7 - (clocks & 7)) % 8 + 1;
+        clocks = 0;
+    }
+    while (clocks)
+    {
+        // When the timer outputs a clock, the following actions occur in order: 
+        // 1. If the silence flag is clear, the output level changes based on bit 0 of the shift register.
+        //    If the bit is 1, add 2; otherwise, subtract 2.
+        //    But if adding or subtracting 2 would cause the output level to leave the 0-127 range,
+        //    leave the output level unchanged. This means subtract 2 only if the current level is at least 2,
+        //    or add 2 only if the current level is at most 125.
+        if (!apu->dmc_output_silence)
+        {
+            if (apu->dmc_output_shift_reg & 0x01)
+                apu->dmc_output += (apu->dmc_output <= 125) ? 2 : 0;
+            else
+                apu->dmc_output -= (apu->dmc_output >= 2) ? 2 : 0;
+        }
+        // 2. The right shift register is clocked
+        apu->dmc_output_shift_reg >>= 1;
+        // 3. As stated above, the bits - remaining counter is decremented. If it becomes zero, a new output cycle is started.
+        if (apu->dmc_output_bits_remaining > 0)
+        {
+            --(apu->dmc_output_bits_remaining);
+        }
+        if (apu->dmc_output_bits_remaining == 0)
+        {
+            // A new cycle is started as follows :
+            // 1. The bits-remaining counter is loaded with 8.
+            apu->dmc_output_bits_remaining = 8;
+            // 2. If the sample buffer is empty, then the silence flag is set; 
+            //    otherwise, the silence flag is cleared and the sample buffer is emptied into the shift register.
+            if (apu->dmc_read_buffer_empty)
+            {
+                apu->dmc_output_silence = true;
+            }
+            else
+            {
+                apu->dmc_output_silence = false;
+                apu->dmc_output_shift_reg = apu->dmc_read_buffer;
+                apu->dmc_read_buffer_empty = true;
+                // Perform memory read
+                dmc_transfer(apu);
+            }
+        }
+        --clocks;
+    }
+    return (apu->dmc_output);
+}
+
+
+nesapu_t * nesapu_create(file_reader_t *reader, bool format, unsigned int clock, unsigned int sample_rate, unsigned int max_samples)
+{
+    nesapu_t *apu = (nesapu_t*)VGM_MALLOC(sizeof(nesapu_t));
+    if (NULL == apu)
+        return NULL;
+    memset(apu, 0, sizeof(nesapu_t));
+    apu->reader = reader;
+    apu->format = format;
+    apu->clock_rate = clock;
+    apu->max_samples = max_samples ? max_samples : NESAPU_MAX_SAMPLES;
+    if (apu->max_samples > NESAPU_BLOCK_LIMIT) apu->max_samples = NESAPU_BLOCK_LIMIT;
+#if NESAPU_USE_BLIPBUF
+    // blip
+    apu->sample_rate = sample_rate;
+    apu->blip = blip_new((int)apu->max_samples);
+    if (NULL == apu->blip)
+    {
+        VGM_FREE(apu);
+        return NULL;
+    }
+    blip_set_rates(apu->blip, apu->clock_rate, sample_rate);
+#else
+    // Sampling
+    apu->sample_period_fp = float_to_q16((float)apu->clock_rate / sample_rate);
+#endif
+    apu->frame_period_fp = float_to_q16((float)apu->clock_rate / 240.0f);  // 240Hz frame counter period
+    // ram
+    apu->ram_list = NULL;
+#if NESAPU_USE_RAM_IMAGE
+    apu->ram_image = NULL;
+#else
+    apu->ram_active = NULL;
+    apu->ram_cache = NULL;
+#endif
+    // Without the queue only writes at the current position are taken
+#if NESAPU_WRITE_QUEUE_SIZE > 0
+    apu->write_queue = (nesapu_write_t *)VGM_MALLOC(NESAPU_WRITE_QUEUE_SIZE * sizeof(nesapu_write_t));
+#else
+    apu->write_queue = NULL;
+#endif
+    nesapu_reset(apu);
+    return apu;
+}
+
+
+static void free_ram_list(nesapu_t *apu)
+{
+    nesapu_ram_t *ram = apu->ram_list, *tram;
+    while (ram)
+    {
+        tram = ram;
+        ram = ram->next;
+        VGM_FREE(tram);
+    }
+    apu->ram_list = NULL;
+#if NESAPU_USE_RAM_IMAGE
+    if (apu->ram_image)
+        memset(apu->ram_image, 0, NESAPU_RAM_IMAGE_SIZE);
+#else
+    apu->ram_active = NULL;
+#endif
+    apu->ram_count = 0;
+    apu->ram_serial = 0;
+}
+
+
+void nesapu_clear_ram(nesapu_t *apu)
+{
+    free_ram_list(apu);
+}
+
+
+#if NESAPU_USE_BLIPBUF && NESAPU_USE_STEMS
+static void free_stem_blips(nesapu_t *apu)
+{
+    for (int ch = 0; ch < NESAPU_CHANNEL_COUNT; ++ch)
+    {
+        if (apu->stem_blip[ch])
+        {
+            blip_delete(apu->stem_blip[ch]);
+            apu->stem_blip[ch] = NULL;
+        }
+    }
+}
+#endif
+
+
+void nesapu_destroy(nesapu_t *apu)
+{
+    if (apu != NULL)
+    {
+        // Free ram list
+        free_ram_list(apu);
+#if NESAPU_USE_RAM_IMAGE
+        if (apu->ram_image)
+        {
+            VGM_FREE(apu->ram_image);
+        }
+#else
+        if (apu->ram_cache)
+        {
+            VGM_FREE(apu->ram_cache);
+        }
+#endif
+        if (apu->write_queue)
+        {
+            VGM_FREE(apu->write_queue);
+        }
+#if NESAPU_USE_BLIPBUF        
+        // Free blip
+        if (apu->blip)
+        {
+            blip_delete(apu->blip);
+            apu->blip = 0;
+        }
+#if NESAPU_USE_STEMS
+        free_stem_blips(apu);
+#endif
+#endif
+        VGM_FREE(apu);
+    }
+}
+
+
+void nesapu_reset(nesapu_t* apu)
+{
+#if !NESAPU_USE_BLIPBUF
+    // samplling
+    apu->sample_accu_fp = 0;
+    apu->sample_prev = 0;
+#endif
+    // Drop queued writes
+    apu->write_count = 0;
+    apu->write_next = 0;
+    apu->write_end = 0;
+    // channel mask
+    apu->mask_pulse1 = false;
+    apu->mask_pulse2 = false;
+    apu->mask_triangle = false;
+    apu->mask_noise = false;
+    apu->mask_dmc = false;
+    // fade control
+    apu->fadeout_enabled = false;
+    apu->fadeout_period_fp = 0;
+    apu->fadeout_accu_fp = 0;
+    apu->fadeout_sequencer_value = 0;
+    // frame counter
+    apu->sequencer_step = 0;
+    apu->sequence_mode = false;
+    apu->quarter_frame = false;
+    apu->half_frame = false;
+    apu->frame_accu_fp = 0;
+    //
+    // Enable Channel NT21 on startup
+    // From: https://www.nesdev.org/wiki/Talk:NSF
+    // Regarding 4015h, well... it's empirical. My experience says that setting 4015h to 0Fh
+    // is required in order to get *a lot of* tunes starting playing. I don't remember of *any* broken
+    // tune by setting such value. So, it's recommended *to follow* such thing. --Zepper 14:25, 29 March 2012 (PDT)
+    // 
+    // Pulse1
+    apu->pulse[0].enabled = true;
+    apu->pulse[0].duty = 0;
+    apu->pulse[0].lenhalt_envloop = false;
+    apu->pulse[0].constant_volume = false;
+    apu->pulse[0].envelope_start = false;
+    apu->pulse[0].envelope_value = 0;
+    apu->pulse[0].volume_envperiod = 0;
+    apu->pulse[0].sweep_enabled = false;
+    apu->pulse[0].sweep_period = 0;
+    apu->pulse[0].sweep_value = 0;
+    apu->pulse[0].sweep_negate = false;
+    apu->pulse[0].sweep_shift = 0;
+    apu->pulse[0].sweep_target = 0;
+    apu->pulse[0].sweep_reload = false;
+    apu->pulse[0].timer_period = 0;
+    apu->pulse[0].timer_value = 0;
+    apu->pulse[0].timer_recip = timer_reciprocal(2);
+    apu->pulse[0].sequencer_value = 0;
+    apu->pulse[0].sweep_timer_mute = true;
+    // Pulse2
+    apu->pulse[1].enabled = true;
+    apu->pulse[1].duty = 0;
+    apu->pulse[1].lenhalt_envloop = false;
+    apu->pulse[1].constant_volume = false;
+    apu->pulse[1].envelope_start = false;
+    apu->pulse[1].envelope_value = 0;
+    apu->pulse[1].volume_envperiod = 0;
+    apu->pulse[1].sweep_enabled = false;
+    apu->pulse[1].sweep_period = 0;
+    apu->pulse[1].sweep_value = 0;
+    apu->pulse[1].sweep_negate = false;
+    apu->pulse[1].sweep_shift = 0;
+    apu->pulse[1].sweep_target = 0;
+    apu->pulse[1].sweep_reload = false;
+    apu->pulse[1].timer_period = 0;
+    apu->pulse[1].timer_value = 0;
+    apu->pulse[1].timer_recip = timer_reciprocal(2);
+    apu->pulse[1].sequencer_value = 0;
+    apu->pulse[1].sweep_timer_mute = true;
+    // Triangle
+    apu->triangle_enabled = true;
+    apu->triangle_length_value = 0;
+    apu->triangle_lnrctl_lenhalt = false;
+    apu->triangle_linear_period = 0;
+    apu->triangle_linear_value = 0;
+    apu->triangle_linear_reload = false;
+    apu->triangle_timer_period = 0;
+    apu->triangle_timer_period_bad = true;
+    apu->triangle_timer_value = 0;
+    apu->triangle_timer_recip = timer_reciprocal(1);
+    apu->triangle_sequencer_value = 0;
+    // Noise
+    apu->noise_enabled = true;
+    apu->noise_lenhalt_envloop = false;
+    apu->noise_constant_volume = false;
+    apu->noise_constant_volume = 0;
+    apu->noise_volume_envperiod = 0;
+    apu->noise_mode = false;
+    apu->noise_envelope_start = false;
+    apu->noise_envelope_decay = 0;
+    apu->noise_envelope_value = 0;
+    apu->noise_length_value = 0;
+    apu->noise_timer_period = 0;
+    apu->noise_timer_value = 0;
+    apu->noise_timer_recip = timer_reciprocal(1);
+    noise_set_shift_reg(apu, 1);
+    // DMC
+    apu->dmc_enabled = false;
+    apu->dmc_loop = false;
+    apu->dmc_output = 0;
+    apu->dmc_sample_addr = 0;
+    apu->dmc_sample_len = 0;
+    apu->dmc_timer_period = 0;
+    apu->dmc_timer_value = 0;
+    apu->dmc_timer_recip = timer_reciprocal(1);
+    apu->dmc_read_buffer = 0;
+    apu->dmc_read_buffer_empty = true;
+    apu->dmc_read_addr = 0;
+    apu->dmc_read_remaining = 0;
+    apu->dmc_output_shift_reg = 0;
+    apu->dmc_output_bits_remaining = 0;
+    apu->dmc_output_silence = true;
+}
+
+
+// Run all channels for cycles, output channel levels in out[] (Pulse1, Pulse2, Triangle, Noise, DMC).
+// Crosses at most one frame counter clock, which takes effect at start of the run.
+static inline void nesapu_run_span(nesapu_t *apu, unsigned int cycles, unsigned int *out)
+{
+    update_frame_counter(apu, cycles);
+    out[0] = update_pulse(apu, 0, cycles);
+    out[1] = update_pulse(apu, 1, cycles);
+    out[2] = update_triangle(apu, cycles);
+    out[3] = update_noise(apu, cycles);
+    out[4] = update_dmc(apu, cycles);
+    if (apu->mask_pulse1) out[0] = 0;
+    if (apu->mask_pulse2) out[1] = 0;
+    if (apu->mask_triangle) out[2] = 0;
+    if (apu->mask_noise) out[3] = 0;
+    if (apu->mask_dmc) out[4] = 0;
+}
+
+
+#define NESAPU_NO_EVENT 0xffffffffU
+
+
+// Apply queued writes due by time, return time of next queued write in this synthesis
+static inline unsigned int nesapu_apply_writes(nesapu_t *apu, unsigned int time)
+{
+    while (apu->write_next < apu->write_end && apu->write_queue[apu->write_next].time <= time)
+    {
+        nesapu_write_reg(apu, apu->write_queue[apu->write_next].reg, apu->write_queue[apu->write_next].val);
+        ++(apu->write_next);
+    }
+    return (apu->write_next < apu->write_end) ? apu->write_queue[apu->write_next].time : NESAPU_NO_EVENT;
+}
+
+
+// Start of synthesis of samples: writes queued in it are taken, with blip timed by clock from its start.
+// Later ones keep their sample, so they are not mistaken for clocks.
+static void nesapu_begin_writes(nesapu_t *apu, unsigned int samples)
+{
+    unsigned int i;
+    for (i = 0; i < apu->write_count && apu->write_queue[i].time <= samples; ++i)
+    {
+#if NESAPU_USE_BLIPBUF
+        apu->write_queue[i].time = (uint32_t)blip_clocks_needed(apu->blip, (int)(apu->write_queue[i].time));
+#endif
+    }
+    apu->write_end = i;
+}
+
+
+// End of synthesis of samples: apply writes due by time, later ones move to start from there
+static void nesapu_end_writes(nesapu_t *apu, unsigned int time, unsigned int samples)
+{
+    if (0 == apu->write_count) return;
+    nesapu_apply_writes(apu, time);
+    unsigned int n = apu->write_count - apu->write_next;
+    for (unsigned int i = 0; i < n; ++i)
+    {
+        apu->write_queue[i] = apu->write_queue[apu->write_next + i];
+        apu->write_queue[i].time -= samples;
+    }
+    apu->write_count = n;
+    apu->write_next = 0;
+    apu->write_end = 0;
+}
+
+
+// Run cycles in frame clock steps. Each frame counter clock takes effect one clock before its time,
+// at start of the step running to one clock before the next, so envelope, sweep and length counters
+// are clocked in order however long the run.
+static void nesapu_run_frames(nesapu_t *apu, unsigned int cycles, unsigned int *out)
+{
+    while (cycles > 0)
+    {
+        unsigned int step = next_frame_step(apu);
+        if (step > cycles) step = cycles;
+        nesapu_run_span(apu, step, out);
+        cycles -= step;
+    }
+}
+
+
+// Run all channels for cycles, output channel levels in out[]. Runs up to a frame period take the
+// frame counter clock they cross at their start, longer runs are taken in frame clock steps.
+static inline void nesapu_run(nesapu_t *apu, unsigned int cycles, unsigned int *out)
+{
+    if (cycles > (unsigned int)q16_to_int(apu->frame_period_fp))
+        nesapu_run_frames(apu, cycles, out);
+    else
+        nesapu_run_span(apu, cycles, out);
+}
+
+
+static inline q29_t nesapu_mix(const unsigned int *out)
+{
+    return mixer_pulse_table[out[0] + out[1]] + mixer_tnd_table[3 * out[2] + 2 * out[3] + out[4]];
+}
+
+
+// Advance fadeout by one sample
+static inline void nesapu_step_fade(nesapu_t *apu)
+{
+    if (apu->fadeout_sequencer_value > 0)
+    {
+         apu->fadeout_accu_fp += int_to_q16(1);
+         if (apu->fadeout_accu_fp >= apu->fadeout_period_fp)
+         {
+            apu->fadeout_accu_fp -= apu->fadeout_period_fp;
+            --(apu->fadeout_sequencer_value);
+         }
+    }
+}
+
+
+// Apply fadeout to mixer output
+static inline q29_t nesapu_fade(nesapu_t *apu, q29_t f)
+{
+    if (apu->fadeout_enabled)
+    {
+        f = q29_mul(f, fadeout_table[apu->fadeout_sequencer_value]);
+    }
+    return f;
+}
+
+
+// Apply fadeout to mixer output and convert to sample
+static inline int16_t nesapu_to_sample(nesapu_t *apu, q29_t f)
+{
+    return q29_to_sample(nesapu_fade(apu, f));
+}
+
+
+static const nesapu_output_t nesapu_output_mono16 = { NESAPU_FORMAT_S16, 1, 1 };
+
+
+#if NESAPU_USE_BLIPBUF
+
+#define NESAPU_OUTPUT_MIX   0x80    // Output bit for mixed output, NESAPU_CHANNEL_xxx bits are for stems
+
+// Add blip deltas at time for outputs which have changed
+static inline void nesapu_blip_output(nesapu_t *apu, unsigned int time, const unsigned int *out, uint8_t outputs)
+{
+    if (outputs & NESAPU_OUTPUT_MIX)
+    {
+        int16_t s = nesapu_to_sample(apu, nesapu_mix(out));
+        if (s != apu->blip_last_sample)
+        {
+            blip_add_delta(apu->blip, time, s - apu->blip_last_sample);
+            apu->blip_last_sample = s;
+        }
+    }
+#if NESAPU_USE_STEMS
+    if (outputs & NESAPU_CHANNEL_ALL)
+    {
+        // Each channel alone through its half of the mixer
+        q29_t f[NESAPU_CHANNEL_COUNT] =
+        {
+            mixer_pulse_table[out[0]],
+            mixer_pulse_table[out[1]],
+            mixer_tnd_table[3 * out[2]],
+            mixer_tnd_table[2 * out[3]],
+            mixer_tnd_table[out[4]]
+        };
+        for (int ch = 0; ch < NESAPU_CHANNEL_COUNT; ++ch)
+        {
+            if (!(outputs & (1 << ch))) continue;
+            int16_t s = nesapu_to_sample(apu, f[ch]);
+            if (s != apu->stem_last_sample[ch])
+            {
+                blip_add_delta(apu->stem_blip[ch], time, s - apu->stem_last_sample[ch]);
+                apu->stem_last_sample[ch] = s;
+            }
+        }
+    }
+#endif
+}
+
+
+#if NESAPU_USE_EVENT_SYNTH
+
+//
+// Cycles until next output change of each channel. Output only changes when channel timer clocks
+// (or at frame counter clocks, which are events by themselves), so idle spans are skipped.
+// Silent channels have no event, their timers are still run by nesapu_run().
+//
+static inline unsigned int next_pulse_event(nesapu_t *apu, int ch)
+{
+    if (!apu->pulse[ch].enabled) return NESAPU_NO_EVENT;
+    if (!apu->pulse[ch].length_value) return NESAPU_NO_EVENT;
+    if (apu->pulse[ch].sweep_timer_mute) return NESAPU_NO_EVENT;
+    if (!(apu->pulse[ch].constant_volume ? apu->pulse[ch].volume_envperiod : apu->pulse[ch].envelope_decay)) return NESAPU_NO_EVENT;
+    // Sequencer counts down, find how many sequencer clocks until duty output flips
+    const bool *wave = pulse_waveform_table[apu->pulse[ch].duty];
+    unsigned int seq = apu->pulse[ch].sequencer_value;
+    unsigned int k = 1;
+    while ((k < 8) && (wave[(seq - k) & 7] == wave[seq])) ++k;
+    return apu->pulse[ch].timer_value + 1 + (k - 1) * ((apu->pulse[ch].timer_period + 1) << 1);
+}
+
+
+static inline unsigned int next_triangle_event(nesapu_t *apu)
+{
+    if (!apu->triangle_enabled) return NESAPU_NO_EVENT;
+    if (apu->triangle_timer_period_bad) return NESAPU_NO_EVENT;
+    if (!apu->triangle_length_value) return NESAPU_NO_EVENT;
+    if (!apu->triangle_linear_value) return NESAPU_NO_EVENT;
+    return apu->triangle_timer_value + 1;
+}
+
+
+static inline unsigned int next_noise_event(nesapu_t *apu)
+{
+    if (!apu->noise_enabled) return NESAPU_NO_EVENT;
+    if (apu->noise_timer_period == 0) return NESAPU_NO_EVENT;
+    if (!apu->noise_length_value) return NESAPU_NO_EVENT;
+    if (!(apu->noise_constant_volume ? apu->noise_volume_envperiod : apu->noise_envelope_decay)) return NESAPU_NO_EVENT;
+    // Next change of bit 0 in the sequence ahead, runs are 15 clocks at most
+    unsigned int bits = noise_window(noise_bits(apu), apu->noise_index);
+    unsigned int changes = (bits ^ (bits >> 1)) & 0x7fff;
+    unsigned int k = 1;
+    while (k < 16 && !(changes & 0x01))
+    {
+        changes >>= 1;
+        ++k;
+    }
+    return apu->noise_timer_value + 1 + (k - 1) * (apu->noise_timer_period + 1);
+}
+
+
+static inline unsigned int next_dmc_event(nesapu_t *apu)
+{
+    if (!apu->dmc_enabled) return NESAPU_NO_EVENT;
+    if (apu->dmc_timer_period == 0) return NESAPU_NO_EVENT;
+    if (apu->dmc_read_addr < 0x8000) return NESAPU_NO_EVENT;
+    return apu->dmc_timer_value + 1;
+}
+
+
+// # of samples until fade volume steps down
+static inline unsigned int next_fade_event(nesapu_t *apu)
+{
+    q16_t left = apu->fadeout_period_fp - apu->fadeout_accu_fp;
+    if (left <= int_to_q16(1)) return 1;
+    return (unsigned int)((left + 0xffff) >> 16);
+}
+
+
+// Run cycles and add blip deltas for samples
+static inline void nesapu_synth(nesapu_t *apu, unsigned int cycles, unsigned int samples, uint8_t outputs)
+{
+    unsigned int out[NESAPU_CHANNEL_COUNT];
+    unsigned int time = 0;
+    // Fade volume steps every fadeout_period_fp samples, map sample position to clock
+    bool fading = apu->fadeout_enabled && (apu->fadeout_sequencer_value > 0);
+    unsigned int fade_done = 0, fade_sample = 0, fade_time = NESAPU_NO_EVENT;
+    if (fading)
+    {
+        fade_sample = next_fade_event(apu);
+        if (fade_sample < samples) fade_time = (unsigned int)((unsigned long long)fade_sample * cycles / samples);
+    }
+    // Queued writes are applied at their clock, writes at end of the span after it
+    unsigned int write_time = nesapu_apply_writes(apu, 0);
+    // First run of 0 clock picks up output change by register writes since last call
+    unsigned int step = 0, t;
+    for (;;)
+    {
+        nesapu_run(apu, step, out);
+        time += step;
+        if (time == fade_time)
+        {
+            apu->fadeout_accu_fp += int_to_q16(fade_sample - fade_done) - apu->fadeout_period_fp;
+            fade_done = fade_sample;
+            --(apu->fadeout_sequencer_value);
+            fade_time = NESAPU_NO_EVENT;
+            if (apu->fadeout_sequencer_value > 0)
+            {
+                fade_sample += next_fade_event(apu);
+                if (fade_sample < samples) fade_time = (unsigned int)((unsigned long long)fade_sample * cycles / samples);
+            }
+        }
+        nesapu_blip_output(apu, time, out, outputs);
+        if (time >= cycles) break;
+        if (time == write_time)
+        {
+            // Run of 0 clock picks up output change by the writes
+            write_time = nesapu_apply_writes(apu, time);
+            step = 0;
+            continue;
+        }
+        // Run to nearest event
+        step = cycles - time;
+        t = next_frame_event(apu); if (t < step) step = t;
+        if (!apu->mask_pulse1) { t = next_pulse_event(apu, 0); if (t < step) step = t; }
+        if (!apu->mask_pulse2) { t = next_pulse_event(apu, 1); if (t < step) step = t; }
+        if (!apu->mask_triangle) { t = next_triangle_event(apu); if (t < step) step = t; }
+        if (!apu->mask_noise) { t = next_noise_event(apu); if (t < step) step = t; }
+        if (!apu->mask_dmc) { t = next_dmc_event(apu); if (t < step) step = t; }
+        if (fade_time - time < step) step = fade_time - time;
+        if (write_time - time < step) step = write_time - time;
+    }
+    // Account fade for rest of samples, step lands on next call
+    if (fading && (apu->fadeout_sequencer_value > 0))
+    {
+        apu->fadeout_accu_fp += int_to_q16(samples - fade_done);
+        if (apu->fadeout_accu_fp >= apu->fadeout_period_fp)
+        {
+            apu->fadeout_accu_fp -= apu->fadeout_period_fp;
+            --(apu->fadeout_sequencer_value);
+        }
+    }
+}
+
+#else
+
+// Run cycles and add blip deltas for samples
+static inline void nesapu_synth(nesapu_t *apu, unsigned int cycles, unsigned int samples, uint8_t outputs)
+{
+    unsigned int out[NESAPU_CHANNEL_COUNT];
+    unsigned int period = cycles / samples; // rough sampling period. blip helps resampling
+    unsigned int time = 0;
+    // Run period clocks per sample, and remaining clocks in last one. Queued writes split a sample
+    // run at their clock, writes at end of the span are applied after it.
+    unsigned int write_time = nesapu_apply_writes(apu, 0);
+    unsigned int sample_end = (cycles > period) ? period : cycles;
+    for (;;)
+    {
+        unsigned int end = (write_time < sample_end) ? write_time : sample_end;
+        nesapu_run(apu, end - time, out);
+        time = end;
+        if (time == sample_end)
+        {
+            if (apu->fadeout_enabled) nesapu_step_fade(apu);
+            sample_end = (cycles - time > period) ? time + period : cycles;
+        }
+        nesapu_blip_output(apu, time, out, outputs);
+        if (time >= cycles) break;
+        if (time == write_time) write_time = nesapu_apply_writes(apu, time);
+    }
+}
+
+#endif
+
+
+// Synthesize samples into blip buffers, in time frames of up to blip_max_frame samples so blip clock
+// arithmetic does not overflow. stems: also end frames of stem buffers.
+static void nesapu_synth_frames(nesapu_t *apu, unsigned int samples, uint8_t outputs, bool stems)
+{
+#if !NESAPU_USE_STEMS
+    (void)stems;
+#endif
+    while (samples > 0)
+    {
+        unsigned int n = (samples > blip_max_frame) ? blip_max_frame : samples;
+        nesapu_begin_writes(apu, n);
+        unsigned int cycles = (unsigned int)blip_clocks_needed(apu->blip, (int)n);
+        nesapu_synth(apu, cycles, n, outputs);
+        nesapu_end_writes(apu, cycles, n);
+        blip_end_frame(apu->blip, cycles);
+#if NESAPU_USE_STEMS
+        for (int ch = 0; stems && ch < NESAPU_CHANNEL_COUNT; ++ch)
+        {
+            blip_end_frame(apu->stem_blip[ch], cycles);
+        }
+#endif
+        samples -= n;
+    }
+}
+
+
+void nesapu_get_samples_ex(nesapu_t *apu, void *buf, unsigned int samples, const nesapu_output_t *output)
+{
+    uint8_t *p = (uint8_t *)buf;
+    size_t step = output->stride * ((output->format == NESAPU_FORMAT_S16) ? sizeof(int16_t) : sizeof(int32_t));
+    // Requests longer than blip buffer are done in pieces
+    while (samples > 0)
+    {
+        unsigned int n = (samples > apu->max_samples) ? apu->max_samples : samples;
+        nesapu_synth_frames(apu, n, NESAPU_OUTPUT_MIX, false);
+        // NESAPU_FORMAT_xxx match blip_format_xxx
+        blip_read_samples_ex(apu->blip, p, (int)n, output->format, (int)output->stride, output->channels);
+        p += n * step;
+        samples -= n;
+    }
+}
+
+
+// Run cycles without output, frame counter clocks taken at their time as in synthesis
+static void nesapu_advance(nesapu_t *apu, unsigned int cycles)
+{
+    unsigned int out[NESAPU_CHANNEL_COUNT];
+    nesapu_run_frames(apu, cycles, out);
+}
+
+
+void nesapu_skip_samples(nesapu_t *apu, unsigned int samples)
+{
+    unsigned int frame = (apu->max_samples > blip_max_frame) ? blip_max_frame : apu->max_samples;
+    while (samples > 0)
+    {
+        unsigned int n = (samples > frame) ? frame : samples;
+        nesapu_begin_writes(apu, n);
+        unsigned int cycles = (unsigned int)blip_clocks_needed(apu->blip, (int)n);
+        unsigned int time = 0, write_time;
+        while ((write_time = nesapu_apply_writes(apu, time)) < cycles)
+        {
+            nesapu_advance(apu, write_time - time);
+            time = write_time;
+        }
+        nesapu_advance(apu, cycles - time);
+        nesapu_end_writes(apu, cycles, n);
+        if (apu->fadeout_enabled)
+        {
+            for (unsigned int i = 0; i < n; ++i) nesapu_step_fade(apu);
+        }
+        // Keep clock position, drop pending deltas. Next level change is added against blip_last_sample.
+        blip_end_frame(apu->blip, cycles);
+        blip_discard(apu->blip);
+#if NESAPU_USE_STEMS
+        for (int ch = 0; ch < NESAPU_CHANNEL_COUNT; ++ch)
+        {
+            if (apu->stem_blip[ch])
+            {
+                blip_end_frame(apu->stem_blip[ch], cycles);
+                blip_discard(apu->stem_blip[ch]);
+            }
+        }
+#endif
+        samples -= n;
+    }
+}
+
+
+#if NESAPU_USE_STEMS
+
+// Read and drop samples
+static void blip_drop_samples(blip_buffer_t *blip, int samples)
+{
+    short tmp[64];
+    int read;
+    while ((samples > 0) && (read = blip_read_samples(blip, tmp, samples > 64 ? 64 : samples, 0)) > 0)
+    {
+        samples -= read;
+    }
+}
+
+
+bool nesapu_get_stems(nesapu_t *apu, int16_t *stems[NESAPU_CHANNEL_COUNT], int16_t *mix, unsigned int samples)
+{
+    if (NULL == apu->stem_blip[0])
+    {
+        // Stem buffers are allocated on first use, starting at the clock position of mixer buffer
+        blip_state_t bs;
+        blip_save_state(apu->blip, &bs);
+        bs.integrator = 0;
+        memset(bs.buf, 0, sizeof(bs.buf));
+        for (int ch = 0; ch < NESAPU_CHANNEL_COUNT; ++ch)
+        {
+            apu->stem_blip[ch] = blip_new((int)apu->max_samples);
+            if (NULL == apu->stem_blip[ch])
+            {
+                free_stem_blips(apu);
+                return false;
+            }
+            blip_set_rates(apu->stem_blip[ch], apu->clock_rate, apu->sample_rate);
+            blip_load_state(apu->stem_blip[ch], &bs);
+            apu->stem_last_sample[ch] = 0;
+        }
+    }
+    uint8_t outputs = mix ? NESAPU_OUTPUT_MIX : 0;
+    for (int ch = 0; ch < NESAPU_CHANNEL_COUNT; ++ch)
+    {
+        if (stems[ch]) outputs |= (uint8_t)(1 << ch);
+    }
+    // All buffers are clocked the same, so they stay in step
+    for (unsigned int done = 0; done < samples; )
+    {
+        unsigned int n = (samples - done > apu->max_samples) ? apu->max_samples : samples - done;
+        nesapu_synth_frames(apu, n, outputs, true);
+        if (mix)
+            blip_read_samples(apu->blip, (short *)(mix + done), (int)n, 0);
+        else
+            blip_drop_samples(apu->blip, (int)n);
+        for (int ch = 0; ch < NESAPU_CHANNEL_COUNT; ++ch)
+        {
+            if (stems[ch])
+                blip_read_samples(apu->stem_blip[ch], (short *)(stems[ch] + done), (int)n, 0);
+            else
+                blip_drop_samples(apu->stem_blip[ch], (int)n);
+        }
+        done += n;
+    }
+    return true;
+}
+
+#endif
+
+#else
+
+void nesapu_get_samples_ex(nesapu_t *apu, void *buf, unsigned int samples, const nesapu_output_t *output)
+{
+    int32_t x, s;
+    unsigned int out[NESAPU_CHANNEL_COUNT];
+    uint8_t *p = (uint8_t *)buf;
+    size_t step = output->stride * ((output->format == NESAPU_FORMAT_S16) ? sizeof(int16_t) : sizeof(int32_t));
+    // Queued writes are timed by sample, applied before its run
+    nesapu_begin_writes(apu, samples);
+    unsigned int write_time = apu->write_end ? 0 : NESAPU_NO_EVENT;
+    for (unsigned int i = 0; i < samples; ++i)
+    {
+        if (i == write_time) write_time = nesapu_apply_writes(apu, i);
+        apu->sample_accu_fp += apu->sample_period_fp;
+        unsigned int cycles = (unsigned int)(q16_to_int(apu->sample_accu_fp));
+        nesapu_run(apu, cycles, out);
+        if (apu->fadeout_enabled) nesapu_step_fade(apu);
+        // q29 sample centered on 0, q29_to_sample() is x >> 13
+        x = nesapu_fade(apu, nesapu_mix(out)) - 268435456;
+        // simple weighted filter, int16 output filters the 16-bit samples as before
+        switch (output->format)
+        {
+        case NESAPU_FORMAT_S32:
+            s = ((x + x + x + apu->sample_prev) >> 2) * 8;
+            for (unsigned int c = 0; c < output->channels; ++c) ((int32_t *)p)[c] = s;
+            break;
+        case NESAPU_FORMAT_F32:
+            s = (x + x + x + apu->sample_prev) >> 2;
+            for (unsigned int c = 0; c < output->channels; ++c) ((float *)p)[c] = (float)s * (1.0f / 268435456.0f);
+            break;
+        default:
+            s = ((x >> 13) * 3 + (apu->sample_prev >> 13)) >> 2;
+            for (unsigned int c = 0; c < output->channels; ++c) ((int16_t *)p)[c] = (int16_t)s;
+            break;
+        }
+        apu->sample_prev = x;
+        p += step;
+        apu->sample_accu_fp -= int_to_q16(cycles);
+    }
+    nesapu_end_writes(apu, samples, samples);
+}
+
+
+void nesapu_skip_samples(nesapu_t *apu, unsigned int samples)
+{
+    unsigned int out[NESAPU_CHANNEL_COUNT];
+    if (0 == samples) return;
+    // Same runs as nesapu_get_samples_ex(), without mixing and filtering
+    nesapu_begin_writes(apu, samples);
+    unsigned int write_time = apu->write_end ? 0 : NESAPU_NO_EVENT;
+    for (unsigned int i = 0; i < samples; ++i)
+    {
+        if (i == write_time) write_time = nesapu_apply_writes(apu, i);
+        apu->sample_accu_fp += apu->sample_period_fp;
+        unsigned int cycles = (unsigned int)(q16_to_int(apu->sample_accu_fp));
+        nesapu_run(apu, cycles, out);
+        if (apu->fadeout_enabled) nesapu_step_fade(apu);
+        apu->sample_accu_fp -= int_to_q16(cycles);
+    }
+    nesapu_end_writes(apu, samples, samples);
+    // Output filter continues from last skipped sample
+    apu->sample_prev = nesapu_fade(apu, nesapu_mix(out)) - 268435456;
+}
+
+#endif
+
+
+void nesapu_get_samples(nesapu_t *apu, int16_t *buf, unsigned int samples)
+{
+    nesapu_get_samples_ex(apu, buf, samples, &nesapu_output_mono16);
+}
+
+
+bool nesapu_queue_write(nesapu_t *apu, unsigned int sample, uint16_t reg, uint8_t val)
+{
+    if (0 == sample && 0 == apu->write_count)
+    {
+        nesapu_write_reg(apu, reg, val);
+        return true;
+    }
+#if NESAPU_WRITE_QUEUE_SIZE > 0
+    if (NULL == apu->write_queue || apu->write_count == NESAPU_WRITE_QUEUE_SIZE || sample > apu->max_samples)
+        return false;
+    nesapu_write_t *w = &(apu->write_queue[apu->write_count]);
+    // Synthesis times it by clock when it gets to the blip frame of the sample
+    w->time = sample;
+    w->reg = reg;
+    w->val = val;
+    ++(apu->write_count);
+    return true;
+#else
+    return false;
+#endif
+}
+
+
+void nesapu_write_reg(nesapu_t *apu, uint16_t reg, uint8_t val)
+{
+    switch (reg)
+    {
+    // Pulse1 regs
+    case 0x00:  // $4000: DDLC VVVV, Duty (D), envelope loop / length counter halt (L), constant volume (C), volume/envelope (V)
+        apu->pulse[0].duty = (val & 0xc0) >> 6;         // Duty (DD), index to tbl_pulse_waveform
+        apu->pulse[0].lenhalt_envloop = (val & 0x20);     // Length counter halt or Envelope loop (L)
+        apu->pulse[0].constant_volume = (val & 0x10);   // Constant volume (true) or Envelope enable (false) (C)
+        apu->pulse[0].volume_envperiod = (val & 0xf);    // Volume or period of envelope (VVVV)
+        break;
+    case 0x01:  // $4001: EPPP NSSS, Sweep unit: enabled (E), period (P), negate (N), shift (S)
+        apu->pulse[0].sweep_enabled = (val & 0x80);     // Sweep enable (E)
+        apu->pulse[0].sweep_period = (val & 0x70) >> 4; // Sweep period (PPP)
+        apu->pulse[0].sweep_negate = (val & 0x08);      // Sweep negate (N)
+        apu->pulse[0].sweep_shift = val & 0x07;         // Sweep shift (SSS)
+        apu->pulse[0].sweep_reload = true;              // Side effects : Sets reload flag 
+        break;
+    case 0x02:  // $4002: LLLL LLLL, Timer low (T)
+        apu->pulse[0].timer_period &= 0xff00;
+        apu->pulse[0].timer_period |= val;                          // Pulse1 timer period low (TTTT TTTT)
+        apu->pulse[0].sweep_target = apu->pulse[0].timer_period;    // Whenever the current period changes, the target period also changes
+        apu->pulse[0].timer_recip = timer_reciprocal((apu->pulse[0].timer_period + 1) << 1);
+        apu->pulse[0].sweep_timer_mute = ((apu->pulse[0].timer_period < 8) || (apu->pulse[0].sweep_target > 0x7ff));
+        break;
+    case 0x03:  // $4003: llll lHHH, Length counter load (L), timer high (T)
+        apu->pulse[0].length_value = length_counter_table[(val & 0xf8) >> 3]; // Length counter load (lllll) 
+        apu->pulse[0].timer_period &= 0x00ff;
+        apu->pulse[0].timer_period |= ((unsigned int)(val & 0x07)) << 8;        // Pulse1 timer period high 3 bits (TTT)
+        apu->pulse[0].sweep_target = apu->pulse[0].timer_period;    // Whenever the current period changes, the target period also changes
+        apu->pulse[0].timer_recip = timer_reciprocal((apu->pulse[0].timer_period + 1) << 1);
+        apu->pulse[0].sweep_timer_mute = ((apu->pulse[0].timer_period < 8) || (apu->pulse[0].sweep_target > 0x7ff));
+        // Side effects : The sequencer is immediately restarted at the first value of the current sequence. 
+        // The envelope is also restarted. The period divider is not reset.
+        apu->pulse[0].envelope_start = true;
+        apu->pulse[0].sequencer_value = 0;
+        break;
+    // Pulse2
+    case 0x04:  // $4004: DDLC VVVV, Duty (D), envelope loop / length counter halt (L), constant volume (C), volume/envelope (V)
+        apu->pulse[1].duty = (val & 0xc0) >> 6;               // Duty (DD), index to tbl_pulse_waveform
+        apu->pulse[1].lenhalt_envloop = (val & 0x20);         // Length counter halt or Envelope loop (L)
+        apu->pulse[1].constant_volume = (val & 0x10);         // Constant volume (true) or Envelope enable (false) (C)
+        apu->pulse[1].volume_envperiod = (val & 0xf);         // Volume or period of envelope (VVVV)
+        break;
+    case 0x05:  // $4005: EPPP NSSS, Sweep unit: enabled (E), period (P), negate (N), shift (S)
+        apu->pulse[1].sweep_enabled = (val & 0x80);           // Sweep enable (E)
+        apu->pulse[1].sweep_period = (val & 0x70) >> 4;       // Sweep period (PPP)
+        apu->pulse[1].sweep_negate = (val & 0x08);            // Sweep negate (N)
+        apu->pulse[1].sweep_shift = val & 0x07;               // Sweep shift (SSS)
+        apu->pulse[1].sweep_reload = true;                    // Side effects : Sets reload flag 
+        break;
+    case 0x06:  // $4006: LLLL LLLL, Timer low (T)
+        apu->pulse[1].timer_period &= 0xff00;
+        apu->pulse[1].timer_period |= val;                          // Pulse2 timer period low (TTTT TTTT)
+        apu->pulse[1].sweep_target = apu->pulse[1].timer_period;    // Whenever the current period changes, the target period also changes
+        apu->pulse[1].timer_recip = timer_reciprocal((apu->pulse[1].timer_period + 1) << 1);
+        apu->pulse[1].sweep_timer_mute = ((apu->pulse[1].timer_period < 8) || (apu->pulse[1].sweep_target > 0x7ff));
+        break;
+    case 0x07:  // $4007: llll lHHH, Length counter load (L), timer high (T)
+        apu->pulse[1].length_value = length_counter_table[(val & 0xf8) >> 3];   // Length counter load (lllll) 
+        apu->pulse[1].timer_period &= 0x00ff;
+        apu->pulse[1].timer_period |= ((unsigned int)(val & 0x07)) << 8;          // Pulse2 timer period high 3 bits (TTT)
+        apu->pulse[1].sweep_target = apu->pulse[1].timer_period;    // Whenever the current period changes, the target period also changes
+        apu->pulse[1].timer_recip = timer_reciprocal((apu->pulse[1].timer_period + 1) << 1);
+        apu->pulse[1].sweep_timer_mute = ((apu->pulse[1].timer_period < 8) || (apu->pulse[1].sweep_target > 0x7ff));
+        // Side effects : The sequencer is immediately restarted at the first value of the current sequence. 
+        // The envelope is also restarted. The period divider is not reset.
+        apu->pulse[1].envelope_start = true;
+        apu->pulse[1].sequencer_value = 0;
+        break;
+    // Triangle
+    case 0x08:  // $4008: CRRR RRRR, Linear counter setup
+        apu->triangle_lnrctl_lenhalt = (val & 0x80);    // Control flag / length counter halt
+        apu->triangle_linear_period = (val & 0x7f);     // Linear counter reload value 
+        break;
+    case 0x09:  // Not used
+        break;
+    case 0x0a:  // $400A: LLLL LLLL, Timer low (write) 
+        apu->triangle_timer_period &= 0xff00;
+        apu->triangle_timer_period |= val;  // Timer low (LLLL LLLL)
+        apu->triangle_timer_period_bad = ((apu->triangle_timer_period >= 0x7fe) || (apu->triangle_timer_period <= 1));
+        apu->triangle_timer_recip = timer_reciprocal(apu->triangle_timer_period + 1);
+        break;
+    case 0x0b:  // $400B: llll lHHH, Length counter load and timer high
+        apu->triangle_timer_period &= 0x00ff;
+        apu->triangle_timer_period |= ((unsigned int)(val & 0x07)) << 8;        // Timer period high (HHH)
+        apu->triangle_timer_period_bad = ((apu->triangle_timer_period >= 0x7fe) || (apu->triangle_timer_period <= 1));
+        apu->triangle_timer_recip = timer_reciprocal(apu->triangle_timer_period + 1);
+        apu->triangle_length_value = length_counter_table[(val & 0xf8) >> 3]; // Length counter load (lllll)
+        apu->triangle_linear_reload = true;  // site effect: sets the linear counter reload flag 
+        //apu->triangle_timer_value = apu->triangle_timer_period;
+        break;
+    // Noise
+    case 0x0c:  // $400C: --LC VVVV, Length counter halt, constant volume/envelope flag, and volume/envelope divider period
+        apu->noise_lenhalt_envloop = (val & 0x20);      // Envelope loop/length counter halt (L)
+        apu->noise_constant_volume = (val & 0x10);      // Constant volume (C)
+        apu->noise_volume_envperiod = (val & 0x0f);     // Volume / Envelope period (VVVV)
+        break;
+    case 0x0d:  // Not used
+        break;
+    case 0x0e:  // $400E: M--- PPPP, Mode and period
+        if ((bool)(val & 0x80) != apu->noise_mode)
+        {
+            // Register carries on in the sequence of the other mode
+            uint16_t reg = noise_shift_reg(apu);
+            apu->noise_mode = (val & 0x80); // Mode Flag (M)
+            noise_set_shift_reg(apu, reg);
+        }
+        if (apu->format)    // PAL
+        {
+            apu->noise_timer_period = noise_timer_period_pal[val & 0x0f];   // Noise period (PPPP) 
+        }
+        else
+        {
+            apu->noise_timer_period = noise_timer_period_ntsc[val & 0x0f];  // Noise period (PPPP)
+        }
+        apu->noise_timer_recip = timer_reciprocal(apu->noise_timer_period + 1);
+        break;
+    case 0x0f:  // $400F: llll l---, Length counter load and envelope restart 
+        apu->noise_length_value = length_counter_table[(val & 0xf8) >> 3];  // Length counter value (lllll)
+        apu->noise_envelope_start = true;   //Side effects: Sets start flag
+        break;
+    // DMC
+    case 0x10:  // $4010: IL-- RRRR, Flags and Rate
+        apu->dmc_loop = (val & 0x40);   // Loop flag (L)
+        if (apu->format)
+        {
+            apu->dmc_timer_period = dmc_timer_period_ntsc[val & 0x0f];  // Rate index (RRRR)
+        }
+        else
+        {
+            apu->dmc_timer_period = dmc_timer_period_pal[val & 0x0f];  // Rate index (RRRR)
+        }
+        apu->dmc_timer_recip = timer_reciprocal(apu->dmc_timer_period + 1);
+        break;
+    case 0x11:  // $4011: -DDD DDDD, Direct load
+        apu->dmc_output = val & 0x7f;   // Direct load (DDD DDDD)
+        break;
+    case 0x12:  // $4012: AAAA AAAA, Sample address
+        apu->dmc_sample_addr = (uint16_t)(0xc000 + ((uint16_t)val << 6)); // Sample address = %11AAAAAA.AA000000 = $C000 + (A * 64)
+        break;
+    case 0x13:  // $4013: LLLL LLLL, Sample length
+        apu->dmc_sample_len = (uint16_t)(((uint16_t)val << 4) + 1); // Sample length = %LLLL.LLLL0001 = (L * 16) + 1 bytes
+        break;
+    // Status
+    case 0x15:  // $4015: ---D NT21, Enable DMC (D), noise (N), triangle (T), and pulse channels (2/1)
+        if (val & 0x01)
+        {
+            apu->pulse[0].enabled = true;
+        }
+        else
+        {
+            // Writing a zero to any of the channel enable bits will silence that channel and immediately set its length counter to 0.
+            apu->pulse[0].enabled = false;
+            apu->pulse[0].length_value = 0;
+        }
+        if (val & 0x02)
+        {
+            apu->pulse[1].enabled = true;
+        }
+        else
+        {
+            // Writing a zero to any of the channel enable bits will silence that channel and immediately set its length counter to 0.
+            apu->pulse[1].enabled = false;
+            apu->pulse[1].length_value = 0;
+        }
+        if (val & 0x04)
+        {
+            apu->triangle_enabled = true;
+        }
+        else
+        {
+            apu->triangle_enabled = false;
+            apu->triangle_length_value = 0;
+        }
+        if (val & 0x08)
+        {
+            apu->noise_enabled = true;
+        }
+        else
+        {
+            // Writing a zero to any of the channel enable bits will silence that channel and immediately set its length counter to 0.
+            apu->noise_enabled = false;
+            apu->noise_length_value = 0;
+        }
+        if (val & 0x10)
+        {
+            apu->dmc_enabled = true;
+            // If the DMC bit is set, the DMC sample will be restarted only if its bytes remaining is 0.
+            if (0 == apu->dmc_read_remaining)
+            {
+                apu->dmc_read_addr = apu->dmc_sample_addr;
+                apu->dmc_read_remaining = apu->dmc_sample_len;
+                if (!apu->dmc_output_shift_reg) 
+                {
+                    dmc_transfer(apu);
+                }
+            }
+            else
+            {
+                // If there are bits remaining in the 1-byte sample buffer, these will finish playing before the next sample is fetched.
+            }
+        }
+        else
+        {
+            apu->dmc_enabled = false;
+            // If the DMC bit is clear, the DMC bytes remaining will be set to 0 and the DMC will silence when it empties
+            apu->dmc_read_remaining = 0;
+        }
+        break;
+    // Frame counter
+    case 0x17:  // $4017:
+        apu->sequence_mode = (val & 0x80);
+        apu->sequencer_step = 0;
+        apu->frame_accu_fp = 0;
+        // TODO: Needs test
+        // Writing to $4017 with bit 7 set ($80) will immediately clock all of its controlled units at the beginning of the 5-step sequence;
+        // with bit 7 clear, only the sequence is reset without clocking any of its units. 
+        if (apu->sequence_mode)
+        {
+            apu->frame_force_clock = true;
+        }
+        else
+        {
+            apu->frame_force_clock = false;
+        }
+        break;
+    }
+}
+
+
+#if NESAPU_USE_RAM_IMAGE
+// Copy the part of ram block within $8000-$FFFF into image. return false if it cannot be read.
+static bool ram_image_copy(nesapu_t *apu, const nesapu_ram_t *ram)
+{
+    uint32_t from = ram->addr, to = (uint32_t)ram->addr + ram->len;
+    if (from < NESAPU_RAM_IMAGE_BASE) from = NESAPU_RAM_IMAGE_BASE;
+    if (to > NESAPU_RAM_IMAGE_BASE + NESAPU_RAM_IMAGE_SIZE) to = NESAPU_RAM_IMAGE_BASE + NESAPU_RAM_IMAGE_SIZE;
+    if (from >= to) return true;
+    size_t len = to - from;
+    return (apu->reader->read(apu->reader, apu->ram_image + (from - NESAPU_RAM_IMAGE_BASE),
+                              ram->offset + (from - ram->addr), len) == len);
+}
+
+
+static nesapu_ram_t * ram_list_reverse(nesapu_ram_t *list)
+{
+    nesapu_ram_t *prev = NULL;
+    while (list)
+    {
+        nesapu_ram_t *next = list->next;
+        list->next = prev;
+        prev = list;
+        list = next;
+    }
+    return prev;
+}
+
+
+// Copy ram blocks into cleared image oldest first, so newer blocks overwrite the ones they overlap
+static void ram_image_rebuild(nesapu_t *apu)
+{
+    memset(apu->ram_image, 0, NESAPU_RAM_IMAGE_SIZE);
+    apu->ram_list = ram_list_reverse(apu->ram_list);
+    for (nesapu_ram_t *ram = apu->ram_list; ram; ram = ram->next)
+    {
+        ram_image_copy(apu, ram);
+    }
+    apu->ram_list = ram_list_reverse(apu->ram_list);
+}
+#endif
+
+
+void nesapu_add_ram(nesapu_t *apu, size_t offset, uint16_t addr, uint16_t len)
+{
+    if (len == 0)
+        return;
+    // Same block again: data is the same, only needs to be newest over blocks overlapping it
+    nesapu_ram_t **link = &(apu->ram_list);
+    bool shadowed = false;
+    for (nesapu_ram_t *ram = apu->ram_list; ram; link = &(ram->next), ram = ram->next)
+    {
+        if (ram->offset == offset && ram->addr == addr && ram->len == len)
+        {
+            if (shadowed)
+            {
+                *link = ram->next;
+                ram->next = apu->ram_list;
+                apu->ram_list = ram;
+#if NESAPU_USE_RAM_IMAGE
+                // Overwrite newer blocks in place
+                if (apu->ram_image)
+                    ram_image_copy(apu, ram);
+#else
+                // Active block is looked up first, it may be the one overlapping
+                if (apu->ram_active && apu->ram_active != ram)
+                {
+                    apu->ram_active->cache = NULL;
+                    apu->ram_active->cache_addr = 0;
+                    apu->ram_active->cache_len = 0;
+                    apu->ram_active = NULL;
+                }
+#endif
+            }
+            return;
+        }
+        if ((addr < ram->addr + ram->len) && (ram->addr < addr + len))
+            shadowed = true;
+    }
+#if NESAPU_USE_RAM_IMAGE
+    // Allocate image if not already allocated, bytes no block covers read 0
+    if (!apu->ram_image)
+    {
+        apu->ram_image = (uint8_t *)VGM_MALLOC(NESAPU_RAM_IMAGE_SIZE);
+        if (apu->ram_image)
+            memset(apu->ram_image, 0, NESAPU_RAM_IMAGE_SIZE);
+    }
+    if (apu->ram_image)
+    {
+        nesapu_ram_t *ram = (nesapu_ram_t *)VGM_MALLOC(sizeof(nesapu_ram_t));
+        if (ram)
+        {
+            memset(ram, 0, sizeof(nesapu_ram_t));
+            ram->offset = offset;
+            ram->addr = addr;
+            ram->len = len;
+            if (ram_image_copy(apu, ram))
+            {
+                ram->serial = apu->ram_serial++;
+                ram->next = apu->ram_list;
+                apu->ram_list = ram;
+                ++apu->ram_count;
+            }
+            else
+            {
+                VGM_FREE(ram);
+            }
+        }
+    }
+#else
+#if VGM_READER_BORROW
+    // Borrowed block needs no cache
+    if (apu->reader->borrow)
+    {
+        const uint8_t *data = apu->reader->borrow(apu->reader, offset, len);
+        if (data)
+        {
+            nesapu_ram_t *ram = (nesapu_ram_t *)VGM_MALLOC(sizeof(nesapu_ram_t));
+            if (ram)
+            {
+                memset(ram, 0, sizeof(nesapu_ram_t));
+                ram->offset = offset;
+                ram->addr = addr;
+                ram->len = len;
+                ram->data = data;
+                ram->serial = apu->ram_serial++;
+                ram->next = apu->ram_list;
+                apu->ram_list = ram;
+                ++apu->ram_count;
+            }
+            return;
+        }
+    }
+#endif
+    // We only have one ram cache. If it is used by other ram block, remove it.
+    if (apu->ram_active)
+    {
+        apu->ram_active->cache = NULL;
+        apu->ram_active->cache_addr = 0;
+        apu->ram_active->cache_len = 0;
+    }
+    // Allocate cache if not already allocated
+    if (!apu->ram_cache)
+    {
+        apu->ram_cache = (uint8_t *)VGM_MALLOC(NESAPU_RAM_CACHE_SIZE);
+    }
+    if (apu->ram_cache)
+    {
+        // Allocate new ram structure and read first cache
+        nesapu_ram_t *ram = (nesapu_ram_t *)VGM_MALLOC(sizeof(nesapu_ram_t));
+        if (ram)
+        {
+            memset(ram, 0, sizeof(nesapu_ram_t));
+            ram->offset = offset;
+            ram->addr = addr;
+            ram->len = len;
+            ram->serial = apu->ram_serial;
+            uint16_t toread = len > NESAPU_RAM_CACHE_SIZE ? NESAPU_RAM_CACHE_SIZE : len;
+            if (apu->reader->read(apu->reader, apu->ram_cache, offset, toread) == toread)
+            {
+                ram->cache = apu->ram_cache;
+                ram->cache_addr = addr;
+                ram->cache_len = toread;
+            }
+            else
+            {
+                VGM_FREE(ram);
+                ram = NULL;
+            }
+        }
+        if (ram)
+        {
+            // Insert into ram list
+            ram->next = apu->ram_list;
+            apu->ram_list = ram;
+            apu->ram_active = ram;
+            ++apu->ram_count;
+            ++apu->ram_serial;
+        }
+    }
+#endif
+    // If anything error (out of memory, cannt read file, etc), just treat the ram does not exist. Music still plays
+    // only DMC channel cannot output sample.
+}
+
+
+uint8_t nesapu_read_ram(nesapu_t *apu, uint16_t addr)
+{
+#if NESAPU_USE_RAM_IMAGE
+    if (addr < NESAPU_RAM_IMAGE_BASE || !apu->ram_image)
+        return 0;
+    return apu->ram_image[addr - NESAPU_RAM_IMAGE_BASE];
+#else
+    // 1. Find which ram block is responsible for the address
+    nesapu_ram_t *ram = NULL;
+    do
+    {
+        ram = apu->ram_active;
+        if (ram)
+        {
+            if ((addr >= ram->addr) && (addr < ram->addr + ram->len))
+                break;
+        }
+        ram = apu->ram_list;
+        while (ram)
+        {
+            if ((addr >= ram->addr) && (addr < ram->addr + ram->len))
+                break;
+            ram = ram->next;
+        }
+    } while (0);
+    if (!ram)
+    {
+        VGM_PRINTDBG("APU: RAM read at 0x%04x not found\n", addr);
+        return 0;
+    }
+#if VGM_READER_BORROW
+    if (ram->data)
+    {
+        return ram->data[addr - ram->addr];
+    }
+#endif
+    // 2. Test if we need to refetch ram
+    bool refetch = true;
+    if (ram == apu->ram_active)
+    {
+        // If read from active ram, check cache range
+        if ((addr >= ram->cache_addr) && (addr < ram->cache_addr + ram->cache_len))
+            refetch = false;
+    }
+    else
+    {
+        // If not read from active ram, switch active ram
+        if (apu->ram_active)
+        {
+            apu->ram_active->cache = NULL;
+            apu->ram_active->cache_addr = 0;
+            apu->ram_active->cache_len = 0;
+        }
+        apu->ram_active = ram;
+    }
+    // 3. Refetch
+    if (refetch)
+    {
+        size_t offset = ram->offset + addr - ram->addr;
+        uint16_t avail = (uint16_t)(ram->addr + ram->len - addr);
+        uint16_t toread = avail > NESAPU_RAM_CACHE_SIZE ? NESAPU_RAM_CACHE_SIZE : avail;
+        if (apu->reader->read(apu->reader, apu->ram_cache, offset, toread) == toread)
+        {
+            ram->cache = apu->ram_cache;
+            ram->cache_addr = addr;
+            ram->cache_len = toread;
+        }
+        else
+        {
+            ram->cache = NULL;
+            ram->cache_addr = 0;
+            ram->cache_len = 0;
+        }
+    }
+    // 4. Read
+    uint8_t read = ram->cache ? ram->cache[addr - ram->cache_addr] : 0;
+    return read;
+#endif
+}
+
+
+uint8_t nesapu_audible_channels(nesapu_t *apu)
+{
+    uint8_t mask = NESAPU_CHANNEL_NONE;
+    for (int ch = 0; ch < 2; ++ch)
+    {
+        // Decayed envelope comes back only if looping
+        if (apu->pulse[ch].enabled && apu->pulse[ch].length_value && !apu->pulse[ch].sweep_timer_mute &&
+            (apu->pulse[ch].constant_volume ? apu->pulse[ch].volume_envperiod :
+             (apu->pulse[ch].envelope_decay || apu->pulse[ch].envelope_start || apu->pulse[ch].lenhalt_envloop)))
+        {
+            mask |= (uint8_t)(NESAPU_CHANNEL_PULSE1 << ch);
+        }
+    }
+    // Stopped triangle holds its level, which is not heard
+    if (apu->triangle_enabled && !apu->triangle_timer_period_bad && apu->triangle_length_value &&
+        (apu->triangle_linear_value || apu->triangle_linear_reload))
+    {
+        mask |= NESAPU_CHANNEL_TRIANGLE;
+    }
+    if (apu->noise_enabled && apu->noise_timer_period && apu->noise_length_value &&
+        (apu->noise_constant_volume ? apu->noise_volume_envperiod :
+         (apu->noise_envelope_decay || apu->noise_envelope_start || apu->noise_lenhalt_envloop)))
+    {
+        mask |= NESAPU_CHANNEL_NOISE;
+    }
+    // DMC is heard while it plays sample bits
+    if (apu->dmc_enabled && apu->dmc_timer_period && apu->dmc_read_addr >= 0x8000 &&
+        (apu->dmc_read_remaining || !apu->dmc_read_buffer_empty || !apu->dmc_output_silence))
+    {
+        mask |= NESAPU_CHANNEL_DMC;
+    }
+    if (apu->mask_pulse1) mask &= (uint8_t)~NESAPU_CHANNEL_PULSE1;
+    if (apu->mask_pulse2) mask &= (uint8_t)~NESAPU_CHANNEL_PULSE2;
+    if (apu->mask_triangle) mask &= (uint8_t)~NESAPU_CHANNEL_TRIANGLE;
+    if (apu->mask_noise) mask &= (uint8_t)~NESAPU_CHANNEL_NOISE;
+    if (apu->mask_dmc) mask &= (uint8_t)~NESAPU_CHANNEL_DMC;
+    return mask;
+}
+
+
+void nesapu_enable_fade(nesapu_t *apu, unsigned int samples)
+{
+    if (apu->fadeout_enabled) return;
+    apu->fadeout_sequencer_value = NESAPU_FADE_STEPS - 1;
+    // We want to decrease fadeout_sequencer_value to 0 in the next samples
+    apu->fadeout_period_fp = float_to_q16((float)samples / NESAPU_FADE_STEPS);
+    apu->fadeout_accu_fp = 0;
+    apu->fadeout_enabled = true;
+}
+
+
+void nesapu_enable_channel(nesapu_t *apu, uint8_t mask, bool enable)
+{
+    if (mask & NESAPU_CHANNEL_PULSE1) apu->mask_pulse1 = !enable;
+    if (mask & NESAPU_CHANNEL_PULSE2) apu->mask_pulse2 = !enable;
+    if (mask & NESAPU_CHANNEL_TRIANGLE) apu->mask_triangle = !enable;
+    if (mask & NESAPU_CHANNEL_NOISE) apu->mask_noise = !enable;
+    if (mask & NESAPU_CHANNEL_DMC) apu->mask_dmc = !enable;
+}
+
+
+void nesapu_save_snapshot(nesapu_t *apu, nesapu_snapshot_t *snap)
+{
+    memcpy(&(snap->apu), apu, sizeof(nesapu_t));
+#if NESAPU_USE_BLIPBUF
+    blip_save_state(apu->blip, &(snap->blip));
+#endif
+    snap->ram_serial = apu->ram_serial;
+}
+
+
+void nesapu_load_snapshot(nesapu_t *apu, const nesapu_snapshot_t *snap)
+{
+    nesapu_t temp;
+    memcpy(&temp, apu, sizeof(nesapu_t));
+    memcpy(apu, &(snap->apu), sizeof(nesapu_t));
+    // Keep resources and user settings of this APU
+    apu->reader = temp.reader;
+    apu->max_samples = temp.max_samples;
+#if NESAPU_USE_BLIPBUF
+    apu->blip = temp.blip;
+    blip_load_state(apu->blip, &(snap->blip));
+#if NESAPU_USE_STEMS
+    memcpy(apu->stem_blip, temp.stem_blip, sizeof(apu->stem_blip));
+    memcpy(apu->stem_last_sample, temp.stem_last_sample, sizeof(apu->stem_last_sample));
+#endif
+#endif
+    apu->ram_list = temp.ram_list;
+#if NESAPU_USE_RAM_IMAGE
+    apu->ram_image = temp.ram_image;
+#else
+    apu->ram_cache = temp.ram_cache;
+#endif
+    apu->ram_count = temp.ram_count;
+    apu->write_queue = temp.write_queue;
+    apu->write_count = 0;
+    apu->write_next = 0;
+    apu->write_end = 0;
+    apu->mask_pulse1 = temp.mask_pulse1;
+    apu->mask_pulse2 = temp.mask_pulse2;
+    apu->mask_triangle = temp.mask_triangle;
+    apu->mask_noise = temp.mask_noise;
+    apu->mask_dmc = temp.mask_dmc;
+    // Drop ram blocks first added after snapshot. They are added again when VGM data is replayed.
+    // Blocks added again after snapshot keep their newer place in the list.
+    nesapu_ram_t **link = &(apu->ram_list);
+    while (*link)
+    {
+        nesapu_ram_t *ram = *link;
+        if (ram->serial >= snap->ram_serial)
+        {
+            *link = ram->next;
+            --apu->ram_count;
+            VGM_FREE(ram);
+        }
+        else
+        {
+            link = &(ram->next);
+        }
+    }
+#if NESAPU_USE_RAM_IMAGE
+    // Image may hold blocks dropped or moved since
+    if (apu->ram_image)
+        ram_image_rebuild(apu);
+#else
+    // Cache is refetched on next read
+    for (nesapu_ram_t *ram = apu->ram_list; ram; ram = ram->next)
+    {
+        ram->cache = NULL;
+        ram->cache_addr = 0;
+        ram->cache_len = 0;
+    }
+    apu->ram_active = NULL;
+#endif
+}
+
+
+//
+// State save/load
+// Values are stored little endian with fixed width, so state can be loaded by another process or machine
+//
+#define NESAPU_STATE_MAGIC      0x5350414e  // "NAPS"
+#define NESAPU_STATE_RAM_SIZE   8           // offset (4), addr (2), len (2)
+
+typedef struct state_io_s
+{
+    uint8_t       *out;     // Save: output buffer, NULL to calculate size only
+    const uint8_t *in;      // Load: input buffer
+    size_t        size;     // Buffer size
+    size_t        pos;      // Current position, may go beyond size
+} state_io_t;
+
+
+static uint32_t state_io(state_io_t *io, uint32_t val, unsigned int bytes)
+{
+    if (io->in)
+    {
+        val = 0;
+        if (io->pos + bytes <= io->size)
+        {
+            for (unsigned int i = 0; i < bytes; ++i)
+                val |= (uint32_t)(io->in[io->pos + i]) << (i * 8);
+        }
+    }
+    else if (io->out && io->pos + bytes <= io->size)
+    {
+        for (unsigned int i = 0; i < bytes; ++i)
+            io->out[io->pos + i] = (uint8_t)(val >> (i * 8));
+    }
+    io->pos += bytes;
+    return val;
+}
+
+// Save or load field x using n bytes
+#define STATE_IO(io, x, n) ((x) = state_io((io), (uint32_t)(x), (n)))
+
+
+// Save or load all channel, frame counter, DMC, mask and fade fields
+static void state_io_fields(state_io_t *io, nesapu_t *apu)
+{
+#if NESAPU_USE_BLIPBUF
+    STATE_IO(io, apu->blip_last_sample, 2);
+#else
+    STATE_IO(io, apu->sample_accu_fp, 4);
+    STATE_IO(io, apu->sample_prev, 4);
+#endif
+    // frame counter
+    STATE_IO(io, apu->sequencer_step, 1);
+    STATE_IO(io, apu->sequence_mode, 1);
+    STATE_IO(io, apu->quarter_frame, 1);
+    STATE_IO(io, apu->half_frame, 1);
+    STATE_IO(io, apu->frame_force_clock, 1);
+    STATE_IO(io, apu->frame_accu_fp, 4);
+    // pulse
+    for (int ch = 0; ch < 2; ++ch)
+    {
+        STATE_IO(io, apu->pulse[ch].enabled, 1);
+        STATE_IO(io, apu->pulse[ch].duty, 1);
+        STATE_IO(io, apu->pulse[ch].length_value, 1);
+        STATE_IO(io, apu->pulse[ch].lenhalt_envloop, 1);
+        STATE_IO(io, apu->pulse[ch].constant_volume, 1);
+        STATE_IO(io, apu->pulse[ch].envelope_start, 1);
+        STATE_IO(io, apu->pulse[ch].envelope_decay, 1);
+        STATE_IO(io, apu->pulse[ch].envelope_value, 1);
+        STATE_IO(io, apu->pulse[ch].volume_envperiod, 1);
+        STATE_IO(io, apu->pulse[ch].sweep_enabled, 1);
+        STATE_IO(io, apu->pulse[ch].sweep_period, 1);
+        STATE_IO(io, apu->pulse[ch].sweep_value, 1);
+        STATE_IO(io, apu->pulse[ch].sweep_negate, 1);
+        STATE_IO(io, apu->pulse[ch].sweep_shift, 1);
+        STATE_IO(io, apu->pulse[ch].sweep_target, 4);
+        STATE_IO(io, apu->pulse[ch].sweep_reload, 1);
+        STATE_IO(io, apu->pulse[ch].timer_period, 4);
+        STATE_IO(io, apu->pulse[ch].timer_value, 4);
+        if (io->in) apu->pulse[ch].timer_recip = timer_reciprocal((apu->pulse[ch].timer_period + 1) << 1);
+        STATE_IO(io, apu->pulse[ch].sequencer_value, 1);
+        STATE_IO(io, apu->pulse[ch].sweep_timer_mute, 1);
+    }
+    // triangle
+    STATE_IO(io, apu->triangle_enabled, 1);
+    STATE_IO(io, apu->triangle_length_value, 1);
+    STATE_IO(io, apu->triangle_lnrctl_lenhalt, 1);
+    STATE_IO(io, apu->triangle_linear_period, 1);
+    STATE_IO(io, apu->triangle_linear_value, 1);
+    STATE_IO(io, apu->triangle_linear_reload, 1);
+    STATE_IO(io, apu->triangle_timer_period, 2);
+    STATE_IO(io, apu->triangle_timer_period_bad, 1);
+    STATE_IO(io, apu->triangle_timer_value, 4);
+    if (io->in) apu->triangle_timer_recip = timer_reciprocal(apu->triangle_timer_period + 1);
+    STATE_IO(io, apu->triangle_sequencer_value, 1);
+    // noise
+    STATE_IO(io, apu->noise_enabled, 1);
+    STATE_IO(io, apu->noise_lenhalt_envloop, 1);
+    STATE_IO(io, apu->noise_constant_volume, 1);
+    STATE_IO(io, apu->noise_volume_envperiod, 1);
+    STATE_IO(io, apu->noise_mode, 1);
+    STATE_IO(io, apu->noise_envelope_start, 1);
+    STATE_IO(io, apu->noise_envelope_decay, 1);
+    STATE_IO(io, apu->noise_envelope_value, 1);
+    STATE_IO(io, apu->noise_length_value, 1);
+    STATE_IO(io, apu->noise_timer_period, 2);
+    STATE_IO(io, apu->noise_timer_value, 4);
+    if (io->in) apu->noise_timer_recip = timer_reciprocal(apu->noise_timer_period + 1);
+    // Saved as register value, position in sequence is found again on load
+    uint16_t noise_reg = io->in ? 0 : noise_shift_reg(apu);
+    STATE_IO(io, noise_reg, 2);
+    if (io->in) noise_set_shift_reg(apu, noise_reg);
+    // DMC
+    STATE_IO(io, apu->dmc_enabled, 1);
+    STATE_IO(io, apu->dmc_loop, 1);
+    STATE_IO(io, apu->dmc_output, 1);
+    STATE_IO(io, apu->dmc_sample_addr, 2);
+    STATE_IO(io, apu->dmc_sample_len, 2);
+    STATE_IO(io, apu->dmc_timer_period, 2);
+    STATE_IO(io, apu->dmc_timer_value, 4);
+    if (io->in) apu->dmc_timer_recip = timer_reciprocal(apu->dmc_timer_period + 1);
+    STATE_IO(io, apu->dmc_read_addr, 2);
+    STATE_IO(io, apu->dmc_read_remaining, 2);
+    STATE_IO(io, apu->dmc_read_buffer, 1);
+    STATE_IO(io, apu->dmc_read_buffer_empty, 1);
+    STATE_IO(io, apu->dmc_output_shift_reg, 1);
+    STATE_IO(io, apu->dmc_output_silence, 1);
+    STATE_IO(io, apu->dmc_output_bits_remaining, 1);
+    // channel masks
+    STATE_IO(io, apu->mask_pulse1, 1);
+    STATE_IO(io, apu->mask_pulse2, 1);
+    STATE_IO(io, apu->mask_triangle, 1);
+    STATE_IO(io, apu->mask_noise, 1);
+    STATE_IO(io, apu->mask_dmc, 1);
+    // fade
+    STATE_IO(io, apu->fadeout_enabled, 1);
+    STATE_IO(io, apu->fadeout_period_fp, 4);
+    STATE_IO(io, apu->fadeout_accu_fp, 4);
+    STATE_IO(io, apu->fadeout_sequencer_value, 1);
+}
+
+
+#if NESAPU_USE_BLIPBUF
+static void state_io_blip(state_io_t *io, blip_state_t *bs)
+{
+    uint32_t lo = (uint32_t)(bs->offset), hi = (uint32_t)(bs->offset >> 32);
+    STATE_IO(io, lo, 4);
+    STATE_IO(io, hi, 4);
+    bs->offset = ((unsigned long long)hi << 32) | lo;
+    STATE_IO(io, bs->integrator, 4);
+    for (int i = 0; i < blip_state_extra; ++i)
+        STATE_IO(io, bs->buf[i], 4);
+}
+#endif
+
+
+size_t nesapu_save_state(nesapu_t *apu, uint8_t *buf, size_t size)
+{
+    state_io_t io = { buf, NULL, size, 0 };
+    uint32_t magic = NESAPU_STATE_MAGIC, version = NESAPU_STATE_VERSION, format = apu->format, clock = apu->clock_rate;
+    STATE_IO(&io, magic, 4);
+    STATE_IO(&io, version, 1);
+    STATE_IO(&io, format, 1);
+    STATE_IO(&io, clock, 4);
+    state_io_fields(&io, apu);
+#if NESAPU_USE_BLIPBUF
+    blip_state_t bs;
+    blip_save_state(apu->blip, &bs);
+    state_io_blip(&io, &bs);
+#endif
+    // RAM blocks, newest first as in ram_list
+    uint32_t count = apu->ram_count;
+    STATE_IO(&io, count, 4);
+    for (nesapu_ram_t *ram = apu->ram_list; ram; ram = ram->next)
+    {
+        uint32_t offset = (uint32_t)(ram->offset);
+        STATE_IO(&io, offset, 4);
+        STATE_IO(&io, ram->addr, 2);
+        STATE_IO(&io, ram->len, 2);
+    }
+    if (buf && io.pos > size) return 0;
+    return io.pos;
+}
+
+
+bool nesapu_load_state(nesapu_t *apu, const uint8_t *buf, size_t size)
+{
+    state_io_t io = { NULL, buf, size, 0 };
+    uint32_t magic = 0, version = 0, format = 0, clock = 0, count = 0;
+    STATE_IO(&io, magic, 4);
+    STATE_IO(&io, version, 1);
+    STATE_IO(&io, format, 1);
+    STATE_IO(&io, clock, 4);
+    if (magic != NESAPU_STATE_MAGIC || version != NESAPU_STATE_VERSION) return false;
+    // APU must be created for the same VGM file
+    if ((format != 0) != apu->format || clock != apu->clock_rate) return false;
+    // Load into a copy, so nothing changes if state is truncated
+    nesapu_t temp;
+    memcpy(&temp, apu, sizeof(nesapu_t));
+    state_io_fields(&io, &temp);
+#if NESAPU_USE_BLIPBUF
+    blip_state_t bs;
+    state_io_blip(&io, &bs);
+#endif
+    STATE_IO(&io, count, 4);
+    if (io.pos + (size_t)count * NESAPU_STATE_RAM_SIZE > size) return false;
+    memcpy(apu, &temp, sizeof(nesapu_t));
+    apu->write_count = 0;
+    apu->write_next = 0;
+    apu->write_end = 0;
+#if NESAPU_USE_BLIPBUF
+    blip_load_state(apu->blip, &bs);
+#endif
+    // Add RAM blocks oldest first, so ram_list has the same order
+    free_ram_list(apu);
+    for (uint32_t i = count; i > 0; --i)
+    {
+        state_io_t ram_io = { NULL, buf, size, io.pos + (i - 1) * NESAPU_STATE_RAM_SIZE };
+        uint32_t offset = 0;
+        uint16_t addr = 0, len = 0;
+        STATE_IO(&ram_io, offset, 4);
+        STATE_IO(&ram_io, addr, 2);
+        STATE_IO(&ram_io, len, 2);
+        nesapu_add_ram(apu, offset, addr, len);
+    }
+    return true;
+}
\ No newline at end of file
@@ -1,170 +1,305 @@
-#pragma once
-
-#ifndef NESAPU_USE_BLIPBUF
-#define NESAPU_USE_BLIPBUF 1
-#endif
-
-#include <stdint.h>
-#include <stdbool.h>
-#if NESAPU_USE_BLIPBUF
-# include "blip_buf.h"
-#endif
-#include "fixedpoint.h"
-#include "file_reader.h"
-#include "vgm_conf.h"
-
-
-#ifdef __cplusplus
-extern "C" {
-#endif
-
-#ifndef NESAPU_SAMPLE_RATE
-# define NESAPU_SAMPLE_RATE      44100
-#endif
-
-#ifndef NESAPU_MAX_SAMPLES
-# define NESAPU_MAX_SAMPLES      1500
-#endif
-
-#ifndef NESAPU_RAM_CACHE_SIZE
-# define NESAPU_RAM_CACHE_SIZE   4096
-#endif
-
-// Channel masks ---D NT21
-#define NESAPU_CHANNEL_PULSE1      0x01
-#define NESAPU_CHANNEL_PULSE2      0x02
-#define NESAPU_CHANNEL_TRIANGLE    0x04
-#define NESAPU_CHANNEL_NOISE       0x08
-#define NESAPU_CHANNEL_DMC         0x10
-#define NESAPU_CHANNEL_NONE        0x00
-#define NESAPU_CHANNEL_ALL         0x1f
-
-typedef struct nesapu_ram_s nesapu_ram_t;
-struct nesapu_ram_s
-{
-    size_t offset;          // data start position in VGM file
-    uint16_t addr;          // ram start address
-    uint16_t len;           // length of ram block
-    uint16_t cache_addr;    // cache start address
-    uint16_t cache_len;     // cache length
-    uint8_t  *cache;        // cache data
-    nesapu_ram_t *next;     // next ram data block
-};
-
-
-typedef struct nesapu_s
-{
-    file_reader_t *reader;      // reader interface
-    bool format;                // true: PAL, false: NTSC
-    unsigned int clock_rate;    // NES clock rate (typ. 1789772)
-#if NESAPU_USE_BLIPBUF    
-    // Blip
-    blip_buffer_t *blip;
-    int16_t blip_last_sample;
-#else    
-    // Sampling counter
-    q16_t    sample_period_fp;
-    q16_t    sample_accu_fp;
-#endif    
-    // frame counter
-    uint8_t  sequencer_step;    // sequencer step, 1-2-3-4 or 1-2-3-4-5
-    bool     sequence_mode;     // false: 4-step sequence. true: 5-step sequence. Set by $4017 bit 7
-    bool     quarter_frame;     // true @step 1,2,3,4 for 4-step sequence or @step 1,2,3,5 for 5-step sequence
-    bool     half_frame;        // true @step 2,4 for 4-step sequence or @step 2,5 for 5-step sequence
-    bool     frame_force_clock; // When writing 0x80 to $4017, immediate clock all units at first step
-    q16_t    frame_accu_fp;     // frame counter accumulator (fixed point)
-    q16_t    frame_period_fp;   // frame clock (240Hz) period (fixed point)
-    // Pulse1 Channel
-    struct pulse_t
-    {
-        bool          enabled;
-        unsigned int  duty;             // duty cycle, 0,1,2,3 -> 12.5%,25%,50%,-25%, see pulse_waveform_table
-        unsigned int  length_value;     // Length counter value
-        bool          lenhalt_envloop;  // Length counter halt or Envelope loop
-        bool          constant_volume;  // Constant volume (true) or Envelope enable (false)
-        bool          envelope_start;   // Envelope start flag
-        unsigned int  envelope_decay;   // Envelope decay value (15, 14, ...)
-        unsigned int  envelope_value;   // Envelope clock divider (counter value)
-        unsigned int  volume_envperiod; // Volume or Envelope period
-        bool          sweep_enabled;    // Sweep enabled
-        unsigned int  sweep_period;     // Sweep period
-        unsigned int  sweep_value;      // Sweep divider value
-        bool          sweep_negate;     // Sweep negate flag
-        unsigned int  sweep_shift;      // Sweep shift
-        unsigned int  sweep_target;     // Sweep target
-        bool          sweep_reload;     // To reload sweep_value
-        unsigned int  timer_period;     // Pulse1 channel main timer period
-        unsigned int  timer_value;      // Pulse1 channel main timer divider (counter value), counting from 2x timer_period
-        unsigned int  sequencer_value;  // Current suquence (8 steps of waveform)
-        bool          sweep_timer_mute; // If sweep or timer will mute the channel
-    } pulse[2];
-    // Triangle Channel
-    bool          triangle_enabled;
-    unsigned int  triangle_length_value;        // Length counter value
-    bool          triangle_lnrctl_lenhalt;      // Linear counter control / length counter halt
-    unsigned int  triangle_linear_period;       // Linear counter period
-    unsigned int  triangle_linear_value;        // Linear counter value
-    bool          triangle_linear_reload;       // Linear counter reload flag
-    unsigned int  triangle_timer_period;        // Channel timer period
-    bool          triangle_timer_period_bad;    // If timer period is out of range
-    unsigned int  triangle_timer_value;         // Channel timer value
-    unsigned int  triangle_sequencer_value;     // Current suquence (32 steps of waveform)
-    // Noise Channel
-    bool          noise_enabled;
-    bool          noise_lenhalt_envloop;        // Length counter halt
-    bool          noise_constant_volume;        // Constant volume
-    unsigned int  noise_volume_envperiod;       // Volume / Envelope period
-    bool          noise_mode;                   // Noise mode / flag
-    bool          noise_envelope_start;         // Envelope start flag
-    unsigned int  noise_envelope_decay;         // Envelope decay value (15, 14, ...)
-    unsigned int  noise_envelope_value;         // Envelope clock divider (counter value)
-    unsigned int  noise_length_value;           // Length counter value
-    unsigned int  noise_timer_period;           // Channel timer period
-    unsigned int  noise_timer_value;            // Channel timer value
-    uint16_t      noise_shift_reg;              // Noise shift register
-    // DMC Channel
-    bool          dmc_enabled;
-    bool          dmc_loop;
-    unsigned int  dmc_output;
-    uint16_t      dmc_sample_addr;
-    uint16_t      dmc_sample_len;
-    unsigned int  dmc_timer_period;
-    unsigned int  dmc_timer_value;
-    uint16_t      dmc_read_addr;
-    uint16_t      dmc_read_remaining;
-    uint8_t       dmc_read_buffer;
-    bool          dmc_read_buffer_empty;
-    uint8_t       dmc_output_shift_reg;
-    bool          dmc_output_silence;
-    unsigned int  dmc_output_bits_remaining;
-    nesapu_ram_t  *ram_list;                    // APU accessible RAM list
-    uint8_t       *ram_cache;                   // Read cache for RAM, shared by all RAM blocks
-    nesapu_ram_t  *ram_active;                  // Active ram block (using cache)
-    // Channel masks
-    bool          mask_pulse1;
-    bool          mask_pulse2;
-    bool          mask_triangle;
-    bool          mask_noise;
-    bool          mask_dmc;
-    // Fade control
-    bool          fadeout_enabled;
-    q16_t         fadeout_period_fp;
-    q16_t         fadeout_accu_fp;
-    unsigned int  fadeout_sequencer_value;
-} nesapu_t;
-
-
-nesapu_t * nesapu_create(file_reader_t *reader, bool format, unsigned int clock, unsigned int sample_rate);
-void    nesapu_destroy(nesapu_t *apu);
-void    nesapu_reset(nesapu_t *apu);
-void    nesapu_write_reg(nesapu_t *apu, uint16_t reg, uint8_t val);
-void    nesapu_get_samples(nesapu_t *apu, int16_t *buf, unsigned int samples);
-void    nesapu_add_ram(nesapu_t *apu, size_t offset, uint16_t addr, uint16_t len);
-uint8_t nesapu_read_ram(nesapu_t *apu, uint16_t addr);
-void    nesapu_enable_fade(nesapu_t *apu, unsigned int samples);
-void    nesapu_enable_channel(nesapu_t *apu, uint8_t mask, bool enable);
-
-
-#ifdef __cplusplus
-}
-#endif
+#pragma once
+
+#ifndef NESAPU_USE_BLIPBUF
+#define NESAPU_USE_BLIPBUF 1
+#endif
+
+#include <stdint.h>
+#include <stdbool.h>
+#if NESAPU_USE_BLIPBUF
+# include "blip_buf.h"
+#endif
+#include "fixedpoint.h"
+#include "file_reader.h"
+#include "vgm_conf.h"
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifndef NESAPU_SAMPLE_RATE
+# define NESAPU_SAMPLE_RATE      44100
+#endif
+
+// Default blip buffer size, samples one synthesis call takes at most. See nesapu_create().
+#ifndef NESAPU_MAX_SAMPLES
+# define NESAPU_MAX_SAMPLES      1500
+#endif
+// Largest blip buffer size nesapu_create() takes (4 MB)
+#define NESAPU_BLOCK_LIMIT       (1U << 20)
+
+// APU RAM $8000-$FFFF as one flat image: RAM blocks are copied in when added and a DMC fetch is a single
+// indexed load. 0 for low RAM targets: blocks stay in the file and share one NESAPU_RAM_CACHE_SIZE cache.
+#ifndef NESAPU_USE_RAM_IMAGE
+# define NESAPU_USE_RAM_IMAGE    1
+#endif
+#define NESAPU_RAM_IMAGE_BASE    0x8000
+#define NESAPU_RAM_IMAGE_SIZE    0x8000
+
+#ifndef NESAPU_RAM_CACHE_SIZE
+# define NESAPU_RAM_CACHE_SIZE   4096
+#endif
+
+// Blip only: run channels from one output change to the next and add blip deltas at the exact
+// clock of each change, instead of sampling all channels once per output sample period.
+#ifndef NESAPU_USE_EVENT_SYNTH
+# define NESAPU_USE_EVENT_SYNTH  0
+#endif
+
+// Blip only: nesapu_get_stems() renders each channel into its own buffer in the same pass
+#ifndef NESAPU_USE_STEMS
+# define NESAPU_USE_STEMS        0
+#endif
+
+// Register writes nesapu_queue_write() holds for the next synthesis call, which applies each at its
+// clock. 0 leaves the queue out, only writes at the current position are taken.
+#ifndef NESAPU_WRITE_QUEUE_SIZE
+# define NESAPU_WRITE_QUEUE_SIZE 128
+#endif
+
+// If file_reader_t has borrow() member, which returns a stable pointer to file data (or NULL if
+// not available), VGM data and APU RAM are accessed in place instead of copied out by read().
+#ifndef VGM_READER_BORROW
+# define VGM_READER_BORROW       0
+#endif
+
+// Channel masks ---D NT21
+#define NESAPU_CHANNEL_PULSE1      0x01
+#define NESAPU_CHANNEL_PULSE2      0x02
+#define NESAPU_CHANNEL_TRIANGLE    0x04
+#define NESAPU_CHANNEL_NOISE       0x08
+#define NESAPU_CHANNEL_DMC         0x10
+#define NESAPU_CHANNEL_NONE        0x00
+#define NESAPU_CHANNEL_ALL         0x1f
+#define NESAPU_CHANNEL_COUNT       5
+
+// Output sample formats. S32 and F32 are full scale and keep the precision S16 rounds off.
+#define NESAPU_FORMAT_S16          0    // int16_t
+#define NESAPU_FORMAT_S32          1    // int32_t
+#define NESAPU_FORMAT_F32          2    // float, -1.0 to 1.0
+
+// Output buffer layout. Each sample is written to channels consecutive elements (e.g. 2 to fill both
+// sides of interleaved stereo), and successive samples are stride elements apart.
+typedef struct nesapu_output_s
+{
+    uint8_t format;         // NESAPU_FORMAT_xxx
+    uint8_t channels;       // Copies of each sample, >= 1
+    unsigned int stride;    // Elements between samples, >= channels
+} nesapu_output_t;
+
+typedef struct nesapu_ram_s nesapu_ram_t;
+struct nesapu_ram_s
+{
+    size_t offset;          // data start position in VGM file
+    uint16_t addr;          // ram start address
+    uint16_t len;           // length of ram block
+#if !NESAPU_USE_RAM_IMAGE
+    uint16_t cache_addr;    // cache start address
+    uint16_t cache_len;     // cache length
+    uint8_t  *cache;        // cache data
+#endif
+    unsigned int serial;    // order of first add, see ram_serial
+#if VGM_READER_BORROW && !NESAPU_USE_RAM_IMAGE
+    const uint8_t *data;    // whole block borrowed from reader, NULL if cached
+#endif
+    nesapu_ram_t *next;     // next ram data block
+};
+
+// Queued register write
+typedef struct nesapu_write_s
+{
+    uint32_t time;          // sample from start of next synthesis call, clock once in the current blip frame
+    uint16_t reg;
+    uint8_t  val;
+} nesapu_write_t;
+
+
+typedef struct nesapu_s
+{
+    file_reader_t *reader;      // reader interface
+    bool format;                // true: PAL, false: NTSC
+    unsigned int clock_rate;    // NES clock rate (typ. 1789772)
+    unsigned int max_samples;   // Largest span synthesized at once, blip buffer size
+#if NESAPU_USE_BLIPBUF    
+    // Blip
+    unsigned int sample_rate;
+    blip_buffer_t *blip;
+    int16_t blip_last_sample;
+#if NESAPU_USE_STEMS
+    blip_buffer_t *stem_blip[NESAPU_CHANNEL_COUNT];         // Per channel buffers, allocated on first nesapu_get_stems()
+    int16_t stem_last_sample[NESAPU_CHANNEL_COUNT];
+#endif
+#else    
+    // Sampling counter
+    q16_t    sample_period_fp;
+    q16_t    sample_accu_fp;
+    int32_t  sample_prev;       // previous sample for output filter, q29 centered on 0
+#endif    
+    // frame counter
+    uint8_t  sequencer_step;    // sequencer step, 1-2-3-4 or 1-2-3-4-5
+    bool     sequence_mode;     // false: 4-step sequence. true: 5-step sequence. Set by $4017 bit 7
+    bool     quarter_frame;     // true @step 1,2,3,4 for 4-step sequence or @step 1,2,3,5 for 5-step sequence
+    bool     half_frame;        // true @step 2,4 for 4-step sequence or @step 2,5 for 5-step sequence
+    bool     frame_force_clock; // When writing 0x80 to $4017, immediate clock all units at first step
+    q16_t    frame_accu_fp;     // frame counter accumulator (fixed point)
+    q16_t    frame_period_fp;   // frame clock (240Hz) period (fixed point)
+    // Pulse1 Channel
+    struct pulse_t
+    {
+        bool          enabled;
+        unsigned int  duty;             // duty cycle, 0,1,2,3 -> 12.5%,25%,50%,-25%, see pulse_waveform_table
+        unsigned int  length_value;     // Length counter value
+        bool          lenhalt_envloop;  // Length counter halt or Envelope loop
+        bool          constant_volume;  // Constant volume (true) or Envelope enable (false)
+        bool          envelope_start;   // Envelope start flag
+        unsigned int  envelope_decay;   // Envelope decay value (15, 14, ...)
+        unsigned int  envelope_value;   // Envelope clock divider (counter value)
+        unsigned int  volume_envperiod; // Volume or Envelope period
+        bool          sweep_enabled;    // Sweep enabled
+        unsigned int  sweep_period;     // Sweep period
+        unsigned int  sweep_value;      // Sweep divider value
+        bool          sweep_negate;     // Sweep negate flag
+        unsigned int  sweep_shift;      // Sweep shift
+        unsigned int  sweep_target;     // Sweep target
+        bool          sweep_reload;     // To reload sweep_value
+        unsigned int  timer_period;     // Pulse1 channel main timer period
+        unsigned int  timer_value;      // Pulse1 channel main timer divider (counter value), counting from 2x timer_period
+        uint32_t      timer_recip;      // Reciprocal of 2x (timer_period + 1), set with timer_period
+        unsigned int  sequencer_value;  // Current suquence (8 steps of waveform)
+        bool          sweep_timer_mute; // If sweep or timer will mute the channel
+    } pulse[2];
+    // Triangle Channel
+    bool          triangle_enabled;
+    unsigned int  triangle_length_value;        // Length counter value
+    bool          triangle_lnrctl_lenhalt;      // Linear counter control / length counter halt
+    unsigned int  triangle_linear_period;       // Linear counter period
+    unsigned int  triangle_linear_value;        // Linear counter value
+    bool          triangle_linear_reload;       // Linear counter reload flag
+    unsigned int  triangle_timer_period;        // Channel timer period
+    bool          triangle_timer_period_bad;    // If timer period is out of range
+    unsigned int  triangle_timer_value;         // Channel timer value
+    uint32_t      triangle_timer_recip;         // Reciprocal of timer period + 1, set with timer period
+    unsigned int  triangle_sequencer_value;     // Current suquence (32 steps of waveform)
+    // Noise Channel
+    bool          noise_enabled;
+    bool          noise_lenhalt_envloop;        // Length counter halt
+    bool          noise_constant_volume;        // Constant volume
+    unsigned int  noise_volume_envperiod;       // Volume / Envelope period
+    bool          noise_mode;                   // Noise mode / flag
+    bool          noise_envelope_start;         // Envelope start flag
+    unsigned int  noise_envelope_decay;         // Envelope decay value (15, 14, ...)
+    unsigned int  noise_envelope_value;         // Envelope clock divider (counter value)
+    unsigned int  noise_length_value;           // Length counter value
+    unsigned int  noise_timer_period;           // Channel timer period
+    unsigned int  noise_timer_value;            // Channel timer value
+    uint32_t      noise_timer_recip;            // Reciprocal of timer period + 1, set with timer period
+    // Noise shift register runs through a fixed sequence in each mode, kept as position in it
+    uint16_t      noise_index;                  // Shift register position in sequence of noise_mode
+    uint8_t       noise_short_period;           // Short mode: clocks of the cycle the register is on (93 or 31)
+    uint8_t       noise_short_bits[16];         // Short mode: bit 0 of the register over its cycle, 16 bits more
+    // DMC Channel
+    bool          dmc_enabled;
+    bool          dmc_loop;
+    unsigned int  dmc_output;
+    uint16_t      dmc_sample_addr;
+    uint16_t      dmc_sample_len;
+    unsigned int  dmc_timer_period;
+    unsigned int  dmc_timer_value;
+    uint32_t      dmc_timer_recip;              // Reciprocal of timer period + 1, set with timer period
+    uint16_t      dmc_read_addr;
+    uint16_t      dmc_read_remaining;
+    uint8_t       dmc_read_buffer;
+    bool          dmc_read_buffer_empty;
+    uint8_t       dmc_output_shift_reg;
+    bool          dmc_output_silence;
+    unsigned int  dmc_output_bits_remaining;
+    nesapu_ram_t  *ram_list;                    // APU accessible RAM list
+#if NESAPU_USE_RAM_IMAGE
+    uint8_t       *ram_image;                   // $8000-$FFFF, newest block wins where blocks overlap
+#else
+    uint8_t       *ram_cache;                   // Read cache for RAM, shared by all RAM blocks
+    nesapu_ram_t  *ram_active;                  // Active ram block (using cache)
+#endif
+    unsigned int  ram_count;                    // # of ram blocks in ram_list
+    unsigned int  ram_serial;                   // # of distinct ram blocks added, numbers new blocks
+    // Register writes queued ahead of synthesis, in time order
+    nesapu_write_t *write_queue;                // NESAPU_WRITE_QUEUE_SIZE entries, NULL if not allocated
+    unsigned int  write_count;                  // # of writes queued
+    unsigned int  write_next;                   // Next write to apply in synthesis
+    unsigned int  write_end;                    // Writes taken by current synthesis
+    // Channel masks
+    bool          mask_pulse1;
+    bool          mask_pulse2;
+    bool          mask_triangle;
+    bool          mask_noise;
+    bool          mask_dmc;
+    // Fade control
+    bool          fadeout_enabled;
+    q16_t         fadeout_period_fp;
+    q16_t         fadeout_accu_fp;
+    unsigned int  fadeout_sequencer_value;
+} nesapu_t;
+
+
+// Version of state saved by nesapu_save_state()
+#define NESAPU_STATE_VERSION    3
+
+
+// Snapshot of APU state between nesapu_get_samples() calls
+typedef struct nesapu_snapshot_s
+{
+    nesapu_t      apu;                          // Copy of APU. Pointers and channel masks are not restored
+#if NESAPU_USE_BLIPBUF
+    blip_state_t  blip;                         // Blip integrator and pending deltas
+#endif
+    unsigned int  ram_serial;                   // ram_serial when snapshot is taken
+} nesapu_snapshot_t;
+
+
+// max_samples sizes the blip buffer, 0 for NESAPU_MAX_SAMPLES, up to NESAPU_BLOCK_LIMIT. Longer requests
+// are split into max_samples pieces. return NULL if out of memory.
+nesapu_t * nesapu_create(file_reader_t *reader, bool format, unsigned int clock, unsigned int sample_rate, unsigned int max_samples);
+void    nesapu_destroy(nesapu_t *apu);
+void    nesapu_reset(nesapu_t *apu);
+void    nesapu_write_reg(nesapu_t *apu, uint16_t reg, uint8_t val);
+// Write register when synthesis reaches sample (from current position, up to max_samples). The
+// next nesapu_get_samples() or nesapu_skip_samples() applies it at that sample's clock, so writes over
+// many waits render in one call. Writes are queued in time order. At sample 0 with nothing queued the
+// write is applied at once. Return false if the queue is full, the write is not taken.
+bool    nesapu_queue_write(nesapu_t *apu, unsigned int sample, uint16_t reg, uint8_t val);
+void    nesapu_get_samples(nesapu_t *apu, int16_t *buf, unsigned int samples);
+// Same as nesapu_get_samples(), writing samples in format and layout of output
+void    nesapu_get_samples_ex(nesapu_t *apu, void *buf, unsigned int samples, const nesapu_output_t *output);
+// Advance channels, frame counter and fade by samples without synthesizing them. Output after the skip
+// starts from the new channel levels.
+void    nesapu_skip_samples(nesapu_t *apu, unsigned int samples);
+#if NESAPU_USE_BLIPBUF && NESAPU_USE_STEMS
+// Render each channel (Pulse1, Pulse2, Triangle, Noise, DMC) to stems[] and mixed output to mix in one pass.
+// NULL buffers are skipped. Stems are not exact parts of mix as the mixer is not linear.
+// Do not mix with nesapu_get_samples() calls, skipped buffers miss level changes.
+bool    nesapu_get_stems(nesapu_t *apu, int16_t *stems[NESAPU_CHANNEL_COUNT], int16_t *mix, unsigned int samples);
+#endif
+// Adding a block again (VGM data replayed on loop) reuses it, so memory stays flat over any number of loops.
+void    nesapu_add_ram(nesapu_t *apu, size_t offset, uint16_t addr, uint16_t len);
+uint8_t nesapu_read_ram(nesapu_t *apu, uint16_t addr);
+// Remove all RAM blocks
+void    nesapu_clear_ram(nesapu_t *apu);
+// Channels (NESAPU_CHANNEL_xxx mask) which can still be heard without further register writes. Others
+// stay silent until written, except $4011 direct loads which step the DMC level.
+uint8_t nesapu_audible_channels(nesapu_t *apu);
+void    nesapu_enable_fade(nesapu_t *apu, unsigned int samples);
+void    nesapu_enable_channel(nesapu_t *apu, uint8_t mask, bool enable);
+void    nesapu_save_snapshot(nesapu_t *apu, nesapu_snapshot_t *snap);
+// RAM blocks first added after the snapshot are dropped, the image is rebuilt from the rest
+void    nesapu_load_snapshot(nesapu_t *apu, const nesapu_snapshot_t *snap);
+// Save state between nesapu_get_samples() calls. Return bytes written, 0 if buf is too small.
+// If buf is NULL, return size needed.
+size_t  nesapu_save_state(nesapu_t *apu, uint8_t *buf, size_t size);
+// Load state saved by nesapu_save_state(). APU must be created for the same VGM file and sample rate.
+bool    nesapu_load_state(nesapu_t *apu, const uint8_t *buf, size_t size);
+
+
+#ifdef __cplusplus
+}
+#endif
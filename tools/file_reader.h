@@ -0,0 +1,15 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+
+// file_reader_t for the tools. Readers are created by mem_reader.c
+typedef struct file_reader_s file_reader_t;
+
+struct file_reader_s
+{
+    size_t (*read)(file_reader_t *reader, uint8_t *buf, size_t offset, size_t len);
+    size_t (*size)(file_reader_t *reader);
+    const uint8_t * (*borrow)(file_reader_t *reader, size_t offset, size_t len);
+};
@@ -0,0 +1,55 @@
+#pragma once
+
+// vgmcore configuration for the tools. Based on vgm_conf.h.template
+// Feature options can be overridden from the compiler command line, e.g. -DNESAPU_USE_BLIPBUF=0
+
+#define PACK( __Declaration__ ) __Declaration__ __attribute__((__packed__))
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#define VGM_PRINTF(...) printf(__VA_ARGS__)
+#define VGM_PRINTINF(...)
+#define VGM_PRINTDBG(...)
+#define VGM_PRINTERR(...) fprintf(stderr, __VA_ARGS__)
+#define VGM_ASSERT assert
+#define VGM_MALLOC malloc
+#define VGM_FREE free
+
+#ifndef VGM_READER_BORROW
+# define VGM_READER_BORROW      1
+#endif
+#ifndef VGM_FILE_CACHE_SIZE
+# define VGM_FILE_CACHE_SIZE    2048
+#endif
+#ifndef VGM_USE_COMPILED_STREAM
+# define VGM_USE_COMPILED_STREAM 0
+#endif
+#ifndef VGM_SEEK_INTERVAL
+# define VGM_SEEK_INTERVAL      0
+#endif
+
+#ifndef NESAPU_USE_BLIPBUF
+# define NESAPU_USE_BLIPBUF     1
+#endif
+#ifndef BLIP_USE_SIMD
+# define BLIP_USE_SIMD          1
+#endif
+#ifndef NESAPU_USE_EVENT_SYNTH
+# define NESAPU_USE_EVENT_SYNTH 0
+#endif
+#ifndef NESAPU_USE_STEMS
+# define NESAPU_USE_STEMS       0
+#endif
+#ifndef NESAPU_MAX_SAMPLES
+# define NESAPU_MAX_SAMPLES     2048
+#endif
+#ifndef NESAPU_USE_RAM_IMAGE
+# define NESAPU_USE_RAM_IMAGE   1
+#endif
+#ifndef NESAPU_RAM_CACHE_SIZE
+# define NESAPU_RAM_CACHE_SIZE  4096
+#endif
+#ifndef NESAPU_WRITE_QUEUE_SIZE
+# define NESAPU_WRITE_QUEUE_SIZE 128
+#endif
@@ -0,0 +1,463 @@
+//
+// vgmbatch: render many VGM files on all cores
+//
+// Usage: vgmbatch [-j threads] [-r rate] [-b block] [-l loops] [-f wav|raw] [-o dir] [-n] [-t] file.vgm... | @list.txt
+//
+// Files are sorted longest first by header total_samples + loops * loop_samples and dealt round robin to
+// per-thread queues. A thread takes work from the front of its own queue and, when that is empty,
+// steals from the back of the others.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "vgm_conf.h"
+#include "vgm.h"
+#include "mem_reader.h"
+
+
+#define BATCH_IO_BUFFER_SIZE    (64 * 1024)
+
+
+typedef struct job_s
+{
+    const char *path;
+    unsigned long cost;     // total_samples + loops * loop_samples from header
+} job_t;
+
+
+// Queue of job indices, [head, tail) of a slice of the shared index array
+typedef struct queue_s
+{
+    pthread_mutex_t lock;
+    size_t *items;
+    size_t head;
+    size_t tail;
+} queue_t;
+
+
+typedef struct worker_s
+{
+    pthread_t thread;
+    unsigned int id;
+    // Reusable buffers
+    int16_t *samples;
+    char *io_buffer;
+    // Statistics
+    unsigned long files;
+    unsigned long failed;
+    unsigned long long rendered;
+    unsigned long steals;
+} worker_t;
+
+
+static struct
+{
+    unsigned int threads;
+    unsigned int rate;
+    unsigned int block;
+    unsigned int loops;
+    bool wav;
+    bool write;
+    unsigned int options;   // VGM_PLAYBACK_xxx
+    const char *out_dir;
+    job_t *jobs;
+    size_t job_count;
+    size_t *order;
+    queue_t *queues;
+    worker_t *workers;
+} batch;
+
+
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+
+static uint32_t get_le32(const uint8_t *p)
+{
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+
+static void put_le16(uint8_t *p, uint16_t v)
+{
+    p[0] = (uint8_t)v; p[1] = (uint8_t)(v >> 8);
+}
+
+
+static void put_le32(uint8_t *p, uint32_t v)
+{
+    p[0] = (uint8_t)v; p[1] = (uint8_t)(v >> 8); p[2] = (uint8_t)(v >> 16); p[3] = (uint8_t)(v >> 24);
+}
+
+
+// Estimate render cost from header, 0 if header can not be read
+static unsigned long read_cost(const char *path)
+{
+    uint8_t hdr[0x24];
+    FILE *fd = fopen(path, "rb");
+    if (NULL == fd) return 0;
+    size_t n = fread(hdr, 1, sizeof(hdr), fd);
+    fclose(fd);
+    if (n != sizeof(hdr) || memcmp(hdr, "Vgm ", 4) != 0) return 0;
+    return (unsigned long)get_le32(hdr + 0x18) + (unsigned long)get_le32(hdr + 0x20) * batch.loops;
+}
+
+
+static int cmp_job_cost(const void *a, const void *b)
+{
+    const job_t *ja = (const job_t *)a, *jb = (const job_t *)b;
+    if (ja->cost != jb->cost) return (ja->cost < jb->cost) ? 1 : -1;
+    return strcmp(ja->path, jb->path);
+}
+
+
+static bool add_job(const char *path, size_t *cap)
+{
+    if (batch.job_count == *cap)
+    {
+        size_t ncap = *cap ? *cap * 2 : 256;
+        job_t *jobs = (job_t *)realloc(batch.jobs, ncap * sizeof(job_t));
+        if (NULL == jobs) return false;
+        batch.jobs = jobs;
+        *cap = ncap;
+    }
+    batch.jobs[batch.job_count].path = path;
+    batch.jobs[batch.job_count].cost = 0;
+    ++batch.job_count;
+    return true;
+}
+
+
+// Read one path per line from list file. Lines are kept for the whole run.
+static bool add_list(const char *list, size_t *cap)
+{
+    FILE *fd = fopen(list, "r");
+    if (NULL == fd)
+    {
+        fprintf(stderr, "Cannot open list %s\n", list);
+        return false;
+    }
+    char line[4096];
+    bool ok = true;
+    while (ok && fgets(line, sizeof(line), fd))
+    {
+        size_t len = strcspn(line, "\r\n");
+        line[len] = 0;
+        if (len == 0) continue;
+        char *path = strdup(line);
+        ok = (path != NULL) && add_job(path, cap);
+    }
+    fclose(fd);
+    return ok;
+}
+
+
+static bool queue_pop_front(queue_t *q, size_t *item)
+{
+    bool ok = false;
+    pthread_mutex_lock(&q->lock);
+    if (q->head < q->tail)
+    {
+        *item = q->items[q->head++];
+        ok = true;
+    }
+    pthread_mutex_unlock(&q->lock);
+    return ok;
+}
+
+
+static bool queue_pop_back(queue_t *q, size_t *item)
+{
+    bool ok = false;
+    pthread_mutex_lock(&q->lock);
+    if (q->head < q->tail)
+    {
+        *item = q->items[--q->tail];
+        ok = true;
+    }
+    pthread_mutex_unlock(&q->lock);
+    return ok;
+}
+
+
+// Next job for worker: own queue first, then steal from others
+static bool next_job(worker_t *w, size_t *job)
+{
+    if (queue_pop_front(&batch.queues[w->id], job)) return true;
+    for (unsigned int i = 1; i < batch.threads; ++i)
+    {
+        if (queue_pop_back(&batch.queues[(w->id + i) % batch.threads], job))
+        {
+            ++w->steals;
+            return true;
+        }
+    }
+    return false;
+}
+
+
+// Output path: out_dir/<name without extension>.wav|.raw
+static void make_out_path(char *out, size_t size, const char *path)
+{
+    const char *name = strrchr(path, '/');
+    name = name ? name + 1 : path;
+    const char *dot = strrchr(name, '.');
+    int len = dot ? (int)(dot - name) : (int)strlen(name);
+    snprintf(out, size, "%s/%.*s.%s", batch.out_dir, len, name, batch.wav ? "wav" : "raw");
+}
+
+
+static void make_wav_header(uint8_t *hdr, unsigned long samples)
+{
+    uint32_t data_size = (uint32_t)(samples * 2);
+    memcpy(hdr, "RIFF", 4);
+    put_le32(hdr + 4, 36 + data_size);
+    memcpy(hdr + 8, "WAVEfmt ", 8);
+    put_le32(hdr + 16, 16);
+    put_le16(hdr + 20, 1);                      // PCM
+    put_le16(hdr + 22, 1);                      // mono
+    put_le32(hdr + 24, batch.rate);
+    put_le32(hdr + 28, batch.rate * 2);
+    put_le16(hdr + 32, 2);
+    put_le16(hdr + 34, 16);
+    memcpy(hdr + 36, "data", 4);
+    put_le32(hdr + 40, data_size);
+}
+
+
+static bool render(worker_t *w, const char *path)
+{
+    bool ok = false;
+    file_reader_t *reader = NULL;
+    vgm_t *vgm = NULL;
+    FILE *out = NULL;
+    unsigned long total = 0;
+    do
+    {
+        reader = mem_reader_map_file(path);
+        if (NULL == reader)
+        {
+            fprintf(stderr, "%s: cannot open\n", path);
+            break;
+        }
+        vgm = vgm_create(reader);
+        if (NULL == vgm)
+        {
+            fprintf(stderr, "%s: not a NES APU VGM file\n", path);
+            break;
+        }
+        vgm_set_loops(vgm, (int)batch.loops);
+        vgm_set_block_size(vgm, batch.block);
+        if (!vgm_prepare_playback(vgm, batch.rate, batch.options))
+        {
+            fprintf(stderr, "%s: cannot prepare playback\n", path);
+            break;
+        }
+        if (batch.write)
+        {
+            char out_path[4096];
+            make_out_path(out_path, sizeof(out_path), path);
+            out = fopen(out_path, "wb");
+            if (NULL == out)
+            {
+                fprintf(stderr, "%s: cannot create %s\n", path, out_path);
+                break;
+            }
+            setvbuf(out, w->io_buffer, _IOFBF, BATCH_IO_BUFFER_SIZE);
+            if (batch.wav)
+            {
+                uint8_t hdr[44];
+                make_wav_header(hdr, 0);
+                fwrite(hdr, 1, sizeof(hdr), out);
+            }
+        }
+        int n;
+        while ((n = vgm_get_samples(vgm, w->samples, batch.block)) > 0)
+        {
+            if (out)
+            {
+                // Host byte order, little endian is assumed for WAV
+                if (fwrite(w->samples, sizeof(int16_t), (size_t)n, out) != (size_t)n) break;
+            }
+            total += (unsigned long)n;
+        }
+        if (n != 0)
+        {
+            fprintf(stderr, "%s: render failed\n", path);
+            break;
+        }
+        if (out && batch.wav)
+        {
+            uint8_t hdr[44];
+            make_wav_header(hdr, total);
+            if (fseek(out, 0, SEEK_SET) != 0 || fwrite(hdr, 1, sizeof(hdr), out) != sizeof(hdr)) break;
+        }
+        ok = true;
+    } while (0);
+    if (out && fclose(out) != 0) ok = false;
+    if (vgm) vgm_destroy(vgm);
+    if (reader) mem_reader_destroy(reader);
+    w->rendered += total;
+    return ok;
+}
+
+
+static void *worker_main(void *arg)
+{
+    worker_t *w = (worker_t *)arg;
+    size_t job;
+    while (next_job(w, &job))
+    {
+        if (render(w, batch.jobs[job].path))
+            ++w->files;
+        else
+            ++w->failed;
+    }
+    return NULL;
+}
+
+
+static void usage(void)
+{
+    fprintf(stderr,
+        "Usage: vgmbatch [options] file.vgm... | @list.txt\n"
+        "  -j threads   worker threads (default: all cores)\n"
+        "  -r rate      sample rate (default 44100)\n"
+        "  -b block     samples per vgm_get_samples() and APU call (default %d, at most %u)\n"
+        "  -l loops     times the loop is played after the first pass (default 1)\n"
+        "  -f wav|raw   output format (default wav)\n"
+        "  -o dir       output directory (default .)\n"
+        "  -n           render only, do not write output\n"
+        "  -t           skip leading and trailing silence\n", NESAPU_MAX_SAMPLES, NESAPU_BLOCK_LIMIT);
+}
+
+
+int main(int argc, char **argv)
+{
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    batch.threads = cores > 0 ? (unsigned int)cores : 1;
+    batch.rate = 44100;
+    batch.block = NESAPU_MAX_SAMPLES;
+    batch.loops = 1;
+    batch.wav = true;
+    batch.write = true;
+    batch.options = VGM_PLAYBACK_FADEOUT;
+    batch.out_dir = ".";
+    size_t cap = 0;
+    int opt;
+    while ((opt = getopt(argc, argv, "j:r:b:l:f:o:nt")) != -1)
+    {
+        switch (opt)
+        {
+        case 'j': batch.threads = (unsigned int)atoi(optarg); break;
+        case 'r': batch.rate = (unsigned int)atoi(optarg); break;
+        case 'b': batch.block = (unsigned int)atoi(optarg); break;
+        case 'l': batch.loops = (unsigned int)atoi(optarg); break;
+        case 'f': batch.wav = (strcmp(optarg, "raw") != 0); break;
+        case 'o': batch.out_dir = optarg; break;
+        case 'n': batch.write = false; break;
+        case 't': batch.options |= VGM_PLAYBACK_SKIP_SILENCE | VGM_PLAYBACK_TRIM_SILENCE; break;
+        default: usage(); return 2;
+        }
+    }
+    if (batch.threads == 0 || batch.rate == 0 || batch.block == 0 || batch.block > NESAPU_BLOCK_LIMIT || batch.loops > INT_MAX)
+    {
+        usage();
+        return 2;
+    }
+    for (int i = optind; i < argc; ++i)
+    {
+        bool ok = (argv[i][0] == '@') ? add_list(argv[i] + 1, &cap) : add_job(argv[i], &cap);
+        if (!ok) return 1;
+    }
+    if (batch.job_count == 0)
+    {
+        usage();
+        return 2;
+    }
+    if (batch.threads > batch.job_count) batch.threads = (unsigned int)batch.job_count;
+
+    double t0 = now();
+    // Longest first
+    for (size_t i = 0; i < batch.job_count; ++i)
+    {
+        batch.jobs[i].cost = read_cost(batch.jobs[i].path);
+    }
+    qsort(batch.jobs, batch.job_count, sizeof(job_t), cmp_job_cost);
+    // Deal round robin, each queue is also longest first
+    batch.order = (size_t *)malloc(batch.job_count * sizeof(size_t));
+    batch.queues = (queue_t *)calloc(batch.threads, sizeof(queue_t));
+    batch.workers = (worker_t *)calloc(batch.threads, sizeof(worker_t));
+    if (!batch.order || !batch.queues || !batch.workers) return 1;
+    size_t per_queue = (batch.job_count + batch.threads - 1) / batch.threads;
+    for (unsigned int t = 0; t < batch.threads; ++t)
+    {
+        queue_t *q = &batch.queues[t];
+        pthread_mutex_init(&q->lock, NULL);
+        q->items = batch.order + t * per_queue;
+        q->head = q->tail = 0;
+        for (size_t i = t; i < batch.job_count; i += batch.threads)
+        {
+            q->items[q->tail++] = i;
+        }
+    }
+    double t1 = now();
+    unsigned int started = 0;
+    for (unsigned int t = 0; t < batch.threads; ++t)
+    {
+        worker_t *w = &batch.workers[t];
+        w->id = t;
+        w->samples = (int16_t *)malloc(batch.block * sizeof(int16_t));
+        w->io_buffer = (char *)malloc(BATCH_IO_BUFFER_SIZE);
+        if (!w->samples || !w->io_buffer) break;
+        if (pthread_create(&w->thread, NULL, worker_main, w) != 0) break;
+        ++started;
+    }
+    if (started == 0) return 1;
+    unsigned long files = 0, failed = 0, steals = 0;
+    unsigned long long rendered = 0;
+    for (unsigned int t = 0; t < started; ++t)
+    {
+        worker_t *w = &batch.workers[t];
+        pthread_join(w->thread, NULL);
+        files += w->files;
+        failed += w->failed;
+        rendered += w->rendered;
+        steals += w->steals;
+    }
+    double t2 = now();
+
+    double secs = t2 - t1;
+    printf("files:       %lu rendered, %lu failed\n", files, failed);
+    printf("threads:     %u (%lu steals)\n", started, steals);
+    printf("samples:     %llu (%.1f s of audio at %u Hz)\n", rendered, (double)rendered / batch.rate, batch.rate);
+    printf("scan:        %.3f s\n", t1 - t0);
+    printf("render:      %.3f s\n", secs);
+    if (secs > 0)
+    {
+        printf("throughput:  %.0f samples/s, %.1f files/s, %.1fx realtime\n",
+            (double)rendered / secs, (double)(files + failed) / secs, (double)rendered / batch.rate / secs);
+    }
+    for (unsigned int t = 0; t < batch.threads; ++t)
+    {
+        free(batch.workers[t].samples);
+        free(batch.workers[t].io_buffer);
+        pthread_mutex_destroy(&batch.queues[t].lock);
+    }
+    free(batch.workers);
+    free(batch.queues);
+    free(batch.order);
+    free(batch.jobs);
+    return failed ? 1 : 0;
+}
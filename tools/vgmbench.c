@@ -0,0 +1,1547 @@
+//
+// vgmbench: decoder benchmarks
+//
+// Usage: vgmbench [-r rate] [-b block] [-j threads] [-x speed] <command> [file.vgm...]
+//
+// Commands:
+//   scale      Run independent decoder instances on 1, 2, 4 ... threads, report aggregate
+//              samples/s and check every instance renders the same output as a single one.
+//   stream     Play through vgm_stream with a paced consumer, report underruns and worst
+//              consumer call time against calling vgm_get_samples() directly.
+//   blip       Cost of blip_read_samples() of one block at different buffer fill levels.
+//   kernels    Check every blip_add_delta() kernel gives the same output as the scalar one,
+//              and time them.
+//   formats    Stereo float / int32 straight from the decoder against int16 plus a conversion
+//              pass, and check they agree.
+//   skip       Fast-forward with vgm_skip_samples() against rendering the same span, and
+//              check channel state matches every second.
+//   analyze    Time vgm_analyze(), show length, loop and end of sound next to the header, and
+//              check rendering has no sound after the reported end.
+//   trim       Play with leading and trailing silence skipped against full playback, report
+//              samples and time saved.
+//   loops      Play looped files endlessly for many passes, check RAM blocks stay flat and
+//              vgm_request_fade() ends playback after the fade.
+//   ram        Count APU RAM reads from the file during playback, build with
+//              -DNESAPU_USE_RAM_IMAGE=0 to compare against the RAM cache.
+//   noise      Noise channel alone at every period in both modes, and with mode and period
+//              changing, time per sample and output hashes to compare builds.
+//   timer      Pulse, triangle and DMC alone at short to long periods, rendered and skipped,
+//              time per sample and output hashes to compare builds.
+//   block      Throughput against block size from 64 to 65536 samples, blip buffer sized to the
+//              block against the default size with blocks split.
+//   bank       Move RAM blocks to compressed data bank blocks, check rendering is the same,
+//              report file size, render time and decompression speed.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "vgm_conf.h"
+#include "vgm.h"
+#include "mem_reader.h"
+#include "vgm_stream.h"
+#include "blip_buf.h"
+
+
+typedef struct bench_file_s
+{
+    const char *path;
+    uint8_t *data;
+    size_t size;
+} bench_file_t;
+
+
+static struct
+{
+    unsigned int rate;
+    unsigned int block;
+    unsigned int threads;
+    unsigned int speed;
+    bench_file_t *files;
+    unsigned int file_count;
+} bench;
+
+
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+
+static bool load_file(bench_file_t *f)
+{
+    FILE *fd = fopen(f->path, "rb");
+    if (NULL == fd) return false;
+    bool ok = false;
+    do
+    {
+        if (fseek(fd, 0, SEEK_END) != 0) break;
+        long size = ftell(fd);
+        if (size <= 0 || fseek(fd, 0, SEEK_SET) != 0) break;
+        f->data = (uint8_t *)malloc((size_t)size);
+        if (NULL == f->data) break;
+        f->size = fread(f->data, 1, (size_t)size, fd);
+        ok = (f->size == (size_t)size);
+    } while (0);
+    fclose(fd);
+    return ok;
+}
+
+
+static void sleep_until(double t)
+{
+    double d = t - now();
+    if (d > 0)
+    {
+        struct timespec ts = { (time_t)d, (long)((d - (double)(time_t)d) * 1e9) };
+        nanosleep(&ts, NULL);
+    }
+}
+
+
+static uint32_t hash_samples(uint32_t h, const int16_t *buf, int n)
+{
+    for (int i = 0; i < n; ++i)
+    {
+        h = (h ^ (uint16_t)buf[i]) * 16777619U;
+    }
+    return h;
+}
+
+
+// Render file from memory with its own reader and decoder.
+// return # of samples, -1 on error. *hash is FNV-1a of the output, *worst (if not NULL) the
+// longest vgm_get_samples() call in seconds.
+static long render_file(const bench_file_t *f, int16_t *buf, uint32_t *hash, double *worst)
+{
+    long total = -1;
+    uint32_t h = 2166136261U;
+    file_reader_t *reader = mem_reader_create(f->data, f->size);
+    vgm_t *vgm = reader ? vgm_create(reader) : NULL;
+    if (vgm && vgm_prepare_playback(vgm, bench.rate, VGM_PLAYBACK_FADEOUT))
+    {
+        int n;
+        total = 0;
+        double t = worst ? now() : 0;
+        if (worst) *worst = 0;
+        while ((n = vgm_get_samples(vgm, buf, bench.block)) > 0)
+        {
+            if (worst)
+            {
+                double t1 = now();
+                if (t1 - t > *worst) *worst = t1 - t;
+            }
+            h = hash_samples(h, buf, n);
+            total += n;
+            if (worst) t = now();
+        }
+        if (n < 0) total = -1;
+    }
+    if (vgm) vgm_destroy(vgm);
+    if (reader) mem_reader_destroy(reader);
+    *hash = h;
+    return total;
+}
+
+
+//
+// scale
+//
+typedef struct scale_worker_s
+{
+    pthread_t thread;
+    const uint32_t *expect;     // Expected hash of each file
+    unsigned long long samples;
+    unsigned int mismatches;
+} scale_worker_t;
+
+
+static void *scale_main(void *arg)
+{
+    scale_worker_t *w = (scale_worker_t *)arg;
+    int16_t *buf = (int16_t *)malloc(bench.block * sizeof(int16_t));
+    if (NULL == buf) return NULL;
+    for (unsigned int i = 0; i < bench.file_count; ++i)
+    {
+        uint32_t hash;
+        long n = render_file(&bench.files[i], buf, &hash, NULL);
+        if (n < 0 || hash != w->expect[i])
+            ++w->mismatches;
+        else
+            w->samples += (unsigned long long)n;
+    }
+    free(buf);
+    return NULL;
+}
+
+
+static int cmd_scale(void)
+{
+    uint32_t *expect = (uint32_t *)malloc(bench.file_count * sizeof(uint32_t));
+    scale_worker_t *workers = (scale_worker_t *)calloc(bench.threads, sizeof(scale_worker_t));
+    int16_t *buf = (int16_t *)malloc(bench.block * sizeof(int16_t));
+    if (!expect || !workers || !buf) return 1;
+    // Reference output, rendered alone
+    for (unsigned int i = 0; i < bench.file_count; ++i)
+    {
+        if (render_file(&bench.files[i], buf, &expect[i], NULL) < 0)
+        {
+            fprintf(stderr, "%s: render failed\n", bench.files[i].path);
+            return 1;
+        }
+    }
+    free(buf);
+    int ret = 0;
+    double base = 0;
+    printf("threads      samples/s    speedup  efficiency  mismatches\n");
+    for (unsigned int n = 1; n <= bench.threads; n = (n == bench.threads) ? n + 1 : ((n * 2 > bench.threads) ? bench.threads : n * 2))
+    {
+        memset(workers, 0, bench.threads * sizeof(scale_worker_t));
+        double t0 = now();
+        unsigned int started = 0;
+        for (unsigned int t = 0; t < n; ++t)
+        {
+            workers[t].expect = expect;
+            if (pthread_create(&workers[t].thread, NULL, scale_main, &workers[t]) != 0) break;
+            ++started;
+        }
+        unsigned long long samples = 0;
+        unsigned int mismatches = 0;
+        for (unsigned int t = 0; t < started; ++t)
+        {
+            pthread_join(workers[t].thread, NULL);
+            samples += workers[t].samples;
+            mismatches += workers[t].mismatches;
+        }
+        double rate = (double)samples / (now() - t0);
+        if (n == 1) base = rate;
+        printf("%7u  %13.0f  %8.2fx  %9.0f%%  %10u\n", started, rate, rate / base, 100.0 * rate / base / started, mismatches);
+        if (mismatches || started < n) ret = 1;
+    }
+    free(workers);
+    free(expect);
+    return ret;
+}
+
+
+//
+// stream
+//
+static int cmd_stream(void)
+{
+    int16_t *buf = (int16_t *)malloc(bench.block * sizeof(int16_t));
+    if (NULL == buf) return 1;
+    // Ring of 16 blocks, refilled from 4 to 12 blocks
+    unsigned int capacity = bench.block * 16;
+    int ret = 0;
+    printf("%-24s %10s %9s %9s %9s %7s %12s %12s  %s\n",
+           "file", "samples", "underrun", "padded", "min_level", "fills", "worst_read", "worst_direct", "output");
+    for (unsigned int i = 0; i < bench.file_count; ++i)
+    {
+        const bench_file_t *f = &bench.files[i];
+        uint32_t hash;
+        double worst_direct;
+        long expect = render_file(f, buf, &hash, &worst_direct);
+        if (expect < 0)
+        {
+            fprintf(stderr, "%s: render failed\n", f->path);
+            ret = 1;
+            continue;
+        }
+        file_reader_t *reader = mem_reader_create(f->data, f->size);
+        vgm_t *vgm = reader ? vgm_create(reader) : NULL;
+        vgm_stream_t *stream = NULL;
+        if (vgm && vgm_prepare_playback(vgm, bench.rate, VGM_PLAYBACK_FADEOUT))
+        {
+            stream = vgm_stream_create(vgm, capacity, bench.block * 4, bench.block * 12);
+        }
+        // Producer paces itself for the consumer speed
+        if (NULL == stream || !vgm_stream_start(stream, bench.rate * bench.speed))
+        {
+            fprintf(stderr, "%s: stream failed\n", f->path);
+            ret = 1;
+        }
+        else
+        {
+            // Consumer pulls one block per period, like an audio callback at speed x real-time
+            double period = (double)bench.block / bench.rate / bench.speed;
+            double next = now();
+            double worst_read = 0;
+            long samples = 0;
+            while (!vgm_stream_finished(stream))
+            {
+                next += period;
+                sleep_until(next);
+                double t = now();
+                unsigned int n = vgm_stream_read(stream, buf, bench.block);
+                t = now() - t;
+                if (t > worst_read) worst_read = t;
+                samples += (long)n;
+            }
+            vgm_stream_stats_t stats;
+            vgm_stream_get_stats(stream, &stats);
+            // Output is not compared sample by sample, synthesis depends on how the calls are split
+            printf("%-24.24s %10ld %9lu %9lu %9u %7lu %10.1fus %10.1fus  %s\n",
+                   f->path, samples, stats.underruns, stats.underrun_samples, stats.min_level, stats.fills,
+                   worst_read * 1e6, worst_direct * 1e6, (samples == expect) ? "complete" : "SHORT");
+            if (samples != expect) ret = 1;
+        }
+        if (stream) vgm_stream_destroy(stream);
+        if (vgm) vgm_destroy(vgm);
+        if (reader) mem_reader_destroy(reader);
+    }
+    free(buf);
+    return ret;
+}
+
+
+//
+// blip
+//
+#define BLIP_BENCH_SIZE     8192
+#define BLIP_BENCH_CLOCK    1789773
+#define BLIP_BENCH_READS    100000
+
+static int cmd_blip(void)
+{
+    blip_t *blip = blip_new(BLIP_BENCH_SIZE);
+    int16_t *buf = (int16_t *)malloc(bench.block * sizeof(int16_t));
+    if (!blip || !buf) return 1;
+    blip_set_rates(blip, BLIP_BENCH_CLOCK, bench.rate);
+    printf("     fill   ns/block  ns/sample\n");
+    for (unsigned int fill = 0; fill + bench.block <= BLIP_BENCH_SIZE; fill = fill ? fill * 2 : 128)
+    {
+        blip_clear(blip);
+        for (unsigned int n = 0; n < fill; n += 1024)
+        {
+            // Frames are limited to blip_max_frame samples
+            blip_end_frame(blip, (unsigned int)blip_clocks_needed(blip, 1024));
+        }
+        // Keep fill samples buffered: per block, add a square wave and read the block out.
+        int level = 1000;
+        double t0 = now();
+        for (int i = 0; i < BLIP_BENCH_READS; ++i)
+        {
+            unsigned int clocks = (unsigned int)blip_clocks_needed(blip, (int)bench.block);
+            for (unsigned int t = 0; t < clocks; t += 200)
+            {
+                blip_add_delta(blip, t + 1, level);
+                level = -level;
+            }
+            blip_end_frame(blip, clocks);
+            blip_read_samples(blip, buf, (int)bench.block, 0);
+        }
+        // Synthesis part is the same at all fill levels, so growth is read cost
+        double per_block = (now() - t0) * 1e9 / BLIP_BENCH_READS;
+        printf("%9u  %9.1f  %9.2f\n", fill, per_block, per_block / bench.block);
+    }
+    blip_delete(blip);
+    free(buf);
+    return 0;
+}
+
+
+//
+// kernels
+//
+#define KERNEL_BENCH_BLOCKS 20000
+
+// Render the same pseudo random level changes with each kernel. Steps are mostly small, like APU
+// output, with some full scale ones beyond 16 bits to cover the kernels' fallback.
+static bool kernel_render(int kernel, int16_t *out, unsigned int blocks, unsigned int block, double *spent)
+{
+    blip_t *blip = blip_new((int)block);
+    if (NULL == blip) return false;
+    if (!blip_set_kernel(blip, kernel))
+    {
+        blip_delete(blip);
+        return false;
+    }
+    blip_set_rates(blip, BLIP_BENCH_CLOCK, bench.rate);
+    uint32_t seed = 12345;
+    int level = 0;
+    *spent = 0;
+    for (unsigned int b = 0; b < blocks; ++b)
+    {
+        unsigned int clocks = (unsigned int)blip_clocks_needed(blip, (int)block);
+        double t0 = now();
+        for (unsigned int t = 0; t < clocks; )
+        {
+            seed = seed * 1664525U + 1013904223U;
+            int next = (int)(seed >> 16) - 32768;
+            if ((seed & 0xF0) != 0) next >>= 4;
+            blip_add_delta(blip, t, next - level);
+            level = next;
+            t += 1 + ((seed >> 8) & 63);
+        }
+        *spent += now() - t0;
+        blip_end_frame(blip, clocks);
+        blip_read_samples(blip, out + (size_t)b * block, (int)block, 0);
+    }
+    blip_delete(blip);
+    return true;
+}
+
+
+static int cmd_kernels(void)
+{
+    static const int kernels[] = { blip_kernel_scalar, blip_kernel_vector, blip_kernel_sse2, blip_kernel_avx2 };
+    size_t total = (size_t)KERNEL_BENCH_BLOCKS * bench.block;
+    int16_t *ref = (int16_t *)malloc(total * sizeof(int16_t));
+    int16_t *out = (int16_t *)malloc(total * sizeof(int16_t));
+    blip_t *blip = blip_new(1);
+    if (!ref || !out || !blip) return 1;
+    printf("default kernel: %s\n", blip_kernel_name(blip_get_kernel(blip)));
+    blip_delete(blip);
+    double base = 0;
+    if (!kernel_render(blip_kernel_scalar, ref, KERNEL_BENCH_BLOCKS, bench.block, &base))
+    {
+        fprintf(stderr, "scalar kernel render failed\n");
+        free(ref);
+        free(out);
+        return 1;
+    }
+    int ret = 0;
+    printf("kernel    add_delta time  speedup  output\n");
+    for (size_t i = 0; i < sizeof(kernels) / sizeof(kernels[0]); ++i)
+    {
+        double spent;
+        if (!kernel_render(kernels[i], out, KERNEL_BENCH_BLOCKS, bench.block, &spent))
+        {
+            printf("%-8s  %14s  %7s  %s\n", blip_kernel_name(kernels[i]), "-", "-", "unsupported");
+            continue;
+        }
+        bool same = (memcmp(ref, out, total * sizeof(int16_t)) == 0);
+        printf("%-8s  %12.1fms  %6.2fx  %s\n", blip_kernel_name(kernels[i]), spent * 1e3, base / spent, same ? "identical" : "DIFFERENT");
+        if (!same) ret = 1;
+    }
+    free(ref);
+    free(out);
+    return ret;
+}
+
+
+//
+// formats
+//
+typedef struct format_pass_s
+{
+    file_reader_t *reader;
+    vgm_t *vgm;
+    double spent;
+} format_pass_t;
+
+
+static int cmd_formats(void)
+{
+    static const vgm_output_t stereo_f32 = { VGM_FORMAT_F32, 2, 2 };
+    static const vgm_output_t stereo_s32 = { VGM_FORMAT_S32, 2, 2 };
+    int16_t *s16 = (int16_t *)malloc(bench.block * sizeof(int16_t));
+    float *f32 = (float *)malloc(bench.block * 2 * sizeof(float));
+    float *conv = (float *)malloc(bench.block * 2 * sizeof(float));
+    int32_t *s32 = (int32_t *)malloc(bench.block * 2 * sizeof(int32_t));
+    if (!s16 || !f32 || !conv || !s32) return 1;
+    int ret = 0;
+    printf("%-24s %16s %12s %12s  %s\n", "file", "s16+convert", "f32 direct", "s32 direct", "output");
+    for (unsigned int i = 0; i < bench.file_count; ++i)
+    {
+        const bench_file_t *f = &bench.files[i];
+        // Same calls on three decoders, so outputs line up
+        format_pass_t pass[3];
+        bool ok = true;
+        memset(pass, 0, sizeof(pass));
+        for (int k = 0; k < 3; ++k)
+        {
+            pass[k].reader = mem_reader_create(f->data, f->size);
+            pass[k].vgm = pass[k].reader ? vgm_create(pass[k].reader) : NULL;
+            if (NULL == pass[k].vgm || !vgm_prepare_playback(pass[k].vgm, bench.rate, VGM_PLAYBACK_FADEOUT)) ok = false;
+        }
+        unsigned long mismatches = 0;
+        while (ok)
+        {
+            double t0 = now();
+            int n = vgm_get_samples(pass[0].vgm, s16, bench.block);
+            for (int j = 0; j < n; ++j)
+            {
+                conv[2 * j] = conv[2 * j + 1] = (float)s16[j] * (1.0f / 32768.0f);
+            }
+            double t1 = now();
+            int n1 = vgm_get_samples_ex(pass[1].vgm, f32, bench.block, &stereo_f32);
+            double t2 = now();
+            int n2 = vgm_get_samples_ex(pass[2].vgm, s32, bench.block, &stereo_s32);
+            double t3 = now();
+            pass[0].spent += t1 - t0;
+            pass[1].spent += t2 - t1;
+            pass[2].spent += t3 - t2;
+            if (n != n1 || n != n2)
+            {
+                ok = false;
+                break;
+            }
+            if (n <= 0) break;
+            // Wider formats carry the int16 sample plus fraction. Without blip, int16 output filters
+            // samples already rounded to 16 bits, so it can be one lower.
+            for (int j = 0; j < n; ++j)
+            {
+                int32_t high = s32[2 * j] >> 16;
+                if (high < s16[j] || high > s16[j] + 1 || s32[2 * j + 1] != s32[2 * j] ||
+                    f32[2 * j] < conv[2 * j] || f32[2 * j] > conv[2 * j] + (2.0f / 32768.0f) || f32[2 * j + 1] != f32[2 * j])
+                {
+                    ++mismatches;
+                }
+            }
+        }
+        if (ok)
+        {
+            printf("%-24.24s %14.1fms %10.1fms %10.1fms  %s\n", f->path, pass[0].spent * 1e3, pass[1].spent * 1e3,
+                   pass[2].spent * 1e3, mismatches ? "MISMATCH" : "consistent");
+        }
+        else
+        {
+            fprintf(stderr, "%s: render failed\n", f->path);
+        }
+        if (!ok || mismatches) ret = 1;
+        for (int k = 0; k < 3; ++k)
+        {
+            if (pass[k].vgm) vgm_destroy(pass[k].vgm);
+            if (pass[k].reader) mem_reader_destroy(pass[k].reader);
+        }
+    }
+    free(s16);
+    free(f32);
+    free(conv);
+    free(s32);
+    return ret;
+}
+
+
+//
+// skip
+//
+typedef struct skip_pass_s
+{
+    file_reader_t *reader;
+    vgm_t *vgm;
+} skip_pass_t;
+
+
+static bool skip_open(skip_pass_t *pass, const bench_file_t *f)
+{
+    pass->reader = mem_reader_create(f->data, f->size);
+    pass->vgm = pass->reader ? vgm_create(pass->reader) : NULL;
+    return pass->vgm && vgm_prepare_playback(pass->vgm, bench.rate, VGM_PLAYBACK_FADEOUT);
+}
+
+
+static void skip_close(skip_pass_t *pass)
+{
+    if (pass->vgm) vgm_destroy(pass->vgm);
+    if (pass->reader) mem_reader_destroy(pass->reader);
+}
+
+
+// Envelope, sweep, length and sequencer state, which skipping shall reproduce. Timer phases
+// are not compared, sweep updates land within a sample period of the rendered ones. Noise is
+// only exact with event synthesis, the sampled one clocks it by run length after period writes.
+// Fade is stepped per run when rendering, per sample when skipping.
+static unsigned int skip_compare(const nesapu_t *a, const nesapu_t *b)
+{
+    unsigned int diff = 0;
+    for (int ch = 0; ch < 2; ++ch)
+    {
+        diff += a->pulse[ch].length_value != b->pulse[ch].length_value;
+        diff += a->pulse[ch].envelope_decay != b->pulse[ch].envelope_decay;
+        diff += a->pulse[ch].timer_period != b->pulse[ch].timer_period;
+        diff += a->pulse[ch].sweep_value != b->pulse[ch].sweep_value;
+    }
+    diff += a->triangle_length_value != b->triangle_length_value;
+    diff += a->triangle_linear_value != b->triangle_linear_value;
+    diff += a->noise_length_value != b->noise_length_value;
+    diff += a->noise_envelope_decay != b->noise_envelope_decay;
+#if NESAPU_USE_EVENT_SYNTH
+    diff += a->noise_mode != b->noise_mode;
+    diff += a->noise_index != b->noise_index;
+    diff += a->noise_mode && memcmp(a->noise_short_bits, b->noise_short_bits, sizeof(a->noise_short_bits)) != 0;
+#endif
+    diff += a->dmc_read_addr != b->dmc_read_addr;
+    diff += a->sequencer_step != b->sequencer_step;
+    diff += a->frame_accu_fp != b->frame_accu_fp;
+    return diff;
+}
+
+
+static int cmd_skip(void)
+{
+    int16_t *buf = (int16_t *)malloc(bench.block * sizeof(int16_t));
+    if (NULL == buf) return 1;
+    int ret = 0;
+    printf("%-24s %10s %11s %11s %9s  %s\n", "file", "samples", "render", "skip", "speedup", "state");
+    for (unsigned int i = 0; i < bench.file_count; ++i)
+    {
+        const bench_file_t *f = &bench.files[i];
+        skip_pass_t render, skip;
+        memset(&render, 0, sizeof(render));
+        memset(&skip, 0, sizeof(skip));
+        bool ok = skip_open(&render, f) && skip_open(&skip, f);
+        long rendered = 0, skipped = 0;
+        double t_render = 0, t_skip = 0;
+        unsigned int checks = 0, diffs = 0;
+        // Render and skip side by side in steps of 1s, compare state at each step
+        while (ok)
+        {
+            int n = 0, m;
+            double t0 = now();
+            for (unsigned int k = 0; k < bench.rate; k += (unsigned int)n)
+            {
+                unsigned int size = bench.rate - k < bench.block ? bench.rate - k : bench.block;
+                if ((n = vgm_get_samples(render.vgm, buf, size)) <= 0) break;
+                rendered += n;
+            }
+            double t1 = now();
+            m = vgm_skip_samples(skip.vgm, bench.rate);
+            double t2 = now();
+            t_render += t1 - t0;
+            t_skip += t2 - t1;
+            if (n < 0 || m < 0)
+            {
+                ok = false;
+                break;
+            }
+            skipped += m;
+            if (rendered != skipped) break;
+            ++checks;
+            if (skip_compare(render.vgm->apu, skip.vgm->apu)) ++diffs;
+            if ((unsigned int)m < bench.rate) break;
+        }
+        if (ok && rendered == skipped)
+        {
+            printf("%-24.24s %10ld %9.1fms %9.2fms %8.1fx  %u/%u match\n", f->path, rendered, t_render * 1e3,
+                   t_skip * 1e3, t_render / t_skip, checks - diffs, checks);
+        }
+        else
+        {
+            fprintf(stderr, "%s: %s\n", f->path, ok ? "skipped length differs" : "render failed");
+        }
+        if (!ok || rendered != skipped || diffs) ret = 1;
+        skip_close(&render);
+        skip_close(&skip);
+    }
+    free(buf);
+    return ret;
+}
+
+
+//
+// analyze
+//
+#define ANALYZE_SOUND_DELTA     16      // Change of sample step taken as sound when checking against rendering
+
+// Render once without loop and fade. return position after last change of sample step above
+// ANALYZE_SOUND_DELTA (level steps, not the slow decay of the high-pass), -1 on error.
+static long analyze_render_end(const bench_file_t *f, int16_t *buf)
+{
+    long end = -1;
+    file_reader_t *reader = mem_reader_create(f->data, f->size);
+    vgm_t *vgm = reader ? vgm_create(reader) : NULL;
+    if (vgm) vgm_set_loops(vgm, 0);
+    if (vgm && vgm_prepare_playback(vgm, VGM_SAMPLE_RATE, 0))
+    {
+        long pos = 0;
+        int prev = 0, step = 0;
+        int n;
+        end = 0;
+        while ((n = vgm_get_samples(vgm, buf, bench.block)) > 0)
+        {
+            for (int j = 0; j < n; ++j)
+            {
+                int d = buf[j] - prev;
+                if (abs(d - step) > ANALYZE_SOUND_DELTA) end = pos + j + 1;
+                step = d;
+                prev = buf[j];
+            }
+            pos += n;
+        }
+        if (n < 0) end = -1;
+    }
+    if (vgm) vgm_destroy(vgm);
+    if (reader) mem_reader_destroy(reader);
+    return end;
+}
+
+
+static int cmd_analyze(void)
+{
+    int16_t *buf = (int16_t *)malloc(bench.block * sizeof(int16_t));
+    if (NULL == buf) return 1;
+    int ret = 0;
+    printf("%-24s %9s %10s %21s %10s %10s %9s  %s\n", "file", "time", "total", "loop", "audible", "rendered", "header",
+           "sound end");
+    for (unsigned int i = 0; i < bench.file_count; ++i)
+    {
+        const bench_file_t *f = &bench.files[i];
+        file_reader_t *reader = mem_reader_create(f->data, f->size);
+        vgm_t *vgm = reader ? vgm_create(reader) : NULL;
+        vgm_analysis_t a;
+        double t = now();
+        bool ok = vgm && vgm_analyze(vgm, &a);
+        t = now() - t;
+        long rendered = ok ? analyze_render_end(f, buf) : -1;
+        if (ok && rendered >= 0)
+        {
+            char loop[32] = "-";
+            if (a.loop_samples) snprintf(loop, sizeof(loop), "%c %lu+%lu", a.loop_detected ? 'D' : 'H', a.loop_start, a.loop_samples);
+            // Analysis shall not report silence where rendering has sound
+            bool late = (unsigned long)rendered > a.audible_samples + VGM_SAMPLE_RATE / 240;
+            bool header = (a.total_samples == vgm->total_samples) && (a.loop_detected || a.loop_samples == vgm->loop_samples);
+            printf("%-24.24s %7.2fms %10lu %21s %10lu %10ld %9s  %s\n", f->path, t * 1e3, a.total_samples, loop,
+                   a.audible_samples, rendered, header ? "agrees" : "differs", late ? "LATE" : "ok");
+            if (late) ret = 1;
+        }
+        else
+        {
+            fprintf(stderr, "%s: analysis failed\n", f->path);
+            ret = 1;
+        }
+        if (vgm) vgm_destroy(vgm);
+        if (reader) mem_reader_destroy(reader);
+    }
+    free(buf);
+    return ret;
+}
+
+
+//
+// trim
+//
+
+// Prepare (timed, silence options analyze the track) and render with fade.
+// return # of samples, -1 on error. *start is the position playback starts at.
+static long trim_render(const bench_file_t *f, unsigned int options, int16_t *buf, unsigned long *start, double *spent)
+{
+    long total = -1;
+    file_reader_t *reader = mem_reader_create(f->data, f->size);
+    vgm_t *vgm = reader ? vgm_create(reader) : NULL;
+    double t = now();
+    if (vgm && vgm_prepare_playback(vgm, bench.rate, options))
+    {
+        int n;
+        *start = vgm->played_samples;
+        total = 0;
+        while ((n = vgm_get_samples(vgm, buf, bench.block)) > 0) total += n;
+        if (n < 0) total = -1;
+    }
+    *spent = now() - t;
+    if (vgm) vgm_destroy(vgm);
+    if (reader) mem_reader_destroy(reader);
+    return total;
+}
+
+
+static int cmd_trim(void)
+{
+    int16_t *buf = (int16_t *)malloc(bench.block * sizeof(int16_t));
+    if (NULL == buf) return 1;
+    int ret = 0;
+    unsigned long long full_sum = 0, trim_sum = 0;
+    double full_time = 0, trim_time = 0;
+    printf("%-24s %10s %10s %10s %10s %10s %10s %7s\n", "file", "full", "time", "lead", "trimmed", "time", "tail", "saved");
+    for (unsigned int i = 0; i < bench.file_count; ++i)
+    {
+        const bench_file_t *f = &bench.files[i];
+        unsigned long start = 0, lead = 0;
+        double t_full, t_trim;
+        long full = trim_render(f, VGM_PLAYBACK_FADEOUT, buf, &start, &t_full);
+        long trimmed = trim_render(f, VGM_PLAYBACK_FADEOUT | VGM_PLAYBACK_SKIP_SILENCE | VGM_PLAYBACK_TRIM_SILENCE, buf,
+                                   &lead, &t_trim);
+        if (full < 0 || trimmed < 0 || (unsigned long)trimmed + lead > (unsigned long)full)
+        {
+            fprintf(stderr, "%s: %s\n", f->path, (full < 0 || trimmed < 0) ? "render failed" : "trimmed past end");
+            ret = 1;
+            continue;
+        }
+        long tail = full - (long)lead - trimmed;
+        printf("%-24.24s %10ld %8.2fms %10lu %10ld %8.2fms %10ld %6.1f%%\n", f->path, full, t_full * 1e3, lead, trimmed,
+               t_trim * 1e3, tail, full ? 100.0 * (double)(full - trimmed) / (double)full : 0.0);
+        full_sum += (unsigned long long)full;
+        trim_sum += (unsigned long long)trimmed;
+        full_time += t_full;
+        trim_time += t_trim;
+    }
+    if (full_sum)
+    {
+        printf("%llu of %llu samples rendered (%.1f%% saved), %.2fms against %.2fms\n", trim_sum, full_sum,
+               100.0 * (double)(full_sum - trim_sum) / (double)full_sum, trim_time * 1e3, full_time * 1e3);
+    }
+    free(buf);
+    return ret;
+}
+
+
+//
+// loops
+//
+#define LOOPS_PASSES    16      // Loop passes played before fade is requested
+
+static int cmd_loops(void)
+{
+    int16_t *buf = (int16_t *)malloc(bench.block * sizeof(int16_t));
+    if (NULL == buf) return 1;
+    int ret = 0;
+    printf("%-24s %7s %11s %10s %9s %12s %12s %8s\n", "file", "passes", "samples", "time", "realtime", "ram blocks",
+           "fade tail", "memory");
+    for (unsigned int i = 0; i < bench.file_count; ++i)
+    {
+        const bench_file_t *f = &bench.files[i];
+        file_reader_t *reader = mem_reader_create(f->data, f->size);
+        vgm_t *vgm = reader ? vgm_create(reader) : NULL;
+        if (vgm && 0 == vgm->loop_offset)
+        {
+            printf("%-24.24s %7s\n", f->path, "-");
+        }
+        else if (vgm)
+        {
+            vgm_set_loops(vgm, VGM_LOOP_FOREVER);
+            bool ok = vgm_prepare_playback(vgm, bench.rate, VGM_PLAYBACK_FADEOUT);
+            unsigned long pass = (unsigned long)((uint64_t)vgm->loop_samples * bench.rate / VGM_SAMPLE_RATE);
+            unsigned long first = (unsigned long)((uint64_t)vgm->total_samples * bench.rate / VGM_SAMPLE_RATE) + pass;
+            unsigned long target = first + pass * (LOOPS_PASSES - 1);
+            unsigned int ram_first = 0;
+            int n = 0;
+            double t = now();
+            while (ok && vgm->played_samples < target && (n = vgm_get_samples(vgm, buf, bench.block)) > 0)
+            {
+                if (vgm->played_samples <= first) ram_first = vgm->apu->ram_count;
+            }
+            t = now() - t;
+            unsigned int ram_last = vgm->apu->ram_count;
+            unsigned long played = vgm->played_samples;
+            // Fade from here, playback shall end exactly when fade does
+            unsigned long tail = 0;
+            vgm_request_fade(vgm, 0);
+            while (ok && n > 0 && (n = vgm_get_samples(vgm, buf, bench.block)) > 0) tail += (unsigned long)n;
+            bool flat = (ram_last == ram_first);
+            bool faded = (tail == VGM_FADEOUT_SECONDS * bench.rate);
+            if (!ok || n < 0 || played < target)
+            {
+                fprintf(stderr, "%s: playback ended early\n", f->path);
+                ret = 1;
+            }
+            else
+            {
+                char ram[24], fade[24];
+                snprintf(ram, sizeof(ram), "%u -> %u", ram_first, ram_last);
+                snprintf(fade, sizeof(fade), "%lu %s", tail, faded ? "ok" : "WRONG");
+                printf("%-24.24s %7d %11lu %8.2fms %8.1fx %12s %12s %8s\n", f->path, LOOPS_PASSES, played, t * 1e3,
+                       (double)played / bench.rate / t, ram, fade, flat ? "flat" : "GROWS");
+                if (!flat || !faded) ret = 1;
+            }
+        }
+        else
+        {
+            fprintf(stderr, "%s: not a NES APU VGM file\n", f->path);
+            ret = 1;
+        }
+        if (vgm) vgm_destroy(vgm);
+        if (reader) mem_reader_destroy(reader);
+    }
+    free(buf);
+    return ret;
+}
+
+
+//
+// ram
+//
+
+// Reader counting APU RAM traffic. No borrow, so every byte goes through read() as on targets
+// reading from storage.
+typedef struct ram_reader_s
+{
+    file_reader_t reader;
+    file_reader_t *source;
+    unsigned long reads;
+    unsigned long long bytes;
+} ram_reader_t;
+
+
+static size_t ram_reader_read(file_reader_t *reader, uint8_t *buf, size_t offset, size_t len)
+{
+    ram_reader_t *rr = (ram_reader_t *)reader;
+    ++rr->reads;
+    rr->bytes += len;
+    return rr->source->read(rr->source, buf, offset, len);
+}
+
+
+static size_t ram_reader_size(file_reader_t *reader)
+{
+    ram_reader_t *rr = (ram_reader_t *)reader;
+    return rr->source->size(rr->source);
+}
+
+
+static int cmd_ram(void)
+{
+    int16_t *buf = (int16_t *)malloc(bench.block * sizeof(int16_t));
+    if (NULL == buf) return 1;
+    int ret = 0;
+#if NESAPU_USE_RAM_IMAGE
+    printf("APU RAM: %u byte image\n", NESAPU_RAM_IMAGE_SIZE);
+#else
+    printf("APU RAM: %u byte cache\n", NESAPU_RAM_CACHE_SIZE);
+#endif
+    printf("%-24s %11s %7s %10s %12s %10s %10s\n", "file", "samples", "blocks", "reads", "bytes", "bytes/s", "time");
+    for (unsigned int i = 0; i < bench.file_count; ++i)
+    {
+        const bench_file_t *f = &bench.files[i];
+        file_reader_t *reader = mem_reader_create(f->data, f->size);
+        vgm_t *vgm = reader ? vgm_create(reader) : NULL;
+        long total = -1;
+        double t = 0;
+        ram_reader_t rr;
+        memset(&rr, 0, sizeof(rr));
+        if (vgm && vgm_prepare_playback(vgm, bench.rate, VGM_PLAYBACK_FADEOUT))
+        {
+            // Count reads of APU only, VGM data goes through its own cache
+            rr.source = vgm->apu->reader;
+            rr.reader.read = ram_reader_read;
+            rr.reader.size = ram_reader_size;
+            vgm->apu->reader = &(rr.reader);
+            int n;
+            total = 0;
+            t = now();
+            while ((n = vgm_get_samples(vgm, buf, bench.block)) > 0) total += n;
+            t = now() - t;
+            if (n < 0) total = -1;
+        }
+        if (total < 0)
+        {
+            fprintf(stderr, "%s: render failed\n", f->path);
+            ret = 1;
+        }
+        else
+        {
+            double seconds = (double)total / bench.rate;
+            printf("%-24.24s %11ld %7u %10lu %12llu %10.0f %8.2fms\n", f->path, total, vgm->apu->ram_count, rr.reads,
+                   rr.bytes, seconds > 0 ? (double)rr.bytes / seconds : 0.0, t * 1e3);
+        }
+        if (vgm) vgm_destroy(vgm);
+        if (reader) mem_reader_destroy(reader);
+    }
+    free(buf);
+    return ret;
+}
+
+
+//
+// noise
+//
+#define NOISE_BENCH_CLOCK   1789773
+#define NOISE_BENCH_SECONDS 10      // Audio per period and mode
+#define NOISE_BENCH_SWITCH  60      // Audio with mode and period changing
+
+// Render APU without VGM. return FNV-1a of output after h, *spent time taken.
+static uint32_t apu_render(nesapu_t *apu, int16_t *buf, unsigned int samples, uint32_t h, double *spent)
+{
+    double t = now();
+    for (unsigned int done = 0, n; done < samples; done += n)
+    {
+        n = (samples - done < bench.block) ? samples - done : bench.block;
+        nesapu_get_samples(apu, buf, n);
+        h = hash_samples(h, buf, (int)n);
+    }
+    *spent = now() - t;
+    return h;
+}
+
+
+static int cmd_noise(void)
+{
+    int16_t *buf = (int16_t *)malloc(bench.block * sizeof(int16_t));
+    nesapu_t *apu = nesapu_create(NULL, false, NOISE_BENCH_CLOCK, bench.rate, 0);
+    if (NULL == buf || NULL == apu)
+    {
+        free(buf);
+        if (apu) nesapu_destroy(apu);
+        return 1;
+    }
+    uint32_t all = 2166136261U;
+    double spent;
+    printf("period  mode  ns/sample  hash\n");
+    for (unsigned int mode = 0; mode < 2; ++mode)
+    {
+        for (unsigned int period = 0; period < 16; ++period)
+        {
+            nesapu_reset(apu);
+            nesapu_write_reg(apu, 0x15, 0x08);
+            nesapu_write_reg(apu, 0x0C, 0x3F);      // Constant volume 15, length counter halted
+            nesapu_write_reg(apu, 0x0E, (uint8_t)((mode << 7) | period));
+            nesapu_write_reg(apu, 0x0F, 0x08);
+            uint32_t h = apu_render(apu, buf, NOISE_BENCH_SECONDS * bench.rate, 2166136261U, &spent);
+            all = (all ^ h) * 16777619U;
+            printf("%6u  %4s  %9.2f  %08x\n", period, mode ? "93" : "32k", spent * 1e9 / (NOISE_BENCH_SECONDS * bench.rate), h);
+        }
+    }
+    // Mode and period from a fixed pseudo random sequence every 64 to 1023 samples, mostly short periods
+    nesapu_reset(apu);
+    nesapu_write_reg(apu, 0x15, 0x08);
+    nesapu_write_reg(apu, 0x0C, 0x3F);
+    nesapu_write_reg(apu, 0x0F, 0x08);
+    uint32_t seed = 1, h = 2166136261U;
+    double total_spent = 0;
+    for (unsigned int done = 0, n; done < NOISE_BENCH_SWITCH * bench.rate; done += n)
+    {
+        seed = seed * 1103515245U + 12345U;
+        uint8_t val = (uint8_t)(((seed >> 16) & 0x80) | ((seed >> 24) & ((seed & 0x100) ? 0x0F : 0x03)));
+        nesapu_write_reg(apu, 0x0E, val);
+        n = 64 + ((seed >> 8) & 0x3FF) % 960;
+        h = apu_render(apu, buf, n, h, &spent);
+        total_spent += spent;
+    }
+    all = (all ^ h) * 16777619U;
+    printf("switch  both  %9.2f  %08x\n", total_spent * 1e9 / (NOISE_BENCH_SWITCH * bench.rate), h);
+    printf("all hashes %08x\n", all);
+    nesapu_destroy(apu);
+    free(buf);
+    return 0;
+}
+
+
+//
+// timer
+//
+#define TIMER_BENCH_SECONDS 10      // Audio per channel and period, rendered and skipped
+
+typedef struct timer_bench_s
+{
+    const char *name;
+    uint8_t enable;                 // $4015
+    uint8_t regs[4];                // Written to base, base + 1 ...
+    uint16_t base;
+} timer_bench_t;
+
+
+static const timer_bench_t timer_benches[] =
+{
+    // Pulse 1, 50% duty, constant volume 15, length counter halted, timer $008 / $040 / $200 / $7FF
+    { "pulse $008", 0x01, { 0xBF, 0x08, 0x08, 0x08 }, 0x00 },
+    { "pulse $040", 0x01, { 0xBF, 0x08, 0x40, 0x08 }, 0x00 },
+    { "pulse $200", 0x01, { 0xBF, 0x08, 0x00, 0x0A }, 0x00 },
+    { "pulse $7FF", 0x01, { 0xBF, 0x08, 0xFF, 0x0F }, 0x00 },
+    // Triangle, linear counter and length counter halted
+    { "tri $002", 0x04, { 0xFF, 0x00, 0x02, 0x08 }, 0x08 },
+    { "tri $040", 0x04, { 0xFF, 0x00, 0x40, 0x08 }, 0x08 },
+    { "tri $200", 0x04, { 0xFF, 0x00, 0x00, 0x0A }, 0x08 },
+    { "tri $7FF", 0x04, { 0xFF, 0x00, 0xFF, 0x0F }, 0x08 },
+    // DMC looping the longest sample from $C000, no RAM so it reads zeros
+    { "dmc rate 0", 0x10, { 0x40, 0x40, 0x00, 0xFF }, 0x10 },
+    { "dmc rate 8", 0x10, { 0x48, 0x40, 0x00, 0xFF }, 0x10 },
+    { "dmc rate 15", 0x10, { 0x4F, 0x40, 0x00, 0xFF }, 0x10 },
+};
+
+
+static void timer_bench_start(nesapu_t *apu, const timer_bench_t *t)
+{
+    nesapu_reset(apu);
+    for (uint16_t i = 0; i < 4; ++i) nesapu_write_reg(apu, (uint16_t)(t->base + i), t->regs[i]);
+    nesapu_write_reg(apu, 0x15, t->enable);
+}
+
+
+static int cmd_timer(void)
+{
+    unsigned int samples = TIMER_BENCH_SECONDS * bench.rate;
+    int16_t *buf = (int16_t *)malloc(bench.block * sizeof(int16_t));
+    nesapu_t *apu = nesapu_create(NULL, false, NOISE_BENCH_CLOCK, bench.rate, 0);
+    if (NULL == buf || NULL == apu)
+    {
+        free(buf);
+        if (apu) nesapu_destroy(apu);
+        return 1;
+    }
+    uint32_t all = 2166136261U;
+    double spent;
+    printf("channel       render ns   skip ns  hash\n");
+    for (size_t i = 0; i < sizeof(timer_benches) / sizeof(timer_benches[0]); ++i)
+    {
+        const timer_bench_t *t = &timer_benches[i];
+        timer_bench_start(apu, t);
+        uint32_t h = apu_render(apu, buf, samples, 2166136261U, &spent);
+        double render = spent;
+        // Skip the same span in one call, then render one more block to check where it ended
+        timer_bench_start(apu, t);
+        double start = now();
+        nesapu_skip_samples(apu, samples);
+        double skip = now() - start;
+        h = apu_render(apu, buf, bench.block, h, &spent);
+        all = (all ^ h) * 16777619U;
+        printf("%-12s  %9.2f  %8.2f  %08x\n", t->name, render * 1e9 / samples, skip * 1e9 / samples, h);
+    }
+    printf("all hashes %08x\n", all);
+    nesapu_destroy(apu);
+    free(buf);
+    return 0;
+}
+
+
+//
+// block
+//
+#define BLOCK_BENCH_MIN     64
+#define BLOCK_BENCH_MAX     65536
+#define BLOCK_BENCH_RUNS    3       // Best time of
+
+// Play all files with block samples per vgm_get_samples() call and blip buffer of capacity samples.
+// return # of samples, -1 on error. *spent is time taken by vgm_get_samples().
+static long block_play(int16_t *buf, unsigned int block, unsigned int capacity, double *spent)
+{
+    long total = 0;
+    *spent = 0;
+    for (unsigned int i = 0; i < bench.file_count && total >= 0; ++i)
+    {
+        file_reader_t *reader = mem_reader_create(bench.files[i].data, bench.files[i].size);
+        vgm_t *vgm = reader ? vgm_create(reader) : NULL;
+        if (vgm) vgm_set_block_size(vgm, capacity);
+        if (vgm && vgm_prepare_playback(vgm, bench.rate, VGM_PLAYBACK_FADEOUT))
+        {
+            int n;
+            double t = now();
+            while ((n = vgm_get_samples(vgm, buf, block)) > 0) total += n;
+            *spent += now() - t;
+            if (n < 0) total = -1;
+        }
+        else
+        {
+            total = -1;
+        }
+        if (vgm) vgm_destroy(vgm);
+        if (reader) mem_reader_destroy(reader);
+    }
+    return total;
+}
+
+
+// block_play() BLOCK_BENCH_RUNS times, *spent is the best time
+static long block_render(int16_t *buf, unsigned int block, unsigned int capacity, double *spent)
+{
+    long total = -1;
+    double t;
+    for (int run = 0; run < BLOCK_BENCH_RUNS; ++run)
+    {
+        total = block_play(buf, block, capacity, &t);
+        if (total < 0) break;
+        if (run == 0 || t < *spent) *spent = t;
+    }
+    return total;
+}
+
+
+static int cmd_block(void)
+{
+    int16_t *buf = (int16_t *)malloc(BLOCK_BENCH_MAX * sizeof(int16_t));
+    if (NULL == buf) return 1;
+    int ret = 0;
+    double spent, spent_split;
+    printf("  block      samples/s  realtime    split at %5u\n", NESAPU_MAX_SAMPLES);
+    for (unsigned int block = BLOCK_BENCH_MIN; block <= BLOCK_BENCH_MAX; block *= 2)
+    {
+        // Blip buffer sized to the block, one APU call per block, against the default size
+        // where vgm_get_samples() splits the block
+        long n = block_render(buf, block, block, &spent);
+        long n_split = block_render(buf, block, NESAPU_MAX_SAMPLES, &spent_split);
+        if (n < 0 || n_split < 0)
+        {
+            fprintf(stderr, "block %u: render failed\n", block);
+            ret = 1;
+            break;
+        }
+        printf("%7u  %13.0f  %8.1fx  %13.0f\n", block, n / spent, n / spent / bench.rate, n_split / spent_split);
+    }
+    free(buf);
+    return ret;
+}
+
+
+#if VGM_USE_DATA_BANK
+//
+// bank
+//
+#define BANK_READ_SIZE  4096    // Bytes per read when timing decompression
+
+static uint32_t get_le32(const uint8_t *p)
+{
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+
+static void put_le(uint8_t *p, uint32_t v, int n)
+{
+    for (int i = 0; i < n; ++i) p[i] = (uint8_t)(v >> (8 * i));
+}
+
+
+// Length of VGM command at p, 0 if unknown or past end
+static size_t bank_command_length(const uint8_t *p, size_t left)
+{
+    size_t n;
+    uint8_t c = p[0];
+    if (0x67 == c)
+        n = (left >= 7) ? 7 + (size_t)get_le32(p + 3) : 0;
+    else if (0x68 == c)
+        n = 12;
+    else if (0x4F == c || 0x50 == c)
+        n = 2;
+    else if ((c >= 0x51 && c <= 0x5F) || 0x61 == c || (c >= 0xA0 && c <= 0xBF))
+        n = 3;
+    else if (0x62 == c || 0x63 == c || 0x66 == c || (c >= 0x70 && c <= 0x8F))
+        n = 1;
+    else if (c >= 0xC0 && c <= 0xDF)
+        n = 4;
+    else if (c >= 0xE0)
+        n = 5;
+    else
+        n = 0;
+    return (n <= left) ? n : 0;
+}
+
+
+static unsigned int bank_bits_for(unsigned int count)
+{
+    unsigned int bits = 1;
+    while ((1U << bits) < count) ++bits;
+    return bits;
+}
+
+
+// Replace RAM block data with a decompression table (0x7F), a compressed block (0x47) and a PCM RAM
+// write (0x68) at out. Picks the n-bit table or DPCM coding with fewer bits per byte, both lossless.
+// return bytes written.
+static size_t bank_compress(const uint8_t *data, uint32_t len, uint16_t addr, uint32_t bank, uint8_t *out)
+{
+    uint8_t value_used[256] = { 0 }, delta_used[256] = { 0 }, index[256];
+    unsigned int values = 0, deltas = 0;
+    uint8_t prev = data[0];
+    for (uint32_t i = 0; i < len; ++i)
+    {
+        uint8_t delta = (uint8_t)(data[i] - prev);
+        if (!value_used[data[i]]) { value_used[data[i]] = 1; ++values; }
+        if (!delta_used[delta]) { delta_used[delta] = 1; ++deltas; }
+        prev = data[i];
+    }
+    bool dpcm = bank_bits_for(deltas) < bank_bits_for(values);
+    const uint8_t *used = dpcm ? delta_used : value_used;
+    unsigned int bits = bank_bits_for(dpcm ? deltas : values);
+    size_t pos = 0;
+    // 67 66 7F ss ss ss ss tt st bd bc cc cc (values)
+    unsigned int count = 0;
+    uint8_t *table = out + 13;
+    for (unsigned int v = 0; v < 256; ++v)
+    {
+        if (used[v])
+        {
+            index[v] = (uint8_t)count;
+            table[count++] = (uint8_t)v;
+        }
+    }
+    out[0] = 0x67; out[1] = 0x66; out[2] = 0x7F;
+    put_le(out + 3, 6 + count, 4);
+    out[7] = dpcm ? 1 : 0;
+    out[8] = dpcm ? 0 : 2;
+    out[9] = 8;
+    out[10] = (uint8_t)bits;
+    put_le(out + 11, count, 2);
+    pos = 13 + count;
+    // 67 66 47 ss ss ss ss tt ss ss ss ss bd bc st aa aa (data)
+    uint8_t *block = out + pos;
+    uint32_t packed = (uint32_t)(((uint64_t)len * bits + 7) / 8);
+    block[0] = 0x67; block[1] = 0x66; block[2] = 0x47;
+    put_le(block + 3, 10 + packed, 4);
+    block[7] = dpcm ? 1 : 0;
+    put_le(block + 8, len, 4);
+    block[12] = 8;
+    block[13] = (uint8_t)bits;
+    block[14] = dpcm ? 0 : 2;
+    put_le(block + 15, dpcm ? data[0] : 0, 2);
+    uint8_t *p = block + 17;
+    memset(p, 0, packed);
+    uint64_t bit = 0;
+    prev = data[0];
+    for (uint32_t i = 0; i < len; ++i)
+    {
+        unsigned int v = index[dpcm ? (uint8_t)(data[i] - prev) : data[i]];
+        prev = data[i];
+        for (int b = (int)bits - 1; b >= 0; --b, ++bit)
+        {
+            if ((v >> b) & 1) p[bit >> 3] |= (uint8_t)(0x80 >> (bit & 7));
+        }
+    }
+    pos += 17 + packed;
+    // 68 66 07 oo oo oo dd dd dd ss ss ss
+    out[pos] = 0x68; out[pos + 1] = 0x66; out[pos + 2] = 0x07;
+    put_le(out + pos + 3, bank, 3);
+    put_le(out + pos + 6, addr, 3);
+    put_le(out + pos + 9, len, 3);
+    return pos + 12;
+}
+
+
+// Copy of f with its RAM blocks (0xC2) moved to compressed data bank blocks. Header offsets are moved
+// with the data, a loop at a RAM block points at its replacement.
+// return false on error. *blocks is # of blocks converted.
+static bool bank_convert(const bench_file_t *f, bench_file_t *out, unsigned int *blocks)
+{
+    const uint8_t *d = f->data;
+    if (f->size < 0x40) return false;
+    uint32_t version = get_le32(d + 0x08);
+    size_t start = (version >= 0x150 && get_le32(d + 0x34)) ? 0x34 + (size_t)get_le32(d + 0x34) : 0x40;
+    size_t loop = get_le32(d + 0x1C) ? 0x1C + (size_t)get_le32(d + 0x1C) : 0;
+    size_t gd3 = get_le32(d + 0x14) ? 0x14 + (size_t)get_le32(d + 0x14) : 0;
+    if (start >= f->size) return false;
+    // Replacement of a block of n bytes is at most n + 7 + 6 + 256 + 17 + 12 bytes, block itself is n + 9
+    size_t max = f->size;
+    for (size_t pos = start, n; pos < f->size && d[pos] != 0x66; pos += n)
+    {
+        n = bank_command_length(d + pos, f->size - pos);
+        if (0 == n) return false;
+        if (0x67 == d[pos] && 0xC2 == d[pos + 2]) max += 7 + 6 + 256 + 17 + 12;
+    }
+    uint8_t *o = (uint8_t *)malloc(max);
+    if (NULL == o) return false;
+    memcpy(o, d, start);
+    size_t pos = start, opos = start, new_loop = 0;
+    uint32_t bank = 0;
+    *blocks = 0;
+    bool end = false;
+    while (pos < f->size && !end)
+    {
+        if (pos == loop) new_loop = opos;
+        end = (0x66 == d[pos]);
+        size_t n = bank_command_length(d + pos, f->size - pos);
+        if (0x67 == d[pos] && 0xC2 == d[pos + 2] && n > 9)
+        {
+            uint32_t len = (uint32_t)(n - 9);
+            uint16_t addr = (uint16_t)(d[pos + 7] | (d[pos + 8] << 8));
+            opos += bank_compress(d + pos + 9, len, addr, bank, o + opos);
+            bank += len;
+            ++(*blocks);
+        }
+        else
+        {
+            memcpy(o + opos, d + pos, n);
+            opos += n;
+        }
+        pos += n;
+    }
+    // GD3 and whatever else follows the data moves as is
+    size_t shift = opos - pos;
+    memcpy(o + opos, d + pos, f->size - pos);
+    opos += f->size - pos;
+    put_le(o + 0x04, (uint32_t)(opos - 4), 4);
+    if (gd3) put_le(o + 0x14, (uint32_t)(gd3 + shift - 0x14), 4);
+    if (loop) put_le(o + 0x1C, (uint32_t)(new_loop - 0x1C), 4);
+    out->path = f->path;
+    out->data = o;
+    out->size = opos;
+    return true;
+}
+
+
+static int cmd_bank(void)
+{
+    int16_t *buf = (int16_t *)malloc(bench.block * sizeof(int16_t));
+    uint8_t *bank_buf = (uint8_t *)malloc(BANK_READ_SIZE);
+    if (NULL == buf || NULL == bank_buf)
+    {
+        free(buf);
+        free(bank_buf);
+        return 1;
+    }
+    int ret = 0;
+    printf("%-24s %7s %10s %10s %7s %10s %10s %10s %7s\n", "file", "blocks", "bytes", "packed", "ratio", "time",
+           "packed", "decode", "output");
+    for (unsigned int i = 0; i < bench.file_count; ++i)
+    {
+        const bench_file_t *f = &bench.files[i];
+        bench_file_t packed = { 0 };
+        unsigned int blocks = 0;
+        if (!bank_convert(f, &packed, &blocks))
+        {
+            fprintf(stderr, "%s: cannot convert\n", f->path);
+            ret = 1;
+            continue;
+        }
+        uint32_t h_ref = 0, h = 2166136261U;
+        double t_ref = now();
+        long ref = render_file(f, buf, &h_ref, NULL);
+        t_ref = now() - t_ref;
+        // Render packed file, keep decoder to read whole bank back after
+        long total = -1;
+        double t = now(), t_decode = 0;
+        file_reader_t *reader = mem_reader_create(packed.data, packed.size);
+        vgm_t *vgm = reader ? vgm_create(reader) : NULL;
+        if (vgm && vgm_prepare_playback(vgm, bench.rate, VGM_PLAYBACK_FADEOUT))
+        {
+            int n;
+            total = 0;
+            while ((n = vgm_get_samples(vgm, buf, bench.block)) > 0)
+            {
+                h = hash_samples(h, buf, n);
+                total += n;
+            }
+            if (n < 0) total = -1;
+        }
+        t = now() - t;
+        uint32_t bank_size = vgm ? vgm->bank_size : 0;
+        if (total >= 0 && bank_size)
+        {
+            t_decode = now();
+            for (uint32_t off = 0; off < bank_size; off += BANK_READ_SIZE)
+            {
+                uint32_t n = (bank_size - off < BANK_READ_SIZE) ? bank_size - off : BANK_READ_SIZE;
+                if (vgm->bank_reader.read(&vgm->bank_reader, bank_buf, vgm->bank_base + off, n) != n) total = -1;
+            }
+            t_decode = now() - t_decode;
+        }
+        if (vgm) vgm_destroy(vgm);
+        if (reader) mem_reader_destroy(reader);
+        free(packed.data);
+        if (ref < 0 || total < 0)
+        {
+            fprintf(stderr, "%s: render failed\n", f->path);
+            ret = 1;
+            continue;
+        }
+        bool same = (ref == total && h_ref == h);
+        char decode[16] = "-";
+        if (t_decode > 0) snprintf(decode, sizeof(decode), "%.1fMB/s", (double)bank_size / t_decode * 1e-6);
+        printf("%-24.24s %7u %10zu %10zu %6.1f%% %8.2fms %8.2fms %10s %7s\n", f->path, blocks, f->size, packed.size,
+               100.0 * (double)packed.size / (double)f->size, t_ref * 1e3, t * 1e3, decode, same ? "same" : "DIFF");
+        if (!same) ret = 1;
+    }
+    free(bank_buf);
+    free(buf);
+    return ret;
+}
+#endif
+
+
+static void usage(void)
+{
+    fprintf(stderr,
+        "Usage: vgmbench [options] <command> [file.vgm...]\n"
+        "  -r rate      sample rate (default 44100)\n"
+        "  -b block     samples per vgm_get_samples() call (default 735, at most %u)\n"
+        "  -j threads   max threads for scale (default: all cores)\n"
+        "  -x speed     consumer speed for stream, multiple of real-time (default 1)\n"
+        "Commands:\n"
+        "  scale        aggregate samples/s of independent instances, 1 to all threads\n"
+        "  stream       underruns and consumer latency through vgm_stream\n"
+        "  blip         blip_read_samples() cost against buffer fill, no files\n"
+        "  kernels      blip_add_delta() kernels against scalar, no files\n"
+        "  formats      stereo float / int32 output against int16 and a conversion pass\n"
+        "  skip         vgm_skip_samples() against rendering, speed and APU state\n"
+        "  analyze      vgm_analyze() length, loop and sound end against header and rendering\n"
+        "  trim         playback with silence skipped and trimmed against full playback\n"
+        "  loops        endless playback memory over many loop passes, and fade on request\n"
+        "  ram          APU RAM reads and bytes read from the file during playback\n"
+        "  noise        noise channel cost at each period and mode, output hash, no files\n"
+        "  timer        pulse, triangle and DMC cost at each period, rendered and skipped, no files\n"
+        "  block        samples/s against block size, 64 to 65536, with and without split\n"
+#if VGM_USE_DATA_BANK
+        "  bank         RAM blocks moved to compressed data bank blocks, size, speed and output\n"
+#endif
+        , NESAPU_BLOCK_LIMIT);
+}
+
+
+typedef struct command_s
+{
+    const char *name;
+    int (*run)(void);
+    bool files;     // Takes files
+} command_t;
+
+
+static const command_t commands[] =
+{
+    { "scale", cmd_scale, true },
+    { "stream", cmd_stream, true },
+    { "blip", cmd_blip, false },
+    { "kernels", cmd_kernels, false },
+    { "formats", cmd_formats, true },
+    { "skip", cmd_skip, true },
+    { "analyze", cmd_analyze, true },
+    { "trim", cmd_trim, true },
+    { "loops", cmd_loops, true },
+    { "ram", cmd_ram, true },
+    { "noise", cmd_noise, false },
+    { "timer", cmd_timer, false },
+    { "block", cmd_block, true },
+#if VGM_USE_DATA_BANK
+    { "bank", cmd_bank, true },
+#endif
+};
+
+
+int main(int argc, char **argv)
+{
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    bench.threads = cores > 0 ? (unsigned int)cores : 1;
+    bench.rate = 44100;
+    bench.block = 735;
+    bench.speed = 1;
+    int opt;
+    while ((opt = getopt(argc, argv, "r:b:j:x:")) != -1)
+    {
+        switch (opt)
+        {
+        case 'r': bench.rate = (unsigned int)atoi(optarg); break;
+        case 'b': bench.block = (unsigned int)atoi(optarg); break;
+        case 'j': bench.threads = (unsigned int)atoi(optarg); break;
+        case 'x': bench.speed = (unsigned int)atoi(optarg); break;
+        default: usage(); return 2;
+        }
+    }
+    if (optind >= argc || bench.rate == 0 || bench.threads == 0 || bench.speed == 0 || bench.block == 0 || bench.block > NESAPU_BLOCK_LIMIT)
+    {
+        usage();
+        return 2;
+    }
+    const command_t *cmd = NULL;
+    for (size_t i = 0; i < sizeof(commands) / sizeof(commands[0]); ++i)
+    {
+        if (strcmp(argv[optind], commands[i].name) == 0) cmd = &commands[i];
+    }
+    ++optind;
+    bench.file_count = (unsigned int)(argc - optind);
+    if (NULL == cmd || (cmd->files && bench.file_count == 0))
+    {
+        usage();
+        return 2;
+    }
+    bench.files = (bench_file_t *)calloc(bench.file_count + 1, sizeof(bench_file_t));
+    if (NULL == bench.files) return 1;
+    for (unsigned int i = 0; i < bench.file_count; ++i)
+    {
+        bench.files[i].path = argv[optind + (int)i];
+        if (!load_file(&bench.files[i]))
+        {
+            fprintf(stderr, "Cannot read %s\n", bench.files[i].path);
+            return 1;
+        }
+    }
+    int ret = cmd->run();
+    for (unsigned int i = 0; i < bench.file_count; ++i)
+    {
+        free(bench.files[i].data);
+    }
+    free(bench.files);
+    return ret;
+}
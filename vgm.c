@@ -1,595 +1,1989 @@
-#include <memory.h>
-#include "vgm_conf.h"
-#include "nesapu.h"
-#include "vgm.h"
-
-// #define VGM_ENABLE_DUMP
-
-#ifdef VGM_ENABLE_DUMP
-# define VGM_DUMP(...) VGM_PRINTINF(__VA_ARGS__)
-#else
-# define VGM_DUMP(...)
-#endif
-
-
-static char * read_gd3_str(file_reader_t *reader, uint32_t *poffset, uint32_t eof, bool convert)
-{
-    uint16_t temp[VGM_GD3_STR_MAX_LEN + 1];
-    int index = 0;
-    uint16_t ch;
-    while (*poffset < eof)
-    {
-        if (reader->read(reader, (uint8_t *)&ch, *poffset, 2) != 2)  break;
-        *poffset += 2;
-        if (0 == ch) break;
-        if (index < VGM_GD3_STR_MAX_LEN)
-        {
-            temp[index] = ch;
-            ++index;
-        }
-    }
-    temp[index] = 0;
-    if (convert && (index > 0))
-    {
-        char *out = VGM_MALLOC((size_t)(index + 1));
-        if (out)
-        {
-            for (int i = 0; i <= index; ++i)
-            {
-                out[i] = (char)(temp[i] & 0xff);
-            }
-            return out;
-        }
-    }
-    return NULL;
-}
-
-
-static void read_vgm_gd3(vgm_t *vgm, uint32_t offset)
-{
-    // https://www.smspower.org/uploads/Music/gd3spec100.txt
-    do
-    {
-        uint32_t temp, len, eof;
-        // read GD3 signature, should be "Gd3 " 0x20336447
-        if (vgm->reader->read(vgm->reader, (uint8_t*)&temp, offset, 4) != 4) break;
-        if (temp != 0x20336447) break;
-        offset += 4;
-        // next 4 bytes is version, should be 0x00 0x01 0x00 0x00
-        if (vgm->reader->read(vgm->reader, (uint8_t*)&temp, offset, 4) != 4) break;
-        if (temp != 0x00000100) break;
-        offset += 4;
-        // next 4 bytes is length
-        if (vgm->reader->read(vgm->reader, (uint8_t*)&len, offset, 4) != 4) break;
-        if (len == 0) break;
-        offset += 4;
-        eof = offset + len; // note eof is last byte + 1
-        vgm->track_name_en = read_gd3_str(vgm->reader, &offset, eof, true);
-        read_gd3_str(vgm->reader, &offset, eof, false); // skip japanese track name
-        vgm->game_name_en = read_gd3_str(vgm->reader, &offset, eof, true);
-        read_gd3_str(vgm->reader, &offset, eof, false); // skip japanese game name
-        vgm->sys_name_en = read_gd3_str(vgm->reader, &offset, eof, true);
-        read_gd3_str(vgm->reader, &offset, eof, false); // skip japanese system name
-        vgm->author_name_en = read_gd3_str(vgm->reader, &offset, eof, true);
-        read_gd3_str(vgm->reader, &offset, eof, false); // skip japanese author name
-        vgm->release_date = read_gd3_str(vgm->reader, &offset, eof, true);
-        vgm->creator = read_gd3_str(vgm->reader, &offset, eof, true);
-        vgm->notes = read_gd3_str(vgm->reader, &offset, eof, true);
-    } while (0);
-}
-
-
-vgm_t * vgm_create(file_reader_t *reader)
-{
-    vgm_t *vgm = NULL;
-    vgm_header_t header;
-    bool success = false;
-    do
-    {
-        vgm = (vgm_t *)VGM_MALLOC(sizeof(vgm_t));
-        if (NULL == vgm) break;
-        memset(vgm, 0, sizeof(vgm_t));
-        vgm->reader = reader;
-        if (reader->read(reader, (uint8_t *)&header, 0, sizeof(vgm_header_t)) != sizeof(vgm_header_t)) break;
-        if (header.ident != 0x206d6756) break;
-        if (header.eof_offset + 4 != reader->size(reader)) break;
-        vgm->version = header.version;
-        // We only support NES VGM for now
-        if (0 == header.nes_apu_clk) break;
-        vgm->nes_apu_clk = header.nes_apu_clk;
-        vgm->rate = header.rate;
-        if (0 == vgm->rate) vgm->rate = 60;
-        // For version 1.50 below, data starts at 0x40. Otherwise data starts from 0x34 + data_offset
-        if (header.version >= 0x00000150 && header.data_offset != 0)
-        {
-            vgm->data_offset = header.data_offset + 0x34;
-        }
-        else
-        {
-            vgm->data_offset = 0x40;
-        }
-        // samples
-        vgm->total_samples = (unsigned int)(header.total_samples);
-        // any loop?
-        if (header.loop_offset != 0 && header.loop_samples != 0)
-        {
-            vgm->loops = 1;
-            vgm->loop_offset = header.loop_offset + 0x1c;
-            vgm->loop_samples = (unsigned int)(header.loop_samples);
-        }
-        else
-        {
-            vgm->loops = 0;
-        }
-        // GD3
-        if (header.gd3_offset != 0)
-        {
-            read_vgm_gd3(vgm, header.gd3_offset + 0x14);
-        }
-        vgm->complete_samples = vgm->total_samples + vgm->loop_samples;
-        vgm->played_samples = 0;
-        vgm->fadeout_samples = 0;
-        // Print Info
-        VGM_DUMP("VGM: Version %X.%X\n", vgm->version >> 8, vgm->version & 0xff);
-        VGM_DUMP("VGM: Total samples: %d+%d (%.2fs+%.2fs)\n", vgm->total_samples, vgm->loop_samples, vgm->total_samples / 44100.0f, vgm->loop_samples / 44100.0f);
-        VGM_DUMP("VGM: Track Name:    %s\n", vgm->track_name_en);
-        VGM_DUMP("VGM: Game Name:     %s\n", vgm->game_name_en);
-        VGM_DUMP("VGM: Author:        %s\n", vgm->author_name_en);
-        VGM_DUMP("VGM: Release Date:  %s\n", vgm->release_date);
-        VGM_DUMP("VGM: Ripped by:     %s\n", vgm->creator);
-        success = true;
-    } while (0);
-    if (!success)
-    {
-        if (vgm != NULL)
-        {
-            vgm_destroy(vgm);
-            vgm = NULL;
-        }
-    }
-    return vgm;
-}
-
-
-void vgm_destroy(vgm_t *vgm)
-{
-    if (vgm)
-    {
-        if (vgm->apu) nesapu_destroy(vgm->apu);
-        if (vgm->notes) VGM_FREE(vgm->notes);
-        if (vgm->creator) VGM_FREE(vgm->creator);
-        if (vgm->release_date) VGM_FREE(vgm->release_date);
-        if (vgm->author_name_en) VGM_FREE(vgm->author_name_en);
-        if (vgm->sys_name_en) VGM_FREE(vgm->sys_name_en);
-        if (vgm->game_name_en) VGM_FREE(vgm->game_name_en);
-        if (vgm->track_name_en) VGM_FREE(vgm->track_name_en);
-        VGM_FREE(vgm);
-    }
-}
-
-
-bool vgm_prepare_playback(vgm_t *vgm, unsigned int sample_rate, bool fadeout)
-{
-    vgm->apu = nesapu_create(vgm->reader, vgm->rate == 50 ? true : false, vgm->nes_apu_clk, sample_rate);
-    if (NULL == vgm->apu)
-        return false;
-    vgm->data_pos = (size_t)vgm->data_offset;
-    vgm->samples_waiting = 0;
-    vgm->played_samples = 0;
-    // Fadeout: If true, last VGM_FADEOUT_SECONDS or 5% of the samples, whichever is shorter, is going to be used as fade out
-    if (fadeout)
-    {
-        unsigned long fades1 = vgm->complete_samples / 20;
-        unsigned long fades2 = VGM_FADEOUT_SECONDS * sample_rate;
-        vgm->fadeout_samples = (unsigned int)(fades1 > fades2 ? fades2 : fades1);
-    }
-    return true;
-}
-
-
-// Execute VGM data, stop when samples waiting
-// return 1 when samples are waiting.
-// return 0 when data finished.
-// return negative on error.
-static int vgm_exec(vgm_t *vgm)
-{
-    // still have unretrieved samples, don't execute any more
-    if (vgm->samples_waiting > 0) return ((int32_t)(vgm->samples_waiting));
-
-    int r = 0;
-    bool stop = false;
-    file_reader_t* reader = vgm->reader;
-    uint8_t data8, tt, aa, dd;
-    uint16_t data16;
-    uint32_t data32;
-    while (!stop)
-    {
-        if (reader->read(reader, &data8, vgm->data_pos, 1) != 1)
-        {
-            VGM_PRINTERR("VGM: Read error\n");
-            r = -1;
-            stop = true;
-        }
-        else
-        {
-            switch (data8)
-            {
-            case 0x30:  // dd : Used for dual chip support
-            case 0x31:  // dd : Set AY8910 stereo mask
-                vgm->data_pos += 2;
-                break;
-            case 0x32:  // 0x32..0x3E dd : one operand, reserved for future use
-            case 0x33:
-            case 0x34:
-            case 0x35:
-            case 0x36:
-            case 0x37:
-            case 0x38:
-            case 0x39:
-            case 0x3A:
-            case 0x3B:
-            case 0x3C:
-            case 0x3D:
-            case 0x3E:
-                vgm->data_pos += 2;
-                break;
-            case 0x3F:  // dd : Used for dual chip support
-                vgm->data_pos += 2;
-                break;
-            case 0x40:  // 0x40..0x4E dd dd : two operands, reserved for future use
-            case 0x41:  //                    Note: was one operand only til v1.60
-            case 0x42:
-            case 0x43:
-            case 0x44:
-            case 0x45:
-            case 0x46:
-            case 0x47:
-            case 0x48:
-            case 0x49:
-            case 0x4A:
-            case 0x4B:
-            case 0x4C:
-            case 0x4D:
-            case 0x4E:
-                if (vgm->version > 0x00000161)
-                    vgm->data_pos += 3;
-                else
-                    vgm->data_pos += 2;
-                break;
-            case 0x4F:  // dd : Game Gear PSG stereo, write dd to port 0x06
-            case 0x50:  // dd : PSG (SN76489/SN76496) write value dd
-                vgm->data_pos += 2;
-                break;
-            case 0x51:  // aa dd : YM2413, write value dd to register aa
-            case 0x52:  // aa dd : YM2612 port 0, write value dd to register aa
-            case 0x53:  // aa dd : YM2612 port 1, write value dd to register aa
-            case 0x54:  // aa dd : YM2151, write value dd to register aa
-            case 0x55:  // aa dd : YM2203, write value dd to register aa
-            case 0x56:  // aa dd : YM2608 port 0, write value dd to register aa
-            case 0x57:  // aa dd : YM2608 port 1, write value dd to register aa
-            case 0x58:  // aa dd : YM2610 port 0, write value dd to register aa
-            case 0x59:  // aa dd : YM2610 port 1, write value dd to register aa
-            case 0x5A:  // aa dd : YM3812, write value dd to register aa
-            case 0x5B:  // aa dd : YM3526, write value dd to register aa
-            case 0x5C:  // aa dd : Y8950, write value dd to register aa
-            case 0x5D:  // aa dd : YMZ280B, write value dd to register aa
-            case 0x5E:  // aa dd : YMF262 port 0, write value dd to register aa
-            case 0x5F:  // aa dd : YMF262 port 1, write value dd to register aa
-                vgm->data_pos += 3;
-                break;
-            case 0x61:  // nn nn : Wait n samples, n can range from 0 to 65535 (approx 1.49s)
-                if (reader->read(reader, (uint8_t *)&data16, vgm->data_pos + 1, 2) != 2)
-                {
-                    VGM_PRINTERR("VGM: Read error\n");
-                    r = -1;
-                    stop = true;
-                }
-                else
-                {
-                    vgm->data_pos += 3;
-                    vgm->samples_waiting = data16;
-                    VGM_DUMP("VGM: Wait %d samples\n", vgm->samples_waiting);
-                    r = 1;
-                    stop = true;
-                }
-                break;
-            case 0x62:  // wait 735 samples (60th of a second)
-                ++vgm->data_pos;
-                vgm->samples_waiting = 735;
-                VGM_DUMP("VGM: Wait 735 samples\n");
-                r = 1;
-                stop = true;
-                break;
-            case 0x63:  // wait 882 samples (50th of a second)
-                ++vgm->data_pos;
-                vgm->samples_waiting = 882;
-                VGM_DUMP("VGM: Wait 882 samples\n");
-                r = 1;
-                stop = true;
-                break;
-            case 0x66:  // end of sound data
-                if (vgm->loops > 0)
-                {
-                    vgm->data_pos = vgm->loop_offset;
-                    VGM_DUMP("VGM: Loop %d\n", vgm->loops);
-                    --vgm->loops;
-                }
-                else
-                {
-                    VGM_DUMP("VGM: End\n");
-                    vgm->samples_waiting = 0;
-                    r = 0;
-                    stop = true;
-                }
-                break;
-            case 0x67:  // data block, 0x67 0x66 tt ss ss ss ss (data)
-                        // tt = data type
-                        // ss ss ss ss = size of data
-                        // (data) = data
-                tt = 0; data16 = 0; data32 = 0;
-                reader->read(reader, (uint8_t *)&data32, vgm->data_pos + 3, 4);
-                if (data32 == 0)
-                {
-                    // bad thing happend in VGM file
-                    VGM_PRINTERR("VGM: Read error\n");
-                    r = -1;
-                    stop = true;   
-                }
-                else
-                {
-                    reader->read(reader, &tt, vgm->data_pos + 2, 1);  // tt
-                    if (0xc2 == tt) // NES APU RAM write
-                    {
-                        // first 2 bytes are RAM address
-                        reader->read(reader, (uint8_t *)&data16, vgm->data_pos + 7, 2);
-                        nesapu_add_ram(vgm->apu, vgm->data_pos + 9, data16, (uint16_t)(data32 - 2));
-                    }
-                    else
-                    {
-                        VGM_DUMP("VGM: Data block type=%02x, len=%d\n", tt, data32);
-                    }
-                    vgm->data_pos += 7 + data32;
-                }
-                break;
-            case 0x68:  // PCM RAM writes, 0x68 0x66 cc oo oo oo dd dd dd ss ss ss
-                vgm->data_pos += 12;
-                break;
-            case 0x70:  // 0x7n:  wait n+1 samples
-            case 0x71:
-            case 0x72:
-            case 0x73:
-            case 0x74:
-            case 0x75:
-            case 0x76:
-            case 0x77:
-            case 0x78:
-            case 0x79:
-            case 0x7A:
-            case 0x7B:
-            case 0x7C:
-            case 0x7D:
-            case 0x7E:
-            case 0x7F:
-                ++vgm->data_pos;
-                vgm->samples_waiting = (data8 & 0x0F) + 1U;
-                VGM_DUMP("VGM: Wait %d samples\n", vgm->samples_waiting);
-                r = 1;
-                stop = true;
-                break;
-            case 0x80:  // 0x8n: YM2612 port 0 address 2A write from the data bank, then wait n samples
-            case 0x81:
-            case 0x82:
-            case 0x83:
-            case 0x84:
-            case 0x85:
-            case 0x86:
-            case 0x87:
-            case 0x88:
-            case 0x89:
-            case 0x8A:
-            case 0x8B:
-            case 0x8C:
-            case 0x8D:
-            case 0x8E:
-            case 0x8F:
-                ++vgm->data_pos;
-                break;
-            case 0x90:  // 0x90-0x95: DAC Stream control write
-            case 0x91:
-            case 0x92:
-            case 0x93:
-            case 0x94:
-            case 0x95:
-                ++vgm->data_pos;
-                break;
-            case 0xA0:  // aa dd : AY8910, write value dd to register aa
-            case 0xA1:  // 0xA1-0xAF: aa dd : Used for dual chip supportw
-            case 0xA2:
-            case 0xA3:
-            case 0xA4:
-            case 0xA5:
-            case 0xA6:
-            case 0xA7:
-            case 0xA8:
-            case 0xA9:
-            case 0xAA:
-            case 0xAB:
-            case 0xAC:
-            case 0xAD:
-            case 0xAE:
-            case 0xAF:
-            case 0xB0:  // aa dd : RF5C68, write value dd to register aa
-            case 0xB1:  // aa dd : RF5C164, write value dd to register aa
-            case 0xB2:  // ad dd : PWM, write value ddd to register a (d is MSB, dd is LSB)
-            case 0xB3:  // aa dd : GameBoy DMG, write value dd to register aa
-                vgm->data_pos += 3;
-                break;
-            case 0xB4:  // aa dd : NES APU, write value dd to register aa
-                if (reader->read(reader, &aa, vgm->data_pos + 1, 1) != 1)
-                {
-                    VGM_PRINTERR("VGM: Read error\n");
-                    r = -1;
-                    stop = true;
-                    break;
-                }
-                if (reader->read(reader, &dd, vgm->data_pos + 2, 1) != 1)
-                {
-                    VGM_PRINTERR("VGM: Read error\n");
-                    r = -1;
-                    stop = true;
-                    break;
-                }
-                vgm->data_pos += 3;
-                VGM_DUMP("VGM: NES APU write reg[$%04X] = 0x%02X\n", aa + 0x4000, dd);
-                nesapu_write_reg(vgm->apu, aa, dd);
-                break;
-            case 0xB5:  // aa dd : MultiPCM, write value dd to register aa
-            case 0xB6:  // aa dd : uPD7759, write value dd to register aa
-            case 0xB7:  // aa dd : OKIM6258, write value dd to register aa
-            case 0xB8:  // aa dd : OKIM6295, write value dd to register aa
-            case 0xB9:  // aa dd : HuC6280, write value dd to register aa
-            case 0xBA:  // aa dd : K053260, write value dd to register aa
-            case 0xBB:  // aa dd : Pokey, write value dd to register aa
-            case 0xBC:  // aa dd : WonderSwan, write value dd to register aa
-            case 0xBD:  // aa dd : SAA1099, write value dd to register aa
-            case 0xBE:  // aa dd : ES5506, write 8-bit value dd to register aa
-            case 0xBF:  // aa dd : GA20, write value dd to register aa
-                vgm->data_pos += 3;
-                break;
-            case 0xC0:  // bbaa dd : Sega PCM, write value dd to memory offset aabb
-            case 0xC1:  // bbaa dd : RF5C68, write value dd to memory offset aabb
-            case 0xC2:  // bbaa dd : RF5C164, write value dd to memory offset aabb
-            case 0xC3:  // cc bbaa : MultiPCM, write set bank offset aabb to channel cc
-            case 0xC4:  // mmll rr : QSound, write value mmll to register rr
-                        // (mm - data MSB, ll - data LSB)
-            case 0xC5:  // mmll dd : SCSP, write value dd to memory offset mmll
-                        // (mm - offset MSB, ll - offset LSB)
-            case 0xC6:  // mmll dd : WonderSwan, write value dd to memory offset mmll
-                        // (mm - offset MSB, ll - offset LSB)
-            case 0xC7:  // mmll dd : VSU, write value dd to register mmll
-                        // (mm - MSB, ll - LSB)
-            case 0xC8:  // mmll dd : X1-010, write value dd to memory offset mmll
-                        // (mm - offset MSB, ll - offset LSB)
-                vgm->data_pos += 4;
-                break;
-            case 0xC9:  // 0xC9..0xCF dd dd dd : three operands, reserved for future use
-            case 0xCA:
-            case 0xCB:
-            case 0xCC:
-            case 0xCD:
-            case 0xCE:
-            case 0xCF:
-                vgm->data_pos += 4;
-                break;
-            case 0xD0:  // pp aa dd : YMF278B port pp, write value dd to register aa
-            case 0xD1:  // pp aa dd : YMF271 port pp, write value dd to register aa
-            case 0xD2:  // pp aa dd : SCC1 port pp, write value dd to register aa
-            case 0xD3:  // pp aa dd : K054539 write value dd to register ppaa
-            case 0xD4:  // pp aa dd : C140 write value dd to register ppaa
-            case 0xD5:  // pp aa dd : ES5503 write value dd to register ppaa
-            case 0xD6:  // aa ddee  : ES5506 write 16-bit value ddee to register aa 
-                vgm->data_pos += 4;
-                break;
-            case 0xD7:  // 0xD7..0xDF dd dd dd : three operands, reserved for future use
-            case 0xD8:
-            case 0xD9:
-            case 0xDA:
-            case 0xDB:
-            case 0xDC:
-            case 0xDD:
-            case 0xDE:
-            case 0xDF:
-                vgm->data_pos += 4;
-                break;
-            case 0xE0:  // dddddddd : seek to offset dddddddd (Intel byte order) in PCM data bank
-            case 0xE1:  // aabb ddee: C352 write 16-bit value ddee to register aabb
-                vgm->data_pos += 5;
-                break;
-            case 0xE2:  // 0xE2..0xFF dd dd dd dd : four operands, reserved for future use
-            case 0xE3:
-            case 0xE4:
-            case 0xE5:
-            case 0xE6:
-            case 0xE7:
-            case 0xE8:
-            case 0xE9:
-            case 0xEA:
-            case 0xEB:
-            case 0xEC:
-            case 0xED:
-            case 0xEE:
-            case 0xEF:
-            case 0xF0:
-            case 0xF1:
-            case 0xF2:
-            case 0xF3:
-            case 0xF4:
-            case 0xF5:
-            case 0xF6:
-            case 0xF7:
-            case 0xF8:
-            case 0xF9:
-            case 0xFA:
-            case 0xFB:
-            case 0xFC:
-            case 0xFD:
-            case 0xFE:
-            case 0xFF:
-                vgm->data_pos += 5;
-                break;
-            default:
-                VGM_PRINTERR("VGM: Unknown command 0x%02X\n", data8);
-                stop = true;
-                r = -1;
-                break;         
-            }  // end of switch-case
-        } // end of read data8
-    } // end of while loop
-    return r;
-}
-
-
-int vgm_get_samples(vgm_t *vgm, int16_t *buf, unsigned int size)
-{
-    int samples = 0;
-    while (size > 0)
-    {
-        if (vgm->samples_waiting)
-        {
-            // If there are samples waiting, read it
-            unsigned int read = (vgm->samples_waiting >= size) ? size : vgm->samples_waiting;  // read which ever is less
-            nesapu_get_samples(vgm->apu, buf + samples, read);
-            vgm->samples_waiting -= read;
-            samples += (int)read;
-            size -= read;
-            vgm->played_samples += read;
-            if (vgm->played_samples + vgm->fadeout_samples > vgm->complete_samples) // not very accurate but shall work
-            {
-                nesapu_enable_fade(vgm->apu, vgm->fadeout_samples);
-            }
-        }
-        else
-        {
-            // Execute vgm file for more samples
-            int r = vgm_exec(vgm);
-            if (r < 0)
-            {
-                VGM_PRINTERR("VGM: Exec error\n");
-                samples = -1;
-                break;
-            }
-            else if (r == 0)
-            {
-                VGM_PRINTINF("VGM: Finished\n");
-                break;
-            }
-        }
-    }
-    return samples;
-}
-
-
-void vgm_nesapu_enable_channel(vgm_t *vgm, uint8_t mask, bool enable)
-{
-    nesapu_enable_channel(vgm->apu, mask, enable);
-}
+#include <memory.h>
+#include <stddef.h>
+#include "vgm_conf.h"
+#include "nesapu.h"
+#include "vgm.h"
+
+// #define VGM_ENABLE_DUMP
+
+#ifdef VGM_ENABLE_DUMP
+# define VGM_DUMP(...) VGM_PRINTINF(__VA_ARGS__)
+#else
+# define VGM_DUMP(...)
+#endif
+
+
+// Read VGM data from borrowed file data, or through read-ahead window. Request not fitting in
+// window is read directly.
+// return number of bytes read.
+static size_t vgm_read(vgm_t *vgm, uint8_t *buf, size_t offset, size_t len)
+{
+#if VGM_READER_BORROW
+    if (vgm->data)
+    {
+        if ((offset > vgm->data_size) || (len > vgm->data_size - offset)) return 0;
+        memcpy(buf, vgm->data + offset, len);
+        return len;
+    }
+#endif
+#if VGM_FILE_CACHE_SIZE > 0
+    if (vgm->cache && len <= VGM_FILE_CACHE_SIZE)
+    {
+        if ((offset < vgm->cache_pos) || (offset + len > vgm->cache_pos + vgm->cache_len))
+        {
+            // Slide window to offset
+            size_t size = vgm->reader->size(vgm->reader);
+            size_t toread = (offset < size) ? size - offset : 0;
+            if (toread > VGM_FILE_CACHE_SIZE) toread = VGM_FILE_CACHE_SIZE;
+            vgm->cache_pos = offset;
+            vgm->cache_len = 0;
+            if (toread < len) return 0;
+            if (vgm->reader->read(vgm->reader, vgm->cache, offset, toread) != toread) return 0;
+            vgm->cache_len = toread;
+            ++vgm->cache_refills;
+            vgm->cache_refill_bytes += toread;
+        }
+        memcpy(buf, vgm->cache + (offset - vgm->cache_pos), len);
+        return len;
+    }
+#endif
+    return vgm->reader->read(vgm->reader, buf, offset, len);
+}
+
+
+static char * read_gd3_str(vgm_t *vgm, uint32_t *poffset, uint32_t eof, bool convert)
+{
+    uint16_t temp[VGM_GD3_STR_MAX_LEN + 1];
+    int index = 0;
+    uint16_t ch;
+    while (*poffset < eof)
+    {
+        if (vgm_read(vgm, (uint8_t *)&ch, *poffset, 2) != 2)  break;
+        *poffset += 2;
+        if (0 == ch) break;
+        if (index < VGM_GD3_STR_MAX_LEN)
+        {
+            temp[index] = ch;
+            ++index;
+        }
+    }
+    temp[index] = 0;
+    if (convert && (index > 0))
+    {
+        char *out = VGM_MALLOC((size_t)(index + 1));
+        if (out)
+        {
+            for (int i = 0; i <= index; ++i)
+            {
+                out[i] = (char)(temp[i] & 0xff);
+            }
+            return out;
+        }
+    }
+    return NULL;
+}
+
+
+static void read_vgm_gd3(vgm_t *vgm, uint32_t offset)
+{
+    // https://www.smspower.org/uploads/Music/gd3spec100.txt
+    do
+    {
+        uint32_t temp, len, eof;
+        // read GD3 signature, should be "Gd3 " 0x20336447
+        if (vgm_read(vgm, (uint8_t*)&temp, offset, 4) != 4) break;
+        if (temp != 0x20336447) break;
+        offset += 4;
+        // next 4 bytes is version, should be 0x00 0x01 0x00 0x00
+        if (vgm_read(vgm, (uint8_t*)&temp, offset, 4) != 4) break;
+        if (temp != 0x00000100) break;
+        offset += 4;
+        // next 4 bytes is length
+        if (vgm_read(vgm, (uint8_t*)&len, offset, 4) != 4) break;
+        if (len == 0) break;
+        offset += 4;
+        eof = offset + len; // note eof is last byte + 1
+        vgm->track_name_en = read_gd3_str(vgm, &offset, eof, true);
+        read_gd3_str(vgm, &offset, eof, false); // skip japanese track name
+        vgm->game_name_en = read_gd3_str(vgm, &offset, eof, true);
+        read_gd3_str(vgm, &offset, eof, false); // skip japanese game name
+        vgm->sys_name_en = read_gd3_str(vgm, &offset, eof, true);
+        read_gd3_str(vgm, &offset, eof, false); // skip japanese system name
+        vgm->author_name_en = read_gd3_str(vgm, &offset, eof, true);
+        read_gd3_str(vgm, &offset, eof, false); // skip japanese author name
+        vgm->release_date = read_gd3_str(vgm, &offset, eof, true);
+        vgm->creator = read_gd3_str(vgm, &offset, eof, true);
+        vgm->notes = read_gd3_str(vgm, &offset, eof, true);
+    } while (0);
+}
+
+
+#if VGM_USE_DATA_BANK
+
+//
+// Data bank
+//
+
+static bool vgm_bank_add(vgm_t *vgm, vgm_bank_block_t *block)
+{
+    if (vgm->bank_block_count == vgm->bank_block_max)
+    {
+        unsigned int max = vgm->bank_block_max ? vgm->bank_block_max * 2 : 4;
+        vgm_bank_block_t *blocks = (vgm_bank_block_t *)VGM_MALLOC(max * sizeof(vgm_bank_block_t));
+        if (NULL == blocks) return false;
+        if (vgm->bank_blocks)
+        {
+            memcpy(blocks, vgm->bank_blocks, vgm->bank_block_count * sizeof(vgm_bank_block_t));
+            VGM_FREE(vgm->bank_blocks);
+        }
+        vgm->bank_blocks = blocks;
+        vgm->bank_block_max = max;
+    }
+    block->start = vgm->bank_size;
+    vgm->bank_blocks[vgm->bank_block_count++] = *block;
+    vgm->bank_size += block->size;
+    return true;
+}
+
+
+// return index of block holding bank offset, -1 if none
+static int vgm_bank_find(vgm_t *vgm, uint32_t offset)
+{
+    int lo = 0, hi = (int)vgm->bank_block_count - 1;
+    while (lo <= hi)
+    {
+        int mid = (lo + hi) / 2;
+        const vgm_bank_block_t *b = &(vgm->bank_blocks[mid]);
+        if (offset < b->start)
+            hi = mid - 1;
+        else if (offset - b->start >= b->size)
+            lo = mid + 1;
+        else
+            return mid;
+    }
+    return -1;
+}
+
+
+// Data block 0x07, 0x47 or 0x7F of size bytes at file position pos. Blocks are added once, in file order.
+// return false on memory error.
+static bool vgm_bank_data_block(vgm_t *vgm, size_t pos, uint8_t tt, uint32_t size)
+{
+    if (pos < vgm->bank_scan_pos) return true;
+    vgm->bank_scan_pos = pos + 7 + size;
+    uint8_t attr[10] = { 0 };
+    vgm_bank_block_t block;
+    memset(&block, 0, sizeof(vgm_bank_block_t));
+    if (0x07 == tt)
+    {
+        block.codec = VGM_BANK_RAW;
+        block.data_pos = pos + 7;
+        block.data_len = size;
+        block.size = size;
+        return vgm_bank_add(vgm, &block);
+    }
+    if (0x7F == tt)
+    {
+        // tt st bd bc cc cc (values)
+        if (size < 6 || vgm_read(vgm, attr, pos + 7, 6) != 6) return true;
+        if (attr[0] < 2)
+        {
+            vgm_bank_table_t *table = &(vgm->bank_tables[attr[0]]);
+            table->pos = pos + 13;
+            table->len = (uint16_t)(attr[4] | (attr[5] << 8));
+            table->sub_type = attr[1];
+            table->bits_out = attr[2];
+            if ((uint32_t)table->len * ((table->bits_out + 7) / 8) > size - 6) table->len = 0;
+        }
+        return true;
+    }
+    // 0x47: tt ss ss ss ss bd bc st aa aa (data)
+    if (size < 10 || vgm_read(vgm, attr, pos + 7, 10) != 10) return true;
+    block.data_pos = pos + 17;
+    block.data_len = size - 10;
+    block.size = (uint32_t)attr[1] | ((uint32_t)attr[2] << 8) | ((uint32_t)attr[3] << 16) | ((uint32_t)attr[4] << 24);
+    block.bits_out = attr[5];
+    block.bits_in = attr[6];
+    block.sub_type = attr[7];
+    block.add = (uint16_t)(attr[8] | (attr[9] << 8));
+    block.codec = (attr[0] == 0) ? VGM_BANK_NBIT : ((attr[0] == 1) ? VGM_BANK_DPCM : VGM_BANK_UNSUPPORTED);
+    if (VGM_BANK_DPCM == block.codec || (VGM_BANK_NBIT == block.codec && 2 == block.sub_type))
+    {
+        const vgm_bank_table_t *table = &(vgm->bank_tables[attr[0]]);
+        if (table->pos && table->sub_type == block.sub_type && table->bits_out == block.bits_out)
+        {
+            block.table_pos = table->pos;
+            block.table_len = table->len;
+        }
+        else
+        {
+            block.codec = VGM_BANK_UNSUPPORTED;
+        }
+    }
+    // APU RAM is bytes: up to 8 bits decompressed, up to 8 bits compressed (table has 256 entries)
+    if (block.bits_out == 0 || block.bits_out > 8 || block.bits_in == 0 || block.bits_in > 8 ||
+        (VGM_BANK_NBIT == block.codec && block.sub_type > 2) ||
+        (VGM_BANK_NBIT == block.codec && 1 == block.sub_type && block.bits_in > block.bits_out))
+    {
+        block.codec = VGM_BANK_UNSUPPORTED;
+    }
+    if (VGM_BANK_UNSUPPORTED == block.codec)
+    {
+        VGM_PRINTERR("VGM: Compressed data block at 0x%x not supported, reads 0\n", (unsigned int)pos);
+    }
+    // Size still counts, later blocks keep their bank offsets
+    return vgm_bank_add(vgm, &block);
+}
+
+
+// Next n bits of compressed data of block, top bits of each byte first. Bits past end of data are 0.
+static unsigned int vgm_bank_bits(vgm_t *vgm, const vgm_bank_block_t *block, unsigned int n)
+{
+    vgm_bank_decoder_t *dec = &(vgm->bank_decoder);
+    unsigned int v = 0;
+    while (n > 0)
+    {
+        uint32_t byte = dec->bit_pos >> 3;
+        unsigned int bit = dec->bit_pos & 7;
+        unsigned int take = 8 - bit;
+        if (take > n) take = n;
+        if (byte < dec->in_pos || byte - dec->in_pos >= dec->in_len)
+        {
+            // Refill window
+            uint32_t toread = (byte < block->data_len) ? block->data_len - byte : 0;
+            if (toread > VGM_BANK_INPUT_SIZE) toread = VGM_BANK_INPUT_SIZE;
+            dec->in_pos = byte;
+            dec->in_len = toread ? (uint32_t)vgm->reader->read(vgm->reader, dec->in, block->data_pos + byte, toread) : 0;
+        }
+        uint8_t x = (byte - dec->in_pos < dec->in_len) ? dec->in[byte - dec->in_pos] : 0;
+        v = (v << take) | ((unsigned int)(x >> (8 - bit - take)) & ((1U << take) - 1));
+        dec->bit_pos += take;
+        n -= take;
+    }
+    return v;
+}
+
+
+// Start decoding block from its first value
+static void vgm_bank_restart(vgm_t *vgm, int index)
+{
+    vgm_bank_decoder_t *dec = &(vgm->bank_decoder);
+    const vgm_bank_block_t *block = &(vgm->bank_blocks[index]);
+    dec->block = index;
+    dec->out_pos = 0;
+    dec->bit_pos = 0;
+    dec->state = (uint8_t)block->add;
+    dec->in_pos = 0;
+    dec->in_len = 0;
+    if (block->table_pos && block->table_pos != dec->table_pos)
+    {
+        unsigned int len = (block->table_len > 256) ? 256 : block->table_len;
+        memset(dec->table, 0, sizeof(dec->table));
+        dec->table_pos = (vgm->reader->read(vgm->reader, dec->table, block->table_pos, len) == len) ? block->table_pos : 0;
+    }
+}
+
+
+// Expand len values of block from index into buf
+static void vgm_bank_expand(vgm_t *vgm, int index, uint32_t offset, uint8_t *buf, uint32_t len)
+{
+    vgm_bank_decoder_t *dec = &(vgm->bank_decoder);
+    const vgm_bank_block_t *block = &(vgm->bank_blocks[index]);
+    unsigned int bits = block->bits_in;
+    uint8_t mask = (uint8_t)((1U << block->bits_out) - 1);
+    if (dec->block != index || offset < dec->out_pos) vgm_bank_restart(vgm, index);
+    if (VGM_BANK_NBIT == block->codec && offset > dec->out_pos)
+    {
+        // Values do not depend on each other, jump to offset
+        dec->out_pos = offset;
+        dec->bit_pos = offset * bits;
+    }
+    uint32_t end = offset + len;
+    while (dec->out_pos < end)
+    {
+        unsigned int in = vgm_bank_bits(vgm, block, bits);
+        uint8_t out;
+        if (VGM_BANK_DPCM == block->codec)
+        {
+            dec->state = (uint8_t)((dec->state + dec->table[in]) & mask);
+            out = dec->state;
+        }
+        else if (2 == block->sub_type)
+        {
+            out = dec->table[in] & mask;
+        }
+        else
+        {
+            unsigned int shift = (1 == block->sub_type) ? block->bits_out - bits : 0;
+            out = (uint8_t)(((in << shift) + block->add) & mask);
+        }
+        if (dec->out_pos >= offset) buf[dec->out_pos - offset] = out;
+        ++dec->out_pos;
+    }
+}
+
+
+static size_t vgm_bank_read(file_reader_t *reader, uint8_t *buf, size_t offset, size_t len)
+{
+    vgm_t *vgm = (vgm_t *)((uint8_t *)reader - offsetof(vgm_t, bank_reader));
+    if (offset < vgm->bank_base) return vgm->reader->read(vgm->reader, buf, offset, len);
+    size_t done = 0;
+    while (done < len)
+    {
+        uint32_t pos = (uint32_t)(offset - vgm->bank_base + done);
+        int index = vgm_bank_find(vgm, pos);
+        if (index < 0) break;
+        const vgm_bank_block_t *block = &(vgm->bank_blocks[index]);
+        uint32_t from = pos - block->start;
+        uint32_t n = block->size - from;
+        if (n > len - done) n = (uint32_t)(len - done);
+        if (VGM_BANK_RAW == block->codec)
+        {
+            if (vgm->reader->read(vgm->reader, buf + done, block->data_pos + from, n) != n) break;
+        }
+        else if (VGM_BANK_UNSUPPORTED == block->codec)
+        {
+            memset(buf + done, 0, n);
+        }
+        else
+        {
+            vgm_bank_expand(vgm, index, from, buf + done, n);
+        }
+        done += n;
+    }
+    return done;
+}
+
+
+static size_t vgm_bank_reader_size(file_reader_t *reader)
+{
+    vgm_t *vgm = (vgm_t *)((uint8_t *)reader - offsetof(vgm_t, bank_reader));
+    return vgm->bank_base + vgm->bank_size;
+}
+
+
+#if VGM_READER_BORROW
+static const uint8_t * vgm_bank_borrow(file_reader_t *reader, size_t offset, size_t len)
+{
+    vgm_t *vgm = (vgm_t *)((uint8_t *)reader - offsetof(vgm_t, bank_reader));
+    if (offset >= vgm->bank_base) return NULL;
+    return vgm->reader->borrow(vgm->reader, offset, len);
+}
+#endif
+
+
+static void vgm_bank_init(vgm_t *vgm)
+{
+    vgm->bank_base = vgm->reader->size(vgm->reader);
+    vgm->bank_scan_pos = vgm->data_offset;
+    vgm->bank_decoder.block = -1;
+    vgm->bank_reader.read = vgm_bank_read;
+    vgm->bank_reader.size = vgm_bank_reader_size;
+#if VGM_READER_BORROW
+    vgm->bank_reader.borrow = vgm->reader->borrow ? vgm_bank_borrow : NULL;
+#endif
+}
+
+#endif // VGM_USE_DATA_BANK
+
+
+// Reader for APU RAM
+static file_reader_t * vgm_ram_reader(vgm_t *vgm)
+{
+#if VGM_USE_DATA_BANK
+    return &(vgm->bank_reader);
+#else
+    return vgm->reader;
+#endif
+}
+
+
+// One decoded VGM command
+typedef struct vgm_command_s
+{
+    uint8_t  type;          // VGM_EVENT_xxx, VGM_EVENT_NONE if command is not for NES APU
+    uint8_t  reg;           // VGM_EVENT_WRITE: register
+    uint8_t  val;           // VGM_EVENT_WRITE: value
+    uint16_t samples;       // VGM_EVENT_WAIT: samples to wait
+    vgm_ram_block_t ram;    // VGM_EVENT_RAM: ram block
+} vgm_command_t;
+
+
+// Decode one command at data_pos, advance data_pos past it.
+// Commands not for NES APU are skipped and reported as VGM_EVENT_NONE.
+// return 0 on success, negative on error.
+static int vgm_fetch_command(vgm_t *vgm, vgm_command_t *cmd)
+{
+    int r = 0;
+    uint8_t data8, tt, aa, dd;
+    uint16_t data16;
+    uint32_t data32;
+    cmd->type = VGM_EVENT_NONE;
+    if (vgm_read(vgm, &data8, vgm->data_pos, 1) != 1)
+    {
+        VGM_PRINTERR("VGM: Read error\n");
+        return -1;
+    }
+    switch (data8)
+    {
+    case 0x30:  // dd : Used for dual chip support
+    case 0x31:  // dd : Set AY8910 stereo mask
+        vgm->data_pos += 2;
+        break;
+    case 0x32:  // 0x32..0x3E dd : one operand, reserved for future use
+    case 0x33:
+    case 0x34:
+    case 0x35:
+    case 0x36:
+    case 0x37:
+    case 0x38:
+    case 0x39:
+    case 0x3A:
+    case 0x3B:
+    case 0x3C:
+    case 0x3D:
+    case 0x3E:
+        vgm->data_pos += 2;
+        break;
+    case 0x3F:  // dd : Used for dual chip support
+        vgm->data_pos += 2;
+        break;
+    case 0x40:  // 0x40..0x4E dd dd : two operands, reserved for future use
+    case 0x41:  //                    Note: was one operand only til v1.60
+    case 0x42:
+    case 0x43:
+    case 0x44:
+    case 0x45:
+    case 0x46:
+    case 0x47:
+    case 0x48:
+    case 0x49:
+    case 0x4A:
+    case 0x4B:
+    case 0x4C:
+    case 0x4D:
+    case 0x4E:
+        if (vgm->version > 0x00000161)
+            vgm->data_pos += 3;
+        else
+            vgm->data_pos += 2;
+        break;
+    case 0x4F:  // dd : Game Gear PSG stereo, write dd to port 0x06
+    case 0x50:  // dd : PSG (SN76489/SN76496) write value dd
+        vgm->data_pos += 2;
+        break;
+    case 0x51:  // aa dd : YM2413, write value dd to register aa
+    case 0x52:  // aa dd : YM2612 port 0, write value dd to register aa
+    case 0x53:  // aa dd : YM2612 port 1, write value dd to register aa
+    case 0x54:  // aa dd : YM2151, write value dd to register aa
+    case 0x55:  // aa dd : YM2203, write value dd to register aa
+    case 0x56:  // aa dd : YM2608 port 0, write value dd to register aa
+    case 0x57:  // aa dd : YM2608 port 1, write value dd to register aa
+    case 0x58:  // aa dd : YM2610 port 0, write value dd to register aa
+    case 0x59:  // aa dd : YM2610 port 1, write value dd to register aa
+    case 0x5A:  // aa dd : YM3812, write value dd to register aa
+    case 0x5B:  // aa dd : YM3526, write value dd to register aa
+    case 0x5C:  // aa dd : Y8950, write value dd to register aa
+    case 0x5D:  // aa dd : YMZ280B, write value dd to register aa
+    case 0x5E:  // aa dd : YMF262 port 0, write value dd to register aa
+    case 0x5F:  // aa dd : YMF262 port 1, write value dd to register aa
+        vgm->data_pos += 3;
+        break;
+    case 0x61:  // nn nn : Wait n samples, n can range from 0 to 65535 (approx 1.49s)
+        if (vgm_read(vgm, (uint8_t *)&data16, vgm->data_pos + 1, 2) != 2)
+        {
+            VGM_PRINTERR("VGM: Read error\n");
+            r = -1;
+        }
+        else
+        {
+            vgm->data_pos += 3;
+            cmd->type = VGM_EVENT_WAIT;
+            cmd->samples = data16;
+        }
+        break;
+    case 0x62:  // wait 735 samples (60th of a second)
+        ++vgm->data_pos;
+        cmd->type = VGM_EVENT_WAIT;
+        cmd->samples = 735;
+        break;
+    case 0x63:  // wait 882 samples (50th of a second)
+        ++vgm->data_pos;
+        cmd->type = VGM_EVENT_WAIT;
+        cmd->samples = 882;
+        break;
+    case 0x66:  // end of sound data, data_pos stays here
+        cmd->type = VGM_EVENT_END;
+        break;
+    case 0x67:  // data block, 0x67 0x66 tt ss ss ss ss (data)
+                // tt = data type
+                // ss ss ss ss = size of data
+                // (data) = data
+        tt = 0; data16 = 0; data32 = 0;
+        vgm_read(vgm, (uint8_t *)&data32, vgm->data_pos + 3, 4);
+        if (data32 == 0)
+        {
+            // bad thing happend in VGM file
+            VGM_PRINTERR("VGM: Read error\n");
+            r = -1;
+        }
+        else
+        {
+            vgm_read(vgm, &tt, vgm->data_pos + 2, 1);  // tt
+            if (0xc2 == tt) // NES APU RAM write
+            {
+                // first 2 bytes are RAM address
+                vgm_read(vgm, (uint8_t *)&data16, vgm->data_pos + 7, 2);
+                cmd->type = VGM_EVENT_RAM;
+                cmd->ram.offset = vgm->data_pos + 9;
+                cmd->ram.addr = data16;
+                cmd->ram.len = (uint16_t)(data32 - 2);
+            }
+#if VGM_USE_DATA_BANK
+            else if (0x07 == tt || 0x47 == tt || 0x7F == tt)    // NES APU DPCM data bank, decompression table
+            {
+                if (!vgm_bank_data_block(vgm, vgm->data_pos, tt, data32))
+                {
+                    VGM_PRINTERR("VGM: Out of memory for data bank\n");
+                    r = -1;
+                }
+            }
+#endif
+            else
+            {
+                VGM_DUMP("VGM: Data block type=%02x, len=%d\n", tt, data32);
+            }
+            vgm->data_pos += 7 + data32;
+        }
+        break;
+    case 0x68:  // PCM RAM writes, 0x68 0x66 cc oo oo oo dd dd dd ss ss ss
+#if VGM_USE_DATA_BANK
+        {
+            uint8_t w[11];
+            if (vgm_read(vgm, w, vgm->data_pos + 1, 11) != 11)
+            {
+                VGM_PRINTERR("VGM: Read error\n");
+                r = -1;
+                break;
+            }
+            uint32_t from = (uint32_t)w[2] | ((uint32_t)w[3] << 8) | ((uint32_t)w[4] << 16);
+            uint32_t to = (uint32_t)w[5] | ((uint32_t)w[6] << 8) | ((uint32_t)w[7] << 16);
+            uint32_t len = (uint32_t)w[8] | ((uint32_t)w[9] << 8) | ((uint32_t)w[10] << 16);
+            if (0 == len) len = 0x1000000;
+            int index = (0x07 == w[1]) ? vgm_bank_find(vgm, from) : -1;
+            if (index >= 0 && to < 0x10000)
+            {
+                // Copy from one bank block, into 64KB address space
+                const vgm_bank_block_t *block = &(vgm->bank_blocks[index]);
+                if (len > block->size - (from - block->start)) len = block->size - (from - block->start);
+                if (len > 0x10000 - to) len = 0x10000 - to;
+                if (len > 0xffff) len = 0xffff;
+                cmd->type = VGM_EVENT_RAM;
+                // Uncompressed data is read from file in place
+                cmd->ram.offset = (VGM_BANK_RAW == block->codec) ? block->data_pos + (from - block->start) : vgm->bank_base + from;
+                cmd->ram.addr = (uint16_t)to;
+                cmd->ram.len = (uint16_t)len;
+            }
+        }
+#endif
+        vgm->data_pos += 12;
+        break;
+    case 0x70:  // 0x7n:  wait n+1 samples
+    case 0x71:
+    case 0x72:
+    case 0x73:
+    case 0x74:
+    case 0x75:
+    case 0x76:
+    case 0x77:
+    case 0x78:
+    case 0x79:
+    case 0x7A:
+    case 0x7B:
+    case 0x7C:
+    case 0x7D:
+    case 0x7E:
+    case 0x7F:
+        ++vgm->data_pos;
+        cmd->type = VGM_EVENT_WAIT;
+        cmd->samples = (data8 & 0x0F) + 1U;
+        break;
+    case 0x80:  // 0x8n: YM2612 port 0 address 2A write from the data bank, then wait n samples
+    case 0x81:
+    case 0x82:
+    case 0x83:
+    case 0x84:
+    case 0x85:
+    case 0x86:
+    case 0x87:
+    case 0x88:
+    case 0x89:
+    case 0x8A:
+    case 0x8B:
+    case 0x8C:
+    case 0x8D:
+    case 0x8E:
+    case 0x8F:
+        ++vgm->data_pos;
+        break;
+    case 0x90:  // 0x90-0x95: DAC Stream control write
+    case 0x91:
+    case 0x92:
+    case 0x93:
+    case 0x94:
+    case 0x95:
+        ++vgm->data_pos;
+        break;
+    case 0xA0:  // aa dd : AY8910, write value dd to register aa
+    case 0xA1:  // 0xA1-0xAF: aa dd : Used for dual chip supportw
+    case 0xA2:
+    case 0xA3:
+    case 0xA4:
+    case 0xA5:
+    case 0xA6:
+    case 0xA7:
+    case 0xA8:
+    case 0xA9:
+    case 0xAA:
+    case 0xAB:
+    case 0xAC:
+    case 0xAD:
+    case 0xAE:
+    case 0xAF:
+    case 0xB0:  // aa dd : RF5C68, write value dd to register aa
+    case 0xB1:  // aa dd : RF5C164, write value dd to register aa
+    case 0xB2:  // ad dd : PWM, write value ddd to register a (d is MSB, dd is LSB)
+    case 0xB3:  // aa dd : GameBoy DMG, write value dd to register aa
+        vgm->data_pos += 3;
+        break;
+    case 0xB4:  // aa dd : NES APU, write value dd to register aa
+        if (vgm_read(vgm, &aa, vgm->data_pos + 1, 1) != 1)
+        {
+            VGM_PRINTERR("VGM: Read error\n");
+            r = -1;
+            break;
+        }
+        if (vgm_read(vgm, &dd, vgm->data_pos + 2, 1) != 1)
+        {
+            VGM_PRINTERR("VGM: Read error\n");
+            r = -1;
+            break;
+        }
+        vgm->data_pos += 3;
+        cmd->type = VGM_EVENT_WRITE;
+        cmd->reg = aa;
+        cmd->val = dd;
+        break;
+    case 0xB5:  // aa dd : MultiPCM, write value dd to register aa
+    case 0xB6:  // aa dd : uPD7759, write value dd to register aa
+    case 0xB7:  // aa dd : OKIM6258, write value dd to register aa
+    case 0xB8:  // aa dd : OKIM6295, write value dd to register aa
+    case 0xB9:  // aa dd : HuC6280, write value dd to register aa
+    case 0xBA:  // aa dd : K053260, write value dd to register aa
+    case 0xBB:  // aa dd : Pokey, write value dd to register aa
+    case 0xBC:  // aa dd : WonderSwan, write value dd to register aa
+    case 0xBD:  // aa dd : SAA1099, write value dd to register aa
+    case 0xBE:  // aa dd : ES5506, write 8-bit value dd to register aa
+    case 0xBF:  // aa dd : GA20, write value dd to register aa
+        vgm->data_pos += 3;
+        break;
+    case 0xC0:  // bbaa dd : Sega PCM, write value dd to memory offset aabb
+    case 0xC1:  // bbaa dd : RF5C68, write value dd to memory offset aabb
+    case 0xC2:  // bbaa dd : RF5C164, write value dd to memory offset aabb
+    case 0xC3:  // cc bbaa : MultiPCM, write set bank offset aabb to channel cc
+    case 0xC4:  // mmll rr : QSound, write value mmll to register rr
+                // (mm - data MSB, ll - data LSB)
+    case 0xC5:  // mmll dd : SCSP, write value dd to memory offset mmll
+                // (mm - offset MSB, ll - offset LSB)
+    case 0xC6:  // mmll dd : WonderSwan, write value dd to memory offset mmll
+                // (mm - offset MSB, ll - offset LSB)
+    case 0xC7:  // mmll dd : VSU, write value dd to register mmll
+                // (mm - MSB, ll - LSB)
+    case 0xC8:  // mmll dd : X1-010, write value dd to memory offset mmll
+                // (mm - offset MSB, ll - offset LSB)
+        vgm->data_pos += 4;
+        break;
+    case 0xC9:  // 0xC9..0xCF dd dd dd : three operands, reserved for future use
+    case 0xCA:
+    case 0xCB:
+    case 0xCC:
+    case 0xCD:
+    case 0xCE:
+    case 0xCF:
+        vgm->data_pos += 4;
+        break;
+    case 0xD0:  // pp aa dd : YMF278B port pp, write value dd to register aa
+    case 0xD1:  // pp aa dd : YMF271 port pp, write value dd to register aa
+    case 0xD2:  // pp aa dd : SCC1 port pp, write value dd to register aa
+    case 0xD3:  // pp aa dd : K054539 write value dd to register ppaa
+    case 0xD4:  // pp aa dd : C140 write value dd to register ppaa
+    case 0xD5:  // pp aa dd : ES5503 write value dd to register ppaa
+    case 0xD6:  // aa ddee  : ES5506 write 16-bit value ddee to register aa 
+        vgm->data_pos += 4;
+        break;
+    case 0xD7:  // 0xD7..0xDF dd dd dd : three operands, reserved for future use
+    case 0xD8:
+    case 0xD9:
+    case 0xDA:
+    case 0xDB:
+    case 0xDC:
+    case 0xDD:
+    case 0xDE:
+    case 0xDF:
+        vgm->data_pos += 4;
+        break;
+    case 0xE0:  // dddddddd : seek to offset dddddddd (Intel byte order) in PCM data bank
+    case 0xE1:  // aabb ddee: C352 write 16-bit value ddee to register aabb
+        vgm->data_pos += 5;
+        break;
+    case 0xE2:  // 0xE2..0xFF dd dd dd dd : four operands, reserved for future use
+    case 0xE3:
+    case 0xE4:
+    case 0xE5:
+    case 0xE6:
+    case 0xE7:
+    case 0xE8:
+    case 0xE9:
+    case 0xEA:
+    case 0xEB:
+    case 0xEC:
+    case 0xED:
+    case 0xEE:
+    case 0xEF:
+    case 0xF0:
+    case 0xF1:
+    case 0xF2:
+    case 0xF3:
+    case 0xF4:
+    case 0xF5:
+    case 0xF6:
+    case 0xF7:
+    case 0xF8:
+    case 0xF9:
+    case 0xFA:
+    case 0xFB:
+    case 0xFC:
+    case 0xFD:
+    case 0xFE:
+    case 0xFF:
+        vgm->data_pos += 5;
+        break;
+    default:
+        VGM_PRINTERR("VGM: Unknown command 0x%02X\n", data8);
+        r = -1;
+        break;         
+    }  // end of switch-case
+    return r;
+}
+
+
+// Convert wait in VGM_SAMPLE_RATE units to output samples. Remainder is carried to next wait,
+// so waits add up to exact output length at any rate.
+static unsigned int vgm_wait_samples(vgm_t *vgm, unsigned int wait)
+{
+    if (vgm->sample_rate == VGM_SAMPLE_RATE) return wait;
+    uint64_t t = (uint64_t)wait * vgm->sample_rate + vgm->wait_frac;
+    vgm->wait_frac = (unsigned int)(t % VGM_SAMPLE_RATE);
+    return (unsigned int)(t / VGM_SAMPLE_RATE);
+}
+
+
+#if VGM_USE_COMPILED_STREAM
+
+static void vgm_free_events(vgm_t *vgm)
+{
+    if (vgm->events) VGM_FREE(vgm->events);
+    if (vgm->ram_blocks) VGM_FREE(vgm->ram_blocks);
+    vgm->events = NULL;
+    vgm->event_count = 0;
+    vgm->event_pos = 0;
+    vgm->event_loop = 0;
+    vgm->ram_blocks = NULL;
+    vgm->ram_block_count = 0;
+}
+
+
+// Walk VGM data from data_offset to end of sound data and translate it into events.
+// If events and ram_blocks are NULL, only count them.
+// return 0 on success, negative on error.
+static int vgm_compile_pass(vgm_t *vgm, vgm_event_t *events, size_t *event_count, vgm_ram_block_t *ram_blocks, size_t *ram_block_count)
+{
+    vgm_command_t cmd = { 0 };
+    size_t ne = 0, nr = 0;
+    bool loop_found = false;
+    vgm->data_pos = (size_t)vgm->data_offset;
+    do
+    {
+        if (vgm->loop_offset != 0 && vgm->data_pos == vgm->loop_offset)
+        {
+            if (events)
+            {
+                events[ne].type = VGM_EVENT_LOOP;
+                vgm->event_loop = ne;
+            }
+            ++ne;
+            loop_found = true;
+        }
+        if (vgm_fetch_command(vgm, &cmd) < 0) return -1;
+        switch (cmd.type)
+        {
+        case VGM_EVENT_WRITE:
+            if (events)
+            {
+                events[ne].type = VGM_EVENT_WRITE;
+                events[ne].reg = cmd.reg;
+                events[ne].val = cmd.val;
+            }
+            ++ne;
+            break;
+        case VGM_EVENT_WAIT:
+            if (cmd.samples == 0) break;    // nothing to wait
+            if (events)
+            {
+                events[ne].type = VGM_EVENT_WAIT;
+                events[ne].val = cmd.samples;
+            }
+            ++ne;
+            break;
+        case VGM_EVENT_RAM:
+            if (nr > 0xffff) return -1;     // event can not index that many ram blocks
+            if (events)
+            {
+                events[ne].type = VGM_EVENT_RAM;
+                events[ne].val = (uint16_t)nr;
+                ram_blocks[nr] = cmd.ram;
+            }
+            ++ne;
+            ++nr;
+            break;
+        case VGM_EVENT_END:
+            if (events)
+            {
+                events[ne].type = VGM_EVENT_END;
+            }
+            ++ne;
+            break;
+        default:    // dropped
+            break;
+        }
+    } while (cmd.type != VGM_EVENT_END);
+    // Loop point not on command boundary, let interpreter handle it
+    if (vgm->loop_offset != 0 && !loop_found) return -1;
+    *event_count = ne;
+    *ram_block_count = nr;
+    return 0;
+}
+
+
+// Translate VGM data into in-memory event array, so playback does not need reader anymore.
+// On failure interpreter is used.
+static void vgm_compile(vgm_t *vgm)
+{
+    size_t ne, nr;
+    bool success = false;
+    vgm_free_events(vgm);
+    do
+    {
+        if (vgm_compile_pass(vgm, NULL, &ne, NULL, &nr) < 0) break;
+        vgm->events = (vgm_event_t *)VGM_MALLOC(ne * sizeof(vgm_event_t));
+        if (NULL == vgm->events) break;
+        if (nr > 0)
+        {
+            vgm->ram_blocks = (vgm_ram_block_t *)VGM_MALLOC(nr * sizeof(vgm_ram_block_t));
+            if (NULL == vgm->ram_blocks) break;
+        }
+        if (vgm_compile_pass(vgm, vgm->events, &ne, vgm->ram_blocks, &nr) < 0) break;
+        vgm->event_count = ne;
+        vgm->ram_block_count = nr;
+        VGM_DUMP("VGM: Compiled %d events, %d ram blocks\n", (int)ne, (int)nr);
+        success = true;
+    } while (0);
+    if (!success)
+    {
+        VGM_PRINTINF("VGM: Compile failed, use interpreter\n");
+        vgm_free_events(vgm);
+    }
+    vgm->data_pos = (size_t)vgm->data_offset;
+}
+
+
+// Execute pre-decoded events, same return values as vgm_exec
+static int vgm_exec_compiled(vgm_t *vgm)
+{
+    const vgm_event_t *ev;
+    const vgm_ram_block_t *ram;
+    while (true)
+    {
+        ev = &(vgm->events[vgm->event_pos]);
+        ++vgm->event_pos;
+        switch (ev->type)
+        {
+        case VGM_EVENT_WRITE:
+            if (!nesapu_queue_write(vgm->apu, vgm->samples_queued, ev->reg, (uint8_t)(ev->val)))
+            {
+                --vgm->event_pos;
+                return 1;
+            }
+            VGM_DUMP("VGM: NES APU write reg[$%04X] = 0x%02X\n", ev->reg + 0x4000, ev->val);
+            break;
+        case VGM_EVENT_WAIT:
+            VGM_DUMP("VGM: Wait %d samples\n", ev->val);
+            vgm->samples_waiting = vgm_wait_samples(vgm, ev->val);
+            if (vgm->samples_waiting) return 1;
+            break;
+        case VGM_EVENT_RAM:
+            if (vgm->samples_queued)
+            {
+                --vgm->event_pos;
+                return 1;
+            }
+            ram = &(vgm->ram_blocks[ev->val]);
+            nesapu_add_ram(vgm->apu, ram->offset, ram->addr, ram->len);
+            break;
+        case VGM_EVENT_END:
+            if (vgm->loops != 0)
+            {
+                vgm->event_pos = vgm->event_loop;
+                vgm->looped = true;
+                VGM_DUMP("VGM: Loop %d\n", vgm->loops);
+                if (vgm->loops > 0) --vgm->loops;
+            }
+            else
+            {
+                // stay at end
+                --vgm->event_pos;
+                VGM_DUMP("VGM: End\n");
+                vgm->samples_waiting = 0;
+                return 0;
+            }
+            break;
+        default:    // VGM_EVENT_LOOP
+            break;
+        }
+    }
+}
+
+#endif
+
+
+vgm_t * vgm_create(file_reader_t *reader)
+{
+    vgm_t *vgm = NULL;
+    vgm_header_t header_copy;
+    const vgm_header_t *header = &header_copy;
+    bool success = false;
+    do
+    {
+        vgm = (vgm_t *)VGM_MALLOC(sizeof(vgm_t));
+        if (NULL == vgm) break;
+        memset(vgm, 0, sizeof(vgm_t));
+        vgm->reader = reader;
+        vgm->block_size = NESAPU_MAX_SAMPLES;
+#if VGM_READER_BORROW
+        // If reader can lend the whole file, everything is read in place
+        if (reader->borrow)
+        {
+            vgm->data_size = reader->size(reader);
+            vgm->data = reader->borrow(reader, 0, vgm->data_size);
+        }
+        if (vgm->data)
+        {
+            if (vgm->data_size < sizeof(vgm_header_t)) break;
+            header = (const vgm_header_t *)vgm->data;
+        }
+        else
+#endif
+        {
+#if VGM_FILE_CACHE_SIZE > 0
+            // Without window, commands are read directly
+            vgm->cache = (uint8_t *)VGM_MALLOC(VGM_FILE_CACHE_SIZE);
+#endif
+            if (reader->read(reader, (uint8_t *)&header_copy, 0, sizeof(vgm_header_t)) != sizeof(vgm_header_t)) break;
+        }
+        if (header->ident != 0x206d6756) break;
+        if (header->eof_offset + 4 != reader->size(reader)) break;
+        vgm->version = header->version;
+        // We only support NES VGM for now
+        if (0 == header->nes_apu_clk) break;
+        vgm->nes_apu_clk = header->nes_apu_clk;
+        vgm->rate = header->rate;
+        if (0 == vgm->rate) vgm->rate = 60;
+        // For version 1.50 below, data starts at 0x40. Otherwise data starts from 0x34 + data_offset
+        if (header->version >= 0x00000150 && header->data_offset != 0)
+        {
+            vgm->data_offset = header->data_offset + 0x34;
+        }
+        else
+        {
+            vgm->data_offset = 0x40;
+        }
+#if VGM_USE_DATA_BANK
+        vgm_bank_init(vgm);
+#endif
+        // samples
+        vgm->total_samples = (unsigned int)(header->total_samples);
+        // any loop?
+        if (header->loop_offset != 0 && header->loop_samples != 0)
+        {
+            vgm->loop_count = 1;
+            vgm->loops = 1;
+            vgm->loop_offset = header->loop_offset + 0x1c;
+            vgm->loop_samples = (unsigned int)(header->loop_samples);
+        }
+        else
+        {
+            vgm->loop_count = 0;
+            vgm->loops = 0;
+        }
+        // GD3
+        if (header->gd3_offset != 0)
+        {
+            read_vgm_gd3(vgm, header->gd3_offset + 0x14);
+        }
+        vgm->complete_samples = vgm->total_samples + vgm->loop_samples;
+        vgm->played_samples = 0;
+        vgm->fadeout_samples = 0;
+        vgm->stop_samples = UINT64_MAX;
+        // Print Info
+        VGM_DUMP("VGM: Version %X.%X\n", vgm->version >> 8, vgm->version & 0xff);
+        VGM_DUMP("VGM: Total samples: %d+%d (%.2fs+%.2fs)\n", vgm->total_samples, vgm->loop_samples, vgm->total_samples / 44100.0f, vgm->loop_samples / 44100.0f);
+        VGM_DUMP("VGM: Track Name:    %s\n", vgm->track_name_en);
+        VGM_DUMP("VGM: Game Name:     %s\n", vgm->game_name_en);
+        VGM_DUMP("VGM: Author:        %s\n", vgm->author_name_en);
+        VGM_DUMP("VGM: Release Date:  %s\n", vgm->release_date);
+        VGM_DUMP("VGM: Ripped by:     %s\n", vgm->creator);
+        success = true;
+    } while (0);
+    if (!success)
+    {
+        if (vgm != NULL)
+        {
+            vgm_destroy(vgm);
+            vgm = NULL;
+        }
+    }
+    return vgm;
+}
+
+
+void vgm_destroy(vgm_t *vgm)
+{
+    if (vgm)
+    {
+        if (vgm->apu) nesapu_destroy(vgm->apu);
+#if VGM_USE_COMPILED_STREAM
+        vgm_free_events(vgm);
+#endif
+#if VGM_FILE_CACHE_SIZE > 0
+        if (vgm->cache) VGM_FREE(vgm->cache);
+#endif
+#if VGM_SEEK_INTERVAL > 0
+        if (vgm->checkpoints) VGM_FREE(vgm->checkpoints);
+#endif
+#if VGM_USE_DATA_BANK
+        if (vgm->bank_blocks) VGM_FREE(vgm->bank_blocks);
+#endif
+        if (vgm->notes) VGM_FREE(vgm->notes);
+        if (vgm->creator) VGM_FREE(vgm->creator);
+        if (vgm->release_date) VGM_FREE(vgm->release_date);
+        if (vgm->author_name_en) VGM_FREE(vgm->author_name_en);
+        if (vgm->sys_name_en) VGM_FREE(vgm->sys_name_en);
+        if (vgm->game_name_en) VGM_FREE(vgm->game_name_en);
+        if (vgm->track_name_en) VGM_FREE(vgm->track_name_en);
+        VGM_FREE(vgm);
+    }
+}
+
+
+// Set # of times the loop is played after the first pass, VGM_LOOP_FOREVER to loop until vgm_request_fade().
+// Default is 1. Takes effect at vgm_prepare_playback(), no effect if file has no loop.
+void vgm_set_loops(vgm_t *vgm, int loops)
+{
+    if (0 == vgm->loop_offset)
+        return;
+    vgm->loop_count = (loops < 0) ? VGM_LOOP_FOREVER : loops;
+}
+
+
+// Set the largest # of samples rendered by one APU call, which sizes the blip buffer (4 bytes per sample).
+// Default is NESAPU_MAX_SAMPLES, capped at NESAPU_BLOCK_LIMIT. Larger blocks save per call work for offline
+// rendering, longer vgm_get_samples() requests are split. Takes effect at vgm_prepare_playback().
+void vgm_set_block_size(vgm_t *vgm, unsigned int samples)
+{
+    vgm->block_size = samples ? samples : NESAPU_MAX_SAMPLES;
+    if (vgm->block_size > NESAPU_BLOCK_LIMIT) vgm->block_size = NESAPU_BLOCK_LIMIT;
+}
+
+
+// options: VGM_PLAYBACK_xxx. Silence options run vgm_analyze() first, which walks the whole track once.
+bool vgm_prepare_playback(vgm_t *vgm, unsigned int sample_rate, unsigned int options)
+{
+    // Preparing again starts over with a new APU
+    if (vgm->apu)
+    {
+        nesapu_destroy(vgm->apu);
+        vgm->apu = NULL;
+    }
+    vgm->apu = nesapu_create(vgm_ram_reader(vgm), vgm->rate == 50 ? true : false, vgm->nes_apu_clk, sample_rate, vgm->block_size);
+    if (NULL == vgm->apu)
+        return false;
+#if VGM_USE_COMPILED_STREAM
+    vgm_compile(vgm);
+#endif
+    vgm->data_pos = (size_t)vgm->data_offset;
+    vgm->sample_rate = sample_rate;
+    vgm->samples_waiting = 0;
+    vgm->samples_queued = 0;
+    vgm->wait_frac = 0;
+    vgm->played_samples = 0;
+    vgm->fadeout_samples = 0;
+    vgm->stop_samples = UINT64_MAX;
+    vgm->loops = vgm->loop_count;
+    vgm->looped = false;
+    bool endless = (vgm->loop_count == VGM_LOOP_FOREVER);
+    // Length in output samples
+    if (endless)
+        vgm->complete_samples = UINT64_MAX;
+    else
+        vgm->complete_samples = ((uint64_t)vgm->total_samples + (uint64_t)vgm->loop_samples * vgm->loop_count) * sample_rate / VGM_SAMPLE_RATE;
+    uint64_t start = 0;
+    if (options & (VGM_PLAYBACK_SKIP_SILENCE | VGM_PLAYBACK_TRIM_SILENCE))
+    {
+        vgm_analysis_t analysis;
+        if (!vgm_analyze(vgm, &analysis))
+            return false;
+        if ((options & VGM_PLAYBACK_TRIM_SILENCE) && !endless)
+        {
+            // Sound ends at the same place in the last loop pass, unless loop is silent all along
+            uint64_t end = analysis.audible_samples;
+            if (vgm->loop_samples && analysis.audible_samples > analysis.loop_start) end += (uint64_t)vgm->loop_samples * vgm->loop_count;
+            vgm->stop_samples = end * sample_rate / VGM_SAMPLE_RATE;
+            if (vgm->stop_samples < vgm->complete_samples) vgm->complete_samples = vgm->stop_samples;
+        }
+        if ((options & VGM_PLAYBACK_SKIP_SILENCE) && analysis.audible_samples)
+        {
+            start = (uint64_t)analysis.audible_start * sample_rate / VGM_SAMPLE_RATE;
+        }
+    }
+#if VGM_SEEK_INTERVAL > 0
+    if (vgm->checkpoints) VGM_FREE(vgm->checkpoints);
+    vgm->checkpoints = NULL;
+    vgm->checkpoint_count = 0;
+    // Endless playback indexes first pass through the loop only
+    uint64_t indexed = endless ? ((uint64_t)vgm->total_samples + vgm->loop_samples) * sample_rate / VGM_SAMPLE_RATE : vgm->complete_samples;
+    vgm->checkpoint_max = (unsigned int)(indexed / VGM_SEEK_INTERVAL + 2);
+#endif
+    // Fadeout: last VGM_FADEOUT_SECONDS or 5% of the samples played, whichever is shorter, is going to be used as fade out
+    if (options & VGM_PLAYBACK_FADEOUT)
+    {
+        uint64_t fades1 = (vgm->complete_samples - start) / 20;
+        uint64_t fades2 = (uint64_t)VGM_FADEOUT_SECONDS * sample_rate;
+        vgm->fadeout_samples = (unsigned int)(fades1 > fades2 ? fades2 : fades1);
+    }
+    // Leading silence is executed without synthesis, playback position starts at first sound
+    if (start && vgm_skip_samples(vgm, (unsigned int)start) < 0)
+        return false;
+    return true;
+}
+
+
+// Fade out from current position over samples (0 for VGM_FADEOUT_SECONDS), playback finishes when fade ends.
+// Ends endless playback. No effect if fade has started already, or playback is not prepared.
+void vgm_request_fade(vgm_t *vgm, unsigned int samples)
+{
+    if (NULL == vgm->apu || vgm->apu->fadeout_enabled)
+        return;
+    if (0 == samples)
+        samples = VGM_FADEOUT_SECONDS * vgm->sample_rate;
+    uint64_t end = vgm->played_samples + samples;
+    vgm->fadeout_samples = samples;
+    vgm->complete_samples = end;
+    if (end < vgm->stop_samples) vgm->stop_samples = end;
+    nesapu_enable_fade(vgm->apu, samples);
+}
+
+
+//
+// Analysis
+//
+#define VGM_ANALYSIS_STEP       (VGM_SAMPLE_RATE / 240)     // Resolution of audible end, one frame counter step
+#define VGM_ANALYSIS_MIN_LOOP   VGM_SAMPLE_RATE             // Shorter repeats are taken as patterns, not loops
+
+// Commands up to and including a wait, for loop detection
+typedef struct vgm_frame_s
+{
+    uint32_t hash;          // FNV-1a of commands
+    uint32_t data_pos;      // File position of first command
+    unsigned long sample;   // Position at start of frame
+    bool writes;            // Frame has register writes or RAM blocks
+} vgm_frame_t;
+
+
+static uint32_t vgm_hash(uint32_t h, const uint8_t *p, size_t len)
+{
+    for (size_t i = 0; i < len; ++i)
+    {
+        h = (h ^ p[i]) * 16777619U;
+    }
+    return h;
+}
+
+
+// Record sound heard in [from, to)
+static void vgm_mark_audible(vgm_analysis_t *analysis, unsigned long from, unsigned long to)
+{
+    if (0 == analysis->audible_samples) analysis->audible_start = from;
+    analysis->audible_samples = to;
+}
+
+
+// Run APU for samples from pos without synthesis. Steps in which any channel can be heard are marked
+// audible to their end. return position after samples.
+static unsigned long vgm_analyze_span(nesapu_t *apu, unsigned long pos, unsigned int samples, vgm_analysis_t *analysis)
+{
+    while (samples > 0)
+    {
+        if (!nesapu_audible_channels(apu))
+        {
+            // Silent until next write
+            nesapu_skip_samples(apu, samples);
+            return pos + samples;
+        }
+        unsigned int n = (samples > VGM_ANALYSIS_STEP) ? VGM_ANALYSIS_STEP : samples;
+        nesapu_skip_samples(apu, n);
+        vgm_mark_audible(analysis, pos, pos + n);
+        pos += n;
+        samples -= n;
+    }
+    return pos;
+}
+
+
+// Find earliest start of frames repeating up to end of data, at least once over. The repeat must
+// contain writes, so silence after the music is not taken as a loop.
+// Z-function of frame hashes read backwards from end: z[p] is how many frames, counted back from end,
+// match the frames p before them. return NULL if out of memory.
+static uint32_t *vgm_frame_z(const vgm_frame_t *frames, size_t end)
+{
+    uint32_t *z = (uint32_t *)VGM_MALLOC(end * sizeof(uint32_t));
+    if (NULL == z) return NULL;
+    z[0] = (uint32_t)end;
+    size_t l = 0, r = 0;    // Match window [l, r) reaching furthest
+    for (size_t i = 1; i < end; ++i)
+    {
+        size_t k = 0;
+        if (i < r) k = (z[i - l] < r - i) ? z[i - l] : r - i;
+        while (i + k < end && frames[end - 1 - k].hash == frames[end - 1 - i - k].hash) ++k;
+        z[i] = (uint32_t)k;
+        if (i + k > r)
+        {
+            l = i;
+            r = i + k;
+        }
+    }
+    return z;
+}
+
+
+// return false if out of memory
+static bool vgm_detect_loop(const vgm_frame_t *frames, size_t count, unsigned long total, vgm_analysis_t *analysis)
+{
+    size_t end = count;
+    // Frame closed by end of data has no wait
+    if (end > 0 && !frames[end - 1].writes) --end;
+    size_t last_write = end;
+    while (last_write > 0 && !frames[last_write - 1].writes) --last_write;
+    if (0 == last_write) return true;
+    // Repeat length for every period at once, so a long repeating tail stays linear
+    uint32_t *z = vgm_frame_z(frames, end);
+    if (NULL == z) return false;
+    size_t best_start = end, best_period = 0;
+    for (size_t p = end - last_write + 1; 2 * p <= end; ++p)
+    {
+        size_t run = z[p];
+        if (run < p) continue;
+        // Waits are hashed, so every p frames in the repeat last as long as the last p
+        unsigned long last = (end < count) ? frames[end].sample : total;
+        if (last - frames[end - p].sample < VGM_ANALYSIS_MIN_LOOP) continue;
+        if (end - run - p < best_start)
+        {
+            best_start = end - run - p;
+            best_period = p;
+        }
+    }
+    if (best_period)
+    {
+        analysis->loop_start = frames[best_start].sample;
+        analysis->loop_samples = frames[best_start + best_period].sample - frames[best_start].sample;
+        analysis->loop_offset = frames[best_start].data_pos;
+        analysis->loop_detected = true;
+    }
+    VGM_FREE(z);
+    return true;
+}
+
+
+// Walk VGM data once, running a private APU without synthesis, to find the real length, loop and
+// where sound ends. If header has no loop, loop is detected from repeated register writes.
+// Call before or between vgm_get_samples() calls, playback position is kept.
+// return false on data or memory error.
+bool vgm_analyze(vgm_t *vgm, vgm_analysis_t *analysis)
+{
+    size_t saved_pos = vgm->data_pos;
+    vgm_frame_t *frames = NULL;
+    size_t frame_count = 0, frame_max = 0;
+    nesapu_t *apu = NULL;
+    vgm_command_t cmd = { 0 };
+    bool success = false;
+    memset(analysis, 0, sizeof(vgm_analysis_t));
+    do
+    {
+        if (0 == vgm->loop_offset)
+        {
+            // One frame per wait, and the writes before end of data
+            vgm->data_pos = (size_t)vgm->data_offset;
+            do
+            {
+                if (vgm_fetch_command(vgm, &cmd) < 0) break;
+                if (cmd.type == VGM_EVENT_WAIT && cmd.samples) ++frame_max;
+            } while (cmd.type != VGM_EVENT_END);
+            if (cmd.type != VGM_EVENT_END) break;
+            ++frame_max;
+            frames = (vgm_frame_t *)VGM_MALLOC(frame_max * sizeof(vgm_frame_t));
+            if (NULL == frames) break;
+        }
+        apu = nesapu_create(vgm_ram_reader(vgm), vgm->rate == 50 ? true : false, vgm->nes_apu_clk, VGM_SAMPLE_RATE, vgm->block_size);
+        if (NULL == apu) break;
+        unsigned long pos = 0;
+        uint32_t hash = 2166136261U;
+        bool writes = false;
+        size_t frame_pos = (size_t)vgm->data_offset;
+        uint8_t b[4];
+        int r = 0;
+        vgm->data_pos = (size_t)vgm->data_offset;
+        while (true)
+        {
+            if (vgm->loop_offset != 0 && vgm->data_pos == vgm->loop_offset)
+            {
+                analysis->loop_start = pos;
+                analysis->loop_offset = vgm->loop_offset;
+            }
+            if ((r = vgm_fetch_command(vgm, &cmd)) < 0) break;
+            if (cmd.type == VGM_EVENT_END) break;
+            switch (cmd.type)
+            {
+            case VGM_EVENT_WRITE:
+                b[0] = cmd.reg;
+                b[1] = cmd.val;
+                hash = vgm_hash(hash, b, 2);
+                writes = true;
+                // Direct load steps DMC level, that is a click
+                if (cmd.reg == 0x11 && (unsigned int)(cmd.val & 0x7f) != apu->dmc_output) vgm_mark_audible(analysis, pos, pos + 1);
+                nesapu_write_reg(apu, cmd.reg, cmd.val);
+                break;
+            case VGM_EVENT_RAM:
+                b[0] = (uint8_t)cmd.ram.addr;
+                b[1] = (uint8_t)(cmd.ram.addr >> 8);
+                b[2] = (uint8_t)cmd.ram.len;
+                b[3] = (uint8_t)(cmd.ram.len >> 8);
+                hash = vgm_hash(hash, b, 4);
+                writes = true;
+                nesapu_add_ram(apu, cmd.ram.offset, cmd.ram.addr, cmd.ram.len);
+                break;
+            case VGM_EVENT_WAIT:
+                if (cmd.samples == 0) break;
+                b[0] = 0x61;
+                b[1] = (uint8_t)cmd.samples;
+                b[2] = (uint8_t)(cmd.samples >> 8);
+                hash = vgm_hash(hash, b, 3);
+                if (frames)
+                {
+                    frames[frame_count].hash = hash;
+                    frames[frame_count].data_pos = (uint32_t)frame_pos;
+                    frames[frame_count].sample = pos;
+                    frames[frame_count].writes = writes;
+                    ++frame_count;
+                }
+                hash = 2166136261U;
+                writes = false;
+                frame_pos = vgm->data_pos;
+                pos = vgm_analyze_span(apu, pos, cmd.samples, analysis);
+                break;
+            default:
+                break;
+            }
+        }
+        if (r < 0) break;
+        if (frames)
+        {
+            frames[frame_count].hash = hash;
+            frames[frame_count].data_pos = (uint32_t)frame_pos;
+            frames[frame_count].sample = pos;
+            frames[frame_count].writes = writes;
+            ++frame_count;
+        }
+        analysis->total_samples = pos;
+        if (analysis->loop_offset)
+        {
+            analysis->loop_samples = pos - analysis->loop_start;
+        }
+        else if (frames)
+        {
+            if (!vgm_detect_loop(frames, frame_count, pos, analysis)) break;
+        }
+        success = true;
+    } while (0);
+    if (apu) nesapu_destroy(apu);
+    if (frames) VGM_FREE(frames);
+    vgm->data_pos = saved_pos;
+    if (!success) VGM_PRINTERR("VGM: Analysis failed\n");
+    return success;
+}
+
+
+#if VGM_SEEK_INTERVAL > 0
+
+// Add RAM blocks of data from position from up to to (events if compiled) to APU
+static void vgm_add_ram_span(vgm_t *vgm, size_t from, size_t to)
+{
+#if VGM_USE_COMPILED_STREAM
+    if (vgm->events)
+    {
+        for (size_t i = from; i < to && i < vgm->event_count; ++i)
+        {
+            if (VGM_EVENT_RAM == vgm->events[i].type)
+            {
+                const vgm_ram_block_t *ram = &(vgm->ram_blocks[vgm->events[i].val]);
+                nesapu_add_ram(vgm->apu, ram->offset, ram->addr, ram->len);
+            }
+        }
+        return;
+    }
+#endif
+    size_t saved_pos = vgm->data_pos;
+    vgm_command_t cmd;
+    vgm->data_pos = from;
+    while (vgm->data_pos < to)
+    {
+        if (vgm_fetch_command(vgm, &cmd) < 0 || VGM_EVENT_END == cmd.type) break;
+        if (VGM_EVENT_RAM == cmd.type) nesapu_add_ram(vgm->apu, cmd.ram.offset, cmd.ram.addr, cmd.ram.len);
+    }
+    vgm->data_pos = saved_pos;
+}
+
+
+// Add RAM blocks of data played up to current position to APU, in the order playback added them
+static void vgm_replay_ram(vgm_t *vgm)
+{
+    size_t start = (size_t)vgm->data_offset, loop = vgm->loop_offset, pos = vgm->data_pos;
+#if VGM_USE_COMPILED_STREAM
+    if (vgm->events)
+    {
+        start = 0;
+        loop = vgm->event_loop;
+        pos = vgm->event_pos;
+    }
+#endif
+    if (vgm->looped)
+    {
+        vgm_add_ram_span(vgm, start, SIZE_MAX);
+        vgm_add_ram_span(vgm, loop, pos);
+    }
+    else
+    {
+        vgm_add_ram_span(vgm, start, pos);
+    }
+}
+
+
+// Take a checkpoint if VGM_SEEK_INTERVAL samples have been played since the last one
+static void vgm_save_checkpoint(vgm_t *vgm)
+{
+    if (vgm->checkpoint_count >= vgm->checkpoint_max) return;
+    // Distance from the last one keeps array sorted and sparse, position may jump after vgm_load_state()
+    if (vgm->checkpoint_count && vgm->played_samples < vgm->checkpoints[vgm->checkpoint_count - 1].played_samples + VGM_SEEK_INTERVAL) return;
+    if (NULL == vgm->checkpoints)
+    {
+        vgm->checkpoints = (vgm_checkpoint_t *)VGM_MALLOC(vgm->checkpoint_max * sizeof(vgm_checkpoint_t));
+        if (NULL == vgm->checkpoints)
+        {
+            // No index, seek will synthesize from current position only
+            vgm->checkpoint_max = 0;
+            return;
+        }
+    }
+    vgm_checkpoint_t *cp = &(vgm->checkpoints[vgm->checkpoint_count]);
+    cp->played_samples = vgm->played_samples;
+    cp->data_pos = vgm->data_pos;
+#if VGM_USE_COMPILED_STREAM
+    cp->event_pos = vgm->event_pos;
+#endif
+    cp->samples_waiting = vgm->samples_waiting;
+    cp->wait_frac = vgm->wait_frac;
+    cp->loops = vgm->loops;
+    cp->looped = vgm->looped;
+    nesapu_save_snapshot(vgm->apu, &(cp->apu));
+    ++vgm->checkpoint_count;
+}
+
+
+static void vgm_load_checkpoint(vgm_t *vgm, const vgm_checkpoint_t *cp)
+{
+    vgm->played_samples = cp->played_samples;
+    vgm->data_pos = cp->data_pos;
+#if VGM_USE_COMPILED_STREAM
+    vgm->event_pos = cp->event_pos;
+#endif
+    vgm->samples_waiting = cp->samples_waiting;
+    vgm->wait_frac = cp->wait_frac;
+    vgm->loops = cp->loops;
+    vgm->looped = cp->looped;
+    // Snapshot drops RAM blocks added after it, but a checkpoint ahead also needs the blocks added
+    // before it. Add them all again in data order, so the newest wins where blocks overlap. Clear them
+    // first, the snapshot then has no blocks to drop or copy into the image.
+    nesapu_clear_ram(vgm->apu);
+    nesapu_load_snapshot(vgm->apu, &(cp->apu));
+    vgm_replay_ram(vgm);
+}
+
+#endif
+
+
+// Execute VGM data, stop when samples waiting
+// return 1 when samples are waiting, or with none waiting when the APU has to render samples queued
+// before the next command (write queue full, or RAM block while samples are queued).
+// return 0 when data finished.
+// return negative on error.
+static int vgm_exec(vgm_t *vgm)
+{
+    // still have unretrieved samples, don't execute any more
+    if (vgm->samples_waiting > 0) return ((int32_t)(vgm->samples_waiting));
+#if VGM_USE_COMPILED_STREAM
+    if (vgm->events) return vgm_exec_compiled(vgm);
+#endif
+    vgm_command_t cmd = { 0 };
+    while (true)
+    {
+        size_t pos = vgm->data_pos;
+        if (vgm_fetch_command(vgm, &cmd) < 0) return -1;
+        switch (cmd.type)
+        {
+        case VGM_EVENT_WRITE:
+            if (!nesapu_queue_write(vgm->apu, vgm->samples_queued, cmd.reg, cmd.val))
+            {
+                vgm->data_pos = pos;
+                return 1;
+            }
+            VGM_DUMP("VGM: NES APU write reg[$%04X] = 0x%02X\n", cmd.reg + 0x4000, cmd.val);
+            break;
+        case VGM_EVENT_WAIT:
+            VGM_DUMP("VGM: Wait %d samples\n", cmd.samples);
+            vgm->samples_waiting = vgm_wait_samples(vgm, cmd.samples);
+            if (vgm->samples_waiting) return 1;
+            break;
+        case VGM_EVENT_RAM:
+            // DMC reads RAM as it plays, so blocks are added at their time
+            if (vgm->samples_queued)
+            {
+                vgm->data_pos = pos;
+                return 1;
+            }
+            nesapu_add_ram(vgm->apu, cmd.ram.offset, cmd.ram.addr, cmd.ram.len);
+            break;
+        case VGM_EVENT_END:
+            if (vgm->loops != 0)
+            {
+                vgm->data_pos = vgm->loop_offset;
+                vgm->looped = true;
+                VGM_DUMP("VGM: Loop %d\n", vgm->loops);
+                if (vgm->loops > 0) --vgm->loops;
+            }
+            else
+            {
+                VGM_DUMP("VGM: End\n");
+                vgm->samples_waiting = 0;
+                return 0;
+            }
+            break;
+        default:    // not for NES APU
+            break;
+        }
+    }
+}
+
+
+
+static const vgm_output_t vgm_output_mono16 = { VGM_FORMAT_S16, 1, 1 };
+
+
+// Execute VGM data ahead of the APU for up to size samples, register writes are queued at their sample.
+// Stops early where the APU has to be at the current position: start of fade, RAM block or full write
+// queue.
+// return # of samples to render, 0 when data finished, negative on error.
+static int vgm_gather(vgm_t *vgm, unsigned int size)
+{
+    unsigned int queued = 0;
+    if (size > vgm->apu->max_samples) size = vgm->apu->max_samples;
+    while (queued < size)
+    {
+        uint64_t pos = vgm->played_samples + queued;
+        if (pos >= vgm->stop_samples) break;
+        if (vgm->samples_waiting)
+        {
+#if VGM_SEEK_INTERVAL > 0
+            // Checkpoint is taken at the start of a batch, with nothing queued. It must not end the batch,
+            // or output would depend on how far the index has been built.
+            if (0 == queued) vgm_save_checkpoint(vgm);
+#endif
+            unsigned int n = (vgm->samples_waiting >= size - queued) ? size - queued : vgm->samples_waiting;
+            if (n > vgm->stop_samples - pos) n = (unsigned int)(vgm->stop_samples - pos);
+            vgm->samples_waiting -= n;
+            queued += n;
+            // Fade is enabled after the span it starts in
+            if (!vgm->apu->fadeout_enabled && (pos + n + vgm->fadeout_samples > vgm->complete_samples)) break;
+        }
+        else
+        {
+            vgm->samples_queued = queued;
+            int r = vgm_exec(vgm);
+            vgm->samples_queued = 0;
+            if (r < 0) return r;
+            if (r == 0 || 0 == vgm->samples_waiting) break;
+        }
+    }
+    return (int)queued;
+}
+
+
+// Render to buf in output format, or to stems and buf (mono int16) if stems is not NULL.
+// Waits and register writes are gathered for one APU call per block.
+static int vgm_render(vgm_t *vgm, void *buf, const vgm_output_t *output, int16_t **stems, unsigned int size)
+{
+#if !(NESAPU_USE_BLIPBUF && NESAPU_USE_STEMS)
+    (void)stems;
+#endif
+    size_t sample_size = output->stride * ((output->format == VGM_FORMAT_S16) ? sizeof(int16_t) : sizeof(int32_t));
+    int samples = 0;
+    while (size > 0)
+    {
+        if (vgm->played_samples >= vgm->stop_samples)
+        {
+            VGM_PRINTINF("VGM: Finished, silent to end\n");
+            break;
+        }
+        int r = vgm_gather(vgm, size);
+        if (r < 0)
+        {
+            VGM_PRINTERR("VGM: Exec error\n");
+            samples = -1;
+            break;
+        }
+        else if (r == 0)
+        {
+            VGM_PRINTINF("VGM: Finished\n");
+            break;
+        }
+        unsigned int read = (unsigned int)r;
+#if NESAPU_USE_BLIPBUF && NESAPU_USE_STEMS
+        if (stems)
+        {
+            int16_t *out[NESAPU_CHANNEL_COUNT];
+            for (int ch = 0; ch < NESAPU_CHANNEL_COUNT; ++ch)
+            {
+                out[ch] = stems[ch] ? stems[ch] + samples : NULL;
+            }
+            if (!nesapu_get_stems(vgm->apu, out, buf ? (int16_t *)buf + samples : NULL, read))
+            {
+                VGM_PRINTERR("VGM: Stem buffer allocation failed\n");
+                samples = -1;
+                break;
+            }
+        }
+        else
+#endif
+        nesapu_get_samples_ex(vgm->apu, (uint8_t *)buf + (size_t)samples * sample_size, read, output);
+        samples += (int)read;
+        size -= read;
+        vgm->played_samples += read;
+        if (vgm->played_samples + vgm->fadeout_samples > vgm->complete_samples) // not very accurate but shall work
+        {
+            nesapu_enable_fade(vgm->apu, vgm->fadeout_samples);
+        }
+    }
+    return samples;
+}
+
+
+int vgm_get_samples(vgm_t *vgm, int16_t *buf, unsigned int size)
+{
+    return vgm_render(vgm, buf, &vgm_output_mono16, NULL, size);
+}
+
+
+// Same as vgm_get_samples(), writing size samples in format and layout of output.
+// buf needs size * output->stride elements.
+int vgm_get_samples_ex(vgm_t *vgm, void *buf, unsigned int size, const vgm_output_t *output)
+{
+    return vgm_render(vgm, buf, output, NULL, size);
+}
+
+
+#if NESAPU_USE_BLIPBUF && NESAPU_USE_STEMS
+
+// Render each channel to stems[NESAPU_CHANNEL_COUNT] and mixed output to buf in one pass.
+// NULL buffers are skipped. Use either this or vgm_get_samples() through the playback.
+int vgm_get_stems(vgm_t *vgm, int16_t **stems, int16_t *buf, unsigned int size)
+{
+    return vgm_render(vgm, buf, &vgm_output_mono16, stems, size);
+}
+
+#endif
+
+
+// Advance playback by size samples without synthesizing them. VGM data is executed and channels are
+// run wait by wait, so APU state, played position and fade follow as if samples were rendered.
+// return # of samples skipped, less than size at end of data. -1 on error.
+int vgm_skip_samples(vgm_t *vgm, unsigned int size)
+{
+    int samples = 0;
+    while (size > 0)
+    {
+        if (vgm->played_samples >= vgm->stop_samples) break;
+        if (vgm->samples_waiting)
+        {
+            unsigned int skip = (vgm->samples_waiting >= size) ? size : vgm->samples_waiting;
+            if (skip > vgm->stop_samples - vgm->played_samples) skip = (unsigned int)(vgm->stop_samples - vgm->played_samples);
+#if VGM_SEEK_INTERVAL > 0
+            vgm_save_checkpoint(vgm);
+#endif
+            // Fade starts within this span, stop there so the rest is skipped fading
+            uint64_t fade_start = vgm->complete_samples - vgm->fadeout_samples + 1;
+            if (vgm->fadeout_samples && (vgm->played_samples < fade_start) && (vgm->played_samples + skip > fade_start))
+            {
+                skip = (unsigned int)(fade_start - vgm->played_samples);
+            }
+            nesapu_skip_samples(vgm->apu, skip);
+            vgm->samples_waiting -= skip;
+            samples += (int)skip;
+            size -= skip;
+            vgm->played_samples += skip;
+            if (vgm->played_samples + vgm->fadeout_samples > vgm->complete_samples)
+            {
+                nesapu_enable_fade(vgm->apu, vgm->fadeout_samples);
+            }
+        }
+        else
+        {
+            int r = vgm_exec(vgm);
+            if (r < 0)
+            {
+                VGM_PRINTERR("VGM: Exec error\n");
+                samples = -1;
+                break;
+            }
+            else if (r == 0)
+            {
+                break;
+            }
+        }
+    }
+    return samples;
+}
+
+
+void vgm_nesapu_enable_channel(vgm_t *vgm, uint8_t mask, bool enable)
+{
+    nesapu_enable_channel(vgm->apu, mask, enable);
+}
+
+
+#if VGM_SEEK_INTERVAL > 0
+
+// Samples synthesized before the seek position after a skip, so blip high pass filter has settled
+#define VGM_SEEK_PREROLL    8192
+
+// Seek to sample position. Playback restarts from the nearest checkpoint, is skipped without synthesis
+// up to VGM_SEEK_PREROLL samples before the position, and only those are synthesized. Checkpoints are
+// taken on the way, so cost is bounded by one interval of skipping.
+// return false if position is beyond end of data.
+bool vgm_seek(vgm_t *vgm, uint64_t sample)
+{
+    int16_t scratch[1024];
+    uint64_t start = (sample > VGM_SEEK_PREROLL) ? sample - VGM_SEEK_PREROLL : 0;
+    const vgm_checkpoint_t *cp = NULL;
+    for (unsigned int i = vgm->checkpoint_count; i > 0; --i)
+    {
+        if (vgm->checkpoints[i - 1].played_samples <= start)
+        {
+            cp = &(vgm->checkpoints[i - 1]);
+            break;
+        }
+    }
+    // Restore checkpoint if seeking backward, or if checkpoint is ahead of current position
+    if ((sample < vgm->played_samples) || (cp && cp->played_samples > vgm->played_samples))
+    {
+        if (NULL == cp) return false;
+        vgm_load_checkpoint(vgm, cp);
+    }
+    // Skip to pre-roll. New checkpoints are taken on the way.
+    while (vgm->played_samples < start)
+    {
+        uint64_t remain = start - vgm->played_samples;
+        if (vgm_skip_samples(vgm, remain > VGM_SEEK_INTERVAL ? VGM_SEEK_INTERVAL : (unsigned int)remain) <= 0) return false;
+    }
+    // Synthesize and drop samples up to position
+    while (vgm->played_samples < sample)
+    {
+        uint64_t remain = sample - vgm->played_samples;
+        unsigned int size = remain > 1024 ? 1024 : (unsigned int)remain;
+        if (vgm_get_samples(vgm, scratch, size) <= 0) return false;
+    }
+    return true;
+}
+
+#endif
+
+
+// Playback state layout, little endian
+//  0: "VGMS"
+//  4: version
+//  8: data_offset, total_samples (must match on load)
+// 16: compiled stream flag
+// 20: data_pos, event_pos, samples_waiting, loops, fadeout_samples
+// 40: sample_rate (must match on load), wait_frac
+// 48: looped
+// 52: played_samples, complete_samples, stop_samples (64 bit, all ones for none)
+// 76: nesapu state
+#define VGM_STATE_HEADER_SIZE 76
+
+static void state_put32(uint8_t *p, uint32_t v)
+{
+    p[0] = (uint8_t)v; p[1] = (uint8_t)(v >> 8); p[2] = (uint8_t)(v >> 16); p[3] = (uint8_t)(v >> 24);
+}
+
+
+static uint32_t state_get32(const uint8_t *p)
+{
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+
+static void state_put64(uint8_t *p, uint64_t v)
+{
+    state_put32(p, (uint32_t)v);
+    state_put32(p + 4, (uint32_t)(v >> 32));
+}
+
+
+static uint64_t state_get64(const uint8_t *p)
+{
+    return (uint64_t)state_get32(p) | ((uint64_t)state_get32(p + 4) << 32);
+}
+
+
+#if VGM_USE_DATA_BANK
+
+// Parse data blocks up to file position end, without executing anything
+static bool vgm_bank_scan(vgm_t *vgm, size_t end)
+{
+    size_t saved_pos = vgm->data_pos;
+    vgm_command_t cmd;
+    bool success = true;
+    vgm->data_pos = vgm->bank_scan_pos;
+    while (vgm->data_pos < end)
+    {
+        if (vgm_fetch_command(vgm, &cmd) < 0)
+        {
+            success = false;
+            break;
+        }
+        if (cmd.type == VGM_EVENT_END) break;
+    }
+    vgm->data_pos = saved_pos;
+    return success;
+}
+
+#endif
+
+
+// Save playback state between vgm_get_samples() calls.
+// return bytes written, 0 if buffer is too small. If buf is NULL, return size needed.
+size_t vgm_save_state(vgm_t *vgm, uint8_t *buf, size_t size)
+{
+    size_t apu_size = nesapu_save_state(vgm->apu, NULL, 0);
+    if (NULL == buf) return VGM_STATE_HEADER_SIZE + apu_size;
+    if (size < VGM_STATE_HEADER_SIZE + apu_size) return 0;
+    uint32_t compiled = 0, event_pos = 0;
+#if VGM_USE_COMPILED_STREAM
+    if (vgm->events)
+    {
+        compiled = 1;
+        event_pos = (uint32_t)vgm->event_pos;
+    }
+#endif
+    memcpy(buf, "VGMS", 4);
+    state_put32(buf + 4, VGM_STATE_VERSION);
+    state_put32(buf + 8, vgm->data_offset);
+    state_put32(buf + 12, vgm->total_samples);
+    state_put32(buf + 16, compiled);
+    state_put32(buf + 20, (uint32_t)vgm->data_pos);
+    state_put32(buf + 24, event_pos);
+    state_put32(buf + 28, vgm->samples_waiting);
+    state_put32(buf + 32, (uint32_t)vgm->loops);
+    state_put32(buf + 36, vgm->fadeout_samples);
+    state_put32(buf + 40, vgm->sample_rate);
+    state_put32(buf + 44, vgm->wait_frac);
+    state_put32(buf + 48, vgm->looped ? 1 : 0);
+    state_put64(buf + 52, vgm->played_samples);
+    state_put64(buf + 60, vgm->complete_samples);
+    state_put64(buf + 68, vgm->stop_samples);
+    if (nesapu_save_state(vgm->apu, buf + VGM_STATE_HEADER_SIZE, size - VGM_STATE_HEADER_SIZE) != apu_size) return 0;
+    return VGM_STATE_HEADER_SIZE + apu_size;
+}
+
+
+// Load playback state saved by vgm_save_state(). vgm shall be created from the same file
+// and prepared for playback with the same sample rate and options.
+// return false if state does not belong to this file, current state is unchanged then.
+bool vgm_load_state(vgm_t *vgm, const uint8_t *buf, size_t size)
+{
+    uint32_t compiled = 0;
+#if VGM_USE_COMPILED_STREAM
+    if (vgm->events) compiled = 1;
+#endif
+    if (size < VGM_STATE_HEADER_SIZE) return false;
+    if (memcmp(buf, "VGMS", 4) != 0) return false;
+    if (state_get32(buf + 4) != VGM_STATE_VERSION) return false;
+    if (state_get32(buf + 8) != vgm->data_offset) return false;
+    if (state_get32(buf + 12) != vgm->total_samples) return false;
+    if (state_get32(buf + 16) != compiled) return false;
+    if (state_get32(buf + 40) != vgm->sample_rate) return false;
+    if (state_get32(buf + 44) >= VGM_SAMPLE_RATE) return false;
+    uint32_t data_pos = state_get32(buf + 20);
+    if (data_pos < vgm->data_offset || data_pos >= vgm->reader->size(vgm->reader)) return false;
+#if VGM_USE_COMPILED_STREAM
+    if (compiled && state_get32(buf + 24) >= vgm->event_count) return false;
+#endif
+#if VGM_USE_DATA_BANK
+    // RAM blocks in state may read from data blocks not parsed yet, all of them once looped
+    if (!vgm_bank_scan(vgm, state_get32(buf + 48) ? SIZE_MAX : data_pos)) return false;
+#endif
+#if VGM_SEEK_INTERVAL > 0
+    // Nothing indexed yet, keep current position so seeking back before the loaded one still works
+    if (0 == vgm->checkpoint_count) vgm_save_checkpoint(vgm);
+#endif
+    if (!nesapu_load_state(vgm->apu, buf + VGM_STATE_HEADER_SIZE, size - VGM_STATE_HEADER_SIZE)) return false;
+    vgm->data_pos = data_pos;
+#if VGM_USE_COMPILED_STREAM
+    vgm->event_pos = state_get32(buf + 24);
+#endif
+    vgm->samples_waiting = state_get32(buf + 28);
+    vgm->loops = (int)state_get32(buf + 32);
+    vgm->fadeout_samples = state_get32(buf + 36);
+    vgm->wait_frac = state_get32(buf + 44);
+    vgm->played_samples = state_get64(buf + 52);
+    vgm->complete_samples = state_get64(buf + 60);
+    vgm->stop_samples = state_get64(buf + 68);
+    vgm->looped = (state_get32(buf + 48) != 0);
+    return true;
+}
@@ -1,141 +1,350 @@
-#pragma once
-
-#include <stdint.h>
-#include <stdbool.h>
-#include "file_reader.h"
-#include "nesapu.h"
-
-
-#ifdef __cplusplus
-extern "C" {
-#endif
-
-
-#define VGM_GD3_STR_MAX_LEN     64      // Max string length in GD3 tags
-#define VGM_SAMPLE_RATE         44100   // Fixed sample rate for all VGM files
-#define VGM_FADEOUT_SECONDS     2
-
-#define VGM_NESAPU_CHANNEL_PULSE1   NESAPU_CHANNEL_PULSE1
-#define VGM_NESAPU_CHANNEL_PULSE2   NESAPU_CHANNEL_PULSE2
-#define VGM_NESAPU_CHANNEL_TRIANGLE NESAPU_CHANNEL_TRIANGLE
-#define VGM_NESAPU_CHANNEL_NOISE    NESAPU_CHANNEL_NOISE
-#define VGM_NESAPU_CHANNEL_DMC      NESAPU_CHANNEL_DMC
-#define VGM_NESAPU_CHANNEL_ALL      NESAPU_CHANNEL_ALL
-
-
-PACK(struct vgm_header_s
-{
-    uint32_t ident;             // 0x00: identification "Vgm " 0x206d6756
-    uint32_t eof_offset;        // 0x04: relative offset to end of file (should be file_length - 4)
-    uint32_t version;           // 0x08: BCD version. Ver 1.7.1 is 0x00000171
-    uint32_t sn76489_clk;
-    uint32_t ym2413_clk;
-    uint32_t gd3_offset;        // 0x14: relative offset to GD3 tag (0 if no GD3 tag
-    uint32_t total_samples;     // 0x18: total samples (sum of wait values) in the file
-    uint32_t loop_offset;       // 0x1c: relative offset to loop point, or 0 if no loop
-    uint32_t loop_samples;      // 0x20: number of samples in one loop. or 0 if no loop
-    uint32_t rate;              // 0x24: rate of recording. typeical 50 for PAL and 60 for NTSC
-    uint16_t sn76489_feedback;
-    uint16_t sn76489_shiftreg;
-    uint32_t ym2612_clk;
-    uint32_t ym2151_clk;
-    uint32_t data_offset;       // 0x34: relative offset to VGM data stream. for version 1.5 and below, its value is 0x0c and data starts at 0x40
-    uint32_t sega_pcm_clk;
-    uint32_t sega_pcm_if_reg;
-    uint32_t rf5c68_clk;
-    uint32_t ym2203_clk;
-    uint32_t ym2608_clk;
-    uint32_t ym2610b_clk;
-    uint32_t ym3812_clk;
-    uint32_t ym3526_clk;
-    uint32_t y8950_clk;
-    uint32_t ymf262_clk;
-    uint32_t ymf278b_clk;
-    uint32_t ymf271_clk;
-    uint32_t ymz280b_clk;
-    uint32_t rf5c164_clk;
-    uint32_t pwm_clock;
-    uint32_t ay8910_clk;
-    uint8_t  ay8910_type;
-    uint8_t  ay8910_flags;
-    uint8_t  ym2203_ay8910_flags;
-    uint8_t  ym2608_ay8910_flags;
-    uint8_t  volume_modifier;   // 0x7c: range [-63 .. 192], volume = 2 ^ (volume_modifier / 0x20)
-    uint8_t  reserved1;
-    uint8_t  loop_base; 
-    uint8_t  loop_modifier;
-    uint32_t gb_dmg_clk;
-    uint32_t nes_apu_clk;       // 0x84: NES APU Clock (typical 1789772). Bit 31 indicates FDS addition
-    uint32_t multi_pcm_clk;
-    uint32_t upd7759_clk;
-    uint32_t okim6258_clk;
-    uint8_t  okim6258_flags;
-    uint8_t  k054539_flags;
-    uint8_t  c140_flags;
-    uint8_t  reserved2;
-    uint32_t oki6295_clk;
-    uint32_t k051649_clk;
-    uint32_t k054539_clk;
-    uint32_t huc6280_clk;
-    uint32_t c140_clk;
-    uint32_t k053260_clk;
-    uint32_t pokey_clk;
-    uint32_t qsound_clock;
-    uint32_t scsp_clk;
-    uint32_t extra_header_offset;   // 0xBC: relative offset to the extra header or 0 if no extra header is present
-    uint32_t wswan_clk;
-    uint32_t vsu_clk;
-    uint32_t saa1090_clk;
-    uint32_t es5503_clk;
-    uint32_t es5506_clk;
-    uint8_t  es5503_chns;
-    uint8_t  es5506_chns;
-    uint8_t  c352_clk_div;
-    uint8_t  reserved3;
-    uint32_t x1010_clk;
-    uint32_t c352_clk;
-    uint32_t ga20_clk;
-    uint8_t  reserved4[7 * 4];
-});
-typedef struct vgm_header_s vgm_header_t;
-
-
-typedef struct vgm_s
-{
-    file_reader_t *reader;
-    // From VGM file
-    uint32_t version;
-    uint32_t data_offset;
-    unsigned int total_samples;
-    int loops;
-    uint32_t loop_offset;
-    unsigned int loop_samples;
-    uint32_t rate;          // (experimental: to find out 50/60Hz)
-    uint32_t nes_apu_clk;   // NES APU clock
-    char *track_name_en;    // track name in English
-	char *game_name_en;     // game name in English
-	char *sys_name_en;      // system name in English
-	char *author_name_en;   // author name in English
-	char *release_date;     // release date
-	char *creator;          // VGM creator name
-	char *notes;            // notes
-    // Playback control
-    size_t data_pos;                // position of current data
-    unsigned int samples_waiting;   // # of samples waiting, in 44100Hz unit
-    nesapu_t *apu;                  // NES APU
-    unsigned long complete_samples; // Total samples including total + loop
-    unsigned long played_samples;   // Played samples
-    unsigned int fadeout_samples;   // From which sample fadeout shall start
- } vgm_t;
-
-
-vgm_t* vgm_create(file_reader_t *reader);
-void vgm_destroy(vgm_t *vgm);
-bool vgm_prepare_playback(vgm_t *vgm, unsigned int sample_rate, bool fadeout);
-int vgm_get_samples(vgm_t *vgm, int16_t *buf, unsigned int size);
-void vgm_nesapu_enable_channel(vgm_t *vgm, uint8_t mask, bool enable);
-
-
-#ifdef __cplusplus
-}
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "file_reader.h"
+#include "nesapu.h"
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+#define VGM_GD3_STR_MAX_LEN     64      // Max string length in GD3 tags
+#define VGM_SAMPLE_RATE         44100   // Rate of VGM wait units, output may be at any rate
+#define VGM_FADEOUT_SECONDS     2
+
+// Options for vgm_prepare_playback(), may be or'ed
+#define VGM_PLAYBACK_FADEOUT        0x01    // Fade out last VGM_FADEOUT_SECONDS or 5% of the track, whichever is shorter
+#define VGM_PLAYBACK_SKIP_SILENCE   0x02    // Start at first sound
+#define VGM_PLAYBACK_TRIM_SILENCE   0x04    // Finish when all channels stay silent to end of data, fade ends there
+
+// Loop count for vgm_set_loops() to loop until vgm_request_fade()
+#define VGM_LOOP_FOREVER            (-1)
+
+// Size of read-ahead window for VGM data stream. 0 to read every command directly from reader.
+#ifndef VGM_FILE_CACHE_SIZE
+# define VGM_FILE_CACHE_SIZE        0
+#endif
+
+// Translate VGM data into in-memory event array at vgm_prepare_playback(), so playback
+// does not call reader anymore. Set to 0 on memory-constrained builds to use the interpreter.
+#ifndef VGM_USE_COMPILED_STREAM
+# define VGM_USE_COMPILED_STREAM    0
+#endif
+
+// Interval (in samples) between seek checkpoints. Each checkpoint keeps a copy of APU state.
+// 0 to disable vgm_seek().
+#ifndef VGM_SEEK_INTERVAL
+# define VGM_SEEK_INTERVAL          0
+#endif
+
+// NES APU DPCM data bank: data blocks 0x07, compressed 0x47 with 0x7F decompression tables, and PCM RAM
+// writes (0x68) from it. Compressed data is decompressed as the APU reads it into RAM image or cache.
+// 0 to skip these blocks (only 0xC2 RAM writes play).
+#ifndef VGM_USE_DATA_BANK
+# define VGM_USE_DATA_BANK          1
+#endif
+#define VGM_BANK_INPUT_SIZE         64      // Compressed bytes read at a time
+
+#define VGM_NESAPU_CHANNEL_PULSE1   NESAPU_CHANNEL_PULSE1
+#define VGM_NESAPU_CHANNEL_PULSE2   NESAPU_CHANNEL_PULSE2
+#define VGM_NESAPU_CHANNEL_TRIANGLE NESAPU_CHANNEL_TRIANGLE
+#define VGM_NESAPU_CHANNEL_NOISE    NESAPU_CHANNEL_NOISE
+#define VGM_NESAPU_CHANNEL_DMC      NESAPU_CHANNEL_DMC
+#define VGM_NESAPU_CHANNEL_ALL      NESAPU_CHANNEL_ALL
+
+// Output formats and layout for vgm_get_samples_ex(), see nesapu_output_t
+#define VGM_FORMAT_S16              NESAPU_FORMAT_S16
+#define VGM_FORMAT_S32              NESAPU_FORMAT_S32
+#define VGM_FORMAT_F32              NESAPU_FORMAT_F32
+typedef nesapu_output_t vgm_output_t;
+
+
+PACK(struct vgm_header_s
+{
+    uint32_t ident;             // 0x00: identification "Vgm " 0x206d6756
+    uint32_t eof_offset;        // 0x04: relative offset to end of file (should be file_length - 4)
+    uint32_t version;           // 0x08: BCD version. Ver 1.7.1 is 0x00000171
+    uint32_t sn76489_clk;
+    uint32_t ym2413_clk;
+    uint32_t gd3_offset;        // 0x14: relative offset to GD3 tag (0 if no GD3 tag
+    uint32_t total_samples;     // 0x18: total samples (sum of wait values) in the file
+    uint32_t loop_offset;       // 0x1c: relative offset to loop point, or 0 if no loop
+    uint32_t loop_samples;      // 0x20: number of samples in one loop. or 0 if no loop
+    uint32_t rate;              // 0x24: rate of recording. typeical 50 for PAL and 60 for NTSC
+    uint16_t sn76489_feedback;
+    uint16_t sn76489_shiftreg;
+    uint32_t ym2612_clk;
+    uint32_t ym2151_clk;
+    uint32_t data_offset;       // 0x34: relative offset to VGM data stream. for version 1.5 and below, its value is 0x0c and data starts at 0x40
+    uint32_t sega_pcm_clk;
+    uint32_t sega_pcm_if_reg;
+    uint32_t rf5c68_clk;
+    uint32_t ym2203_clk;
+    uint32_t ym2608_clk;
+    uint32_t ym2610b_clk;
+    uint32_t ym3812_clk;
+    uint32_t ym3526_clk;
+    uint32_t y8950_clk;
+    uint32_t ymf262_clk;
+    uint32_t ymf278b_clk;
+    uint32_t ymf271_clk;
+    uint32_t ymz280b_clk;
+    uint32_t rf5c164_clk;
+    uint32_t pwm_clock;
+    uint32_t ay8910_clk;
+    uint8_t  ay8910_type;
+    uint8_t  ay8910_flags;
+    uint8_t  ym2203_ay8910_flags;
+    uint8_t  ym2608_ay8910_flags;
+    uint8_t  volume_modifier;   // 0x7c: range [-63 .. 192], volume = 2 ^ (volume_modifier / 0x20)
+    uint8_t  reserved1;
+    uint8_t  loop_base; 
+    uint8_t  loop_modifier;
+    uint32_t gb_dmg_clk;
+    uint32_t nes_apu_clk;       // 0x84: NES APU Clock (typical 1789772). Bit 31 indicates FDS addition
+    uint32_t multi_pcm_clk;
+    uint32_t upd7759_clk;
+    uint32_t okim6258_clk;
+    uint8_t  okim6258_flags;
+    uint8_t  k054539_flags;
+    uint8_t  c140_flags;
+    uint8_t  reserved2;
+    uint32_t oki6295_clk;
+    uint32_t k051649_clk;
+    uint32_t k054539_clk;
+    uint32_t huc6280_clk;
+    uint32_t c140_clk;
+    uint32_t k053260_clk;
+    uint32_t pokey_clk;
+    uint32_t qsound_clock;
+    uint32_t scsp_clk;
+    uint32_t extra_header_offset;   // 0xBC: relative offset to the extra header or 0 if no extra header is present
+    uint32_t wswan_clk;
+    uint32_t vsu_clk;
+    uint32_t saa1090_clk;
+    uint32_t es5503_clk;
+    uint32_t es5506_clk;
+    uint8_t  es5503_chns;
+    uint8_t  es5506_chns;
+    uint8_t  c352_clk_div;
+    uint8_t  reserved3;
+    uint32_t x1010_clk;
+    uint32_t c352_clk;
+    uint32_t ga20_clk;
+    uint8_t  reserved4[7 * 4];
+});
+typedef struct vgm_header_s vgm_header_t;
+
+
+// Pre-decoded event types
+enum
+{
+    VGM_EVENT_NONE = 0,     // Command not for NES APU (not stored)
+    VGM_EVENT_WRITE,        // NES APU register write, reg = aa, val = dd
+    VGM_EVENT_WAIT,         // Wait val samples
+    VGM_EVENT_RAM,          // NES APU RAM block, val = index to ram_blocks
+    VGM_EVENT_LOOP,         // Loop point
+    VGM_EVENT_END           // End of sound data
+};
+
+typedef struct vgm_event_s
+{
+    uint8_t  type;          // VGM_EVENT_xxx
+    uint8_t  reg;           // register for VGM_EVENT_WRITE
+    uint16_t val;           // see event types
+} vgm_event_t;
+
+typedef struct vgm_ram_block_s
+{
+    size_t   offset;        // data start position in VGM file
+    uint16_t addr;          // ram start address
+    uint16_t len;           // length of ram block
+} vgm_ram_block_t;
+
+#if VGM_USE_DATA_BANK
+// Data bank block codecs
+enum
+{
+    VGM_BANK_RAW = 0,       // Block 0x07, data as is
+    VGM_BANK_NBIT,          // Block 0x47, n-bit compression
+    VGM_BANK_DPCM,          // Block 0x47, DPCM compression
+    VGM_BANK_UNSUPPORTED    // Block 0x47 this decoder can not expand, reads 0
+};
+
+typedef struct vgm_bank_block_s
+{
+    size_t   data_pos;      // File position of (compressed) data
+    uint32_t data_len;      // Bytes of data in file
+    uint32_t start;         // Offset in data bank
+    uint32_t size;          // Bytes in data bank
+    uint8_t  codec;         // VGM_BANK_xxx
+    uint8_t  sub_type;      // n-bit compression sub-type
+    uint8_t  bits_out;      // Bits decompressed
+    uint8_t  bits_in;       // Bits compressed
+    uint16_t add;           // Value added (n-bit), start value (DPCM)
+    size_t   table_pos;     // File position of decompression table, 0 if none
+    uint16_t table_len;     // # of table values
+} vgm_bank_block_t;
+
+typedef struct vgm_bank_table_s
+{
+    size_t   pos;           // File position of values, 0 if none
+    uint16_t len;           // # of values
+    uint8_t  sub_type;      // Compression sub-type the table is for
+    uint8_t  bits_out;      // Bits of each value
+} vgm_bank_table_t;
+
+// Decompression state of the block read last. Reading ahead continues, reading back starts over.
+typedef struct vgm_bank_decoder_s
+{
+    int      block;                     // Index of block, -1 if none
+    uint32_t out_pos;                   // Index of next value
+    uint32_t bit_pos;                   // Next bit of compressed data
+    uint8_t  state;                     // DPCM value
+    size_t   table_pos;                 // Table in table[], 0 if none
+    uint8_t  table[256];                // Decompression table of block
+    uint32_t in_pos;                    // Data offset of in[0]
+    uint32_t in_len;                    // Valid bytes in in[]
+    uint8_t  in[VGM_BANK_INPUT_SIZE];   // Compressed data window
+} vgm_bank_decoder_t;
+#endif
+
+
+// Result of vgm_analyze(), in VGM_SAMPLE_RATE samples
+typedef struct vgm_analysis_s
+{
+    unsigned long total_samples;    // Sum of waits to end of sound data
+    unsigned long audible_start;    // Position where first sound starts
+    unsigned long loop_start;       // Loop start position, 0 if no loop
+    unsigned long loop_samples;     // Length of one loop from loop_start, 0 if no loop
+    uint32_t loop_offset;           // File position of loop start, 0 if no loop
+    bool loop_detected;             // Loop found from repeated register writes, header has none
+    unsigned long audible_samples;  // Position where last sound ends, rest of data is silent
+} vgm_analysis_t;
+
+
+// Version of state saved by vgm_save_state()
+#define VGM_STATE_VERSION           5
+
+
+#if VGM_SEEK_INTERVAL > 0
+// Playback state at a sample position, for seeking
+typedef struct vgm_checkpoint_s
+{
+    uint64_t played_samples;        // Sample position of checkpoint
+    size_t data_pos;                // position of current data
+#if VGM_USE_COMPILED_STREAM
+    size_t event_pos;               // position of current event
+#endif
+    unsigned int samples_waiting;   // # of samples waiting
+    unsigned int wait_frac;         // Wait remainder
+    int loops;                      // loops remaining
+    bool looped;                    // data end passed
+    nesapu_snapshot_t apu;          // APU state
+} vgm_checkpoint_t;
+#endif
+
+
+typedef struct vgm_s
+{
+    file_reader_t *reader;
+    // From VGM file
+    uint32_t version;
+    uint32_t data_offset;
+    unsigned int total_samples;
+    int loop_count;         // # of times loop is played after first pass, VGM_LOOP_FOREVER for endless
+    int loops;              // loops remaining in playback, counts down from loop_count
+    unsigned int block_size;    // Samples rendered by one APU call at most, blip buffer size
+    bool looped;            // data end passed and playback went back to loop, all RAM blocks were added
+    uint32_t loop_offset;
+    unsigned int loop_samples;
+    uint32_t rate;          // (experimental: to find out 50/60Hz)
+    uint32_t nes_apu_clk;   // NES APU clock
+    char *track_name_en;    // track name in English
+	char *game_name_en;     // game name in English
+	char *sys_name_en;      // system name in English
+	char *author_name_en;   // author name in English
+	char *release_date;     // release date
+	char *creator;          // VGM creator name
+	char *notes;            // notes
+    // Playback control
+    size_t data_pos;                // position of current data
+    unsigned int sample_rate;       // Output sample rate
+    unsigned int samples_waiting;   // # of output samples waiting
+    unsigned int samples_queued;    // Output samples executed ahead of the APU, register writes are queued at this sample
+    unsigned int wait_frac;         // Remainder of waits converted to output samples, in 1/VGM_SAMPLE_RATE samples
+    nesapu_t *apu;                  // NES APU
+    uint64_t complete_samples;      // Total samples including total + loops, in output samples after vgm_prepare_playback(), UINT64_MAX if endless
+    uint64_t played_samples;        // Played samples
+    unsigned int fadeout_samples;   // From which sample fadeout shall start
+    uint64_t stop_samples;          // Playback finishes here if trimmed, UINT64_MAX to play to end of data
+#if VGM_SEEK_INTERVAL > 0
+    // Seek index, checkpoints are taken every VGM_SEEK_INTERVAL samples during playback
+    vgm_checkpoint_t *checkpoints;  // Checkpoint array, allocated on first checkpoint
+    unsigned int checkpoint_count;  // # of checkpoints taken
+    unsigned int checkpoint_max;    // Capacity of checkpoint array
+#endif
+#if VGM_READER_BORROW
+    const uint8_t *data;            // Whole VGM file borrowed from reader, NULL if not available
+    size_t data_size;               // Size of borrowed data
+#endif
+#if VGM_FILE_CACHE_SIZE > 0
+    // Read-ahead window
+    uint8_t *cache;                 // Window data, NULL if not allocated
+    size_t cache_pos;               // VGM file position of cache[0]
+    size_t cache_len;               // Valid bytes in window
+    unsigned long cache_refills;    // # of window refills (for tuning VGM_FILE_CACHE_SIZE)
+    unsigned long cache_refill_bytes;   // Bytes read by window refills
+#endif
+#if VGM_USE_COMPILED_STREAM
+    // Pre-decoded data, NULL if not compiled
+    vgm_event_t *events;            // Event array
+    size_t event_count;             // # of events
+    size_t event_pos;               // position of current event
+    size_t event_loop;              // event index of loop point
+    vgm_ram_block_t *ram_blocks;    // RAM blocks referenced by VGM_EVENT_RAM
+    size_t ram_block_count;         // # of RAM blocks
+#endif
+#if VGM_USE_DATA_BANK
+    // Data bank, blocks are added in file order as they are parsed
+    vgm_bank_block_t *bank_blocks;  // Block array, NULL if none
+    unsigned int bank_block_count;  // # of blocks
+    unsigned int bank_block_max;    // Capacity of block array
+    uint32_t bank_size;             // Bytes in data bank
+    size_t bank_scan_pos;           // Data blocks before this file position are added
+    vgm_bank_table_t bank_tables[2];    // Current decompression table of each compression type
+    vgm_bank_decoder_t bank_decoder;
+    // Reader given to APU. Reads file, and data bank at bank_base + bank offset.
+    file_reader_t bank_reader;
+    size_t bank_base;               // File size
+#endif
+ } vgm_t;
+
+
+vgm_t* vgm_create(file_reader_t *reader);
+void vgm_destroy(vgm_t *vgm);
+void vgm_set_loops(vgm_t *vgm, int loops);
+void vgm_set_block_size(vgm_t *vgm, unsigned int samples);
+bool vgm_prepare_playback(vgm_t *vgm, unsigned int sample_rate, unsigned int options);
+void vgm_request_fade(vgm_t *vgm, unsigned int samples);
+int vgm_get_samples(vgm_t *vgm, int16_t *buf, unsigned int size);
+int vgm_get_samples_ex(vgm_t *vgm, void *buf, unsigned int size, const vgm_output_t *output);
+int vgm_skip_samples(vgm_t *vgm, unsigned int size);
+#if NESAPU_USE_BLIPBUF && NESAPU_USE_STEMS
+int vgm_get_stems(vgm_t *vgm, int16_t **stems, int16_t *buf, unsigned int size);
+#endif
+bool vgm_analyze(vgm_t *vgm, vgm_analysis_t *analysis);
+void vgm_nesapu_enable_channel(vgm_t *vgm, uint8_t mask, bool enable);
+#if VGM_SEEK_INTERVAL > 0
+bool vgm_seek(vgm_t *vgm, uint64_t sample);
+#endif
+size_t vgm_save_state(vgm_t *vgm, uint8_t *buf, size_t size);
+bool vgm_load_state(vgm_t *vgm, const uint8_t *buf, size_t size);
+
+
+#ifdef __cplusplus
+}
 #endif
\ No newline at end of file
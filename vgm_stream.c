@@ -0,0 +1,266 @@
+#include <stdatomic.h>
+#include <memory.h>
+#include "vgm_conf.h"
+#include "vgm_stream.h"
+
+#if defined(__unix__) || defined(__APPLE__)
+# define VGM_STREAM_THREAD 1
+# include <pthread.h>
+# include <time.h>
+#else
+# define VGM_STREAM_THREAD 0
+#endif
+
+
+#define STREAM_RUNNING  0
+#define STREAM_ENDED    1
+#define STREAM_FAILED   (-1)
+
+
+// head is written by consumer only, tail and state by producer only. Both are free running and
+// wrap at UINT_MAX, so level is always tail - head. Statistics have a single writer each, so
+// plain load/store is enough and also works on cores without atomic read-modify-write.
+struct vgm_stream_s
+{
+    vgm_t *vgm;
+    int16_t *ring;
+    unsigned int mask;              // capacity - 1
+    unsigned int low_watermark;
+    unsigned int high_watermark;
+    atomic_uint head;               // Next sample to read
+    atomic_uint tail;               // Next sample to write
+    atomic_int state;               // STREAM_xxx, set by producer after final tail
+    int16_t last_sample;            // Pad value on underrun (consumer)
+    // Statistics
+    atomic_ulong underruns;
+    atomic_ulong underrun_samples;
+    atomic_ulong fills;
+    atomic_uint min_level;
+#if VGM_STREAM_THREAD
+    pthread_t thread;
+    bool thread_running;
+    unsigned int sample_rate;
+    atomic_bool stop;
+#endif
+};
+
+
+vgm_stream_t * vgm_stream_create(vgm_t *vgm, unsigned int capacity, unsigned int low_watermark, unsigned int high_watermark)
+{
+    vgm_stream_t *stream = NULL;
+    bool success = false;
+    do
+    {
+        if (NULL == vgm || NULL == vgm->apu || capacity == 0 || capacity > 0x80000000U) break;
+        unsigned int size = 1;
+        while (size < capacity) size <<= 1;
+        if (low_watermark >= high_watermark || high_watermark > size) break;
+        stream = (vgm_stream_t *)VGM_MALLOC(sizeof(vgm_stream_t));
+        if (NULL == stream) break;
+        memset(stream, 0, sizeof(vgm_stream_t));
+        stream->ring = (int16_t *)VGM_MALLOC(size * sizeof(int16_t));
+        if (NULL == stream->ring) break;
+        stream->vgm = vgm;
+        stream->mask = size - 1;
+        stream->low_watermark = low_watermark;
+        stream->high_watermark = high_watermark;
+        atomic_init(&stream->head, 0);
+        atomic_init(&stream->tail, 0);
+        atomic_init(&stream->state, STREAM_RUNNING);
+        atomic_init(&stream->underruns, 0);
+        atomic_init(&stream->underrun_samples, 0);
+        atomic_init(&stream->fills, 0);
+        atomic_init(&stream->min_level, size);
+#if VGM_STREAM_THREAD
+        atomic_init(&stream->stop, false);
+#endif
+        success = true;
+    } while (0);
+    if (!success)
+    {
+        VGM_PRINTERR("VGM: Stream creation failed\n");
+        if (stream)
+        {
+            if (stream->ring) VGM_FREE(stream->ring);
+            VGM_FREE(stream);
+            stream = NULL;
+        }
+    }
+    return stream;
+}
+
+
+void vgm_stream_destroy(vgm_stream_t *stream)
+{
+    if (stream)
+    {
+        vgm_stream_stop(stream);
+        VGM_FREE(stream->ring);
+        VGM_FREE(stream);
+    }
+}
+
+
+int vgm_stream_fill(vgm_stream_t *stream)
+{
+    if (atomic_load_explicit(&stream->state, memory_order_relaxed) != STREAM_RUNNING) return 0;
+    unsigned int tail = atomic_load_explicit(&stream->tail, memory_order_relaxed);
+    unsigned int level = tail - atomic_load_explicit(&stream->head, memory_order_acquire);
+    int added = 0;
+    while (level < stream->high_watermark)
+    {
+        // Decode straight into ring, in contiguous pieces the APU can do in one go
+        unsigned int pos = tail & stream->mask;
+        unsigned int n = stream->high_watermark - level;
+        if (n > stream->mask + 1 - pos) n = stream->mask + 1 - pos;
+        if (n > stream->vgm->apu->max_samples) n = stream->vgm->apu->max_samples;
+        int r = vgm_get_samples(stream->vgm, stream->ring + pos, n);
+        if (r <= 0)
+        {
+            atomic_store_explicit(&stream->state, r < 0 ? STREAM_FAILED : STREAM_ENDED, memory_order_release);
+            if (r < 0) added = -1;
+            break;
+        }
+        tail += (unsigned int)r;
+        level += (unsigned int)r;
+        added += r;
+        atomic_store_explicit(&stream->tail, tail, memory_order_release);
+    }
+    if (added > 0)
+    {
+        atomic_store_explicit(&stream->fills, atomic_load_explicit(&stream->fills, memory_order_relaxed) + 1, memory_order_relaxed);
+    }
+    return added;
+}
+
+
+bool vgm_stream_needs_fill(vgm_stream_t *stream)
+{
+    return (atomic_load_explicit(&stream->state, memory_order_relaxed) == STREAM_RUNNING) &&
+           (vgm_stream_level(stream) <= stream->low_watermark);
+}
+
+
+unsigned int vgm_stream_read(vgm_stream_t *stream, int16_t *buf, unsigned int size)
+{
+    // state before tail: once it is not running, tail is final
+    int state = atomic_load_explicit(&stream->state, memory_order_acquire);
+    unsigned int head = atomic_load_explicit(&stream->head, memory_order_relaxed);
+    unsigned int level = atomic_load_explicit(&stream->tail, memory_order_acquire) - head;
+    unsigned int n = (level < size) ? level : size;
+    unsigned int pos = head & stream->mask;
+    unsigned int first = stream->mask + 1 - pos;
+    if (first > n) first = n;
+    memcpy(buf, stream->ring + pos, first * sizeof(int16_t));
+    memcpy(buf + first, stream->ring, (n - first) * sizeof(int16_t));
+    if (n > 0) stream->last_sample = buf[n - 1];
+    atomic_store_explicit(&stream->head, head + n, memory_order_release);
+    level -= n;
+    if (state == STREAM_RUNNING && level < atomic_load_explicit(&stream->min_level, memory_order_relaxed))
+    {
+        atomic_store_explicit(&stream->min_level, level, memory_order_relaxed);
+    }
+    if (n < size)
+    {
+        for (unsigned int i = n; i < size; ++i)
+        {
+            buf[i] = stream->last_sample;
+        }
+        if (state == STREAM_RUNNING)
+        {
+            atomic_store_explicit(&stream->underruns, atomic_load_explicit(&stream->underruns, memory_order_relaxed) + 1, memory_order_relaxed);
+            atomic_store_explicit(&stream->underrun_samples, atomic_load_explicit(&stream->underrun_samples, memory_order_relaxed) + (size - n), memory_order_relaxed);
+        }
+    }
+    return n;
+}
+
+
+unsigned int vgm_stream_level(vgm_stream_t *stream)
+{
+    return atomic_load_explicit(&stream->tail, memory_order_acquire) - atomic_load_explicit(&stream->head, memory_order_acquire);
+}
+
+
+bool vgm_stream_finished(vgm_stream_t *stream)
+{
+    return (atomic_load_explicit(&stream->state, memory_order_acquire) != STREAM_RUNNING) && (vgm_stream_level(stream) == 0);
+}
+
+
+void vgm_stream_get_stats(vgm_stream_t *stream, vgm_stream_stats_t *stats)
+{
+    stats->underruns = atomic_load_explicit(&stream->underruns, memory_order_relaxed);
+    stats->underrun_samples = atomic_load_explicit(&stream->underrun_samples, memory_order_relaxed);
+    stats->fills = atomic_load_explicit(&stream->fills, memory_order_relaxed);
+    stats->min_level = atomic_load_explicit(&stream->min_level, memory_order_relaxed);
+}
+
+
+#if VGM_STREAM_THREAD
+
+static void *vgm_stream_thread(void *arg)
+{
+    vgm_stream_t *stream = (vgm_stream_t *)arg;
+    while (!atomic_load_explicit(&stream->stop, memory_order_relaxed))
+    {
+        if (vgm_stream_needs_fill(stream))
+        {
+            vgm_stream_fill(stream);
+            continue;
+        }
+        if (atomic_load_explicit(&stream->state, memory_order_relaxed) != STREAM_RUNNING) break;
+        // Sleep for half the time consumer needs to drain ring to low_watermark, 0.5 to 20ms
+        unsigned long samples = vgm_stream_level(stream) - stream->low_watermark;
+        uint64_t ns = (uint64_t)samples * 500000000U / stream->sample_rate;
+        if (ns < 500000U) ns = 500000U;
+        if (ns > 20000000U) ns = 20000000U;
+        struct timespec ts = { 0, (long)ns };
+        nanosleep(&ts, NULL);
+    }
+    return NULL;
+}
+
+
+bool vgm_stream_start(vgm_stream_t *stream, unsigned int sample_rate)
+{
+    if (stream->thread_running || sample_rate == 0) return false;
+    if (vgm_stream_fill(stream) < 0) return false;
+    stream->sample_rate = sample_rate;
+    atomic_store_explicit(&stream->stop, false, memory_order_relaxed);
+    if (pthread_create(&stream->thread, NULL, vgm_stream_thread, stream) != 0)
+    {
+        VGM_PRINTERR("VGM: Stream thread creation failed\n");
+        return false;
+    }
+    stream->thread_running = true;
+    return true;
+}
+
+
+void vgm_stream_stop(vgm_stream_t *stream)
+{
+    if (stream->thread_running)
+    {
+        atomic_store_explicit(&stream->stop, true, memory_order_relaxed);
+        pthread_join(stream->thread, NULL);
+        stream->thread_running = false;
+    }
+}
+
+#else
+
+bool vgm_stream_start(vgm_stream_t *stream, unsigned int sample_rate)
+{
+    (void)stream;
+    (void)sample_rate;
+    return false;
+}
+
+
+void vgm_stream_stop(vgm_stream_t *stream)
+{
+    (void)stream;
+}
+
+#endif
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "vgm.h"
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+// Streaming front-end for real-time playback.
+//
+// A producer runs the decoder ahead into a lock-free single-producer/single-consumer ring of samples and
+// the audio callback only pops from it with vgm_stream_read(), so it never reaches the reader or the
+// synthesis path. The producer refills the ring up to high_watermark whenever the level drops to
+// low_watermark. It is either the thread started by vgm_stream_start() (POSIX), or the application calls
+// vgm_stream_fill() from its own thread / core / main loop.
+//
+// While a stream is attached, the vgm_t must only be touched by the producer.
+
+typedef struct vgm_stream_s vgm_stream_t;
+
+typedef struct vgm_stream_stats_s
+{
+    unsigned long underruns;        // # of vgm_stream_read() calls the ring could not fully serve
+    unsigned long underrun_samples; // # of samples padded on underrun
+    unsigned long fills;            // # of vgm_stream_fill() calls that decoded samples
+    unsigned int min_level;         // Lowest ring level seen by the consumer before decoder finished
+} vgm_stream_stats_t;
+
+
+// capacity is rounded up to a power of 2. Requires low_watermark < high_watermark <= capacity.
+// Playback must have been prepared with vgm_prepare_playback().
+vgm_stream_t * vgm_stream_create(vgm_t *vgm, unsigned int capacity, unsigned int low_watermark, unsigned int high_watermark);
+void vgm_stream_destroy(vgm_stream_t *stream);
+
+// Producer side. Decode until ring level reaches high_watermark.
+// return # of samples added, -1 on decoder error.
+int vgm_stream_fill(vgm_stream_t *stream);
+// true if ring level is at or below low_watermark and decoder has not finished.
+bool vgm_stream_needs_fill(vgm_stream_t *stream);
+
+// Consumer side, safe in audio callback. Always writes size samples to buf; on underrun the rest is padded
+// with the last sample.
+// return # of decoded samples copied. 0 with vgm_stream_finished() means end of playback.
+unsigned int vgm_stream_read(vgm_stream_t *stream, int16_t *buf, unsigned int size);
+// # of samples ready in ring
+unsigned int vgm_stream_level(vgm_stream_t *stream);
+// true if decoder has finished (or failed) and ring is drained
+bool vgm_stream_finished(vgm_stream_t *stream);
+
+void vgm_stream_get_stats(vgm_stream_t *stream, vgm_stream_stats_t *stats);
+
+// Producer thread, only available on POSIX systems. vgm_stream_start() fills the ring before returning.
+// sample_rate paces the thread's polling.
+bool vgm_stream_start(vgm_stream_t *stream, unsigned int sample_rate);
+void vgm_stream_stop(vgm_stream_t *stream);
+
+
+#ifdef __cplusplus
+}
+#endif